@@ -0,0 +1,473 @@
+#include "aggregate.h"
+
+#include <string.h>
+
+#include "spec.h"
+
+/* Object name of the aggregator, and device name of aggregates as inputs */
+#define AGGREGATOR_NAME "aggregates"
+
+typedef struct
+{
+    gdouble value;
+    /* Whether the channel has had a value yet */
+    gboolean valid;
+} AggregateInputValue;
+
+typedef struct
+{
+    LiquidAggregateOperation operation;
+    GArray *inputs;
+    guint n_valid;
+    /* Sum of the valid inputs, or the extreme one for max and min */
+    gdouble accumulator;
+} Aggregate;
+
+/* An input of an aggregate fed by a channel */
+typedef struct
+{
+    guint aggregate;
+    guint input;
+} AggregateBinding;
+
+struct _LiquidAggregator
+{
+    LiquidDriver parent;
+
+    /* Aggregate i is channel i */
+    GArray *aggregates;
+    GPtrArray *specs;
+
+    /* LiquidDriver -> GPtrArray indexed by channel, of AggregateBinding GArrays or NULL */
+    GHashTable *bindings;
+};
+
+G_DEFINE_FINAL_TYPE(LiquidAggregator, liquid_aggregator, LIQUID_TYPE_DRIVER)
+
+static const gchar *const operation_names[] = {
+    [LIQUID_AGGREGATE_SUM] = "sum",
+    [LIQUID_AGGREGATE_MAX] = "max",
+    [LIQUID_AGGREGATE_MIN] = "min",
+    [LIQUID_AGGREGATE_MEAN] = "mean",
+    [LIQUID_AGGREGATE_PRODUCT] = "product",
+};
+
+static gboolean
+parse_input(const gchar *spec, const gchar *token, LiquidChannelType type, LiquidAggregateInput *input, GError **error)
+{
+    const gchar *colon = strchr(token, ':');
+
+    input->type = type;
+
+    if (colon)
+    {
+        g_autofree gchar *nick = g_strndup(token, (gsize)(colon - token));
+
+        input->type = liquid_channel_type_from_nick(nick);
+        token = colon + 1;
+
+        if (input->type == LIQUID_CHANNEL_N_TYPES)
+        {
+            g_set_error(error,
+                        G_OPTION_ERROR,
+                        G_OPTION_ERROR_BAD_VALUE,
+                        "Aggregate '%s': unknown channel type '%s'",
+                        spec,
+                        nick);
+            return FALSE;
+        }
+    }
+
+    if (strchr(token, '/') == NULL)
+    {
+        g_set_error(error,
+                    G_OPTION_ERROR,
+                    G_OPTION_ERROR_BAD_VALUE,
+                    "Aggregate '%s': expected DEVICE/CHANNEL, got '%s'",
+                    spec,
+                    token);
+        return FALSE;
+    }
+
+    input->pattern = g_pattern_spec_new(token);
+
+    return TRUE;
+}
+
+LiquidAggregateSpec *
+liquid_aggregate_spec_parse(const gchar *spec, GError **error)
+{
+    g_return_val_if_fail(spec != NULL, NULL);
+
+    const gchar *colon = strchr(spec, ':');
+    g_autoptr(LiquidAggregateSpec) aggregate = g_new0(LiquidAggregateSpec, 1);
+
+    aggregate->name = colon ? g_strndup(spec, (gsize)(colon - spec)) : NULL;
+
+    if (aggregate->name == NULL || !liquid_spec_is_valid_name(aggregate->name))
+    {
+        g_set_error(error,
+                    G_OPTION_ERROR,
+                    G_OPTION_ERROR_BAD_VALUE,
+                    "Aggregate '%s': expected NAME: first, of letters, digits and underscores",
+                    spec);
+        return NULL;
+    }
+
+    g_auto(GStrv) tokens = liquid_spec_tokenize(colon + 1, NULL);
+    guint n_tokens = g_strv_length(tokens);
+
+    if (n_tokens < 3)
+    {
+        g_set_error(error,
+                    G_OPTION_ERROR,
+                    G_OPTION_ERROR_BAD_VALUE,
+                    "Aggregate '%s': expected OPERATION TYPE INPUT...",
+                    spec);
+        return NULL;
+    }
+
+    guint operation = 0;
+
+    while (operation < G_N_ELEMENTS(operation_names) && !g_str_equal(tokens[0], operation_names[operation]))
+    {
+        operation++;
+    }
+
+    if (operation == G_N_ELEMENTS(operation_names))
+    {
+        g_set_error(error,
+                    G_OPTION_ERROR,
+                    G_OPTION_ERROR_BAD_VALUE,
+                    "Aggregate '%s': unknown operation '%s', expected sum, max, min, mean or product",
+                    spec,
+                    tokens[0]);
+        return NULL;
+    }
+
+    aggregate->operation = operation;
+    aggregate->type = liquid_channel_type_from_nick(tokens[1]);
+
+    if (aggregate->type == LIQUID_CHANNEL_N_TYPES)
+    {
+        g_set_error(error,
+                    G_OPTION_ERROR,
+                    G_OPTION_ERROR_BAD_VALUE,
+                    "Aggregate '%s': unknown channel type '%s'",
+                    spec,
+                    tokens[1]);
+        return NULL;
+    }
+
+    for (guint i = 2; i < n_tokens; i++)
+    {
+        if (aggregate->n_inputs == LIQUID_AGGREGATE_MAX_INPUTS)
+        {
+            g_set_error(error,
+                        G_OPTION_ERROR,
+                        G_OPTION_ERROR_BAD_VALUE,
+                        "Aggregate '%s': more than %d inputs",
+                        spec,
+                        LIQUID_AGGREGATE_MAX_INPUTS);
+            return NULL;
+        }
+
+        if (!parse_input(spec, tokens[i], aggregate->type, &aggregate->inputs[aggregate->n_inputs++], error))
+        {
+            return NULL;
+        }
+    }
+
+    return g_steal_pointer(&aggregate);
+}
+
+void
+liquid_aggregate_spec_free(LiquidAggregateSpec *spec)
+{
+    g_free(spec->name);
+
+    for (guint i = 0; i < spec->n_inputs; i++)
+    {
+        g_clear_pointer(&spec->inputs[i].pattern, g_pattern_spec_free);
+    }
+
+    g_free(spec);
+}
+
+static gdouble
+aggregate_rescan(Aggregate *aggregate)
+{
+    gdouble result = aggregate->operation == LIQUID_AGGREGATE_PRODUCT ? 1.0 : 0.0;
+    gboolean first = TRUE;
+
+    for (guint i = 0; i < aggregate->inputs->len; i++)
+    {
+        const AggregateInputValue *input = &g_array_index(aggregate->inputs, AggregateInputValue, i);
+
+        if (!input->valid)
+        {
+            continue;
+        }
+
+        switch (aggregate->operation)
+        {
+        case LIQUID_AGGREGATE_MAX:
+            result = first ? input->value : MAX(result, input->value);
+            break;
+
+        case LIQUID_AGGREGATE_MIN:
+            result = first ? input->value : MIN(result, input->value);
+            break;
+
+        case LIQUID_AGGREGATE_PRODUCT:
+            result *= input->value;
+            break;
+
+        case LIQUID_AGGREGATE_SUM:
+        case LIQUID_AGGREGATE_MEAN:
+            result += input->value;
+            break;
+        }
+
+        first = FALSE;
+    }
+
+    return result;
+}
+
+/*
+ * Sums are kept up to date with the difference, and extremes are only looked
+ * for again when the input that held one moves away from it; products are
+ * rescanned, since a factor can be zero.
+ */
+static gdouble
+aggregate_update(Aggregate *aggregate, guint input, gdouble value)
+{
+    AggregateInputValue *entry = &g_array_index(aggregate->inputs, AggregateInputValue, input);
+    gdouble previous = entry->value;
+    gboolean was_valid = entry->valid;
+
+    entry->value = value;
+    entry->valid = TRUE;
+
+    if (!was_valid)
+    {
+        aggregate->n_valid++;
+    }
+
+    switch (aggregate->operation)
+    {
+    case LIQUID_AGGREGATE_SUM:
+    case LIQUID_AGGREGATE_MEAN:
+        aggregate->accumulator += was_valid ? value - previous : value;
+        break;
+
+    case LIQUID_AGGREGATE_MAX:
+        if (aggregate->n_valid == 1 || value >= aggregate->accumulator)
+        {
+            aggregate->accumulator = value;
+        }
+        else if (was_valid && previous == aggregate->accumulator)
+        {
+            aggregate->accumulator = aggregate_rescan(aggregate);
+        }
+        break;
+
+    case LIQUID_AGGREGATE_MIN:
+        if (aggregate->n_valid == 1 || value <= aggregate->accumulator)
+        {
+            aggregate->accumulator = value;
+        }
+        else if (was_valid && previous == aggregate->accumulator)
+        {
+            aggregate->accumulator = aggregate_rescan(aggregate);
+        }
+        break;
+
+    case LIQUID_AGGREGATE_PRODUCT:
+        aggregate->accumulator = aggregate_rescan(aggregate);
+        break;
+    }
+
+    if (aggregate->operation == LIQUID_AGGREGATE_MEAN)
+    {
+        return aggregate->accumulator / aggregate->n_valid;
+    }
+
+    return aggregate->accumulator;
+}
+
+/* Aggregates feeding others get here too, through their own channels */
+static void
+liquid_aggregator_input_changed(LiquidDriver *driver, guint channel, LiquidAggregator *aggregator)
+{
+    GPtrArray *channel_bindings = g_hash_table_lookup(aggregator->bindings, driver);
+
+    if (channel_bindings == NULL || channel >= channel_bindings->len || channel_bindings->pdata[channel] == NULL)
+    {
+        return;
+    }
+
+    GArray *bindings = channel_bindings->pdata[channel];
+    gdouble value = liquid_driver_get_channel_values(driver)[channel];
+
+    for (guint i = 0; i < bindings->len; i++)
+    {
+        const AggregateBinding *binding = &g_array_index(bindings, AggregateBinding, i);
+        Aggregate *aggregate = &g_array_index(aggregator->aggregates, Aggregate, binding->aggregate);
+        gdouble *values = liquid_driver_get_channel_values(LIQUID_DRIVER(aggregator));
+
+        values[binding->aggregate] = aggregate_update(aggregate, binding->input, value);
+        liquid_driver_channels_changed(LIQUID_DRIVER(aggregator), binding->aggregate, 1);
+    }
+}
+
+static void
+liquid_aggregator_bind(LiquidAggregator *aggregator, LiquidDriver *driver, const gchar *device_name)
+{
+    g_autoptr(GPtrArray) channel_bindings = g_ptr_array_new_with_free_func((GDestroyNotify)g_array_unref);
+    gboolean bound = FALSE;
+
+    for (guint channel = 0; channel < liquid_driver_get_n_channels(driver); channel++)
+    {
+        LiquidChannelType type = liquid_driver_get_channel_type(driver, channel);
+        g_autofree gchar *path
+            = g_strdup_printf("%s/%s", device_name, liquid_driver_get_channel_name(driver, channel));
+        GArray *bindings = NULL;
+
+        /* An aggregate only reads earlier ones, which keeps the graph acyclic and in evaluation order */
+        guint first = driver == LIQUID_DRIVER(aggregator) ? channel + 1 : 0;
+
+        for (guint i = first; i < aggregator->specs->len; i++)
+        {
+            const LiquidAggregateSpec *spec = g_ptr_array_index(aggregator->specs, i);
+            Aggregate *aggregate = &g_array_index(aggregator->aggregates, Aggregate, i);
+
+            for (guint j = 0; j < spec->n_inputs; j++)
+            {
+                if (spec->inputs[j].type != type || !g_pattern_spec_match_string(spec->inputs[j].pattern, path))
+                {
+                    continue;
+                }
+
+                AggregateBinding binding = { i, aggregate->inputs->len };
+                AggregateInputValue input = { 0.0, FALSE };
+
+                if (bindings == NULL)
+                {
+                    bindings = g_array_new(FALSE, FALSE, sizeof(AggregateBinding));
+                }
+
+                g_array_append_val(bindings, binding);
+                g_array_append_val(aggregate->inputs, input);
+            }
+        }
+
+        g_ptr_array_add(channel_bindings, bindings);
+        bound = bound || bindings;
+    }
+
+    if (!bound)
+    {
+        return;
+    }
+
+    g_hash_table_insert(aggregator->bindings, driver, g_steal_pointer(&channel_bindings));
+
+    if (driver == LIQUID_DRIVER(aggregator))
+    {
+        g_signal_connect(driver, "channel-changed", G_CALLBACK(liquid_aggregator_input_changed), aggregator);
+    }
+    else
+    {
+        g_signal_connect_object(driver,
+                                "channel-changed",
+                                G_CALLBACK(liquid_aggregator_input_changed),
+                                aggregator,
+                                G_CONNECT_DEFAULT);
+    }
+}
+
+static gchar *
+liquid_aggregator_dup_object_name(LiquidDriver *driver G_GNUC_UNUSED)
+{
+    return g_strdup(AGGREGATOR_NAME);
+}
+
+static void
+liquid_aggregator_finalize(GObject *object)
+{
+    LiquidAggregator *aggregator = LIQUID_AGGREGATOR(object);
+
+    for (guint i = 0; i < aggregator->aggregates->len; i++)
+    {
+        g_array_unref(g_array_index(aggregator->aggregates, Aggregate, i).inputs);
+    }
+
+    g_array_unref(aggregator->aggregates);
+    g_ptr_array_unref(aggregator->specs);
+    g_hash_table_unref(aggregator->bindings);
+
+    G_OBJECT_CLASS(liquid_aggregator_parent_class)->finalize(object);
+}
+
+static void
+liquid_aggregator_init(LiquidAggregator *aggregator)
+{
+    aggregator->aggregates = g_array_new(FALSE, FALSE, sizeof(Aggregate));
+    aggregator->bindings
+        = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, (GDestroyNotify)g_ptr_array_unref);
+}
+
+static void
+liquid_aggregator_class_init(LiquidAggregatorClass *class)
+{
+    GObjectClass *gobject_class = G_OBJECT_CLASS(class);
+    LiquidDriverClass *driver_class = LIQUID_DRIVER_CLASS(class);
+
+    gobject_class->finalize = liquid_aggregator_finalize;
+
+    driver_class->dup_object_name = liquid_aggregator_dup_object_name;
+}
+
+LiquidAggregator *
+liquid_aggregator_new(GPtrArray *specs)
+{
+    g_return_val_if_fail(specs != NULL, NULL);
+
+    LiquidAggregator *aggregator = g_object_new(LIQUID_TYPE_AGGREGATOR, NULL);
+
+    aggregator->specs = g_ptr_array_ref(specs);
+
+    for (guint i = 0; i < specs->len; i++)
+    {
+        const LiquidAggregateSpec *spec = g_ptr_array_index(specs, i);
+
+        Aggregate aggregate = {
+            .operation = spec->operation,
+            .inputs = g_array_new(FALSE, FALSE, sizeof(AggregateInputValue)),
+            .n_valid = 0,
+            .accumulator = 0.0,
+        };
+
+        g_array_append_val(aggregator->aggregates, aggregate);
+        liquid_driver_add_channel(LIQUID_DRIVER(aggregator), spec->name, spec->type, LIQUID_CHANNEL_FLAG_DERIVED);
+    }
+
+    liquid_aggregator_bind(aggregator, LIQUID_DRIVER(aggregator), AGGREGATOR_NAME);
+
+    return aggregator;
+}
+
+void
+liquid_aggregator_add_driver(LiquidAggregator *aggregator, LiquidDriver *driver)
+{
+    g_return_if_fail(LIQUID_IS_AGGREGATOR(aggregator));
+    g_return_if_fail(LIQUID_IS_DRIVER(driver));
+
+    const gchar *path = g_dbus_object_get_object_path(G_DBUS_OBJECT(driver));
+
+    g_return_if_fail(path != NULL);
+
+    liquid_aggregator_bind(aggregator, driver, strrchr(path, '/') + 1);
+}
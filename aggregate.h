@@ -0,0 +1,70 @@
+#pragma once
+
+#include <glib-object.h>
+
+#include "driver.h"
+
+G_BEGIN_DECLS
+
+typedef enum
+{
+    LIQUID_AGGREGATE_SUM,
+    LIQUID_AGGREGATE_MAX,
+    LIQUID_AGGREGATE_MIN,
+    LIQUID_AGGREGATE_MEAN,
+    LIQUID_AGGREGATE_PRODUCT,
+} LiquidAggregateOperation;
+
+#define LIQUID_AGGREGATE_MAX_INPUTS 8
+
+typedef struct
+{
+    GPatternSpec *pattern;
+    LiquidChannelType type;
+} LiquidAggregateInput;
+
+/*
+ * A channel combining channels of any device, parsed from
+ *
+ *     NAME: OPERATION TYPE INPUT...
+ *
+ * where OPERATION is sum, max, min, mean or product, TYPE the channel type of
+ * the result and each INPUT a DEVICE/CHANNEL glob, optionally prefixed by the
+ * type of the channels it matches (TYPE otherwise), as in `current:aggregates/total`.
+ * Aggregates defined earlier are the device "aggregates". NAME may only hold
+ * letters, digits and underscores, as it ends up in object paths.
+ */
+typedef struct
+{
+    gchar *name;
+    LiquidAggregateOperation operation;
+    LiquidChannelType type;
+    LiquidAggregateInput inputs[LIQUID_AGGREGATE_MAX_INPUTS];
+    guint n_inputs;
+} LiquidAggregateSpec;
+
+LiquidAggregateSpec *
+liquid_aggregate_spec_parse(const gchar *spec, GError **error);
+
+void
+liquid_aggregate_spec_free(LiquidAggregateSpec *spec);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC(LiquidAggregateSpec, liquid_aggregate_spec_free)
+
+/*
+ * A driver without a device, exported as "aggregates", with one derived
+ * channel per aggregate. An aggregate is only recomputed when one of the
+ * channels it reads changes, and only takes a value once one of them has.
+ */
+#define LIQUID_TYPE_AGGREGATOR (liquid_aggregator_get_type())
+G_DECLARE_FINAL_TYPE(LiquidAggregator, liquid_aggregator, LIQUID, AGGREGATOR, LiquidDriver)
+
+/* `specs` is a LiquidAggregateSpec array; inputs can only be earlier aggregates, so there are no cycles */
+LiquidAggregator *
+liquid_aggregator_new(GPtrArray *specs);
+
+/* Binds the channels of an exported driver to the aggregates reading them */
+void
+liquid_aggregator_add_driver(LiquidAggregator *aggregator, LiquidDriver *driver);
+
+G_END_DECLS
@@ -0,0 +1,280 @@
+#include "alert.h"
+
+#include <string.h>
+
+#include "spec.h"
+
+typedef struct
+{
+    const gchar *spec;
+    gchar **tokens;
+    guint next;
+} Parser;
+
+static const gchar *
+parser_peek(Parser *parser)
+{
+    return parser->tokens[parser->next];
+}
+
+static const gchar *
+parser_next(Parser *parser, const gchar *what, GError **error)
+{
+    const gchar *token = parser->tokens[parser->next];
+
+    if (token == NULL)
+    {
+        g_set_error(error, G_OPTION_ERROR, G_OPTION_ERROR_BAD_VALUE, "Alert '%s': expected %s", parser->spec, what);
+        return NULL;
+    }
+
+    parser->next++;
+    return token;
+}
+
+static gboolean
+parser_next_double(Parser *parser, const gchar *what, gdouble *value, GError **error)
+{
+    const gchar *token = parser_next(parser, what, error);
+    gchar *end = NULL;
+
+    if (token == NULL)
+    {
+        return FALSE;
+    }
+
+    *value = g_ascii_strtod(token, &end);
+
+    if (*end != '\0' || end == token)
+    {
+        g_set_error(error,
+                    G_OPTION_ERROR,
+                    G_OPTION_ERROR_BAD_VALUE,
+                    "Alert '%s': '%s' is not a valid %s",
+                    parser->spec,
+                    token,
+                    what);
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+/* [CHANNEL] TYPE OP VALUE, where only conditions that can name a channel pass `channel` */
+static gboolean
+parser_next_condition(Parser *parser, gchar **channel, LiquidAlertCondition *condition, GError **error)
+{
+    const gchar *token = parser_next(parser, channel ? "a channel" : "a channel type", error);
+
+    if (token == NULL)
+    {
+        return FALSE;
+    }
+
+    condition->type = liquid_channel_type_from_nick(token);
+
+    if (condition->type == LIQUID_CHANNEL_N_TYPES && channel)
+    {
+        *channel = g_strdup(token);
+        token = parser_next(parser, "a channel type", error);
+
+        if (token == NULL)
+        {
+            return FALSE;
+        }
+
+        condition->type = liquid_channel_type_from_nick(token);
+    }
+
+    if (condition->type == LIQUID_CHANNEL_N_TYPES)
+    {
+        g_set_error(error,
+                    G_OPTION_ERROR,
+                    G_OPTION_ERROR_BAD_VALUE,
+                    "Alert '%s': unknown channel type '%s'",
+                    parser->spec,
+                    token);
+        return FALSE;
+    }
+
+    token = parser_next(parser, "< or >", error);
+
+    if (token == NULL)
+    {
+        return FALSE;
+    }
+
+    if (g_str_equal(token, "<"))
+    {
+        condition->direction = LIQUID_ALERT_BELOW;
+    }
+    else if (g_str_equal(token, ">"))
+    {
+        condition->direction = LIQUID_ALERT_ABOVE;
+    }
+    else
+    {
+        g_set_error(error, G_OPTION_ERROR, G_OPTION_ERROR_BAD_VALUE, "Alert '%s': expected < or >", parser->spec);
+        return FALSE;
+    }
+
+    return parser_next_double(parser, "threshold", &condition->threshold, error);
+}
+
+LiquidAlertRule *
+liquid_alert_rule_parse(const gchar *spec, GError **error)
+{
+    g_return_val_if_fail(spec != NULL, NULL);
+
+    const gchar *colon = strchr(spec, ':');
+
+    if (colon == NULL || colon == spec)
+    {
+        g_set_error(error, G_OPTION_ERROR, G_OPTION_ERROR_BAD_VALUE, "Alert '%s': expected NAME: before the rule", spec);
+        return NULL;
+    }
+
+    g_autoptr(LiquidAlertRule) rule = g_new0(LiquidAlertRule, 1);
+    g_auto(GStrv) tokens = liquid_spec_tokenize(colon + 1, NULL);
+    Parser parser = { spec, tokens, 0 };
+
+    rule->name = g_strndup(spec, (gsize)(colon - spec));
+    rule->samples = 1;
+
+    const gchar *channel_token = parser_next(&parser, "a channel", error);
+
+    if (channel_token == NULL)
+    {
+        return NULL;
+    }
+
+    rule->channel_pattern = g_pattern_spec_new(channel_token);
+
+    if (!parser_next_condition(&parser, NULL, &rule->condition, error))
+    {
+        return NULL;
+    }
+
+    while (parser_peek(&parser))
+    {
+        const gchar *keyword = parser_next(&parser, "a keyword", error);
+
+        if (g_str_equal(keyword, "for"))
+        {
+            gdouble samples = 0;
+
+            if (!parser_next_double(&parser, "number of samples", &samples, error))
+            {
+                return NULL;
+            }
+
+            if (samples < 1 || samples > G_MAXUINT || samples != (guint)samples)
+            {
+                g_set_error(error, G_OPTION_ERROR, G_OPTION_ERROR_BAD_VALUE, "Alert '%s': invalid number of samples", spec);
+                return NULL;
+            }
+
+            rule->samples = (guint)samples;
+        }
+        else if (g_str_equal(keyword, "hysteresis"))
+        {
+            if (!parser_next_double(&parser, "hysteresis", &rule->hysteresis, error))
+            {
+                return NULL;
+            }
+
+            if (rule->hysteresis < 0)
+            {
+                g_set_error(error, G_OPTION_ERROR, G_OPTION_ERROR_BAD_VALUE, "Alert '%s': negative hysteresis", spec);
+                return NULL;
+            }
+        }
+        else if (g_str_equal(keyword, "while") && !rule->has_guard)
+        {
+            if (!parser_next_condition(&parser, &rule->guard_channel, &rule->guard, error))
+            {
+                return NULL;
+            }
+
+            rule->has_guard = TRUE;
+        }
+        else
+        {
+            g_set_error(error, G_OPTION_ERROR, G_OPTION_ERROR_BAD_VALUE, "Alert '%s': unexpected '%s'", spec, keyword);
+            return NULL;
+        }
+    }
+
+    return g_steal_pointer(&rule);
+}
+
+void
+liquid_alert_rule_free(LiquidAlertRule *rule)
+{
+    g_free(rule->name);
+    g_clear_pointer(&rule->channel_pattern, g_pattern_spec_free);
+    g_free(rule->guard_channel);
+    g_free(rule);
+}
+
+static gboolean
+liquid_alert_condition_equal(const LiquidAlertCondition *a, const LiquidAlertCondition *b)
+{
+    return a->type == b->type && a->direction == b->direction && a->threshold == b->threshold;
+}
+
+gboolean
+liquid_alert_rule_equal(const LiquidAlertRule *a, const LiquidAlertRule *b)
+{
+    g_return_val_if_fail(a != NULL, FALSE);
+    g_return_val_if_fail(b != NULL, FALSE);
+
+    return g_str_equal(a->name, b->name) && g_pattern_spec_equal(a->channel_pattern, b->channel_pattern)
+           && liquid_alert_condition_equal(&a->condition, &b->condition) && a->samples == b->samples
+           && a->hysteresis == b->hysteresis && a->has_guard == b->has_guard
+           && g_strcmp0(a->guard_channel, b->guard_channel) == 0
+           && (!a->has_guard || liquid_alert_condition_equal(&a->guard, &b->guard));
+}
+
+gboolean
+liquid_alert_condition_holds(const LiquidAlertCondition *condition, gdouble value)
+{
+    return condition->direction == LIQUID_ALERT_BELOW ? value < condition->threshold
+                                                      : value > condition->threshold;
+}
+
+gboolean
+liquid_alert_state_update(LiquidAlertState *state, const LiquidAlertRule *rule, gdouble value, gboolean guard_holds)
+{
+    const LiquidAlertCondition *condition = &rule->condition;
+    gboolean toward_other_state;
+
+    if (state->active)
+    {
+        gboolean cleared = condition->direction == LIQUID_ALERT_BELOW
+                               ? value >= condition->threshold + rule->hysteresis
+                               : value <= condition->threshold - rule->hysteresis;
+
+        toward_other_state = cleared || !guard_holds;
+    }
+    else
+    {
+        toward_other_state = guard_holds && liquid_alert_condition_holds(condition, value);
+    }
+
+    if (!toward_other_state)
+    {
+        state->count = 0;
+        return FALSE;
+    }
+
+    if (++state->count < rule->samples)
+    {
+        return FALSE;
+    }
+
+    state->active = !state->active;
+    state->count = 0;
+
+    return TRUE;
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <glib.h>
+
+#include "driver.h"
+
+G_BEGIN_DECLS
+
+typedef enum
+{
+    LIQUID_ALERT_BELOW,
+    LIQUID_ALERT_ABOVE,
+} LiquidAlertDirection;
+
+typedef struct
+{
+    LiquidChannelType type;
+    LiquidAlertDirection direction;
+    gdouble threshold;
+} LiquidAlertCondition;
+
+/*
+ * A threshold rule for the channels of every device, parsed from
+ *
+ *     NAME: CHANNEL TYPE OP VALUE [for N] [hysteresis H] [while [CHANNEL] TYPE OP VALUE]
+ *
+ * where CHANNEL is a glob pattern on channel names, TYPE a channel type nick
+ * such as rpm or current and OP either < or >. For example:
+ *
+ *     fan-stopped: fan* rpm < 300 for 3 hysteresis 200 while duty > 20
+ *
+ * The rule becomes active after N consecutive samples past the threshold
+ * (default 1) while the optional condition on another channel of the same
+ * device holds; the channel named there defaults to the one alerting. It
+ * clears after N consecutive samples back past the threshold by H (default 0),
+ * or once that other condition no longer holds.
+ */
+typedef struct
+{
+    gchar *name;
+    GPatternSpec *channel_pattern;
+    LiquidAlertCondition condition;
+    guint samples;
+    gdouble hysteresis;
+
+    gboolean has_guard;
+    /* NULL for the channel of the same name as the alerting one */
+    gchar *guard_channel;
+    LiquidAlertCondition guard;
+} LiquidAlertRule;
+
+LiquidAlertRule *
+liquid_alert_rule_parse(const gchar *spec, GError **error);
+
+void
+liquid_alert_rule_free(LiquidAlertRule *rule);
+
+/* Whether two rules, from different configurations say, have the same name and behavior */
+gboolean
+liquid_alert_rule_equal(const LiquidAlertRule *a, const LiquidAlertRule *b);
+
+gboolean
+liquid_alert_condition_holds(const LiquidAlertCondition *condition, gdouble value);
+
+/* Where a rule stands on one channel */
+typedef struct
+{
+    gboolean active;
+    /* Consecutive samples pointing to the other state */
+    guint count;
+} LiquidAlertState;
+
+/*
+ * Feeds one sample of the channel and whether the rule's other condition
+ * holds; returns TRUE if that made the rule become active or clear.
+ */
+gboolean
+liquid_alert_state_update(LiquidAlertState *state, const LiquidAlertRule *rule, gdouble value, gboolean guard_holds);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC(LiquidAlertRule, liquid_alert_rule_free)
+
+G_END_DECLS
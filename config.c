@@ -0,0 +1,348 @@
+#include "config.h"
+
+#include <string.h>
+
+#include <gio/gio.h>
+
+#include "alert.h"
+#include "fan_controller.h"
+
+#define GROUP_PREFIX "device "
+
+#define KEY_ENABLED "enabled"
+#define KEY_UPDATE_INTERVAL "update-interval"
+#define KEY_ALERT "alert"
+#define KEY_FAN_CONTROL "fan-control"
+
+#define UPDATE_INTERVAL_MAX_MS 60000
+
+typedef struct
+{
+    GPatternSpec *pattern;
+
+    /* What the group doesn't set is left to earlier groups */
+    gboolean has_enabled;
+    gboolean enabled;
+    gboolean has_update_interval;
+    guint update_interval_ms;
+
+    /* NULL when not set; an empty list clears what earlier groups set */
+    gchar **alert_specs;
+    GPtrArray *alert_rules;
+    gchar **fan_control_specs;
+    GPtrArray *fan_controls;
+} DeviceGroup;
+
+struct _LiquidConfig
+{
+    grefcount ref_count;
+    GPtrArray *groups;
+};
+
+static const gchar *const no_specs[] = { NULL };
+
+static void
+device_group_free(DeviceGroup *group)
+{
+    g_clear_pointer(&group->pattern, g_pattern_spec_free);
+    g_strfreev(group->alert_specs);
+    g_clear_pointer(&group->alert_rules, g_ptr_array_unref);
+    g_strfreev(group->fan_control_specs);
+    g_clear_pointer(&group->fan_controls, g_ptr_array_unref);
+    g_free(group);
+}
+
+static gboolean
+parse_alerts(GKeyFile *key_file, const gchar *group_name, DeviceGroup *group, GError **error)
+{
+    group->alert_specs = g_key_file_get_string_list(key_file, group_name, KEY_ALERT, NULL, error);
+
+    if (group->alert_specs == NULL)
+    {
+        return FALSE;
+    }
+
+    group->alert_rules = g_ptr_array_new_with_free_func((GDestroyNotify)liquid_alert_rule_free);
+
+    for (gchar **spec = group->alert_specs; *spec; spec++)
+    {
+        LiquidAlertRule *rule = liquid_alert_rule_parse(*spec, error);
+
+        if (rule == NULL)
+        {
+            return FALSE;
+        }
+
+        g_ptr_array_add(group->alert_rules, rule);
+    }
+
+    return TRUE;
+}
+
+static gboolean
+parse_fan_controls(GKeyFile *key_file, const gchar *group_name, DeviceGroup *group, GError **error)
+{
+    group->fan_control_specs = g_key_file_get_string_list(key_file, group_name, KEY_FAN_CONTROL, NULL, error);
+
+    if (group->fan_control_specs == NULL)
+    {
+        return FALSE;
+    }
+
+    group->fan_controls = g_ptr_array_new_with_free_func((GDestroyNotify)liquid_fan_control_free);
+
+    for (gchar **spec = group->fan_control_specs; *spec; spec++)
+    {
+        LiquidFanControl *control = liquid_fan_control_parse(*spec, error);
+
+        if (control == NULL)
+        {
+            return FALSE;
+        }
+
+        if (liquid_fan_control_lookup(group->fan_controls, control->channel))
+        {
+            g_set_error(error,
+                        G_KEY_FILE_ERROR,
+                        G_KEY_FILE_ERROR_INVALID_VALUE,
+                        "Fan channel %s is controlled twice",
+                        control->channel);
+            liquid_fan_control_free(control);
+            return FALSE;
+        }
+
+        g_ptr_array_add(group->fan_controls, control);
+    }
+
+    return TRUE;
+}
+
+static gboolean
+parse_device_group(GKeyFile *key_file, const gchar *group_name, DeviceGroup *group, GError **error)
+{
+    g_auto(GStrv) keys = g_key_file_get_keys(key_file, group_name, NULL, error);
+
+    if (keys == NULL)
+    {
+        return FALSE;
+    }
+
+    for (GStrv key = keys; *key; key++)
+    {
+        g_autoptr(GError) key_error = NULL;
+
+        if (g_str_equal(*key, KEY_ENABLED))
+        {
+            group->enabled = g_key_file_get_boolean(key_file, group_name, KEY_ENABLED, &key_error);
+            group->has_enabled = TRUE;
+        }
+        else if (g_str_equal(*key, KEY_UPDATE_INTERVAL))
+        {
+            guint64 interval = g_key_file_get_uint64(key_file, group_name, KEY_UPDATE_INTERVAL, &key_error);
+
+            if (key_error == NULL && (interval == 0 || interval > UPDATE_INTERVAL_MAX_MS))
+            {
+                g_set_error(&key_error,
+                            G_KEY_FILE_ERROR,
+                            G_KEY_FILE_ERROR_INVALID_VALUE,
+                            "Update interval must be between 1 and %d ms",
+                            UPDATE_INTERVAL_MAX_MS);
+            }
+
+            group->update_interval_ms = (guint)interval;
+            group->has_update_interval = TRUE;
+        }
+        else if (g_str_equal(*key, KEY_ALERT))
+        {
+            parse_alerts(key_file, group_name, group, &key_error);
+        }
+        else if (g_str_equal(*key, KEY_FAN_CONTROL))
+        {
+            parse_fan_controls(key_file, group_name, group, &key_error);
+        }
+        else
+        {
+            g_set_error(&key_error, G_KEY_FILE_ERROR, G_KEY_FILE_ERROR_KEY_NOT_FOUND, "Unknown key");
+        }
+
+        if (key_error)
+        {
+            g_propagate_prefixed_error(error, g_steal_pointer(&key_error), "%s: ", *key);
+            return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
+static LiquidConfig *
+liquid_config_new(void)
+{
+    LiquidConfig *config = g_new0(LiquidConfig, 1);
+
+    g_ref_count_init(&config->ref_count);
+    config->groups = g_ptr_array_new_with_free_func((GDestroyNotify)device_group_free);
+
+    return config;
+}
+
+LiquidConfig *
+liquid_config_load(const gchar *path, GError **error)
+{
+    g_autoptr(LiquidConfig) config = liquid_config_new();
+    g_autoptr(GKeyFile) key_file = g_key_file_new();
+    g_autoptr(GError) load_error = NULL;
+
+    if (!g_key_file_load_from_file(key_file, path, G_KEY_FILE_NONE, &load_error))
+    {
+        if (g_error_matches(load_error, G_FILE_ERROR, G_FILE_ERROR_NOENT))
+        {
+            return g_steal_pointer(&config);
+        }
+
+        g_propagate_prefixed_error(error, g_steal_pointer(&load_error), "%s: ", path);
+        return NULL;
+    }
+
+    g_auto(GStrv) group_names = g_key_file_get_groups(key_file, NULL);
+
+    for (GStrv name = group_names; *name; name++)
+    {
+        if (!g_str_has_prefix(*name, GROUP_PREFIX))
+        {
+            g_set_error(error, G_KEY_FILE_ERROR, G_KEY_FILE_ERROR_GROUP_NOT_FOUND, "%s: unknown group [%s]", path, *name);
+            return NULL;
+        }
+
+        DeviceGroup *group = g_new0(DeviceGroup, 1);
+
+        group->pattern = g_pattern_spec_new(*name + strlen(GROUP_PREFIX));
+        g_ptr_array_add(config->groups, group);
+
+        if (!parse_device_group(key_file, *name, group, error))
+        {
+            g_prefix_error(error, "%s: [%s] ", path, *name);
+            return NULL;
+        }
+    }
+
+    return g_steal_pointer(&config);
+}
+
+LiquidConfig *
+liquid_config_ref(LiquidConfig *config)
+{
+    g_ref_count_inc(&config->ref_count);
+
+    return config;
+}
+
+void
+liquid_config_unref(LiquidConfig *config)
+{
+    if (g_ref_count_dec(&config->ref_count))
+    {
+        g_ptr_array_unref(config->groups);
+        g_free(config);
+    }
+}
+
+static void
+append_all(GPtrArray *array, GPtrArray *elements)
+{
+    for (guint i = 0; elements && i < elements->len; i++)
+    {
+        g_ptr_array_add(array, g_ptr_array_index(elements, i));
+    }
+}
+
+LiquidDevicePlan *
+liquid_config_resolve(LiquidConfig *config, const gchar *device_key, GPtrArray *alert_rules, GPtrArray *fan_controls)
+{
+    LiquidDevicePlan *plan = g_new0(LiquidDevicePlan, 1);
+    const DeviceGroup *alerts = NULL;
+    const DeviceGroup *fans = NULL;
+
+    g_ref_count_init(&plan->ref_count);
+    plan->config = liquid_config_ref(config);
+    plan->enabled = TRUE;
+
+    for (guint i = 0; i < config->groups->len; i++)
+    {
+        const DeviceGroup *group = g_ptr_array_index(config->groups, i);
+
+        if (!g_pattern_spec_match_string(group->pattern, device_key))
+        {
+            continue;
+        }
+
+        if (group->has_enabled)
+        {
+            plan->enabled = group->enabled;
+        }
+
+        if (group->has_update_interval)
+        {
+            plan->update_interval_ms = group->update_interval_ms;
+        }
+
+        alerts = group->alert_specs ? group : alerts;
+        fans = group->fan_control_specs ? group : fans;
+    }
+
+    /* Elements are owned by the caller and by the configuration */
+    plan->alert_rules = g_ptr_array_new();
+    append_all(plan->alert_rules, alert_rules);
+    append_all(plan->alert_rules, alerts ? alerts->alert_rules : NULL);
+    plan->alert_specs = alerts ? (const gchar *const *)alerts->alert_specs : no_specs;
+
+    /* A configured control replaces the daemon-wide one of its channel */
+    plan->fan_controls = g_ptr_array_new();
+
+    for (guint i = 0; fan_controls && i < fan_controls->len; i++)
+    {
+        LiquidFanControl *control = g_ptr_array_index(fan_controls, i);
+
+        if (fans == NULL || liquid_fan_control_lookup(fans->fan_controls, control->channel) == NULL)
+        {
+            g_ptr_array_add(plan->fan_controls, control);
+        }
+    }
+
+    append_all(plan->fan_controls, fans ? fans->fan_controls : NULL);
+    plan->fan_control_specs = fans ? (const gchar *const *)fans->fan_control_specs : no_specs;
+
+    return plan;
+}
+
+LiquidDevicePlan *
+liquid_device_plan_ref(LiquidDevicePlan *plan)
+{
+    g_ref_count_inc(&plan->ref_count);
+
+    return plan;
+}
+
+void
+liquid_device_plan_unref(LiquidDevicePlan *plan)
+{
+    if (g_ref_count_dec(&plan->ref_count))
+    {
+        g_ptr_array_unref(plan->alert_rules);
+        g_ptr_array_unref(plan->fan_controls);
+        liquid_config_unref(plan->config);
+        g_free(plan);
+    }
+}
+
+gboolean
+liquid_device_plan_alerts_equal(const LiquidDevicePlan *a, const LiquidDevicePlan *b)
+{
+    return g_strv_equal(a->alert_specs, b->alert_specs);
+}
+
+gboolean
+liquid_device_plan_fan_controls_equal(const LiquidDevicePlan *a, const LiquidDevicePlan *b)
+{
+    return g_strv_equal(a->fan_control_specs, b->fan_control_specs);
+}
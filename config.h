@@ -0,0 +1,82 @@
+#pragma once
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/*
+ * liquidd's configuration file: a key file of device groups, such as
+ *
+ *     [device *]
+ *     alert=fan-stopped: fan* rpm < 300 for 3
+ *
+ *     [device 1-4.2]
+ *     update-interval=500
+ *     fan-control=fan0: /sys/class/hwmon/hwmon1/temp1_input target 45
+ *
+ * each applying to the devices whose key (USB port path, or `emulated-N`)
+ * matches its glob. Keys are `enabled` (a boolean), `update-interval` (in
+ * milliseconds) and the `alert` and `fan-control` lists, with the syntax of
+ * the options of the same names; where several groups set a key, the last one
+ * wins. Everything is parsed and validated by liquid_config_load(), so that a
+ * LiquidConfig is never partly valid, and never changes afterwards.
+ */
+typedef struct _LiquidConfig LiquidConfig;
+
+/* A file that doesn't exist is an empty configuration */
+LiquidConfig *
+liquid_config_load(const gchar *path, GError **error);
+
+LiquidConfig *
+liquid_config_ref(LiquidConfig *config);
+
+void
+liquid_config_unref(LiquidConfig *config);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC(LiquidConfig, liquid_config_unref)
+
+/*
+ * What applies to one device, resolved once per configuration so that
+ * nothing is looked up while the device runs. Immutable, and keeps the
+ * configuration it was resolved from alive.
+ */
+typedef struct
+{
+    gboolean enabled;
+    /* 0 for the driver's own */
+    guint update_interval_ms;
+    /*
+     * LiquidAlertRule and LiquidFanControl arrays: the daemon-wide ones, then
+     * the configured ones; a configured fan control replaces the daemon-wide
+     * one of its channel.
+     */
+    GPtrArray *alert_rules;
+    GPtrArray *fan_controls;
+
+    /*< private >*/
+    grefcount ref_count;
+    LiquidConfig *config;
+    const gchar *const *alert_specs;
+    const gchar *const *fan_control_specs;
+} LiquidDevicePlan;
+
+/* `alert_rules` and `fan_controls` are the daemon-wide ones, which must outlive the plan */
+LiquidDevicePlan *
+liquid_config_resolve(LiquidConfig *config, const gchar *device_key, GPtrArray *alert_rules, GPtrArray *fan_controls);
+
+LiquidDevicePlan *
+liquid_device_plan_ref(LiquidDevicePlan *plan);
+
+void
+liquid_device_plan_unref(LiquidDevicePlan *plan);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC(LiquidDevicePlan, liquid_device_plan_unref)
+
+/* Whether the configured alerts, or fan controls, of `a` and `b` are the same */
+gboolean
+liquid_device_plan_alerts_equal(const LiquidDevicePlan *a, const LiquidDevicePlan *b);
+
+gboolean
+liquid_device_plan_fan_controls_equal(const LiquidDevicePlan *a, const LiquidDevicePlan *b);
+
+G_END_DECLS
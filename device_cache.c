@@ -0,0 +1,327 @@
+#include "device_cache.h"
+
+#include <errno.h>
+
+/*
+ * Persistent per-device state, keyed by USB path.
+ *
+ * Each group also records what the device looked like when the state was saved
+ * (IDs, serial number and report descriptor size); a cached entry is only handed
+ * out again if all of them still match, so a device that was swapped or
+ * reflashed gets initialized from scratch. With per-boot set, so does a device
+ * that may have lost power, and with it its configuration, since the state was
+ * saved: entries also record the boot and the USB address, which changes
+ * whenever the device enumerates again, so that only a daemon restart finds
+ * them. Without it, entries are for what outlives the device's configuration,
+ * such as energy counters.
+ */
+
+#define KEY_VENDOR_ID "VendorId"
+#define KEY_PRODUCT_ID "ProductId"
+#define KEY_SERIAL "Serial"
+#define KEY_REPORT_DESCRIPTOR_SIZE "ReportDescriptorSize"
+#define KEY_BOOT_ID "BootId"
+#define KEY_USB_ADDRESS "UsbAddress"
+#define KEY_STATE "State"
+
+struct _LiquidDeviceCache
+{
+    GObject parent;
+
+    gchar *path;
+    gboolean per_boot;
+    GKeyFile *key_file;
+    gboolean dirty;
+
+    /* NULL if unknown, which makes every entry stale */
+    gchar *boot_id;
+};
+
+G_DEFINE_FINAL_TYPE(LiquidDeviceCache, liquid_device_cache, G_TYPE_OBJECT)
+
+enum
+{
+    PROP_0,
+    PROP_PATH,
+    PROP_PER_BOOT,
+    N_PROPERTIES
+};
+
+static GParamSpec *pspecs[N_PROPERTIES];
+
+static void
+liquid_device_cache_get_property(GObject *object, guint property_id, GValue *value, GParamSpec *pspec)
+{
+    LiquidDeviceCache *cache = LIQUID_DEVICE_CACHE(object);
+
+    switch (property_id)
+    {
+    case PROP_PATH:
+        g_value_set_string(value, cache->path);
+        break;
+
+    case PROP_PER_BOOT:
+        g_value_set_boolean(value, cache->per_boot);
+        break;
+
+    default:
+        G_OBJECT_WARN_INVALID_PROPERTY_ID(object, property_id, pspec);
+    }
+}
+
+static void
+liquid_device_cache_set_property(GObject *object, guint property_id, const GValue *value, GParamSpec *pspec)
+{
+    LiquidDeviceCache *cache = LIQUID_DEVICE_CACHE(object);
+
+    switch (property_id)
+    {
+    case PROP_PATH:
+        g_clear_pointer(&cache->path, g_free);
+        cache->path = g_value_dup_string(value);
+        break;
+
+    case PROP_PER_BOOT:
+        cache->per_boot = g_value_get_boolean(value);
+        break;
+
+    default:
+        G_OBJECT_WARN_INVALID_PROPERTY_ID(object, property_id, pspec);
+    }
+}
+
+static void
+liquid_device_cache_finalize(GObject *object)
+{
+    LiquidDeviceCache *cache = LIQUID_DEVICE_CACHE(object);
+
+    g_clear_pointer(&cache->path, g_free);
+    g_clear_pointer(&cache->key_file, g_key_file_unref);
+    g_clear_pointer(&cache->boot_id, g_free);
+
+    G_OBJECT_CLASS(liquid_device_cache_parent_class)->finalize(object);
+}
+
+static void
+liquid_device_cache_init(LiquidDeviceCache *cache)
+{
+    cache->key_file = g_key_file_new();
+
+    if (g_file_get_contents("/proc/sys/kernel/random/boot_id", &cache->boot_id, NULL, NULL))
+    {
+        g_strstrip(cache->boot_id);
+    }
+}
+
+static void
+liquid_device_cache_class_init(LiquidDeviceCacheClass *class)
+{
+    GObjectClass *gobject_class = G_OBJECT_CLASS(class);
+
+    gobject_class->finalize = liquid_device_cache_finalize;
+    gobject_class->get_property = liquid_device_cache_get_property;
+    gobject_class->set_property = liquid_device_cache_set_property;
+
+    pspecs[PROP_PATH]
+        = g_param_spec_string("path", /* name */
+                              "Cache file path", /* nick */
+                              "Cache file path", /* blurb */
+                              NULL, /* default_value */
+                              G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY | G_PARAM_STATIC_STRINGS);
+
+    pspecs[PROP_PER_BOOT]
+        = g_param_spec_boolean("per-boot", /* name */
+                               "Per boot", /* nick */
+                               "Whether entries are only valid within the boot and USB enumeration they were saved in", /* blurb */
+                               FALSE, /* default_value */
+                               G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY | G_PARAM_STATIC_STRINGS);
+
+    g_object_class_install_properties(gobject_class, N_PROPERTIES, pspecs);
+}
+
+LiquidDeviceCache *
+liquid_device_cache_new(const gchar *path, gboolean per_boot)
+{
+    return g_object_new(LIQUID_TYPE_DEVICE_CACHE,
+                        "path",
+                        path,
+                        "per-boot",
+                        per_boot,
+                        NULL);
+}
+
+gboolean
+liquid_device_cache_load(LiquidDeviceCache *cache, GError **error)
+{
+    g_return_val_if_fail(LIQUID_IS_DEVICE_CACHE(cache), FALSE);
+
+    g_autoptr(GError) inner_error = NULL;
+
+    if (!g_key_file_load_from_file(cache->key_file, cache->path, G_KEY_FILE_NONE, &inner_error))
+    {
+        /* No cache yet is the normal state on first start */
+        if (g_error_matches(inner_error, G_FILE_ERROR, G_FILE_ERROR_NOENT))
+        {
+            return TRUE;
+        }
+
+        g_propagate_prefixed_error(error,
+                                   g_steal_pointer(&inner_error),
+                                   "Failed to load %s: ",
+                                   cache->path);
+        return FALSE;
+    }
+
+    cache->dirty = FALSE;
+
+    return TRUE;
+}
+
+gboolean
+liquid_device_cache_save(LiquidDeviceCache *cache, GError **error)
+{
+    g_return_val_if_fail(LIQUID_IS_DEVICE_CACHE(cache), FALSE);
+
+    if (!cache->dirty)
+    {
+        return TRUE;
+    }
+
+    g_autofree gchar *dir = g_path_get_dirname(cache->path);
+
+    if (g_mkdir_with_parents(dir, 0700) == -1)
+    {
+        int errsv = errno;
+        g_set_error(error,
+                    G_FILE_ERROR,
+                    G_FILE_ERROR_FAILED,
+                    "Failed to create %s: %s",
+                    dir,
+                    g_strerror(errsv));
+        return FALSE;
+    }
+
+    if (!g_key_file_save_to_file(cache->key_file, cache->path, error))
+    {
+        return FALSE;
+    }
+
+    cache->dirty = FALSE;
+
+    return TRUE;
+}
+
+static gboolean
+liquid_device_cache_identity_matches(LiquidDeviceCache *cache,
+                                     const gchar *group,
+                                     LiquidHidDeviceInfo *info)
+{
+    GKeyFile *key_file = cache->key_file;
+    g_autofree gchar *cached_serial = g_key_file_get_string(key_file, group, KEY_SERIAL, NULL);
+    const gchar *serial = liquid_hid_device_info_get_serial(info);
+    g_autofree gchar *cached_boot_id = g_key_file_get_string(key_file, group, KEY_BOOT_ID, NULL);
+    g_autofree gchar *cached_usb_address = g_key_file_get_string(key_file, group, KEY_USB_ADDRESS, NULL);
+    const gchar *usb_address = liquid_hid_device_info_get_usb_address(info);
+
+    if (g_strcmp0(cached_serial, serial ? serial : "") != 0)
+    {
+        return FALSE;
+    }
+
+    if (cache->per_boot
+        && (cache->boot_id == NULL || usb_address == NULL || g_strcmp0(cached_boot_id, cache->boot_id) != 0
+            || g_strcmp0(cached_usb_address, usb_address) != 0))
+    {
+        return FALSE;
+    }
+
+    return g_key_file_get_uint64(key_file, group, KEY_VENDOR_ID, NULL)
+               == liquid_hid_device_info_get_vendor_id(info)
+        && g_key_file_get_uint64(key_file, group, KEY_PRODUCT_ID, NULL)
+               == liquid_hid_device_info_get_product_id(info)
+        && g_key_file_get_uint64(key_file, group, KEY_REPORT_DESCRIPTOR_SIZE, NULL)
+               == liquid_hid_device_info_get_report_descriptor_size(info);
+}
+
+GVariant *
+liquid_device_cache_lookup(LiquidDeviceCache *cache, LiquidHidDeviceInfo *info)
+{
+    g_return_val_if_fail(LIQUID_IS_DEVICE_CACHE(cache), NULL);
+    g_return_val_if_fail(LIQUID_IS_HID_DEVICE_INFO(info), NULL);
+
+    const gchar *group = liquid_hid_device_info_get_usb_path(info);
+
+    if (group == NULL || !g_key_file_has_group(cache->key_file, group))
+    {
+        return NULL;
+    }
+
+    if (!liquid_device_cache_identity_matches(cache, group, info))
+    {
+        return NULL;
+    }
+
+    g_autofree gchar *text = g_key_file_get_string(cache->key_file, group, KEY_STATE, NULL);
+
+    if (text == NULL)
+    {
+        return NULL;
+    }
+
+    g_autoptr(GError) error = NULL;
+    g_autoptr(GVariant) state = g_variant_parse(G_VARIANT_TYPE_VARDICT, text, NULL, NULL, &error);
+
+    if (state == NULL)
+    {
+        g_printerr("Ignoring cached state for %s: %s\n", group, error->message);
+        return NULL;
+    }
+
+    return g_steal_pointer(&state);
+}
+
+void
+liquid_device_cache_store(LiquidDeviceCache *cache, LiquidHidDeviceInfo *info, GVariant *state)
+{
+    g_return_if_fail(LIQUID_IS_DEVICE_CACHE(cache));
+    g_return_if_fail(LIQUID_IS_HID_DEVICE_INFO(info));
+    g_return_if_fail(state == NULL || g_variant_is_of_type(state, G_VARIANT_TYPE_VARDICT));
+
+    const gchar *group = liquid_hid_device_info_get_usb_path(info);
+
+    /* Without a stable location there is nothing to key the entry on */
+    if (group == NULL)
+    {
+        return;
+    }
+
+    GKeyFile *key_file = cache->key_file;
+
+    g_key_file_remove_group(key_file, group, NULL);
+    cache->dirty = TRUE;
+
+    if (state == NULL)
+    {
+        return;
+    }
+
+    const gchar *serial = liquid_hid_device_info_get_serial(info);
+    const gchar *usb_address = liquid_hid_device_info_get_usb_address(info);
+    g_autofree gchar *text = g_variant_print(state, TRUE);
+
+    g_key_file_set_uint64(key_file, group, KEY_VENDOR_ID, liquid_hid_device_info_get_vendor_id(info));
+    g_key_file_set_uint64(key_file, group, KEY_PRODUCT_ID, liquid_hid_device_info_get_product_id(info));
+    g_key_file_set_string(key_file, group, KEY_SERIAL, serial ? serial : "");
+
+    if (cache->per_boot)
+    {
+        g_key_file_set_string(key_file, group, KEY_BOOT_ID, cache->boot_id ? cache->boot_id : "");
+        g_key_file_set_string(key_file, group, KEY_USB_ADDRESS, usb_address ? usb_address : "");
+    }
+
+    g_key_file_set_uint64(key_file,
+                          group,
+                          KEY_REPORT_DESCRIPTOR_SIZE,
+                          liquid_hid_device_info_get_report_descriptor_size(info));
+    g_key_file_set_string(key_file, group, KEY_STATE, text);
+}
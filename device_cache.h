@@ -0,0 +1,28 @@
+#pragma once
+
+#include <glib-object.h>
+
+#include "hid_device_info.h"
+
+G_BEGIN_DECLS
+
+#define LIQUID_TYPE_DEVICE_CACHE (liquid_device_cache_get_type())
+G_DECLARE_FINAL_TYPE(LiquidDeviceCache, liquid_device_cache, LIQUID, DEVICE_CACHE, GObject)
+
+/* See device_cache.c for `per_boot` */
+LiquidDeviceCache *
+liquid_device_cache_new(const gchar *path, gboolean per_boot);
+
+gboolean
+liquid_device_cache_load(LiquidDeviceCache *cache, GError **error);
+
+gboolean
+liquid_device_cache_save(LiquidDeviceCache *cache, GError **error);
+
+GVariant *
+liquid_device_cache_lookup(LiquidDeviceCache *cache, LiquidHidDeviceInfo *info);
+
+void
+liquid_device_cache_store(LiquidDeviceCache *cache, LiquidHidDeviceInfo *info, GVariant *state);
+
+G_END_DECLS
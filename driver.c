@@ -1,20 +1,314 @@
 #include "driver.h"
-#include "gio/gdbusobjectskeleton.h"
+
+#include <string.h>
+
+#include "alert.h"
+#include "dbus_interfaces.h"
+#include "filter.h"
+#include "metrics.h"
+
+enum
+{
+    SIGNAL_STATE_CHANGED,
+    SIGNAL_COUNTERS_CHANGED,
+    SIGNAL_CHANNEL_CHANGED,
+    N_SIGNALS
+};
+
+static guint signals[N_SIGNALS];
+
+typedef struct
+{
+    GQuark name;
+    LiquidChannelType type;
+    LiquidChannelFlags flags;
+
+    /* Value and number of the last change, see liquid_driver_get_sequence() */
+    gdouble published_value;
+    guint64 sequence;
+    /* Not in the view yet, see liquid_driver_publish() */
+    gboolean unpublished;
+
+    /* Range of LiquidDriverPrivate.alerts evaluated on every sample */
+    guint first_alert;
+    guint n_alerts;
+
+    /* Range of LiquidDriverPrivate.filters fed with every sample */
+    guint first_filter;
+    guint n_filters;
+
+    /* Created on export, as a view over the value in LiquidDriverPrivate.values */
+    GDBusInterfaceSkeleton *view;
+    /* Prometheus labels, also formatted on export */
+    gchar *metric_labels;
+} LiquidDriverChannel;
 
 typedef struct
 {
-    GHashTable *channels;
+    GArray *channels;
+    GArray *values;
+
+    /* Set once exported: channel name quark -> GDBusObjectSkeleton */
+    GDBusObjectManagerServer *object_manager_server;
+    GHashTable *channel_objects;
+
+    LiquidPublisher *publisher;
+    /* Unpublished values replaced by newer ones since the last publication */
+    guint superseded;
+
+    /* LiquidAlertRule array shared by all drivers, and the rules bound to channels */
+    GPtrArray *alert_rules;
+    GArray *alerts;
+    LiquidDBusAlerts *dbus_alerts;
+
+    /* Filter chains of device channels, each writing a derived channel */
+    GArray *filters;
 } LiquidDriverPrivate;
 
+typedef struct
+{
+    const LiquidAlertRule *rule;
+    guint channel;
+    /* Channel of the rule's other condition, or G_MAXUINT */
+    guint guard_channel;
+    LiquidAlertState state;
+} LiquidDriverAlert;
+
+typedef struct
+{
+    LiquidFilterChain *chain;
+    /* The derived channel holding the output */
+    guint channel;
+} LiquidDriverFilter;
+
+typedef struct
+{
+    const gchar *nick;
+    const gchar *interface_name;
+    const gchar *metric_name;
+    const gchar *metric_type;
+    const gchar *metric_help;
+    GDBusInterfaceSkeleton *(*new_view)(void);
+    void (*update_view)(GDBusInterfaceSkeleton *view, gdouble value);
+    /* The value as it appears in the interface's Value property */
+    GVariant *(*to_variant)(gdouble value);
+} LiquidChannelTypeInfo;
+
+/* Shared by all drivers; only touched from the main thread */
+static guint64 sequence;
+static guint64 first_sequence;
+
+static GDBusInterfaceSkeleton *
+fan_speed_rpm_new_view(void)
+{
+    return G_DBUS_INTERFACE_SKELETON(liquid_dbus_fan_speed_rpm_skeleton_new());
+}
+
+static void
+fan_speed_rpm_update_view(GDBusInterfaceSkeleton *view, gdouble value)
+{
+    liquid_dbus_fan_speed_rpm_set_value(LIQUID_DBUS_FAN_SPEED_RPM(view), (guint)value);
+}
+
+static GVariant *
+uint32_to_variant(gdouble value)
+{
+    return g_variant_new_uint32((guint)value);
+}
+
+static GDBusInterfaceSkeleton *
+duty_percent_new_view(void)
+{
+    return G_DBUS_INTERFACE_SKELETON(liquid_dbus_duty_percent_skeleton_new());
+}
+
+static void
+duty_percent_update_view(GDBusInterfaceSkeleton *view, gdouble value)
+{
+    liquid_dbus_duty_percent_set_value(LIQUID_DBUS_DUTY_PERCENT(view), (guint)value);
+}
+
+static GDBusInterfaceSkeleton *
+voltage_new_view(void)
+{
+    return G_DBUS_INTERFACE_SKELETON(liquid_dbus_voltage_skeleton_new());
+}
+
+static void
+voltage_update_view(GDBusInterfaceSkeleton *view, gdouble value)
+{
+    liquid_dbus_voltage_set_value(LIQUID_DBUS_VOLTAGE(view), value);
+}
+
+static GDBusInterfaceSkeleton *
+current_new_view(void)
+{
+    return G_DBUS_INTERFACE_SKELETON(liquid_dbus_current_skeleton_new());
+}
+
+static void
+current_update_view(GDBusInterfaceSkeleton *view, gdouble value)
+{
+    liquid_dbus_current_set_value(LIQUID_DBUS_CURRENT(view), value);
+}
+
+static GDBusInterfaceSkeleton *
+power_new_view(void)
+{
+    return G_DBUS_INTERFACE_SKELETON(liquid_dbus_power_skeleton_new());
+}
+
+static void
+power_update_view(GDBusInterfaceSkeleton *view, gdouble value)
+{
+    liquid_dbus_power_set_value(LIQUID_DBUS_POWER(view), value);
+}
+
+static GDBusInterfaceSkeleton *
+energy_new_view(void)
+{
+    return G_DBUS_INTERFACE_SKELETON(liquid_dbus_energy_skeleton_new());
+}
+
+static void
+energy_update_view(GDBusInterfaceSkeleton *view, gdouble value)
+{
+    liquid_dbus_energy_set_value(LIQUID_DBUS_ENERGY(view), value);
+}
+
+static const LiquidChannelTypeInfo channel_types[LIQUID_CHANNEL_N_TYPES] = {
+    [LIQUID_CHANNEL_FAN_SPEED_RPM] = {
+        "rpm",
+        "org.liquidctl.FanSpeedRPM",
+        "liquidd_fan_speed_rpm",
+        "gauge",
+        "Fan speed in revolutions per minute.",
+        fan_speed_rpm_new_view,
+        fan_speed_rpm_update_view,
+        uint32_to_variant,
+    },
+    [LIQUID_CHANNEL_DUTY_PERCENT] = {
+        "duty",
+        "org.liquidctl.DutyPercent",
+        "liquidd_duty_percent",
+        "gauge",
+        "Duty cycle in percent.",
+        duty_percent_new_view,
+        duty_percent_update_view,
+        uint32_to_variant,
+    },
+    [LIQUID_CHANNEL_VOLTAGE] = {
+        "voltage",
+        "org.liquidctl.Voltage",
+        "liquidd_voltage_volts",
+        "gauge",
+        "Voltage in volts.",
+        voltage_new_view,
+        voltage_update_view,
+        g_variant_new_double,
+    },
+    [LIQUID_CHANNEL_CURRENT] = {
+        "current",
+        "org.liquidctl.Current",
+        "liquidd_current_amperes",
+        "gauge",
+        "Current in amperes.",
+        current_new_view,
+        current_update_view,
+        g_variant_new_double,
+    },
+    [LIQUID_CHANNEL_POWER] = {
+        "power",
+        "org.liquidctl.Power",
+        "liquidd_power_watts",
+        "gauge",
+        "Power in watts.",
+        power_new_view,
+        power_update_view,
+        g_variant_new_double,
+    },
+    [LIQUID_CHANNEL_ENERGY] = {
+        "energy",
+        "org.liquidctl.Energy",
+        "liquidd_energy_watt_hours_total",
+        "counter",
+        "Energy in watt-hours since the device was first seen.",
+        energy_new_view,
+        energy_update_view,
+        g_variant_new_double,
+    },
+};
+
 G_DEFINE_TYPE_WITH_PRIVATE(LiquidDriver, liquid_driver, G_TYPE_DBUS_OBJECT_SKELETON)
 
+/*
+ * Starting from a random point rather than from the clock, which can step
+ * back across a restart: a number held from a previous daemon then almost
+ * surely falls outside this one's range, which is how it's told apart. The
+ * start leaves at least 2^63 numbers of room.
+ */
+static guint64
+liquid_driver_next_sequence(void)
+{
+    if (sequence == 0)
+    {
+        sequence = (guint64)g_random_int() << 30;
+        first_sequence = sequence + 1;
+    }
+
+    return ++sequence;
+}
+
+guint64
+liquid_driver_get_sequence(void)
+{
+    return sequence;
+}
+
+gboolean
+liquid_driver_sequence_is_current(guint64 number)
+{
+    return number >= first_sequence && number <= sequence;
+}
+
+LiquidChannelType
+liquid_channel_type_from_nick(const gchar *nick)
+{
+    g_return_val_if_fail(nick != NULL, LIQUID_CHANNEL_N_TYPES);
+
+    LiquidChannelType type = 0;
+
+    while (type < LIQUID_CHANNEL_N_TYPES && !g_str_equal(channel_types[type].nick, nick))
+    {
+        type++;
+    }
+
+    return type;
+}
+
+const gchar *
+liquid_channel_type_get_nick(LiquidChannelType type)
+{
+    g_return_val_if_fail(type < LIQUID_CHANNEL_N_TYPES, NULL);
+
+    return channel_types[type].nick;
+}
+
 static void
 liquid_driver_dispose(GObject *object)
 {
     LiquidDriver *driver = LIQUID_DRIVER(object);
     LiquidDriverPrivate *priv = liquid_driver_get_instance_private(driver);
 
-    g_hash_table_remove_all(priv->channels);
+    for (guint i = 0; i < priv->channels->len; i++)
+    {
+        g_clear_object(&g_array_index(priv->channels, LiquidDriverChannel, i).view);
+    }
+
+    g_clear_pointer(&priv->channel_objects, g_hash_table_unref);
+    g_clear_object(&priv->object_manager_server);
+    g_clear_object(&priv->publisher);
+    g_clear_object(&priv->dbus_alerts);
 
     G_OBJECT_CLASS(liquid_driver_parent_class)->dispose(object);
 }
@@ -25,18 +319,75 @@ liquid_driver_finalize(GObject *object)
     LiquidDriver *driver = LIQUID_DRIVER(object);
     LiquidDriverPrivate *priv = liquid_driver_get_instance_private(driver);
 
-    g_hash_table_unref(priv->channels);
+    for (guint i = 0; i < priv->channels->len; i++)
+    {
+        g_free(g_array_index(priv->channels, LiquidDriverChannel, i).metric_labels);
+    }
+
+    g_array_unref(priv->channels);
+    g_array_unref(priv->values);
+    g_array_unref(priv->alerts);
+    g_clear_pointer(&priv->alert_rules, g_ptr_array_unref);
+
+    for (guint i = 0; i < priv->filters->len; i++)
+    {
+        liquid_filter_chain_free(g_array_index(priv->filters, LiquidDriverFilter, i).chain);
+    }
+
+    g_array_unref(priv->filters);
 
     G_OBJECT_CLASS(liquid_driver_parent_class)->finalize(object);
 }
 
+static gchar *
+liquid_driver_real_dup_object_name(LiquidDriver *driver)
+{
+    return g_strdup(G_OBJECT_TYPE_NAME(driver));
+}
+
 static void
 liquid_driver_class_init(LiquidDriverClass *class)
 {
     GObjectClass *gobject_class = G_OBJECT_CLASS(class);
 
+    class->dup_object_name = liquid_driver_real_dup_object_name;
+
     gobject_class->dispose = liquid_driver_dispose;
     gobject_class->finalize = liquid_driver_finalize;
+
+    signals[SIGNAL_STATE_CHANGED]
+        = g_signal_new("state-changed", /* signal_name */
+                       G_TYPE_FROM_CLASS(class), /* itype */
+                       G_SIGNAL_RUN_LAST, /* signal_flags */
+                       G_STRUCT_OFFSET(LiquidDriverClass, state_changed), /* class_offset */
+                       NULL, /* accumulator */
+                       NULL, /* accu_data */
+                       NULL, /* c_marshaller */
+                       G_TYPE_NONE, /* return_type */
+                       0 /* n_params */);
+
+    signals[SIGNAL_COUNTERS_CHANGED]
+        = g_signal_new("counters-changed", /* signal_name */
+                       G_TYPE_FROM_CLASS(class), /* itype */
+                       G_SIGNAL_RUN_LAST, /* signal_flags */
+                       G_STRUCT_OFFSET(LiquidDriverClass, counters_changed), /* class_offset */
+                       NULL, /* accumulator */
+                       NULL, /* accu_data */
+                       NULL, /* c_marshaller */
+                       G_TYPE_NONE, /* return_type */
+                       0 /* n_params */);
+
+    signals[SIGNAL_CHANNEL_CHANGED]
+        = g_signal_new("channel-changed", /* signal_name */
+                       G_TYPE_FROM_CLASS(class), /* itype */
+                       G_SIGNAL_RUN_LAST, /* signal_flags */
+                       G_STRUCT_OFFSET(LiquidDriverClass, channel_changed), /* class_offset */
+                       NULL, /* accumulator */
+                       NULL, /* accu_data */
+                       NULL, /* c_marshaller */
+                       G_TYPE_NONE, /* return_type */
+                       1, /* n_params */
+                       G_TYPE_UINT);
 }
 
 static void
@@ -44,56 +395,698 @@ liquid_driver_init(LiquidDriver *driver)
 {
     LiquidDriverPrivate *priv = liquid_driver_get_instance_private(driver);
 
-    priv->channels = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_object_unref);
+    priv->channels = g_array_new(FALSE, FALSE, sizeof(LiquidDriverChannel));
+    priv->values = g_array_new(FALSE, TRUE, sizeof(gdouble));
+    priv->alerts = g_array_new(FALSE, FALSE, sizeof(LiquidDriverAlert));
+    priv->filters = g_array_new(FALSE, FALSE, sizeof(LiquidDriverFilter));
+}
+
+gboolean
+liquid_driver_init_device(LiquidDriver *driver, GError **error)
+{
+    g_return_val_if_fail(LIQUID_IS_DRIVER(driver), FALSE);
+
+    LiquidDriverClass *class = LIQUID_DRIVER_GET_CLASS(driver);
+
+    if (class->init_device == NULL)
+    {
+        return TRUE;
+    }
+
+    return class->init_device(driver, error);
+}
+
+GVariant *
+liquid_driver_save_state(LiquidDriver *driver)
+{
+    g_return_val_if_fail(LIQUID_IS_DRIVER(driver), NULL);
+
+    LiquidDriverClass *class = LIQUID_DRIVER_GET_CLASS(driver);
+
+    if (class->save_state == NULL)
+    {
+        return NULL;
+    }
+
+    return class->save_state(driver);
+}
+
+gboolean
+liquid_driver_restore_state(LiquidDriver *driver, GVariant *state)
+{
+    g_return_val_if_fail(LIQUID_IS_DRIVER(driver), FALSE);
+    g_return_val_if_fail(g_variant_is_of_type(state, G_VARIANT_TYPE_VARDICT), FALSE);
+
+    LiquidDriverClass *class = LIQUID_DRIVER_GET_CLASS(driver);
+
+    if (class->restore_state == NULL)
+    {
+        return FALSE;
+    }
+
+    return class->restore_state(driver, state);
 }
 
 void
-liquid_driver_for_each_channel(LiquidDriver *driver,
-                               LiquidDriverForEachChannelCallback callback,
-                               gpointer user_data)
+liquid_driver_state_changed(LiquidDriver *driver)
 {
     g_return_if_fail(LIQUID_IS_DRIVER(driver));
 
+    g_signal_emit(driver, signals[SIGNAL_STATE_CHANGED], 0);
+}
+
+GVariant *
+liquid_driver_save_counters(LiquidDriver *driver)
+{
+    g_return_val_if_fail(LIQUID_IS_DRIVER(driver), NULL);
+
+    LiquidDriverClass *class = LIQUID_DRIVER_GET_CLASS(driver);
+
+    if (class->save_counters == NULL)
+    {
+        return NULL;
+    }
+
+    return class->save_counters(driver);
+}
+
+void
+liquid_driver_restore_counters(LiquidDriver *driver, GVariant *counters)
+{
+    g_return_if_fail(LIQUID_IS_DRIVER(driver));
+    g_return_if_fail(g_variant_is_of_type(counters, G_VARIANT_TYPE_VARDICT));
+
+    LiquidDriverClass *class = LIQUID_DRIVER_GET_CLASS(driver);
+
+    if (class->restore_counters)
+    {
+        class->restore_counters(driver, counters);
+    }
+}
+
+void
+liquid_driver_counters_changed(LiquidDriver *driver)
+{
+    g_return_if_fail(LIQUID_IS_DRIVER(driver));
+
+    g_signal_emit(driver, signals[SIGNAL_COUNTERS_CHANGED], 0);
+}
+
+static void
+liquid_driver_export_channel(LiquidDriver *driver, guint channel)
+{
+    LiquidDriverPrivate *priv = liquid_driver_get_instance_private(driver);
+    LiquidDriverChannel *entry = &g_array_index(priv->channels, LiquidDriverChannel, channel);
+    const LiquidChannelTypeInfo *type_info = &channel_types[entry->type];
+
+    entry->view = type_info->new_view();
+    type_info->update_view(entry->view, g_array_index(priv->values, gdouble, channel));
+
+    const gchar *object_name = strrchr(g_dbus_object_get_object_path(G_DBUS_OBJECT(driver)), '/') + 1;
+
+    entry->metric_labels
+        = g_strdup_printf("device=\"%s\",channel=\"%s\"", object_name, g_quark_to_string(entry->name));
+
+    GDBusObjectSkeleton *object = g_hash_table_lookup(priv->channel_objects, GUINT_TO_POINTER(entry->name));
+
+    /* The object manager picks up interfaces added to objects it already exports */
+    if (object)
+    {
+        g_dbus_object_skeleton_add_interface(object, entry->view);
+        return;
+    }
+
+    const gchar *base_path = g_dbus_object_get_object_path(G_DBUS_OBJECT(driver));
+    g_autofree gchar *path = g_strdup_printf("%s/%s", base_path, g_quark_to_string(entry->name));
+
+    object = g_dbus_object_skeleton_new(path);
+    g_hash_table_insert(priv->channel_objects, GUINT_TO_POINTER(entry->name), object);
+
+    g_dbus_object_skeleton_add_interface(object, entry->view);
+    g_dbus_object_manager_server_export(priv->object_manager_server, object);
+}
+
+static guint
+liquid_driver_find_channel(LiquidDriver *driver, GQuark name, LiquidChannelType type)
+{
+    LiquidDriverPrivate *priv = liquid_driver_get_instance_private(driver);
+    const LiquidDriverChannel *entries = &g_array_index(priv->channels, LiquidDriverChannel, 0);
+
+    for (guint i = 0; i < priv->channels->len; i++)
+    {
+        if (entries[i].name == name && entries[i].type == type)
+        {
+            return i;
+        }
+    }
+
+    return G_MAXUINT;
+}
+
+/*
+ * Binds the rules to the channels. A binding with the same channels and an
+ * equal rule as an earlier one keeps its state; earlier ones left unmatched
+ * while active are returned, to be reported as cleared.
+ */
+static GArray *
+liquid_driver_bind_alerts(LiquidDriver *driver)
+{
+    LiquidDriverPrivate *priv = liquid_driver_get_instance_private(driver);
+    LiquidDriverChannel *entries = &g_array_index(priv->channels, LiquidDriverChannel, 0);
+    GArray *previous = priv->alerts;
+
+    priv->alerts = g_array_new(FALSE, FALSE, sizeof(LiquidDriverAlert));
+
+    for (guint i = 0; i < priv->channels->len; i++)
+    {
+        entries[i].first_alert = priv->alerts->len;
+
+        for (guint j = 0; priv->alert_rules && j < priv->alert_rules->len; j++)
+        {
+            const LiquidAlertRule *rule = g_ptr_array_index(priv->alert_rules, j);
+            const gchar *name = g_quark_to_string(entries[i].name);
+
+            if (rule->condition.type != entries[i].type || !g_pattern_spec_match_string(rule->channel_pattern, name))
+            {
+                continue;
+            }
+
+            guint guard_channel = G_MAXUINT;
+
+            /* Rules whose other condition is on a channel the device doesn't have don't apply */
+            if (rule->has_guard)
+            {
+                GQuark guard_name = rule->guard_channel ? g_quark_from_string(rule->guard_channel) : entries[i].name;
+
+                guard_channel = liquid_driver_find_channel(driver, guard_name, rule->guard.type);
+
+                if (guard_channel == G_MAXUINT)
+                {
+                    continue;
+                }
+            }
+
+            LiquidDriverAlert alert = {
+                .rule = rule,
+                .channel = i,
+                .guard_channel = guard_channel,
+                .state = { FALSE, 0 },
+            };
+
+            for (guint k = 0; k < previous->len; k++)
+            {
+                LiquidDriverAlert *bound = &g_array_index(previous, LiquidDriverAlert, k);
+
+                if (bound->channel == i && bound->guard_channel == guard_channel
+                    && liquid_alert_rule_equal(bound->rule, rule))
+                {
+                    alert.state = bound->state;
+                    g_array_remove_index(previous, k);
+                    break;
+                }
+            }
+
+            g_array_append_val(priv->alerts, alert);
+        }
+
+        entries[i].n_alerts = priv->alerts->len - entries[i].first_alert;
+    }
+
+    for (guint k = previous->len; k > 0; k--)
+    {
+        if (!g_array_index(previous, LiquidDriverAlert, k - 1).state.active)
+        {
+            g_array_remove_index(previous, k - 1);
+        }
+    }
+
+    return previous;
+}
+
+static void
+liquid_driver_update_active_alerts(LiquidDriver *driver)
+{
+    LiquidDriverPrivate *priv = liquid_driver_get_instance_private(driver);
+    g_auto(GVariantBuilder) active = G_VARIANT_BUILDER_INIT(G_VARIANT_TYPE("a(ss)"));
+
+    for (guint i = 0; i < priv->alerts->len; i++)
+    {
+        const LiquidDriverAlert *alert = &g_array_index(priv->alerts, LiquidDriverAlert, i);
+
+        if (alert->state.active)
+        {
+            g_variant_builder_add(&active,
+                                  "(ss)",
+                                  alert->rule->name,
+                                  liquid_driver_get_channel_name(driver, alert->channel));
+        }
+    }
+
+    liquid_dbus_alerts_set_active(priv->dbus_alerts, g_variant_builder_end(&active));
+}
+
+static void
+liquid_driver_alert_changed(LiquidDriver *driver, const LiquidDriverAlert *alert, gdouble value)
+{
+    LiquidDriverPrivate *priv = liquid_driver_get_instance_private(driver);
+    const gchar *channel_name = liquid_driver_get_channel_name(driver, alert->channel);
+
+    g_print("%s: alert %s %s on %s at %g\n",
+            g_dbus_object_get_object_path(G_DBUS_OBJECT(driver)),
+            alert->rule->name,
+            alert->state.active ? "active" : "cleared",
+            channel_name,
+            value);
+
+    if (priv->dbus_alerts == NULL)
+    {
+        return;
+    }
+
+    /* Unlike channel values, transitions are rare and never superseded, so they skip the publisher */
+    liquid_driver_update_active_alerts(driver);
+    g_dbus_interface_skeleton_flush(G_DBUS_INTERFACE_SKELETON(priv->dbus_alerts));
+    liquid_dbus_alerts_emit_alert_changed(priv->dbus_alerts,
+                                          alert->rule->name,
+                                          channel_name,
+                                          alert->state.active,
+                                          value);
+}
+
+/* Only devices with rules bound to their channels get the interface */
+static void
+liquid_driver_export_alerts(LiquidDriver *driver)
+{
+    LiquidDriverPrivate *priv = liquid_driver_get_instance_private(driver);
+
+    if (priv->dbus_alerts || priv->alerts->len == 0)
+    {
+        return;
+    }
+
+    priv->dbus_alerts = liquid_dbus_alerts_skeleton_new();
+    liquid_driver_update_active_alerts(driver);
+
+    g_dbus_object_skeleton_add_interface(G_DBUS_OBJECT_SKELETON(driver),
+                                         G_DBUS_INTERFACE_SKELETON(priv->dbus_alerts));
+}
+
+/*
+ * Rebinds the rules, reports the alerts that went away as cleared, and adds
+ * or removes the interface if the device gained its first or lost its last
+ * binding.
+ */
+static void
+liquid_driver_rebind_alerts(LiquidDriver *driver)
+{
     LiquidDriverPrivate *priv = liquid_driver_get_instance_private(driver);
+    g_autoptr(GArray) dropped = liquid_driver_bind_alerts(driver);
+    const gdouble *values = &g_array_index(priv->values, gdouble, 0);
+
+    if (priv->object_manager_server)
+    {
+        liquid_driver_export_alerts(driver);
+    }
+
+    for (guint i = 0; i < dropped->len; i++)
+    {
+        LiquidDriverAlert *alert = &g_array_index(dropped, LiquidDriverAlert, i);
 
-    GHashTableIter iter;
-    g_hash_table_iter_init(&iter, priv->channels);
+        alert->state.active = FALSE;
+        liquid_driver_alert_changed(driver, alert, values[alert->channel]);
+    }
+
+    if (priv->dbus_alerts == NULL)
+    {
+        return;
+    }
 
-    gchar *key;
-    GDBusObjectSkeleton *value;
+    liquid_driver_update_active_alerts(driver);
+    g_dbus_interface_skeleton_flush(G_DBUS_INTERFACE_SKELETON(priv->dbus_alerts));
 
-    while (g_hash_table_iter_next(&iter, (gpointer)&key, (gpointer)&value))
+    if (priv->alerts->len == 0)
     {
-        callback(driver, key, value, user_data);
+        g_dbus_object_skeleton_remove_interface(G_DBUS_OBJECT_SKELETON(driver),
+                                                G_DBUS_INTERFACE_SKELETON(priv->dbus_alerts));
+        g_clear_object(&priv->dbus_alerts);
     }
 }
 
-GDBusObjectSkeleton *
-liquid_driver_add_channel(LiquidDriver *driver, const gchar *name)
+guint
+liquid_driver_add_channel(LiquidDriver *driver,
+                          const gchar *name,
+                          LiquidChannelType type,
+                          LiquidChannelFlags flags)
+{
+    g_return_val_if_fail(LIQUID_IS_DRIVER(driver), G_MAXUINT);
+    g_return_val_if_fail(name != NULL, G_MAXUINT);
+    g_return_val_if_fail(type < LIQUID_CHANNEL_N_TYPES, G_MAXUINT);
+
+    LiquidDriverPrivate *priv = liquid_driver_get_instance_private(driver);
+    guint channel = priv->channels->len;
+
+    LiquidDriverChannel entry = {
+        .name = g_quark_from_string(name),
+        .type = type,
+        .flags = flags,
+        .published_value = 0.0,
+        .sequence = 0,
+        .unpublished = FALSE,
+        .first_alert = 0,
+        .n_alerts = 0,
+        .first_filter = 0,
+        .n_filters = 0,
+        .view = NULL,
+        .metric_labels = NULL,
+    };
+
+    g_array_append_val(priv->channels, entry);
+    g_array_set_size(priv->values, priv->channels->len);
+
+    if (priv->alert_rules)
+    {
+        liquid_driver_rebind_alerts(driver);
+    }
+
+    if (priv->object_manager_server)
+    {
+        liquid_driver_export_channel(driver, channel);
+    }
+
+    return channel;
+}
+
+guint
+liquid_driver_get_n_channels(LiquidDriver *driver)
+{
+    g_return_val_if_fail(LIQUID_IS_DRIVER(driver), 0);
+
+    LiquidDriverPrivate *priv = liquid_driver_get_instance_private(driver);
+
+    return priv->channels->len;
+}
+
+const gchar *
+liquid_driver_get_channel_name(LiquidDriver *driver, guint channel)
 {
     g_return_val_if_fail(LIQUID_IS_DRIVER(driver), NULL);
 
     LiquidDriverPrivate *priv = liquid_driver_get_instance_private(driver);
-    GDBusObjectSkeleton *object_skeleton = g_object_new(G_TYPE_DBUS_OBJECT_SKELETON, NULL);
 
-    g_hash_table_insert(priv->channels, g_strdup(name), g_object_ref(object_skeleton));
+    g_return_val_if_fail(channel < priv->channels->len, NULL);
+
+    return g_quark_to_string(g_array_index(priv->channels, LiquidDriverChannel, channel).name);
+}
+
+LiquidChannelType
+liquid_driver_get_channel_type(LiquidDriver *driver, guint channel)
+{
+    g_return_val_if_fail(LIQUID_IS_DRIVER(driver), LIQUID_CHANNEL_N_TYPES);
+
+    LiquidDriverPrivate *priv = liquid_driver_get_instance_private(driver);
+
+    g_return_val_if_fail(channel < priv->channels->len, LIQUID_CHANNEL_N_TYPES);
 
-    return g_steal_pointer(&object_skeleton);
+    return g_array_index(priv->channels, LiquidDriverChannel, channel).type;
 }
 
+LiquidChannelFlags
+liquid_driver_get_channel_flags(LiquidDriver *driver, guint channel)
+{
+    g_return_val_if_fail(LIQUID_IS_DRIVER(driver), LIQUID_CHANNEL_FLAG_NONE);
+
+    LiquidDriverPrivate *priv = liquid_driver_get_instance_private(driver);
+
+    g_return_val_if_fail(channel < priv->channels->len, LIQUID_CHANNEL_FLAG_NONE);
+
+    return g_array_index(priv->channels, LiquidDriverChannel, channel).flags;
+}
+
+guint
+liquid_driver_lookup_channel(LiquidDriver *driver, const gchar *name, LiquidChannelType type)
+{
+    g_return_val_if_fail(LIQUID_IS_DRIVER(driver), G_MAXUINT);
+    g_return_val_if_fail(name != NULL, G_MAXUINT);
+
+    GQuark quark = g_quark_try_string(name);
+
+    return quark ? liquid_driver_find_channel(driver, quark, type) : G_MAXUINT;
+}
+
+gboolean
+liquid_driver_set_duty(LiquidDriver *driver, guint channel, guint duty_percent, GError **error)
+{
+    g_return_val_if_fail(LIQUID_IS_DRIVER(driver), FALSE);
+    g_return_val_if_fail(duty_percent <= 100, FALSE);
+
+    LiquidDriverClass *class = LIQUID_DRIVER_GET_CLASS(driver);
+
+    if (class->set_duty == NULL || liquid_driver_get_channel_type(driver, channel) != LIQUID_CHANNEL_DUTY_PERCENT)
+    {
+        g_set_error(error,
+                    G_IO_ERROR,
+                    G_IO_ERROR_NOT_SUPPORTED,
+                    "Channel %s doesn't have a duty that can be set",
+                    liquid_driver_get_channel_name(driver, channel));
+        return FALSE;
+    }
+
+    return class->set_duty(driver, channel, duty_percent, error);
+}
+
+gdouble *
+liquid_driver_get_channel_values(LiquidDriver *driver)
+{
+    g_return_val_if_fail(LIQUID_IS_DRIVER(driver), NULL);
+
+    LiquidDriverPrivate *priv = liquid_driver_get_instance_private(driver);
+
+    return &g_array_index(priv->values, gdouble, 0);
+}
+
+/* Evaluates the alerts of a channel on a new sample and marks it for publication if it changed */
 static void
-liquid_driver_export_channel(LiquidDriver *driver,
-                             const gchar *name,
-                             GDBusObjectSkeleton *channel,
-                             gpointer user_data)
+liquid_driver_channel_sampled(LiquidDriver *driver, guint channel, const gdouble *values)
 {
-    GDBusObjectManagerServer *object_manager_server = user_data;
+    LiquidDriverPrivate *priv = liquid_driver_get_instance_private(driver);
+    LiquidDriverChannel *entry = &g_array_index(priv->channels, LiquidDriverChannel, channel);
 
-    const gchar *base_path = g_dbus_object_get_object_path(G_DBUS_OBJECT(driver));
-    g_autofree gchar *path = g_strdup_printf("%s/%s", base_path, name);
+    for (guint j = entry->first_alert; j < entry->first_alert + entry->n_alerts; j++)
+    {
+        LiquidDriverAlert *alert = &g_array_index(priv->alerts, LiquidDriverAlert, j);
+        gboolean guard_holds = alert->guard_channel == G_MAXUINT
+                               || liquid_alert_condition_holds(&alert->rule->guard, values[alert->guard_channel]);
+
+        if (liquid_alert_state_update(&alert->state, alert->rule, values[channel], guard_holds))
+        {
+            liquid_driver_alert_changed(driver, alert, values[channel]);
+        }
+    }
+
+    /* The first value is a change even if it's zero */
+    if (entry->sequence != 0 && entry->published_value == values[channel])
+    {
+        return;
+    }
+
+    if (entry->unpublished)
+    {
+        priv->superseded++;
+    }
+
+    entry->published_value = values[channel];
+    entry->sequence = liquid_driver_next_sequence();
+    entry->unpublished = TRUE;
+
+    g_signal_emit(driver, signals[SIGNAL_CHANNEL_CHANGED], 0, channel);
+}
 
-    g_dbus_object_skeleton_set_object_path(channel, path);
-    g_dbus_object_manager_server_export(object_manager_server, channel);
+void
+liquid_driver_channels_changed(LiquidDriver *driver, guint first, guint n_channels)
+{
+    g_return_if_fail(LIQUID_IS_DRIVER(driver));
+
+    LiquidDriverPrivate *priv = liquid_driver_get_instance_private(driver);
+
+    g_return_if_fail(first + n_channels <= priv->channels->len);
+
+    const LiquidDriverChannel *entries = &g_array_index(priv->channels, LiquidDriverChannel, 0);
+    gdouble *values = &g_array_index(priv->values, gdouble, 0);
+    gint64 now = priv->filters->len ? g_get_monotonic_time() : 0;
+
+    for (guint i = first; i < first + n_channels; i++)
+    {
+        liquid_driver_channel_sampled(driver, i, values);
+
+        for (guint j = entries[i].first_filter; j < entries[i].first_filter + entries[i].n_filters; j++)
+        {
+            const LiquidDriverFilter *filter = &g_array_index(priv->filters, LiquidDriverFilter, j);
+
+            values[filter->channel] = liquid_filter_chain_update(filter->chain, values[i], now);
+            liquid_driver_channel_sampled(driver, filter->channel, values);
+        }
+    }
+
+    /* Even with no value changed, the subclass may have telemetry of its own */
+    if (priv->publisher)
+    {
+        liquid_publisher_schedule(priv->publisher, driver);
+    }
+    else
+    {
+        liquid_driver_publish(driver, NULL);
+    }
+}
+
+guint
+liquid_driver_publish(LiquidDriver *driver, guint *n_superseded)
+{
+    g_return_val_if_fail(LIQUID_IS_DRIVER(driver), 0);
+
+    LiquidDriverPrivate *priv = liquid_driver_get_instance_private(driver);
+    LiquidDriverChannel *entries = &g_array_index(priv->channels, LiquidDriverChannel, 0);
+    guint n_published = 0;
+
+    for (guint i = 0; i < priv->channels->len; i++)
+    {
+        if (!entries[i].unpublished)
+        {
+            continue;
+        }
+
+        entries[i].unpublished = FALSE;
+
+        if (entries[i].view)
+        {
+            channel_types[entries[i].type].update_view(entries[i].view, entries[i].published_value);
+            /* Emit now rather than from an idle, so that a connection flush covers it */
+            g_dbus_interface_skeleton_flush(entries[i].view);
+            n_published++;
+        }
+    }
+
+    LiquidDriverClass *class = LIQUID_DRIVER_GET_CLASS(driver);
+
+    if (class->publish)
+    {
+        n_published += class->publish(driver);
+    }
+
+    if (n_superseded)
+    {
+        *n_superseded = priv->superseded;
+    }
+
+    priv->superseded = 0;
+
+    return n_published;
+}
+
+void
+liquid_driver_set_publisher(LiquidDriver *driver, LiquidPublisher *publisher)
+{
+    g_return_if_fail(LIQUID_IS_DRIVER(driver));
+    g_return_if_fail(publisher == NULL || LIQUID_IS_PUBLISHER(publisher));
+
+    LiquidDriverPrivate *priv = liquid_driver_get_instance_private(driver);
+
+    g_set_object(&priv->publisher, publisher);
+}
+
+void
+liquid_driver_set_alert_rules(LiquidDriver *driver, GPtrArray *rules)
+{
+    g_return_if_fail(LIQUID_IS_DRIVER(driver));
+
+    LiquidDriverPrivate *priv = liquid_driver_get_instance_private(driver);
+
+    g_clear_pointer(&priv->alert_rules, g_ptr_array_unref);
+    priv->alert_rules = rules ? g_ptr_array_ref(rules) : NULL;
+
+    liquid_driver_rebind_alerts(driver);
+}
+
+void
+liquid_driver_set_filters(LiquidDriver *driver, GPtrArray *specs)
+{
+    g_return_if_fail(LIQUID_IS_DRIVER(driver));
+    g_return_if_fail(specs != NULL);
+
+    LiquidDriverPrivate *priv = liquid_driver_get_instance_private(driver);
+
+    g_return_if_fail(priv->filters->len == 0);
+
+    /* Derived channels are appended, so only the device's channels are looked at */
+    guint n_channels = priv->channels->len;
+
+    for (guint i = 0; i < n_channels; i++)
+    {
+        LiquidDriverChannel *entry = &g_array_index(priv->channels, LiquidDriverChannel, i);
+        LiquidChannelType type = entry->type;
+        g_autofree gchar *name = g_strdup(g_quark_to_string(entry->name));
+        guint first_filter = priv->filters->len;
+
+        if (entry->flags & LIQUID_CHANNEL_FLAG_DERIVED)
+        {
+            continue;
+        }
+
+        for (guint j = 0; j < specs->len; j++)
+        {
+            const LiquidFilterSpec *spec = g_ptr_array_index(specs, j);
+
+            if (spec->type != type || !g_pattern_spec_match_string(spec->channel_pattern, name))
+            {
+                continue;
+            }
+
+            g_autofree gchar *derived_name = g_strdup_printf("%s_%s", name, spec->name);
+
+            LiquidDriverFilter filter = {
+                .chain = liquid_filter_chain_new(spec),
+                .channel = liquid_driver_add_channel(driver, derived_name, type, LIQUID_CHANNEL_FLAG_DERIVED),
+            };
+
+            g_array_append_val(priv->filters, filter);
+        }
+
+        /* Adding channels moves the array */
+        entry = &g_array_index(priv->channels, LiquidDriverChannel, i);
+        entry->first_filter = first_filter;
+        entry->n_filters = priv->filters->len - first_filter;
+    }
+}
+
+void
+liquid_driver_collect_changes(LiquidDriver *driver, guint64 since, GVariantBuilder *builder)
+{
+    g_return_if_fail(LIQUID_IS_DRIVER(driver));
+
+    LiquidDriverPrivate *priv = liquid_driver_get_instance_private(driver);
+
+    if (priv->channel_objects == NULL)
+    {
+        return;
+    }
+
+    const LiquidDriverChannel *entries = &g_array_index(priv->channels, LiquidDriverChannel, 0);
+
+    for (guint i = 0; i < priv->channels->len; i++)
+    {
+        if (entries[i].sequence <= since)
+        {
+            continue;
+        }
+
+        GDBusObject *object = g_hash_table_lookup(priv->channel_objects, GUINT_TO_POINTER(entries[i].name));
+        const LiquidChannelTypeInfo *type_info = &channel_types[entries[i].type];
+
+        g_variant_builder_add(builder,
+                              "(osv)",
+                              g_dbus_object_get_object_path(object),
+                              type_info->interface_name,
+                              type_info->to_variant(entries[i].published_value));
+    }
 }
 
 void
@@ -102,13 +1095,70 @@ liquid_driver_export(LiquidDriver *driver, GDBusObjectManagerServer *object_mana
     g_return_if_fail(LIQUID_IS_DRIVER(driver));
     g_return_if_fail(G_IS_DBUS_OBJECT_MANAGER_SERVER(object_manager_server));
 
+    LiquidDriverPrivate *priv = liquid_driver_get_instance_private(driver);
+
+    g_return_if_fail(priv->object_manager_server == NULL);
+
     const gchar *base_path =
         g_dbus_object_manager_get_object_path(G_DBUS_OBJECT_MANAGER(object_manager_server));
 
-    g_autofree gchar *path = g_strdup_printf("%s/%s", base_path, G_OBJECT_TYPE_NAME(driver));
+    g_autofree gchar *name = LIQUID_DRIVER_GET_CLASS(driver)->dup_object_name(driver);
+    g_autofree gchar *path = g_strdup_printf("%s/%s", base_path, name);
 
     g_dbus_object_skeleton_set_object_path(G_DBUS_OBJECT_SKELETON(driver), path);
     g_dbus_object_manager_server_export(object_manager_server, G_DBUS_OBJECT_SKELETON(driver));
 
-    liquid_driver_for_each_channel(driver, liquid_driver_export_channel, object_manager_server);
+    priv->object_manager_server = g_object_ref(object_manager_server);
+    priv->channel_objects = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, g_object_unref);
+
+    for (guint i = 0; i < priv->channels->len; i++)
+    {
+        liquid_driver_export_channel(driver, i);
+    }
+
+    liquid_driver_export_alerts(driver);
+}
+
+void
+liquid_driver_append_metrics(GList *objects, GString *out)
+{
+    for (LiquidChannelType type = 0; type < LIQUID_CHANNEL_N_TYPES; type++)
+    {
+        const LiquidChannelTypeInfo *type_info = &channel_types[type];
+        gboolean family_appended = FALSE;
+
+        for (GList *l = objects; l; l = l->next)
+        {
+            if (!LIQUID_IS_DRIVER(l->data))
+            {
+                continue;
+            }
+
+            LiquidDriverPrivate *priv = liquid_driver_get_instance_private(LIQUID_DRIVER(l->data));
+            const LiquidDriverChannel *entries = &g_array_index(priv->channels, LiquidDriverChannel, 0);
+
+            for (guint i = 0; i < priv->channels->len; i++)
+            {
+                /* Not exported yet, or never reported */
+                if (entries[i].type != type || entries[i].metric_labels == NULL || entries[i].sequence == 0)
+                {
+                    continue;
+                }
+
+                if (!family_appended)
+                {
+                    liquid_metrics_append_family(out,
+                                                 type_info->metric_name,
+                                                 type_info->metric_type,
+                                                 type_info->metric_help);
+                    family_appended = TRUE;
+                }
+
+                liquid_metrics_append_sample(out,
+                                             type_info->metric_name,
+                                             entries[i].metric_labels,
+                                             entries[i].published_value);
+            }
+        }
+    }
 }
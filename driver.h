@@ -2,30 +2,196 @@
 
 #include <gio/gio.h>
 
+#include "publisher.h"
+
 G_BEGIN_DECLS
 
+typedef enum
+{
+    LIQUID_CHANNEL_FAN_SPEED_RPM,
+    LIQUID_CHANNEL_DUTY_PERCENT,
+    LIQUID_CHANNEL_VOLTAGE,
+    LIQUID_CHANNEL_CURRENT,
+    LIQUID_CHANNEL_POWER,
+    /* Cumulative, only ever increasing */
+    LIQUID_CHANNEL_ENERGY,
+    LIQUID_CHANNEL_N_TYPES,
+} LiquidChannelType;
+
+/* Short name for use in configuration, such as "rpm"; LIQUID_CHANNEL_N_TYPES if unknown */
+LiquidChannelType
+liquid_channel_type_from_nick(const gchar *nick);
+
+const gchar *
+liquid_channel_type_get_nick(LiquidChannelType type);
+
+typedef enum
+{
+    LIQUID_CHANNEL_FLAG_NONE = 0,
+    /* Computed by the daemon rather than reported by the device */
+    LIQUID_CHANNEL_FLAG_DERIVED = 1 << 0,
+} LiquidChannelFlags;
+
 #define LIQUID_TYPE_DRIVER (liquid_driver_get_type())
 G_DECLARE_DERIVABLE_TYPE(LiquidDriver, liquid_driver, LIQUID, DRIVER, GDBusObjectSkeleton)
 
 struct _LiquidDriverClass
 {
     GDBusObjectSkeletonClass parent_class;
+
+    gboolean (*init_device)(LiquidDriver *driver, GError **error);
+
+    /* Device state that survives daemon restarts, as an a{sv} dictionary */
+    GVariant *(*save_state)(LiquidDriver *driver);
+    gboolean (*restore_state)(LiquidDriver *driver, GVariant *state);
+
+    /*
+     * Values accumulated by the daemon, such as energy counters, as an a{sv}
+     * dictionary: unlike state, they stay valid when the device loses power
+     */
+    GVariant *(*save_counters)(LiquidDriver *driver);
+    void (*restore_counters)(LiquidDriver *driver, GVariant *counters);
+
+    void (*state_changed)(LiquidDriver *driver);
+    void (*counters_changed)(LiquidDriver *driver);
+
+    /* A channel took a new value, before it is published */
+    void (*channel_changed)(LiquidDriver *driver, guint channel);
+
+    /* Telemetry of the subclass's own, published along with the channel values */
+    guint (*publish)(LiquidDriver *driver);
+
+    /* Last element of the exported object path; must be unique and stable */
+    gchar *(*dup_object_name)(LiquidDriver *driver);
+
+    /* Sets the duty of a LIQUID_CHANNEL_DUTY_PERCENT channel; NULL if none can be set */
+    gboolean (*set_duty)(LiquidDriver *driver, guint channel, guint duty_percent, GError **error);
 };
 
-GDBusObjectSkeleton *
-liquid_driver_add_channel(LiquidDriver *driver, const gchar *name);
+gboolean
+liquid_driver_init_device(LiquidDriver *driver, GError **error);
+
+GVariant *
+liquid_driver_save_state(LiquidDriver *driver);
+
+gboolean
+liquid_driver_restore_state(LiquidDriver *driver, GVariant *state);
+
+void
+liquid_driver_state_changed(LiquidDriver *driver);
+
+GVariant *
+liquid_driver_save_counters(LiquidDriver *driver);
+
+void
+liquid_driver_restore_counters(LiquidDriver *driver, GVariant *counters);
+
+void
+liquid_driver_counters_changed(LiquidDriver *driver);
+
+/*
+ * Channels are numbered densely from 0 in the order they were added. Channels
+ * sharing a name are exported as a single object with one interface per type.
+ */
+guint
+liquid_driver_add_channel(LiquidDriver *driver,
+                          const gchar *name,
+                          LiquidChannelType type,
+                          LiquidChannelFlags flags);
+
+guint
+liquid_driver_get_n_channels(LiquidDriver *driver);
+
+const gchar *
+liquid_driver_get_channel_name(LiquidDriver *driver, guint channel);
+
+LiquidChannelType
+liquid_driver_get_channel_type(LiquidDriver *driver, guint channel);
+
+LiquidChannelFlags
+liquid_driver_get_channel_flags(LiquidDriver *driver, guint channel);
+
+/* Returns G_MAXUINT if the driver has no such channel */
+guint
+liquid_driver_lookup_channel(LiquidDriver *driver, const gchar *name, LiquidChannelType type);
+
+/* Fails with G_IO_ERROR_NOT_SUPPORTED if the channel's duty can't be set */
+gboolean
+liquid_driver_set_duty(LiquidDriver *driver, guint channel, guint duty_percent, GError **error);
+
+/*
+ * Contiguous value storage, indexed by channel; drivers write decoded values
+ * directly and then publish them with liquid_driver_channels_changed(). The
+ * pointer is invalidated by liquid_driver_add_channel().
+ */
+gdouble *
+liquid_driver_get_channel_values(LiquidDriver *driver);
+
+void
+liquid_driver_channels_changed(LiquidDriver *driver, guint first, guint n_channels);
 
-typedef void (*LiquidDriverForEachChannelCallback)(LiquidDriver *driver,
-                                                   const gchar *name,
-                                                   GDBusObjectSkeleton *channel,
-                                                   gpointer user_data);
+/*
+ * Without a publisher, changed values are published as soon as they are
+ * announced; with one, when it says so.
+ */
+void
+liquid_driver_set_publisher(LiquidDriver *driver, LiquidPublisher *publisher);
 
+/*
+ * Threshold rules (a LiquidAlertRule array, see alert.h) evaluated on every
+ * sample passed to liquid_driver_channels_changed(). Transitions are announced
+ * by the org.liquidctl.Alerts interface, which the driver has once exported
+ * if any rule applies to its channels. When the rules are replaced, those
+ * equal to earlier ones keep their state, and active alerts of the others are
+ * reported as cleared.
+ */
 void
-liquid_driver_for_each_channel(LiquidDriver *driver,
-                               LiquidDriverForEachChannelCallback callback,
-                               gpointer user_data);
+liquid_driver_set_alert_rules(LiquidDriver *driver, GPtrArray *rules);
+
+/*
+ * Adds a LIQUID_CHANNEL_FLAG_DERIVED channel CHANNEL_NAME for every filter
+ * (a LiquidFilterSpec array, see filter.h) matching one of the device's
+ * channels, updated with each sample of that channel. Call once, before
+ * setting the alert rules so that they can apply to derived channels too.
+ */
+void
+liquid_driver_set_filters(LiquidDriver *driver, GPtrArray *specs);
+
+/*
+ * Puts changed values into the exported interfaces and emits their signals
+ * right away. Returns the number of values published; n_superseded is set to
+ * how many were replaced by newer ones before getting there.
+ */
+guint
+liquid_driver_publish(LiquidDriver *driver, guint *n_superseded);
+
+/*
+ * Every channel value that changes is stamped with the next number of a
+ * sequence shared by all drivers. liquid_driver_get_sequence() returns the
+ * latest number handed out, 0 if none yet.
+ */
+guint64
+liquid_driver_get_sequence(void);
+
+/* Whether a number was handed out by this process, rather than by a daemon before it */
+gboolean
+liquid_driver_sequence_is_current(guint64 number);
+
+/*
+ * Adds the exported channels whose value changed after `since`, as (channel
+ * object path, interface name, Value property) to an a(osv) builder.
+ */
+void
+liquid_driver_collect_changes(LiquidDriver *driver, guint64 since, GVariantBuilder *builder);
 
 void
 liquid_driver_export(LiquidDriver *driver, GDBusObjectManagerServer *object_manager_server);
 
+/*
+ * Current channel values of all drivers among `objects`, one Prometheus metric
+ * family per channel type; see metrics.h.
+ */
+void
+liquid_driver_append_metrics(GList *objects, GString *out);
+
 G_END_DECLS
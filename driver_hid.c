@@ -1,7 +1,23 @@
 #include "driver_hid.h"
 
+#include <string.h>
+
+#include <gio/gunixfdlist.h>
+
 #include "dbus_interfaces.h"
 #include "hid_device_info.h"
+#include "hid_passthrough.h"
+#include "histogram.h"
+#include "metrics.h"
+
+/* Silence, in update intervals, after which a device is considered stalled */
+#define WATCHDOG_STALL_INTERVALS 3
+
+#define WATCHDOG_BACKOFF_MIN_MS 1000
+#define WATCHDOG_BACKOFF_MAX_MS 60000
+
+/* From Linux kernel's include/linux/hid.h */
+#define HID_MAX_BUFFER_SIZE 16384
 
 static GQuark byte_quarks[G_MAXUINT8 + 1];
 
@@ -24,38 +40,112 @@ enum
 
 static guint signals[N_SIGNALS];
 
+typedef struct
+{
+    guint64 reports;
+    guint64 decode_errors;
+    guint64 gaps;
+    guint64 missed_samples;
+    gint64 last_sample_time;
+
+    guint64 output_reports;
+    guint64 output_errors;
+    /* Time spent writing each output report */
+    LiquidHistogram *output_latency;
+
+    /* From read to the end of input-report emission */
+    LiquidHistogram *dispatch_lag;
+    LiquidHistogram *sample_interval;
+    /* Absolute deviation of sample_interval from the update interval */
+    LiquidHistogram *sample_jitter;
+} LiquidDriverHidStatistics;
+
+typedef struct
+{
+    guint check_source_id;
+    guint retry_source_id;
+
+    gboolean recovering;
+    /* Delay before the next recovery attempt; 0 until an attempt has been made */
+    guint backoff_ms;
+    gint64 last_activity_time;
+    gint64 down_since;
+
+    guint64 stalls;
+    guint64 read_errors;
+    guint64 recoveries;
+    guint64 failed_attempts;
+    gint64 downtime;
+} LiquidDriverHidWatchdog;
+
 typedef struct
 {
     LiquidHidDevice *hid_device;
     LiquidHidDeviceInfo *hid_device_info;
+    LiquidDBusHidDevice *dbus_hid_device;
+    /* Created on the first OpenPassthrough call */
+    LiquidHidPassthrough *passthrough;
+    /* Prometheus labels, formatted on first use */
+    gchar *metric_labels;
+
+    guint update_interval_ms;
+    LiquidDriverHidStatistics statistics;
+    LiquidDriverHidWatchdog watchdog;
 } LiquidDriverHidPrivate;
 
 G_DEFINE_TYPE_WITH_PRIVATE(LiquidDriverHid, liquid_driver_hid, LIQUID_TYPE_DRIVER)
 
 static void
-liquid_driver_hid_emit_input_report(LiquidHidDevice *hid_device G_GNUC_UNUSED,
+liquid_driver_hid_emit_input_report(LiquidHidDevice *hid_device,
                                     GBytes *report,
                                     LiquidDriverHid *driver)
 {
+    LiquidDriverHidPrivate *priv = liquid_driver_hid_get_instance_private(driver);
     const guint8 *data = g_bytes_get_data(report, NULL);
     GQuark detail = g_bytes_get_size(report) > 0 ? byte_quarks[*data] : 0;
     gboolean return_value = FALSE;
 
+    /* Before decoding, so that passthrough clients aren't held up by it */
+    if (priv->passthrough)
+    {
+        liquid_hid_passthrough_forward(priv->passthrough, report);
+    }
+
     g_signal_emit(driver, signals[SIGNAL_INPUT_REPORT], detail, report, &return_value);
+
+    gint64 report_time = liquid_hid_device_get_report_time(hid_device);
+
+    priv->statistics.reports++;
+    liquid_histogram_add(priv->statistics.dispatch_lag, g_get_monotonic_time() - report_time);
 }
 
+static void
+liquid_driver_hid_begin_recovery(LiquidDriverHid *driver);
+
 static void
 liquid_driver_hid_emit_device_error(LiquidHidDevice *hid_device G_GNUC_UNUSED,
                                     GError *error,
                                     LiquidDriverHid *driver)
 {
+    LiquidDriverHidPrivate *priv = liquid_driver_hid_get_instance_private(driver);
+
     g_signal_emit(driver, signals[SIGNAL_DEVICE_ERROR], 0, error);
+
+    /* The device stops reading after an error, so waiting for a stall is pointless */
+    if (!priv->watchdog.recovering)
+    {
+        g_printerr("Device %s read error: %s\n",
+                   liquid_hid_device_info_get_hidraw_path(priv->hid_device_info),
+                   error->message);
+
+        priv->watchdog.read_errors++;
+        liquid_driver_hid_begin_recovery(driver);
+    }
 }
 
 static void
-liquid_driver_hid_dispose(GObject *object)
+liquid_driver_hid_set_device(LiquidDriverHid *driver, LiquidHidDevice *hid_device)
 {
-    LiquidDriverHid *driver = LIQUID_DRIVER_HID(object);
     LiquidDriverHidPrivate *priv = liquid_driver_hid_get_instance_private(driver);
 
     if (priv->hid_device)
@@ -67,15 +157,170 @@ liquid_driver_hid_dispose(GObject *object)
         g_signal_handlers_disconnect_by_func(priv->hid_device,
                                              liquid_driver_hid_emit_device_error,
                                              driver);
+    }
+
+    g_set_object(&priv->hid_device, hid_device);
+
+    if (priv->hid_device)
+    {
+        g_signal_connect(priv->hid_device,
+                         "input-report",
+                         G_CALLBACK(liquid_driver_hid_emit_input_report),
+                         driver);
 
-        g_clear_object(&priv->hid_device);
+        g_signal_connect(priv->hid_device,
+                         "error",
+                         G_CALLBACK(liquid_driver_hid_emit_device_error),
+                         driver);
     }
+}
 
+static gboolean
+liquid_driver_hid_retry_recovery(gpointer user_data);
+
+static void
+liquid_driver_hid_device_reopened(GObject *source_object G_GNUC_UNUSED,
+                                  GAsyncResult *result,
+                                  gpointer user_data)
+{
+    g_autoptr(LiquidDriverHid) driver = user_data;
+    LiquidDriverHidPrivate *priv = liquid_driver_hid_get_instance_private(driver);
+    const gchar *hidraw_path = liquid_hid_device_info_get_hidraw_path(priv->hid_device_info);
+
+    g_autoptr(GError) error = NULL;
+    g_autoptr(LiquidHidDevice) hid_device = liquid_hid_device_new_for_path_finish(result, &error);
+
+    if (hid_device)
+    {
+        liquid_driver_hid_set_device(driver, hid_device);
+        g_object_notify_by_pspec(G_OBJECT(driver), pspecs[PROP_HID_DEVICE]);
+
+        if (liquid_driver_init_device(LIQUID_DRIVER(driver), &error))
+        {
+            gint64 now = g_get_monotonic_time();
+
+            g_printerr("Device %s recovered\n", hidraw_path);
+
+            priv->watchdog.recovering = FALSE;
+            priv->watchdog.recoveries++;
+            priv->watchdog.downtime += now - priv->watchdog.down_since;
+            priv->watchdog.last_activity_time = now;
+            return;
+        }
+    }
+
+    g_printerr("Can't recover device %s, retrying in %u ms: %s\n",
+               hidraw_path,
+               priv->watchdog.backoff_ms,
+               error->message);
+
+    priv->watchdog.failed_attempts++;
+    priv->watchdog.retry_source_id
+        = g_timeout_add(priv->watchdog.backoff_ms, liquid_driver_hid_retry_recovery, driver);
+    priv->watchdog.backoff_ms = MIN(priv->watchdog.backoff_ms * 2, WATCHDOG_BACKOFF_MAX_MS);
+}
+
+/* Re-opening also recovers devices whose file descriptor went bad after a USB reset */
+static void
+liquid_driver_hid_attempt_recovery(LiquidDriverHid *driver)
+{
+    LiquidDriverHidPrivate *priv = liquid_driver_hid_get_instance_private(driver);
+
+    liquid_hid_device_new_for_path_async(liquid_hid_device_info_get_hidraw_path(priv->hid_device_info),
+                                         liquid_hid_device_get_max_input_report_size(priv->hid_device),
+                                         liquid_hid_device_get_io_context(priv->hid_device),
+                                         liquid_driver_hid_device_reopened,
+                                         g_object_ref(driver));
+}
+
+static gboolean
+liquid_driver_hid_retry_recovery(gpointer user_data)
+{
+    LiquidDriverHid *driver = user_data;
+    LiquidDriverHidPrivate *priv = liquid_driver_hid_get_instance_private(driver);
+
+    priv->watchdog.retry_source_id = 0;
+    liquid_driver_hid_attempt_recovery(driver);
+
+    return G_SOURCE_REMOVE;
+}
+
+/*
+ * The first recovery after the device was last seen healthy is immediate;
+ * repeated failures, including stalls right after a recovery, back off.
+ */
+static void
+liquid_driver_hid_begin_recovery(LiquidDriverHid *driver)
+{
+    LiquidDriverHidPrivate *priv = liquid_driver_hid_get_instance_private(driver);
+
+    priv->watchdog.recovering = TRUE;
+    priv->watchdog.down_since = g_get_monotonic_time();
+
+    if (priv->watchdog.backoff_ms == 0)
+    {
+        priv->watchdog.backoff_ms = WATCHDOG_BACKOFF_MIN_MS;
+        liquid_driver_hid_attempt_recovery(driver);
+        return;
+    }
+
+    priv->watchdog.retry_source_id
+        = g_timeout_add(priv->watchdog.backoff_ms, liquid_driver_hid_retry_recovery, driver);
+    priv->watchdog.backoff_ms = MIN(priv->watchdog.backoff_ms * 2, WATCHDOG_BACKOFF_MAX_MS);
+}
+
+static gboolean
+liquid_driver_hid_check_stall(gpointer user_data)
+{
+    LiquidDriverHid *driver = user_data;
+    LiquidDriverHidPrivate *priv = liquid_driver_hid_get_instance_private(driver);
+    gint64 timeout = (gint64)priv->update_interval_ms * G_TIME_SPAN_MILLISECOND * WATCHDOG_STALL_INTERVALS;
+
+    if (priv->watchdog.recovering || g_get_monotonic_time() - priv->watchdog.last_activity_time < timeout)
+    {
+        return G_SOURCE_CONTINUE;
+    }
+
+    g_printerr("Device %s stalled\n", liquid_hid_device_info_get_hidraw_path(priv->hid_device_info));
+
+    priv->watchdog.stalls++;
+    liquid_driver_hid_begin_recovery(driver);
+
+    return G_SOURCE_CONTINUE;
+}
+
+static void
+liquid_driver_hid_dispose(GObject *object)
+{
+    LiquidDriverHid *driver = LIQUID_DRIVER_HID(object);
+    LiquidDriverHidPrivate *priv = liquid_driver_hid_get_instance_private(driver);
+
+    g_clear_handle_id(&priv->watchdog.check_source_id, g_source_remove);
+    g_clear_handle_id(&priv->watchdog.retry_source_id, g_source_remove);
+
+    liquid_driver_hid_set_device(driver, NULL);
     g_clear_object(&priv->hid_device_info);
+    g_clear_object(&priv->dbus_hid_device);
+    g_clear_object(&priv->passthrough);
 
     G_OBJECT_CLASS(liquid_driver_hid_parent_class)->dispose(object);
 }
 
+static void
+liquid_driver_hid_finalize(GObject *object)
+{
+    LiquidDriverHid *driver = LIQUID_DRIVER_HID(object);
+    LiquidDriverHidPrivate *priv = liquid_driver_hid_get_instance_private(driver);
+
+    liquid_histogram_free(priv->statistics.dispatch_lag);
+    liquid_histogram_free(priv->statistics.sample_interval);
+    liquid_histogram_free(priv->statistics.sample_jitter);
+    liquid_histogram_free(priv->statistics.output_latency);
+    g_free(priv->metric_labels);
+
+    G_OBJECT_CLASS(liquid_driver_hid_parent_class)->finalize(object);
+}
+
 static void
 liquid_driver_hid_get_property(GObject *object,
                                guint property_id,
@@ -100,6 +345,55 @@ liquid_driver_hid_get_property(GObject *object,
     }
 }
 
+static void
+liquid_driver_hid_passthrough_output_report(LiquidHidPassthrough *passthrough G_GNUC_UNUSED,
+                                            GBytes *report,
+                                            LiquidDriverHid *driver)
+{
+    gsize size = 0;
+    const guint8 *data = g_bytes_get_data(report, &size);
+    g_autoptr(GError) error = NULL;
+
+    if (!liquid_driver_hid_output_report(driver, data, size, &error))
+    {
+        g_printerr("Passthrough output report failed: %s\n", error->message);
+    }
+}
+
+static gboolean
+liquid_driver_hid_handle_open_passthrough(LiquidDBusHidDevice *interface,
+                                          GDBusMethodInvocation *invocation,
+                                          GUnixFDList *fd_list G_GNUC_UNUSED,
+                                          LiquidDriverHid *driver)
+{
+    LiquidDriverHidPrivate *priv = liquid_driver_hid_get_instance_private(driver);
+    g_autoptr(GError) error = NULL;
+
+    if (priv->passthrough == NULL)
+    {
+        priv->passthrough = liquid_hid_passthrough_new(HID_MAX_BUFFER_SIZE);
+
+        g_signal_connect(priv->passthrough,
+                         "output-report",
+                         G_CALLBACK(liquid_driver_hid_passthrough_output_report),
+                         driver);
+    }
+
+    gint fd = liquid_hid_passthrough_add_client(priv->passthrough, &error);
+
+    if (fd == -1)
+    {
+        g_dbus_method_invocation_return_gerror(invocation, error);
+        return TRUE;
+    }
+
+    g_autoptr(GUnixFDList) out_fd_list = g_unix_fd_list_new_from_array(&fd, 1);
+
+    liquid_dbus_hid_device_complete_open_passthrough(interface, invocation, out_fd_list, g_variant_new_handle(0));
+
+    return TRUE;
+}
+
 static void
 liquid_driver_hid_set_property(GObject *object,
                                guint property_id,
@@ -112,32 +406,37 @@ liquid_driver_hid_set_property(GObject *object,
     switch (property_id)
     {
     case PROP_HID_DEVICE:
-        g_set_object(&priv->hid_device, g_value_get_object(value));
-
-        g_signal_connect(priv->hid_device,
-                         "input-report",
-                         G_CALLBACK(liquid_driver_hid_emit_input_report),
-                         driver);
-
-        g_signal_connect(priv->hid_device,
-                         "error",
-                         G_CALLBACK(liquid_driver_hid_emit_device_error),
-                         driver);
+        liquid_driver_hid_set_device(driver, g_value_get_object(value));
         break;
 
     case PROP_HID_DEVICE_INFO:
         g_set_object(&priv->hid_device_info, g_value_get_object(value));
 
         {
-            g_autoptr(LiquidDBusHidDevice) dbus_info = liquid_dbus_hid_device_skeleton_new();
+            LiquidDBusHidDevice *dbus_info = liquid_dbus_hid_device_skeleton_new();
 
             liquid_dbus_hid_device_set_vendor_id(dbus_info,
                                                  liquid_hid_device_info_get_vendor_id(priv->hid_device_info));
             liquid_dbus_hid_device_set_product_id(dbus_info,
                                                   liquid_hid_device_info_get_product_id(priv->hid_device_info));
+            const gchar *usb_path = liquid_hid_device_info_get_usb_path(priv->hid_device_info);
+            const gchar *serial = liquid_hid_device_info_get_serial(priv->hid_device_info);
+
+            liquid_dbus_hid_device_set_usb_path(dbus_info, usb_path ? usb_path : "");
+            liquid_dbus_hid_device_set_serial(dbus_info, serial ? serial : "");
+            liquid_dbus_hid_device_set_interface_number(dbus_info,
+                                                        liquid_hid_device_info_get_interface_number(priv->hid_device_info));
+
+            g_signal_connect(dbus_info,
+                             "handle-open-passthrough",
+                             G_CALLBACK(liquid_driver_hid_handle_open_passthrough),
+                             driver);
 
             g_dbus_object_skeleton_add_interface(G_DBUS_OBJECT_SKELETON(driver),
                                                  G_DBUS_INTERFACE_SKELETON(dbus_info));
+
+            g_clear_object(&priv->dbus_hid_device);
+            priv->dbus_hid_device = dbus_info;
         }
 
         break;
@@ -147,15 +446,69 @@ liquid_driver_hid_set_property(GObject *object,
     }
 }
 
+/* ReportTime goes out with the values it belongs to, see liquid_driver_hid_sample_received() */
+static guint
+liquid_driver_hid_publish(LiquidDriver *driver)
+{
+    LiquidDriverHidPrivate *priv = liquid_driver_hid_get_instance_private(LIQUID_DRIVER_HID(driver));
+    gint64 time = priv->statistics.last_sample_time;
+
+    if (priv->dbus_hid_device == NULL || time == liquid_dbus_hid_device_get_report_time(priv->dbus_hid_device))
+    {
+        return 0;
+    }
+
+    liquid_dbus_hid_device_set_report_time(priv->dbus_hid_device, time);
+    g_dbus_interface_skeleton_flush(G_DBUS_INTERFACE_SKELETON(priv->dbus_hid_device));
+
+    return 1;
+}
+
+/*
+ * Two identical devices only differ in where they are plugged in, so the USB
+ * path is part of the name; it's also stable across reboots and replugging into
+ * the same port.
+ */
+static gchar *
+liquid_driver_hid_dup_object_name(LiquidDriver *driver)
+{
+    LiquidDriverHidPrivate *priv = liquid_driver_hid_get_instance_private(LIQUID_DRIVER_HID(driver));
+    const gchar *key = liquid_hid_device_info_get_device_key(priv->hid_device_info);
+
+    g_autofree gchar *name = g_strdup_printf("%s_%s", G_OBJECT_TYPE_NAME(driver), key);
+
+    g_strcanon(name, G_CSET_A_2_Z G_CSET_a_2_z G_CSET_DIGITS "_", '_');
+
+    return g_steal_pointer(&name);
+}
+
+static gboolean
+liquid_driver_hid_handle_get_statistics(LiquidDBusDiagnostics *interface,
+                                        GDBusMethodInvocation *invocation,
+                                        LiquidDriverHid *driver)
+{
+    liquid_dbus_diagnostics_complete_get_statistics(interface,
+                                                    invocation,
+                                                    liquid_driver_hid_dup_statistics(driver));
+
+    return TRUE;
+}
+
 static void
 liquid_driver_hid_class_init(LiquidDriverHidClass *class)
 {
     GObjectClass *gobject_class = G_OBJECT_CLASS(class);
 
     gobject_class->dispose = liquid_driver_hid_dispose;
+    gobject_class->finalize = liquid_driver_hid_finalize;
     gobject_class->get_property = liquid_driver_hid_get_property;
     gobject_class->set_property = liquid_driver_hid_set_property;
 
+    LiquidDriverClass *driver_class = LIQUID_DRIVER_CLASS(class);
+
+    driver_class->dup_object_name = liquid_driver_hid_dup_object_name;
+    driver_class->publish = liquid_driver_hid_publish;
+
     pspecs[PROP_HID_DEVICE]
         = g_param_spec_object("hid-device", /* name */
                               "HID device", /* nick */
@@ -204,8 +557,24 @@ liquid_driver_hid_class_init(LiquidDriverHidClass *class)
 }
 
 static void
-liquid_driver_hid_init(LiquidDriverHid *driver G_GNUC_UNUSED)
+liquid_driver_hid_init(LiquidDriverHid *driver)
 {
+    LiquidDriverHidPrivate *priv = liquid_driver_hid_get_instance_private(driver);
+
+    priv->statistics.dispatch_lag = liquid_histogram_new();
+    priv->statistics.sample_interval = liquid_histogram_new();
+    priv->statistics.sample_jitter = liquid_histogram_new();
+    priv->statistics.output_latency = liquid_histogram_new();
+
+    g_autoptr(LiquidDBusDiagnostics) diagnostics = liquid_dbus_diagnostics_skeleton_new();
+
+    g_signal_connect(diagnostics,
+                     "handle-get-statistics",
+                     G_CALLBACK(liquid_driver_hid_handle_get_statistics),
+                     driver);
+
+    g_dbus_object_skeleton_add_interface(G_DBUS_OBJECT_SKELETON(driver),
+                                         G_DBUS_INTERFACE_SKELETON(diagnostics));
 }
 
 LiquidHidDevice *
@@ -227,3 +596,393 @@ liquid_driver_hid_get_device_info(LiquidDriverHid *driver)
 
     return priv->hid_device_info;
 }
+
+void
+liquid_driver_hid_set_update_interval(LiquidDriverHid *driver, guint interval_ms)
+{
+    g_return_if_fail(LIQUID_IS_DRIVER_HID(driver));
+
+    LiquidDriverHidPrivate *priv = liquid_driver_hid_get_instance_private(driver);
+
+    priv->update_interval_ms = interval_ms;
+    /* The next sample may arrive at any time after a reconfiguration */
+    priv->statistics.last_sample_time = 0;
+
+    g_clear_handle_id(&priv->watchdog.check_source_id, g_source_remove);
+
+    if (interval_ms > 0)
+    {
+        priv->watchdog.last_activity_time = g_get_monotonic_time();
+        priv->watchdog.check_source_id = g_timeout_add(interval_ms, liquid_driver_hid_check_stall, driver);
+    }
+}
+
+void
+liquid_driver_hid_recover(LiquidDriverHid *driver)
+{
+    g_return_if_fail(LIQUID_IS_DRIVER_HID(driver));
+
+    LiquidDriverHidPrivate *priv = liquid_driver_hid_get_instance_private(driver);
+
+    if (!priv->watchdog.recovering)
+    {
+        liquid_driver_hid_begin_recovery(driver);
+    }
+}
+
+void
+liquid_driver_hid_sample_received(LiquidDriverHid *driver)
+{
+    g_return_if_fail(LIQUID_IS_DRIVER_HID(driver));
+
+    LiquidDriverHidPrivate *priv = liquid_driver_hid_get_instance_private(driver);
+    LiquidDriverHidStatistics *statistics = &priv->statistics;
+    gint64 time = liquid_hid_device_get_report_time(priv->hid_device);
+    gint64 last_time = statistics->last_sample_time;
+
+    statistics->last_sample_time = time;
+    priv->watchdog.last_activity_time = time;
+    priv->watchdog.backoff_ms = 0;
+
+    if (last_time == 0)
+    {
+        return;
+    }
+
+    gint64 interval = time - last_time;
+    gint64 expected = (gint64)priv->update_interval_ms * G_TIME_SPAN_MILLISECOND;
+
+    liquid_histogram_add(statistics->sample_interval, interval);
+
+    if (expected == 0)
+    {
+        return;
+    }
+
+    liquid_histogram_add(statistics->sample_jitter, ABS(interval - expected));
+
+    /* Anything past one and a half intervals means at least one sample never arrived */
+    if (interval > expected + expected / 2)
+    {
+        statistics->gaps++;
+        statistics->missed_samples += (guint64)((interval + expected / 2) / expected - 1);
+    }
+}
+
+gboolean
+liquid_driver_hid_configure_update_interval(LiquidDriverHid *driver, guint interval_ms, GError **error)
+{
+    g_return_val_if_fail(LIQUID_IS_DRIVER_HID(driver), FALSE);
+
+    LiquidDriverHidClass *class = LIQUID_DRIVER_HID_GET_CLASS(driver);
+
+    if (class->configure_update_interval == NULL)
+    {
+        /* Nothing was changed, so nothing needs to be undone */
+        if (interval_ms == 0)
+        {
+            return TRUE;
+        }
+
+        g_set_error(error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED, "The update interval can't be configured");
+        return FALSE;
+    }
+
+    return class->configure_update_interval(driver, interval_ms, error);
+}
+
+gboolean
+liquid_driver_hid_output_report(LiquidDriverHid *driver, const void *buffer, gsize count, GError **error)
+{
+    g_return_val_if_fail(LIQUID_IS_DRIVER_HID(driver), FALSE);
+
+    LiquidDriverHidPrivate *priv = liquid_driver_hid_get_instance_private(driver);
+    gint64 start = g_get_monotonic_time();
+    gboolean written = liquid_hid_device_output_report(priv->hid_device, buffer, count, error);
+
+    liquid_histogram_add(priv->statistics.output_latency, g_get_monotonic_time() - start);
+    priv->statistics.output_reports++;
+
+    if (!written)
+    {
+        priv->statistics.output_errors++;
+    }
+
+    return written;
+}
+
+guint
+liquid_driver_hid_get_n_led_channels(LiquidDriverHid *driver)
+{
+    g_return_val_if_fail(LIQUID_IS_DRIVER_HID(driver), 0);
+
+    return LIQUID_DRIVER_HID_GET_CLASS(driver)->n_led_channels;
+}
+
+guint
+liquid_driver_hid_get_max_leds(LiquidDriverHid *driver)
+{
+    g_return_val_if_fail(LIQUID_IS_DRIVER_HID(driver), 0);
+
+    return LIQUID_DRIVER_HID_GET_CLASS(driver)->max_leds;
+}
+
+gsize
+liquid_driver_hid_encode_led_frame(LiquidDriverHid *driver,
+                                   guint channel,
+                                   const guint8 *rgb,
+                                   guint n_leds,
+                                   GByteArray *reports)
+{
+    g_return_val_if_fail(LIQUID_IS_DRIVER_HID(driver), 0);
+
+    LiquidDriverHidClass *class = LIQUID_DRIVER_HID_GET_CLASS(driver);
+
+    g_return_val_if_fail(channel < class->n_led_channels, 0);
+    g_return_val_if_fail(n_leds <= class->max_leds, 0);
+
+    class->encode_led_frame(driver, channel, rgb, n_leds, reports);
+
+    return class->led_report_size;
+}
+
+void
+liquid_driver_hid_decode_error(LiquidDriverHid *driver)
+{
+    g_return_if_fail(LIQUID_IS_DRIVER_HID(driver));
+
+    LiquidDriverHidPrivate *priv = liquid_driver_hid_get_instance_private(driver);
+
+    priv->statistics.decode_errors++;
+}
+
+GVariant *
+liquid_driver_hid_dup_statistics(LiquidDriverHid *driver)
+{
+    g_return_val_if_fail(LIQUID_IS_DRIVER_HID(driver), NULL);
+
+    LiquidDriverHidPrivate *priv = liquid_driver_hid_get_instance_private(driver);
+    LiquidDriverHidStatistics *statistics = &priv->statistics;
+    g_auto(GVariantDict) dict = G_VARIANT_DICT_INIT(NULL);
+
+    g_variant_dict_insert(&dict, "reports", "t", statistics->reports);
+    g_variant_dict_insert(&dict, "decode-errors", "t", statistics->decode_errors);
+    g_variant_dict_insert(&dict, "dropped-reports", "u", liquid_hid_device_get_dropped_reports(priv->hid_device));
+    g_variant_dict_insert(&dict, "update-interval", "u", priv->update_interval_ms);
+    g_variant_dict_insert(&dict, "gaps", "t", statistics->gaps);
+    g_variant_dict_insert(&dict, "missed-samples", "t", statistics->missed_samples);
+    g_variant_dict_insert_value(&dict, "dispatch-lag", liquid_histogram_to_variant(statistics->dispatch_lag));
+    g_variant_dict_insert(&dict, "output-reports", "t", statistics->output_reports);
+    g_variant_dict_insert(&dict, "output-errors", "t", statistics->output_errors);
+    g_variant_dict_insert_value(&dict, "output-latency", liquid_histogram_to_variant(statistics->output_latency));
+
+    LiquidDriverHidWatchdog *watchdog = &priv->watchdog;
+    gint64 downtime = watchdog->downtime;
+
+    if (watchdog->recovering)
+    {
+        downtime += g_get_monotonic_time() - watchdog->down_since;
+    }
+
+    g_variant_dict_insert(&dict, "recovering", "b", watchdog->recovering);
+    g_variant_dict_insert(&dict, "stalls", "t", watchdog->stalls);
+    g_variant_dict_insert(&dict, "read-errors", "t", watchdog->read_errors);
+    g_variant_dict_insert(&dict, "recoveries", "t", watchdog->recoveries);
+    g_variant_dict_insert(&dict, "failed-recovery-attempts", "t", watchdog->failed_attempts);
+    g_variant_dict_insert(&dict, "downtime", "x", downtime);
+    g_variant_dict_insert_value(&dict, "sample-interval", liquid_histogram_to_variant(statistics->sample_interval));
+    g_variant_dict_insert_value(&dict, "sample-jitter", liquid_histogram_to_variant(statistics->sample_jitter));
+
+    if (priv->passthrough)
+    {
+        g_variant_dict_insert_value(&dict, "passthrough", liquid_hid_passthrough_dup_statistics(priv->passthrough));
+    }
+
+    return g_variant_dict_end(&dict);
+}
+
+typedef struct
+{
+    const gchar *name;
+    const gchar *help;
+    /* Of a guint64 counter in LiquidDriverHidPrivate */
+    glong offset;
+} LiquidDriverHidCounter;
+
+static const LiquidDriverHidCounter metric_counters[] = {
+    { "liquidd_reports_total",
+      "Input reports received.",
+      G_STRUCT_OFFSET(LiquidDriverHidPrivate, statistics.reports) },
+    { "liquidd_decode_errors_total",
+      "Input reports that couldn't be decoded.",
+      G_STRUCT_OFFSET(LiquidDriverHidPrivate, statistics.decode_errors) },
+    { "liquidd_report_gaps_total",
+      "Periodic reports that came later than one and a half update intervals.",
+      G_STRUCT_OFFSET(LiquidDriverHidPrivate, statistics.gaps) },
+    { "liquidd_missed_samples_total",
+      "Periodic reports estimated lost in gaps.",
+      G_STRUCT_OFFSET(LiquidDriverHidPrivate, statistics.missed_samples) },
+    { "liquidd_output_reports_total",
+      "Output reports written.",
+      G_STRUCT_OFFSET(LiquidDriverHidPrivate, statistics.output_reports) },
+    { "liquidd_output_errors_total",
+      "Output reports that failed to be written.",
+      G_STRUCT_OFFSET(LiquidDriverHidPrivate, statistics.output_errors) },
+    { "liquidd_stalls_total",
+      "Times the device went silent and was reopened.",
+      G_STRUCT_OFFSET(LiquidDriverHidPrivate, watchdog.stalls) },
+    { "liquidd_read_errors_total",
+      "Read errors that made the device be reopened.",
+      G_STRUCT_OFFSET(LiquidDriverHidPrivate, watchdog.read_errors) },
+    { "liquidd_recoveries_total",
+      "Successful recoveries from stalls and read errors.",
+      G_STRUCT_OFFSET(LiquidDriverHidPrivate, watchdog.recoveries) },
+    { "liquidd_failed_recovery_attempts_total",
+      "Attempts to reopen the device that failed.",
+      G_STRUCT_OFFSET(LiquidDriverHidPrivate, watchdog.failed_attempts) },
+};
+
+static const gchar *
+liquid_driver_hid_get_metric_labels(LiquidDriverHid *driver)
+{
+    LiquidDriverHidPrivate *priv = liquid_driver_hid_get_instance_private(driver);
+    const gchar *object_path = g_dbus_object_get_object_path(G_DBUS_OBJECT(driver));
+
+    if (priv->metric_labels == NULL && object_path)
+    {
+        priv->metric_labels = g_strdup_printf("device=\"%s\"", strrchr(object_path, '/') + 1);
+    }
+
+    return priv->metric_labels;
+}
+
+static gdouble
+liquid_driver_hid_get_dropped_reports(LiquidDriverHidPrivate *priv)
+{
+    return priv->hid_device ? liquid_hid_device_get_dropped_reports(priv->hid_device) : 0.0;
+}
+
+static gdouble
+liquid_driver_hid_get_downtime(LiquidDriverHidPrivate *priv)
+{
+    gint64 downtime = priv->watchdog.downtime;
+
+    if (priv->watchdog.recovering)
+    {
+        downtime += g_get_monotonic_time() - priv->watchdog.down_since;
+    }
+
+    return (gdouble)downtime / G_USEC_PER_SEC;
+}
+
+static gdouble
+liquid_driver_hid_get_recovering(LiquidDriverHidPrivate *priv)
+{
+    return priv->watchdog.recovering;
+}
+
+typedef struct
+{
+    const gchar *name;
+    const gchar *type;
+    const gchar *help;
+    gdouble (*get)(LiquidDriverHidPrivate *priv);
+} LiquidDriverHidComputedMetric;
+
+static const LiquidDriverHidComputedMetric metric_computed[] = {
+    { "liquidd_dropped_reports_total",
+      "counter",
+      "Input reports dropped because the main thread fell behind an I/O thread.",
+      liquid_driver_hid_get_dropped_reports },
+    { "liquidd_downtime_seconds_total",
+      "counter",
+      "Time spent recovering the device.",
+      liquid_driver_hid_get_downtime },
+    { "liquidd_device_recovering",
+      "gauge",
+      "Whether the device is being recovered.",
+      liquid_driver_hid_get_recovering },
+};
+
+typedef struct
+{
+    const gchar *name;
+    const gchar *help;
+    glong offset;
+} LiquidDriverHidHistogramMetric;
+
+static const LiquidDriverHidHistogramMetric metric_histograms[] = {
+    { "liquidd_dispatch_lag_seconds",
+      "Time from reading an input report to the end of its processing.",
+      G_STRUCT_OFFSET(LiquidDriverHidPrivate, statistics.dispatch_lag) },
+    { "liquidd_output_report_latency_seconds",
+      "Time spent writing an output report.",
+      G_STRUCT_OFFSET(LiquidDriverHidPrivate, statistics.output_latency) },
+    { "liquidd_sample_jitter_seconds",
+      "Deviation of periodic report intervals from the update interval.",
+      G_STRUCT_OFFSET(LiquidDriverHidPrivate, statistics.sample_jitter) },
+};
+
+void
+liquid_driver_hid_append_metrics(GList *objects, GString *out)
+{
+    g_autoptr(GPtrArray) drivers = g_ptr_array_new();
+
+    for (GList *l = objects; l; l = l->next)
+    {
+        if (LIQUID_IS_DRIVER_HID(l->data) && liquid_driver_hid_get_metric_labels(l->data))
+        {
+            g_ptr_array_add(drivers, l->data);
+        }
+    }
+
+    if (drivers->len == 0)
+    {
+        return;
+    }
+
+    for (guint i = 0; i < G_N_ELEMENTS(metric_counters); i++)
+    {
+        liquid_metrics_append_family(out, metric_counters[i].name, "counter", metric_counters[i].help);
+
+        for (guint j = 0; j < drivers->len; j++)
+        {
+            LiquidDriverHid *driver = g_ptr_array_index(drivers, j);
+            LiquidDriverHidPrivate *priv = liquid_driver_hid_get_instance_private(driver);
+
+            liquid_metrics_append_sample(out,
+                                         metric_counters[i].name,
+                                         priv->metric_labels,
+                                         (gdouble)G_STRUCT_MEMBER(guint64, priv, metric_counters[i].offset));
+        }
+    }
+
+    for (guint i = 0; i < G_N_ELEMENTS(metric_computed); i++)
+    {
+        liquid_metrics_append_family(out, metric_computed[i].name, metric_computed[i].type, metric_computed[i].help);
+
+        for (guint j = 0; j < drivers->len; j++)
+        {
+            LiquidDriverHid *driver = g_ptr_array_index(drivers, j);
+            LiquidDriverHidPrivate *priv = liquid_driver_hid_get_instance_private(driver);
+
+            liquid_metrics_append_sample(out, metric_computed[i].name, priv->metric_labels, metric_computed[i].get(priv));
+        }
+    }
+
+    for (guint i = 0; i < G_N_ELEMENTS(metric_histograms); i++)
+    {
+        liquid_metrics_append_family(out, metric_histograms[i].name, "histogram", metric_histograms[i].help);
+
+        for (guint j = 0; j < drivers->len; j++)
+        {
+            LiquidDriverHid *driver = g_ptr_array_index(drivers, j);
+            LiquidDriverHidPrivate *priv = liquid_driver_hid_get_instance_private(driver);
+
+            liquid_histogram_append_metrics(G_STRUCT_MEMBER(LiquidHistogram *, priv, metric_histograms[i].offset),
+                                            out,
+                                            metric_histograms[i].name,
+                                            priv->metric_labels);
+        }
+    }
+}
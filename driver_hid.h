@@ -15,6 +15,20 @@ struct _LiquidDriverHidClass
 
     gboolean (*input_report)(LiquidDriverHid *driver, GBytes *input_report);
     void (*device_error)(LiquidDriverHid *driver, GError *error);
+
+    /*
+     * LED strips, numbered from 0: a frame of up to max_leds packed RGB
+     * triplets is shown by the output reports, each led_report_size bytes,
+     * that encode_led_frame() appends to `reports`. Only the last of them
+     * may change what the LEDs show.
+     */
+    guint n_led_channels;
+    guint max_leds;
+    gsize led_report_size;
+    void (*encode_led_frame)(LiquidDriverHid *driver, guint channel, const guint8 *rgb, guint n_leds, GByteArray *reports);
+
+    /* Asks the device to report at another interval, 0 for the driver's default, for devices that can */
+    gboolean (*configure_update_interval)(LiquidDriverHid *driver, guint interval_ms, GError **error);
 };
 
 LiquidHidDevice *
@@ -23,4 +37,58 @@ liquid_driver_hid_get_device(LiquidDriverHid *driver);
 LiquidHidDeviceInfo *
 liquid_driver_hid_get_device_info(LiquidDriverHid *driver);
 
+/*
+ * For drivers of devices that report on their own at a fixed interval: the
+ * interval configured, and a call for every periodic report received, so that
+ * gaps in the reports (lost to a stalled main loop) can be detected. The call
+ * must come before liquid_driver_channels_changed() for the report's values,
+ * which also publishes the report's time.
+ */
+void
+liquid_driver_hid_set_update_interval(LiquidDriverHid *driver, guint interval_ms);
+
+void
+liquid_driver_hid_sample_received(LiquidDriverHid *driver);
+
+/* Reopens and re-initializes the device, as after a read error, unless that's already underway */
+void
+liquid_driver_hid_recover(LiquidDriverHid *driver);
+
+/* Reconfigures the device's own update interval, if its driver supports it; 0 for the driver's default */
+gboolean
+liquid_driver_hid_configure_update_interval(LiquidDriverHid *driver, guint interval_ms, GError **error);
+
+/* Writes to the device, keeping count and track of how long writes take */
+gboolean
+liquid_driver_hid_output_report(LiquidDriverHid *driver, const void *buffer, gsize count, GError **error);
+
+guint
+liquid_driver_hid_get_n_led_channels(LiquidDriverHid *driver);
+
+guint
+liquid_driver_hid_get_max_leds(LiquidDriverHid *driver);
+
+/*
+ * Appends the output reports for a frame on an LED channel to `reports` and
+ * returns the size of each. Only reads class data, so it's safe to call from
+ * any thread; the reports can be written with liquid_hid_device_output_report().
+ */
+gsize
+liquid_driver_hid_encode_led_frame(LiquidDriverHid *driver,
+                                   guint channel,
+                                   const guint8 *rgb,
+                                   guint n_leds,
+                                   GByteArray *reports);
+
+/* For drivers to count input reports they received but couldn't make sense of */
+void
+liquid_driver_hid_decode_error(LiquidDriverHid *driver);
+
+GVariant *
+liquid_driver_hid_dup_statistics(LiquidDriverHid *driver);
+
+/* Counters and histograms of all HID drivers among `objects`, see metrics.h */
+void
+liquid_driver_hid_append_metrics(GList *objects, GString *out);
+
 G_END_DECLS
@@ -1,21 +1,38 @@
 #include "driver_nzxt_smart2.h"
 
+#include <string.h>
+
+#include <gmodule.h>
+
 #include "dbus_interfaces.h"
 #include "driver.h"
-#include "gio/gdbusinterfaceskeleton.h"
-#include "gio/gdbusobjectskeleton.h"
+#include "driver_registry.h"
 
 #define OUTPUT_REPORT_SIZE 64
 
 #define FAN_CHANNELS 3
 #define FAN_CHANNELS_MAX 8
 
+#define LED_CHANNELS 2
+#define LEDS_MAX 40
+#define LEDS_PER_REPORT 20
+
 #define INPUT_REPORT_ID_FAN_CONFIG 0x61
 #define INPUT_REPORT_ID_FAN_STATUS 0x67
 
 #define FAN_STATUS_REPORT_SPEED 0x02
 #define FAN_STATUS_REPORT_VOLTAGE 0x04
 
+/* The interval is sent as 16 bits; much shorter ones would only flood the main loop with reports */
+#define UPDATE_INTERVAL_DEFAULT_MS 1000
+#define UPDATE_INTERVAL_MIN_MS 250
+#define UPDATE_INTERVAL_MAX_MS G_MAXUINT16
+
+/* Longer silences between voltage reports aren't integrated, since the power in between is unknown */
+#define ENERGY_MAX_GAP_INTERVALS 5
+/* How often accumulated energy is saved, which bounds what a crash loses */
+#define ENERGY_SAVE_INTERVAL_US (60 * G_TIME_SPAN_SECOND)
+
 struct unknown_static_data
 {
     guint8 unknown1[14]; // NOLINT(readability-magic-numbers)
@@ -57,10 +74,24 @@ struct fan_status_report
 
 enum
 {
+    OUTPUT_REPORT_ID_LED = 0x22,
     OUTPUT_REPORT_ID_INIT_COMMAND = 0x60,
     OUTPUT_REPORT_ID_SET_FAN_SPEED = 0x62,
 };
 
+/* Second byte of OUTPUT_REPORT_ID_LED reports */
+enum
+{
+    LED_COMMAND_COLORS_FIRST = 0x10,
+    LED_COMMAND_COLORS_SECOND = 0x11,
+    LED_COMMAND_APPLY = 0xa0,
+};
+
+/* Mode "fixed" with per-LED colors, as liquidctl sets it up for super-fixed */
+static const guint8 led_apply_parameters[] = {
+    0x01, 0x00, 0x00, LEDS_MAX, 0x00, 0x00, 0x80, 0x00, 0x32, 0x00, 0x00, 0x01,
+};
+
 enum
 {
     INIT_COMMAND_SET_UPDATE_INTERVAL = 0x02,
@@ -72,28 +103,40 @@ static const guint8 detect_fans_report[OUTPUT_REPORT_SIZE] = {
     INIT_COMMAND_DETECT_FANS,
 };
 
-static const guint8 set_update_interval_report[OUTPUT_REPORT_SIZE] = {
-    OUTPUT_REPORT_ID_INIT_COMMAND,
-    INIT_COMMAND_SET_UPDATE_INTERVAL,
-    0x01,
-    0xe8,
-    0x03,
-    0x01,
-    0xe8,
-    0x03,
-};
-
 struct _LiquidDriverNzxtSmart2
 {
     LiquidDriverHid parent;
 
-    LiquidDBusFanSpeedRPM *rpm[FAN_CHANNELS];
+    /*
+     * First of FAN_CHANNELS consecutive LIQUID_CHANNEL_FAN_SPEED_RPM channels,
+     * followed by as many LIQUID_CHANNEL_DUTY_PERCENT ones, so that a speed
+     * report changes a single range; the same for voltage and current,
+     * followed by the power and energy of each fan and of all of them, which
+     * are computed from each voltage report.
+     */
+    guint rpm_channel;
+    guint duty_channel;
+    guint voltage_channel;
+    guint power_channel;
+    guint energy_channel;
+
+    gboolean fan_types_known;
+    guint8 fan_type[FAN_CHANNELS];
+
+    /* What the device was last told to report at */
+    guint update_interval_ms;
+
+    /* Watt-hours per fan and in total, kept as state */
+    gdouble energy[FAN_CHANNELS + 1];
+    gboolean energy_known;
+    gint64 last_power_time;
+    gint64 energy_save_time;
 };
 
 G_DEFINE_FINAL_TYPE(LiquidDriverNzxtSmart2, liquid_driver_nzxt_smart2, LIQUID_TYPE_DRIVER_HID)
 
 static gboolean
-liquid_driver_nzxt_smart2_input_report_fan_config(LiquidDriverHid *driver G_GNUC_UNUSED,
+liquid_driver_nzxt_smart2_input_report_fan_config(LiquidDriverNzxtSmart2 *driver,
                                                   GBytes *bytes)
 {
     gsize size = 0;
@@ -102,12 +145,14 @@ liquid_driver_nzxt_smart2_input_report_fan_config(LiquidDriverHid *driver G_GNUC
     if (size < sizeof(struct fan_config_report))
     {
         g_printerr("Fan config report too short: %" G_GSIZE_FORMAT "\n", size);
+        liquid_driver_hid_decode_error(LIQUID_DRIVER_HID(driver));
         return TRUE;
     }
 
     if (data->magic != 0x03)
     {
         g_printerr("Fan config report: invalid magic = %#x\n", data->magic);
+        liquid_driver_hid_decode_error(LIQUID_DRIVER_HID(driver));
         return TRUE;
     }
 
@@ -116,9 +161,63 @@ liquid_driver_nzxt_smart2_input_report_fan_config(LiquidDriverHid *driver G_GNUC
         g_print("Fan %d type: %d\n", i + 1, data->fan_type[i]);
     }
 
+    if (!driver->fan_types_known || memcmp(driver->fan_type, data->fan_type, FAN_CHANNELS) != 0)
+    {
+        memcpy(driver->fan_type, data->fan_type, FAN_CHANNELS);
+        driver->fan_types_known = TRUE;
+        liquid_driver_state_changed(LIQUID_DRIVER(driver));
+    }
+
     return TRUE;
 }
 
+/*
+ * Integrates power over the time between the reads of consecutive voltage
+ * reports, with the trapezoidal rule.
+ */
+static void
+liquid_driver_nzxt_smart2_account_energy(LiquidDriverNzxtSmart2 *driver, gdouble *values)
+{
+    LiquidHidDevice *hid_device = liquid_driver_hid_get_device(LIQUID_DRIVER_HID(driver));
+    gint64 time = liquid_hid_device_get_report_time(hid_device);
+    gint64 interval = time - driver->last_power_time;
+    gint64 max_gap = (gint64)driver->update_interval_ms * G_TIME_SPAN_MILLISECOND * ENERGY_MAX_GAP_INTERVALS;
+    gboolean integrate = driver->last_power_time != 0 && interval > 0 && interval <= max_gap;
+    gdouble *power = &values[driver->power_channel];
+    gdouble total_power = 0.0;
+
+    for (guint i = 0; i <= FAN_CHANNELS; i++)
+    {
+        gdouble previous = power[i];
+
+        if (i < FAN_CHANNELS)
+        {
+            power[i] = values[driver->voltage_channel + i] * values[driver->voltage_channel + FAN_CHANNELS + i];
+            total_power += power[i];
+        }
+        else
+        {
+            power[i] = total_power;
+        }
+
+        if (integrate)
+        {
+            driver->energy[i] += (previous + power[i]) / 2.0 * (gdouble)interval / (3600.0 * G_TIME_SPAN_SECOND);
+        }
+
+        values[driver->energy_channel + i] = driver->energy[i];
+    }
+
+    driver->last_power_time = time;
+    driver->energy_known = TRUE;
+
+    if (time - driver->energy_save_time >= ENERGY_SAVE_INTERVAL_US)
+    {
+        driver->energy_save_time = time;
+        liquid_driver_counters_changed(LIQUID_DRIVER(driver));
+    }
+}
+
 static gboolean
 liquid_driver_nzxt_smart2_input_report_fan_status(LiquidDriverNzxtSmart2 *driver,
                                                   GBytes *bytes)
@@ -129,9 +228,12 @@ liquid_driver_nzxt_smart2_input_report_fan_status(LiquidDriverNzxtSmart2 *driver
     if (size < sizeof(struct fan_status_report))
     {
         g_printerr("Fan status report too short: %" G_GSIZE_FORMAT "\n", size);
+        liquid_driver_hid_decode_error(LIQUID_DRIVER_HID(driver));
         return TRUE;
     }
 
+    gdouble *values = liquid_driver_get_channel_values(LIQUID_DRIVER(driver));
+
     switch (data->type)
     {
     case FAN_STATUS_REPORT_SPEED:
@@ -143,9 +245,12 @@ liquid_driver_nzxt_smart2_input_report_fan_status(LiquidDriverNzxtSmart2 *driver
                     GUINT16_FROM_LE(data->fan_speed.fan_rpm[i]),
                     data->fan_speed.duty_percent[i]);
 
-            liquid_dbus_fan_speed_rpm_set_value(driver->rpm[i],
-                                                GUINT16_FROM_LE(data->fan_speed.fan_rpm[i]));
+            values[driver->rpm_channel + i] = GUINT16_FROM_LE(data->fan_speed.fan_rpm[i]);
+            values[driver->rpm_channel + FAN_CHANNELS + i] = data->fan_speed.duty_percent[i];
         }
+
+        liquid_driver_hid_sample_received(LIQUID_DRIVER_HID(driver));
+        liquid_driver_channels_changed(LIQUID_DRIVER(driver), driver->rpm_channel, 2 * FAN_CHANNELS);
         break;
 
     case FAN_STATUS_REPORT_VOLTAGE:
@@ -156,11 +261,21 @@ liquid_driver_nzxt_smart2_input_report_fan_status(LiquidDriverNzxtSmart2 *driver
                     data->fan_type[i],
                     GUINT16_FROM_LE(data->fan_voltage.fan_in[i]),
                     GUINT16_FROM_LE(data->fan_voltage.fan_current[i]));
+
+            values[driver->voltage_channel + i] = GUINT16_FROM_LE(data->fan_voltage.fan_in[i]) / 1000.0;
+            values[driver->voltage_channel + FAN_CHANNELS + i]
+                = GUINT16_FROM_LE(data->fan_voltage.fan_current[i]) / 1000.0;
         }
+
+        liquid_driver_nzxt_smart2_account_energy(driver, values);
+        liquid_driver_channels_changed(LIQUID_DRIVER(driver),
+                                       driver->voltage_channel,
+                                       2 * FAN_CHANNELS + 2 * (FAN_CHANNELS + 1));
         break;
 
     default:
         g_printerr("Unknown fan status report type %#x\n", data->type);
+        liquid_driver_hid_decode_error(LIQUID_DRIVER_HID(driver));
         break;
     }
 
@@ -168,7 +283,7 @@ liquid_driver_nzxt_smart2_input_report_fan_status(LiquidDriverNzxtSmart2 *driver
 }
 
 static gboolean
-liquid_driver_nzxt_smart2_input_report_unknown(LiquidDriverHid *driver G_GNUC_UNUSED,
+liquid_driver_nzxt_smart2_input_report_unknown(LiquidDriverHid *driver,
                                                GBytes *bytes)
 {
     gsize size = 0;
@@ -177,20 +292,37 @@ liquid_driver_nzxt_smart2_input_report_unknown(LiquidDriverHid *driver G_GNUC_UN
     if (size > 0)
     {
         g_printerr("Unhandled input report %#x\n", *data);
+        liquid_driver_hid_decode_error(driver);
     }
 
     return TRUE;
 }
 
+/* The interval goes in twice, little-endian, each time after a 0x01 */
 static gboolean
-liquid_driver_nzxt_smart2_init_device(LiquidDriverNzxtSmart2 *driver, GError **error)
+liquid_driver_nzxt_smart2_send_update_interval(LiquidDriverNzxtSmart2 *driver, guint interval_ms, GError **error)
 {
-    g_return_val_if_fail(LIQUID_IS_DRIVER_NZXT_SMART2(driver), FALSE);
+    guint8 report[OUTPUT_REPORT_SIZE] = {
+        OUTPUT_REPORT_ID_INIT_COMMAND,
+        INIT_COMMAND_SET_UPDATE_INTERVAL,
+    };
 
-    LiquidHidDevice *hid_device = liquid_driver_hid_get_device(LIQUID_DRIVER_HID(driver));
+    for (int i = 0; i < 2; i++)
+    {
+        report[2 + 3 * i] = 0x01;
+        report[3 + 3 * i] = interval_ms & 0xff;
+        report[4 + 3 * i] = (interval_ms >> 8) & 0xff;
+    }
+
+    return liquid_driver_hid_output_report(LIQUID_DRIVER_HID(driver), report, OUTPUT_REPORT_SIZE, error);
+}
+
+static gboolean
+liquid_driver_nzxt_smart2_init_device(LiquidDriver *driver, GError **error)
+{
     g_autoptr(GError) inner_error = NULL;
 
-    if (!liquid_hid_device_output_report(hid_device,
+    if (!liquid_driver_hid_output_report(LIQUID_DRIVER_HID(driver),
                                          detect_fans_report,
                                          OUTPUT_REPORT_SIZE,
                                          &inner_error))
@@ -199,10 +331,9 @@ liquid_driver_nzxt_smart2_init_device(LiquidDriverNzxtSmart2 *driver, GError **e
         return FALSE;
     }
 
-    if (!liquid_hid_device_output_report(hid_device,
-                                         set_update_interval_report,
-                                         OUTPUT_REPORT_SIZE,
-                                         &inner_error))
+    if (!liquid_driver_nzxt_smart2_send_update_interval(LIQUID_DRIVER_NZXT_SMART2(driver),
+                                                        LIQUID_DRIVER_NZXT_SMART2(driver)->update_interval_ms,
+                                                        &inner_error))
     {
         g_propagate_prefixed_error(error, inner_error, "Failed to send update interval command: ");
         return FALSE;
@@ -211,6 +342,218 @@ liquid_driver_nzxt_smart2_init_device(LiquidDriverNzxtSmart2 *driver, GError **e
     return TRUE;
 }
 
+static GVariant *
+liquid_driver_nzxt_smart2_save_state(LiquidDriver *driver)
+{
+    LiquidDriverNzxtSmart2 *self = LIQUID_DRIVER_NZXT_SMART2(driver);
+    g_auto(GVariantDict) dict = G_VARIANT_DICT_INIT(NULL);
+
+    if (!self->fan_types_known)
+    {
+        return NULL;
+    }
+
+    g_variant_dict_insert_value(&dict,
+                                "fan-types",
+                                g_variant_new_fixed_array(G_VARIANT_TYPE_BYTE,
+                                                          self->fan_type,
+                                                          FAN_CHANNELS,
+                                                          sizeof(guint8)));
+    g_variant_dict_insert(&dict, "update-interval", "u", self->update_interval_ms);
+
+    return g_variant_dict_end(&dict);
+}
+
+static gboolean
+liquid_driver_nzxt_smart2_restore_state(LiquidDriver *driver, GVariant *state)
+{
+    LiquidDriverNzxtSmart2 *self = LIQUID_DRIVER_NZXT_SMART2(driver);
+    guint32 update_interval = 0;
+
+    /* The device keeps reporting at the interval it was last told to */
+    if (!g_variant_lookup(state, "update-interval", "u", &update_interval)
+        || update_interval < UPDATE_INTERVAL_MIN_MS || update_interval > UPDATE_INTERVAL_MAX_MS)
+    {
+        return FALSE;
+    }
+
+    g_autoptr(GVariant) fan_types
+        = g_variant_lookup_value(state, "fan-types", G_VARIANT_TYPE_BYTESTRING);
+
+    if (fan_types == NULL)
+    {
+        return FALSE;
+    }
+
+    gsize n_fan_types = 0;
+    const guint8 *data = g_variant_get_fixed_array(fan_types, &n_fan_types, sizeof(guint8));
+
+    if (n_fan_types != FAN_CHANNELS)
+    {
+        return FALSE;
+    }
+
+    memcpy(self->fan_type, data, FAN_CHANNELS);
+    self->fan_types_known = TRUE;
+    self->update_interval_ms = update_interval;
+    liquid_driver_hid_set_update_interval(LIQUID_DRIVER_HID(driver), update_interval);
+
+    return TRUE;
+}
+
+static GVariant *
+liquid_driver_nzxt_smart2_save_counters(LiquidDriver *driver)
+{
+    LiquidDriverNzxtSmart2 *self = LIQUID_DRIVER_NZXT_SMART2(driver);
+    g_auto(GVariantDict) dict = G_VARIANT_DICT_INIT(NULL);
+
+    if (!self->energy_known)
+    {
+        return NULL;
+    }
+
+    g_variant_dict_insert_value(&dict,
+                                "energy-wh",
+                                g_variant_new_fixed_array(G_VARIANT_TYPE_DOUBLE,
+                                                          self->energy,
+                                                          FAN_CHANNELS + 1,
+                                                          sizeof(gdouble)));
+
+    return g_variant_dict_end(&dict);
+}
+
+/* Energy carries on even when the device has to be initialized again */
+static void
+liquid_driver_nzxt_smart2_restore_counters(LiquidDriver *driver, GVariant *counters)
+{
+    LiquidDriverNzxtSmart2 *self = LIQUID_DRIVER_NZXT_SMART2(driver);
+    g_autoptr(GVariant) energy = g_variant_lookup_value(counters, "energy-wh", G_VARIANT_TYPE("ad"));
+
+    if (energy == NULL)
+    {
+        return;
+    }
+
+    gsize n_energy = 0;
+    const gdouble *data = g_variant_get_fixed_array(energy, &n_energy, sizeof(gdouble));
+
+    if (n_energy == FAN_CHANNELS + 1)
+    {
+        memcpy(self->energy, data, sizeof(self->energy));
+        self->energy_known = TRUE;
+    }
+}
+
+static gboolean
+liquid_driver_nzxt_smart2_configure_update_interval(LiquidDriverHid *driver, guint interval_ms, GError **error)
+{
+    LiquidDriverNzxtSmart2 *self = LIQUID_DRIVER_NZXT_SMART2(driver);
+
+    if (interval_ms == 0)
+    {
+        interval_ms = UPDATE_INTERVAL_DEFAULT_MS;
+    }
+
+    if (interval_ms < UPDATE_INTERVAL_MIN_MS || interval_ms > UPDATE_INTERVAL_MAX_MS)
+    {
+        g_set_error(error,
+                    G_IO_ERROR,
+                    G_IO_ERROR_INVALID_ARGUMENT,
+                    "Update interval must be between %d and %d ms",
+                    UPDATE_INTERVAL_MIN_MS,
+                    UPDATE_INTERVAL_MAX_MS);
+        return FALSE;
+    }
+
+    if (interval_ms == self->update_interval_ms)
+    {
+        return TRUE;
+    }
+
+    if (!liquid_driver_nzxt_smart2_send_update_interval(self, interval_ms, error))
+    {
+        g_prefix_error(error, "Failed to send update interval command: ");
+        return FALSE;
+    }
+
+    self->update_interval_ms = interval_ms;
+    liquid_driver_hid_set_update_interval(driver, interval_ms);
+
+    /* Without fan types, there's no state that would skip initialization */
+    if (self->fan_types_known)
+    {
+        liquid_driver_state_changed(LIQUID_DRIVER(driver));
+    }
+
+    return TRUE;
+}
+
+/* The duty of each fan goes after the channel mask, in a byte of its own */
+static gboolean
+liquid_driver_nzxt_smart2_set_duty(LiquidDriver *driver, guint channel, guint duty_percent, GError **error)
+{
+    LiquidDriverNzxtSmart2 *self = LIQUID_DRIVER_NZXT_SMART2(driver);
+    guint fan = channel - self->duty_channel;
+    guint8 report[OUTPUT_REPORT_SIZE] = { OUTPUT_REPORT_ID_SET_FAN_SPEED, 0x01 };
+    g_autoptr(GError) inner_error = NULL;
+
+    g_return_val_if_fail(fan < FAN_CHANNELS, FALSE);
+
+    report[2] = (guint8)(1 << fan);
+    report[fan + 3] = (guint8)duty_percent;
+
+    if (!liquid_driver_hid_output_report(LIQUID_DRIVER_HID(driver), report, sizeof(report), &inner_error))
+    {
+        g_propagate_prefixed_error(error, inner_error, "Failed to send fan speed command: ");
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+/*
+ * Colors for up to LEDS_MAX LEDs go out in two reports of LEDS_PER_REPORT,
+ * in GRB order, and show once the apply report follows.
+ */
+static void
+liquid_driver_nzxt_smart2_encode_led_frame(LiquidDriverHid *driver G_GNUC_UNUSED,
+                                           guint channel,
+                                           const guint8 *rgb,
+                                           guint n_leds,
+                                           GByteArray *reports)
+{
+    const guint8 commands[] = { LED_COMMAND_COLORS_FIRST, LED_COMMAND_COLORS_SECOND };
+    guint offset = reports->len;
+
+    g_byte_array_set_size(reports, offset + 3 * OUTPUT_REPORT_SIZE);
+    memset(reports->data + offset, 0, 3 * OUTPUT_REPORT_SIZE);
+
+    for (guint i = 0; i < G_N_ELEMENTS(commands); i++)
+    {
+        guint8 *report = reports->data + offset + i * OUTPUT_REPORT_SIZE;
+        guint first = i * LEDS_PER_REPORT;
+        guint8 *grb = report + 4;
+
+        report[0] = OUTPUT_REPORT_ID_LED;
+        report[1] = commands[i];
+        report[2] = (guint8)(1 << channel);
+
+        for (guint j = first; j < MIN(n_leds, first + LEDS_PER_REPORT); j++)
+        {
+            grb[3 * (j - first)] = rgb[3 * j + 1];
+            grb[3 * (j - first) + 1] = rgb[3 * j];
+            grb[3 * (j - first) + 2] = rgb[3 * j + 2];
+        }
+    }
+
+    guint8 *apply = reports->data + offset + 2 * OUTPUT_REPORT_SIZE;
+
+    apply[0] = OUTPUT_REPORT_ID_LED;
+    apply[1] = LED_COMMAND_APPLY;
+    apply[2] = (guint8)(1 << channel);
+    memcpy(apply + 4, led_apply_parameters, sizeof(led_apply_parameters));
+}
+
 static gboolean
 liquid_driver_nzxt_smart2_handle_init_device(LiquidDBusInitDeviceSkeleton *interface G_GNUC_UNUSED,
                                              GDBusMethodInvocation *invocation,
@@ -218,7 +561,7 @@ liquid_driver_nzxt_smart2_handle_init_device(LiquidDBusInitDeviceSkeleton *inter
 {
     g_autoptr(GError) error = NULL;
 
-    if (liquid_driver_nzxt_smart2_init_device(driver, &error))
+    if (liquid_driver_init_device(LIQUID_DRIVER(driver), &error))
     {
         g_dbus_method_invocation_return_value(invocation, NULL);
     }
@@ -231,28 +574,47 @@ liquid_driver_nzxt_smart2_handle_init_device(LiquidDBusInitDeviceSkeleton *inter
 }
 
 static void
-liquid_driver_nzxt_smart2_dispose(GObject *object)
+liquid_driver_nzxt_smart2_class_init(LiquidDriverNzxtSmart2Class *class)
 {
-    LiquidDriverNzxtSmart2 *driver = LIQUID_DRIVER_NZXT_SMART2(object);
+    LiquidDriverClass *driver_class = LIQUID_DRIVER_CLASS(class);
 
-    for (int i = 0; i < FAN_CHANNELS; i++)
-    {
-        g_clear_object(&driver->rpm[i]);
-    }
+    driver_class->init_device = liquid_driver_nzxt_smart2_init_device;
+    driver_class->save_state = liquid_driver_nzxt_smart2_save_state;
+    driver_class->restore_state = liquid_driver_nzxt_smart2_restore_state;
+    driver_class->save_counters = liquid_driver_nzxt_smart2_save_counters;
+    driver_class->restore_counters = liquid_driver_nzxt_smart2_restore_counters;
+    driver_class->set_duty = liquid_driver_nzxt_smart2_set_duty;
+
+    LiquidDriverHidClass *driver_hid_class = LIQUID_DRIVER_HID_CLASS(class);
 
-    G_OBJECT_CLASS(liquid_driver_nzxt_smart2_parent_class)->dispose(object);
+    driver_hid_class->input_report = liquid_driver_nzxt_smart2_input_report_unknown;
+    driver_hid_class->n_led_channels = LED_CHANNELS;
+    driver_hid_class->max_leds = LEDS_MAX;
+    driver_hid_class->led_report_size = OUTPUT_REPORT_SIZE;
+    driver_hid_class->encode_led_frame = liquid_driver_nzxt_smart2_encode_led_frame;
+    driver_hid_class->configure_update_interval = liquid_driver_nzxt_smart2_configure_update_interval;
 }
 
-static void
-liquid_driver_nzxt_smart2_class_init(LiquidDriverNzxtSmart2Class *class)
+/* Returns the first of FAN_CHANNELS consecutive channels */
+static guint
+liquid_driver_nzxt_smart2_add_fan_channels(LiquidDriverNzxtSmart2 *driver,
+                                           LiquidChannelType type,
+                                           LiquidChannelFlags flags)
 {
-    LiquidDriverHidClass *driver_hid_class = LIQUID_DRIVER_HID_CLASS(class);
+    guint first = G_MAXUINT;
 
-    driver_hid_class->input_report = liquid_driver_nzxt_smart2_input_report_unknown;
+    for (int i = 0; i < FAN_CHANNELS; i++)
+    {
+        g_autofree gchar *channel_name = g_strdup_printf("fan%d", i);
+        guint channel = liquid_driver_add_channel(LIQUID_DRIVER(driver), channel_name, type, flags);
 
-    GObjectClass *gobject_class = G_OBJECT_CLASS(class);
+        if (i == 0)
+        {
+            first = channel;
+        }
+    }
 
-    gobject_class->dispose = liquid_driver_nzxt_smart2_dispose;
+    return first;
 }
 
 static void
@@ -268,6 +630,10 @@ liquid_driver_nzxt_smart2_init(LiquidDriverNzxtSmart2 *driver)
                      G_CALLBACK(liquid_driver_nzxt_smart2_input_report_fan_status),
                      NULL);
 
+    /* Set here rather than in init_device, which restored devices skip */
+    driver->update_interval_ms = UPDATE_INTERVAL_DEFAULT_MS;
+    liquid_driver_hid_set_update_interval(LIQUID_DRIVER_HID(driver), driver->update_interval_ms);
+
     g_autoptr(LiquidDBusInitDevice) init_interface = liquid_dbus_init_device_skeleton_new();
 
     g_signal_connect(init_interface,
@@ -278,15 +644,18 @@ liquid_driver_nzxt_smart2_init(LiquidDriverNzxtSmart2 *driver)
     g_dbus_object_skeleton_add_interface(G_DBUS_OBJECT_SKELETON(driver),
                                          G_DBUS_INTERFACE_SKELETON(init_interface));
 
-    for (int i = 0; i < FAN_CHANNELS; i++)
-    {
-        g_autofree gchar *channel_name = g_strdup_printf("fan%d", i);
-        g_autoptr(GDBusObjectSkeleton) channel_dbus = liquid_driver_add_channel(LIQUID_DRIVER(driver), channel_name);
-        g_autoptr(LiquidDBusFanSpeedRPM) rpm = liquid_dbus_fan_speed_rpm_skeleton_new();
+    LiquidChannelFlags reported = LIQUID_CHANNEL_FLAG_NONE;
+    LiquidChannelFlags derived = LIQUID_CHANNEL_FLAG_DERIVED;
 
-        g_dbus_object_skeleton_add_interface(channel_dbus, G_DBUS_INTERFACE_SKELETON(rpm));
-        driver->rpm[i] = g_steal_pointer(&rpm);
-    }
+    driver->rpm_channel = liquid_driver_nzxt_smart2_add_fan_channels(driver, LIQUID_CHANNEL_FAN_SPEED_RPM, reported);
+    driver->duty_channel = liquid_driver_nzxt_smart2_add_fan_channels(driver, LIQUID_CHANNEL_DUTY_PERCENT, reported);
+    driver->voltage_channel = liquid_driver_nzxt_smart2_add_fan_channels(driver, LIQUID_CHANNEL_VOLTAGE, reported);
+    liquid_driver_nzxt_smart2_add_fan_channels(driver, LIQUID_CHANNEL_CURRENT, reported);
+
+    driver->power_channel = liquid_driver_nzxt_smart2_add_fan_channels(driver, LIQUID_CHANNEL_POWER, derived);
+    liquid_driver_add_channel(LIQUID_DRIVER(driver), "total", LIQUID_CHANNEL_POWER, derived);
+    driver->energy_channel = liquid_driver_nzxt_smart2_add_fan_channels(driver, LIQUID_CHANNEL_ENERGY, derived);
+    liquid_driver_add_channel(LIQUID_DRIVER(driver), "total", LIQUID_CHANNEL_ENERGY, derived);
 }
 
 gboolean
@@ -328,3 +697,15 @@ liquid_driver_nzxt_smart2_new(LiquidHidDevice *hid_device, LiquidHidDeviceInfo *
                         info,
                         NULL);
 }
+
+static LiquidDriverHid *
+liquid_driver_nzxt_smart2_create(LiquidHidDevice *hid_device, LiquidHidDeviceInfo *info)
+{
+    return LIQUID_DRIVER_HID(liquid_driver_nzxt_smart2_new(hid_device, info));
+}
+
+/* Entry point when built as a module; nzxt-smart2.driver lists the same products as the match */
+G_MODULE_EXPORT const LiquidDriverModule liquid_driver_module = {
+    .match = liquid_driver_nzxt_smart2_match,
+    .create = liquid_driver_nzxt_smart2_create,
+};
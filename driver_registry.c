@@ -0,0 +1,321 @@
+#include "driver_registry.h"
+
+#include <gio/gio.h>
+#include <gmodule.h>
+
+#define MANIFEST_SUFFIX ".driver"
+#define MANIFEST_GROUP "Driver"
+
+typedef struct
+{
+    gchar *module_path;
+    gchar *module_name;
+
+    /* NULL until loaded; a module that failed to load isn't tried again */
+    const LiquidDriverModule *module;
+    gboolean failed;
+} Manifest;
+
+typedef struct
+{
+    guint vendor_id;
+    guint product_id;
+    Manifest *manifest;
+} DeviceEntry;
+
+struct _LiquidDriverRegistry
+{
+    GObject parent;
+
+    GPtrArray *manifests;
+    /* Looked up linearly: a few hundred entries at most, and only on probes */
+    GArray *devices;
+
+    gint64 load_time_us;
+};
+
+G_DEFINE_FINAL_TYPE(LiquidDriverRegistry, liquid_driver_registry, G_TYPE_OBJECT)
+
+static void
+manifest_free(Manifest *manifest)
+{
+    g_free(manifest->module_path);
+    g_free(manifest->module_name);
+    g_free(manifest);
+}
+
+static void
+liquid_driver_registry_finalize(GObject *object)
+{
+    LiquidDriverRegistry *registry = LIQUID_DRIVER_REGISTRY(object);
+
+    g_array_unref(registry->devices);
+    g_ptr_array_unref(registry->manifests);
+
+    G_OBJECT_CLASS(liquid_driver_registry_parent_class)->finalize(object);
+}
+
+static void
+liquid_driver_registry_init(LiquidDriverRegistry *registry)
+{
+    registry->manifests = g_ptr_array_new_with_free_func((GDestroyNotify)manifest_free);
+    registry->devices = g_array_new(FALSE, FALSE, sizeof(DeviceEntry));
+}
+
+static void
+liquid_driver_registry_class_init(LiquidDriverRegistryClass *class)
+{
+    GObjectClass *gobject_class = G_OBJECT_CLASS(class);
+
+    gobject_class->finalize = liquid_driver_registry_finalize;
+}
+
+LiquidDriverRegistry *
+liquid_driver_registry_new(void)
+{
+    return g_object_new(LIQUID_TYPE_DRIVER_REGISTRY, NULL);
+}
+
+/* VENDOR:PRODUCT, in hex */
+static gboolean
+parse_device_id(const gchar *id, guint *vendor_id, guint *product_id, GError **error)
+{
+    g_auto(GStrv) parts = g_strsplit(id, ":", 2);
+    guint64 vendor = 0;
+    guint64 product = 0;
+
+    if (g_strv_length(parts) != 2)
+    {
+        g_set_error(error, G_KEY_FILE_ERROR, G_KEY_FILE_ERROR_INVALID_VALUE, "Expected VENDOR:PRODUCT, got '%s'", id);
+        return FALSE;
+    }
+
+    if (!g_ascii_string_to_unsigned(parts[0], 16, 0, G_MAXUINT16, &vendor, error)
+        || !g_ascii_string_to_unsigned(parts[1], 16, 0, G_MAXUINT16, &product, error))
+    {
+        g_prefix_error(error, "Invalid device ID '%s': ", id);
+        return FALSE;
+    }
+
+    *vendor_id = (guint)vendor;
+    *product_id = (guint)product;
+
+    return TRUE;
+}
+
+static gboolean
+liquid_driver_registry_add_manifest(LiquidDriverRegistry *registry,
+                                    const gchar *directory,
+                                    const gchar *path,
+                                    GError **error)
+{
+    g_autoptr(GKeyFile) key_file = g_key_file_new();
+
+    if (!g_key_file_load_from_file(key_file, path, G_KEY_FILE_NONE, error))
+    {
+        return FALSE;
+    }
+
+    g_autofree gchar *module_name = g_key_file_get_string(key_file, MANIFEST_GROUP, "Module", error);
+    g_auto(GStrv) ids = module_name ? g_key_file_get_string_list(key_file, MANIFEST_GROUP, "Devices", NULL, error)
+                                    : NULL;
+
+    if (ids == NULL)
+    {
+        return FALSE;
+    }
+
+    g_autoptr(GArray) devices = g_array_new(FALSE, FALSE, sizeof(DeviceEntry));
+
+    for (GStrv id = ids; *id; id++)
+    {
+        DeviceEntry entry = { 0 };
+
+        if (!parse_device_id(*id, &entry.vendor_id, &entry.product_id, error))
+        {
+            return FALSE;
+        }
+
+        g_array_append_val(devices, entry);
+    }
+
+    Manifest *manifest = g_new0(Manifest, 1);
+
+    manifest->module_name = g_steal_pointer(&module_name);
+    manifest->module_path = g_build_filename(directory, manifest->module_name, NULL);
+    g_ptr_array_add(registry->manifests, manifest);
+
+    for (guint i = 0; i < devices->len; i++)
+    {
+        g_array_index(devices, DeviceEntry, i).manifest = manifest;
+    }
+
+    g_array_append_vals(registry->devices, devices->data, devices->len);
+
+    return TRUE;
+}
+
+gboolean
+liquid_driver_registry_add_directory(LiquidDriverRegistry *registry, const gchar *path, GError **error)
+{
+    g_return_val_if_fail(LIQUID_IS_DRIVER_REGISTRY(registry), FALSE);
+
+    g_autoptr(GDir) dir = g_dir_open(path, 0, error);
+    const gchar *name;
+
+    if (dir == NULL)
+    {
+        return FALSE;
+    }
+
+    while ((name = g_dir_read_name(dir)) != NULL)
+    {
+        if (!g_str_has_suffix(name, MANIFEST_SUFFIX))
+        {
+            continue;
+        }
+
+        g_autofree gchar *manifest_path = g_build_filename(path, name, NULL);
+        g_autoptr(GError) manifest_error = NULL;
+
+        if (!liquid_driver_registry_add_manifest(registry, path, manifest_path, &manifest_error))
+        {
+            g_printerr("Ignoring driver manifest %s: %s\n", manifest_path, manifest_error->message);
+        }
+    }
+
+    return TRUE;
+}
+
+static gboolean
+liquid_driver_registry_load(LiquidDriverRegistry *registry, Manifest *manifest, GError **error)
+{
+    if (manifest->module || manifest->failed)
+    {
+        return manifest->module != NULL;
+    }
+
+    gint64 start = g_get_monotonic_time();
+    GModule *module = g_module_open(manifest->module_path, G_MODULE_BIND_LAZY | G_MODULE_BIND_LOCAL);
+    gpointer symbol = NULL;
+
+    if (module == NULL || !g_module_symbol(module, LIQUID_DRIVER_MODULE_SYMBOL, &symbol) || symbol == NULL)
+    {
+        g_set_error(error,
+                    G_IO_ERROR,
+                    G_IO_ERROR_FAILED,
+                    "Can't load driver module %s: %s",
+                    manifest->module_name,
+                    g_module_error());
+        g_clear_pointer(&module, g_module_close);
+        manifest->failed = TRUE;
+        return FALSE;
+    }
+
+    /* Types registered by the module can't be unregistered */
+    g_module_make_resident(module);
+    manifest->module = symbol;
+
+    gint64 elapsed = g_get_monotonic_time() - start;
+
+    registry->load_time_us += elapsed;
+    g_printerr("Driver module %s loaded in %.1f ms\n", manifest->module_name, (gdouble)elapsed / 1000.0);
+
+    return TRUE;
+}
+
+const LiquidDriverModule *
+liquid_driver_registry_lookup(LiquidDriverRegistry *registry, LiquidHidDeviceInfo *info, GError **error)
+{
+    g_return_val_if_fail(LIQUID_IS_DRIVER_REGISTRY(registry), NULL);
+
+    guint vendor_id = liquid_hid_device_info_get_vendor_id(info);
+    guint product_id = liquid_hid_device_info_get_product_id(info);
+    g_autoptr(GError) load_error = NULL;
+
+    for (guint i = 0; i < registry->devices->len; i++)
+    {
+        const DeviceEntry *entry = &g_array_index(registry->devices, DeviceEntry, i);
+
+        if (entry->vendor_id != vendor_id || entry->product_id != product_id)
+        {
+            continue;
+        }
+
+        /* Another module listing the device may still handle it */
+        if (!liquid_driver_registry_load(registry, entry->manifest, load_error ? NULL : &load_error))
+        {
+            continue;
+        }
+
+        if (entry->manifest->module->match(info))
+        {
+            return entry->manifest->module;
+        }
+    }
+
+    if (load_error)
+    {
+        g_propagate_error(error, g_steal_pointer(&load_error));
+    }
+
+    return NULL;
+}
+
+gboolean
+liquid_driver_registry_load_all(LiquidDriverRegistry *registry, GError **error)
+{
+    g_return_val_if_fail(LIQUID_IS_DRIVER_REGISTRY(registry), FALSE);
+
+    gboolean loaded = TRUE;
+
+    for (guint i = 0; i < registry->manifests->len; i++)
+    {
+        g_autoptr(GError) load_error = NULL;
+
+        if (!liquid_driver_registry_load(registry, g_ptr_array_index(registry->manifests, i), &load_error))
+        {
+            if (loaded)
+            {
+                g_propagate_error(error, g_steal_pointer(&load_error));
+            }
+
+            loaded = FALSE;
+        }
+    }
+
+    return loaded;
+}
+
+guint
+liquid_driver_registry_get_n_manifests(LiquidDriverRegistry *registry)
+{
+    g_return_val_if_fail(LIQUID_IS_DRIVER_REGISTRY(registry), 0);
+
+    return registry->manifests->len;
+}
+
+GVariant *
+liquid_driver_registry_dup_statistics(LiquidDriverRegistry *registry)
+{
+    g_return_val_if_fail(LIQUID_IS_DRIVER_REGISTRY(registry), NULL);
+
+    g_auto(GVariantDict) dict = G_VARIANT_DICT_INIT(NULL);
+    g_auto(GVariantBuilder) loaded = G_VARIANT_BUILDER_INIT(G_VARIANT_TYPE_STRING_ARRAY);
+
+    for (guint i = 0; i < registry->manifests->len; i++)
+    {
+        const Manifest *manifest = g_ptr_array_index(registry->manifests, i);
+
+        if (manifest->module)
+        {
+            g_variant_builder_add(&loaded, "s", manifest->module_name);
+        }
+    }
+
+    g_variant_dict_insert(&dict, "manifests", "u", registry->manifests->len);
+    g_variant_dict_insert_value(&dict, "loaded", g_variant_builder_end(&loaded));
+    g_variant_dict_insert(&dict, "load-time-us", "t", (guint64)registry->load_time_us);
+
+    return g_variant_dict_end(&dict);
+}
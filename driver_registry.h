@@ -0,0 +1,65 @@
+#pragma once
+
+#include <glib-object.h>
+
+#include "driver_hid.h"
+#include "hid_device.h"
+#include "hid_device_info.h"
+
+G_BEGIN_DECLS
+
+/* What a driver module exports, as LIQUID_DRIVER_MODULE_SYMBOL */
+typedef struct
+{
+    /* Can refine the manifest's match, on interface numbers for instance */
+    gboolean (*match)(LiquidHidDeviceInfo *info);
+    LiquidDriverHid *(*create)(LiquidHidDevice *device, LiquidHidDeviceInfo *info);
+} LiquidDriverModule;
+
+#define LIQUID_DRIVER_MODULE_SYMBOL "liquid_driver_module"
+
+/*
+ * Driver modules, found through their manifests: NAME.driver key files next
+ * to the module, such as
+ *
+ *     [Driver]
+ *     Module=libnzxt-smart2.so
+ *     Devices=1e71:2006;1e71:200d;
+ *
+ * naming the module file, in the same directory, and listing the vendor and
+ * product IDs that it handles. A module is only loaded once a device it lists
+ * is looked up, and stays loaded.
+ */
+#define LIQUID_TYPE_DRIVER_REGISTRY (liquid_driver_registry_get_type())
+G_DECLARE_FINAL_TYPE(LiquidDriverRegistry, liquid_driver_registry, LIQUID, DRIVER_REGISTRY, GObject)
+
+LiquidDriverRegistry *
+liquid_driver_registry_new(void);
+
+/* Reads the manifests of a directory, skipping invalid ones */
+gboolean
+liquid_driver_registry_add_directory(LiquidDriverRegistry *registry, const gchar *path, GError **error);
+
+/*
+ * Returns the module for a device, loading it if needed, or NULL if there's
+ * none. Modules that fail to load are skipped for the next one listing the
+ * device; `error` is only set, to the first failure, if none handles it.
+ */
+const LiquidDriverModule *
+liquid_driver_registry_lookup(LiquidDriverRegistry *registry, LiquidHidDeviceInfo *info, GError **error);
+
+/* Loads every module up front, for comparison; returns FALSE if any failed to load */
+gboolean
+liquid_driver_registry_load_all(LiquidDriverRegistry *registry, GError **error);
+
+guint
+liquid_driver_registry_get_n_manifests(LiquidDriverRegistry *registry);
+
+/*
+ * Returns an a{sv} dictionary with the number of "manifests" (u), the names
+ * of the "loaded" modules (as) and the total "load-time-us" (t).
+ */
+GVariant *
+liquid_driver_registry_dup_statistics(LiquidDriverRegistry *registry);
+
+G_END_DECLS
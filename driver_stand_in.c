@@ -0,0 +1,51 @@
+#include <gmodule.h>
+
+#include "driver_registry.h"
+
+/*
+ * A driver module that handles no device, for liquidd-scale to install many
+ * copies of. Unlike copies of a real driver, it registers no types, which only
+ * one copy could do; its tables stand in for those of a small driver, so that
+ * each copy costs about as much to load.
+ */
+
+#define STAND_IN_CHANNELS 64
+
+typedef struct
+{
+    const gchar *name;
+    guint8 report_id;
+    guint8 offset;
+    guint8 size;
+} StandInChannel;
+
+#define CHANNEL(n) { "channel", 0x60 + (n) / 8, 2 + (n) % 8 * 2, 2 }
+#define CHANNELS_8(n) \
+    CHANNEL(n), CHANNEL(n + 1), CHANNEL(n + 2), CHANNEL(n + 3), CHANNEL(n + 4), CHANNEL(n + 5), CHANNEL(n + 6), CHANNEL(n + 7)
+
+/*
+ * Names are pointers, so that loading involves relocations like a real
+ * driver's tables; exported, so that the table is kept although nothing reads it.
+ */
+G_MODULE_EXPORT const StandInChannel liquid_driver_stand_in_channels[STAND_IN_CHANNELS] = {
+    CHANNELS_8(0),  CHANNELS_8(8),  CHANNELS_8(16), CHANNELS_8(24),
+    CHANNELS_8(32), CHANNELS_8(40), CHANNELS_8(48), CHANNELS_8(56),
+};
+
+/* Claims no device, not even those its manifest lists, since it can't drive any */
+static gboolean
+liquid_driver_stand_in_match(LiquidHidDeviceInfo *info G_GNUC_UNUSED)
+{
+    return FALSE;
+}
+
+static LiquidDriverHid *
+liquid_driver_stand_in_create(LiquidHidDevice *hid_device G_GNUC_UNUSED, LiquidHidDeviceInfo *info G_GNUC_UNUSED)
+{
+    return NULL;
+}
+
+G_MODULE_EXPORT const LiquidDriverModule liquid_driver_module = {
+    .match = liquid_driver_stand_in_match,
+    .create = liquid_driver_stand_in_create,
+};
@@ -0,0 +1,401 @@
+#include "emulator_nzxt_smart2.h"
+
+#include <errno.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <glib-unix.h>
+
+#define REPORT_SIZE 64
+
+#define VENDOR_NZXT 0x1e71
+#define PRODUCT_SMART_DEVICE_V2 0x2006
+
+/* Offsets into the reports decoded by driver_nzxt_smart2.c */
+#define REPORT_FAN_TYPE_OFFSET 16
+#define REPORT_FAN_RPM_OFFSET 24
+#define REPORT_FAN_DUTY_OFFSET 40
+#define REPORT_FAN_VOLTAGE_OFFSET 24
+#define REPORT_FAN_CURRENT_OFFSET 40
+
+#define FAN_VOLTAGE_MV 12000
+
+#define FAN_TYPE_PWM 2
+
+#define REPORT_ID_LED 0x22
+#define LED_COMMAND_APPLY 0xa0
+#define REPORT_ID_INIT_COMMAND 0x60
+#define INIT_COMMAND_SET_UPDATE_INTERVAL 0x02
+#define INIT_COMMAND_DETECT_FANS 0x03
+#define REPORT_ID_SET_FAN_SPEED 0x62
+
+struct _LiquidEmulatorNzxtSmart2
+{
+    GObject parent;
+
+    guint index;
+    int device_fd;
+    int driver_fd;
+
+    GSource *output_source;
+    guint output_delay_us;
+    guint update_source_id;
+    guint update_interval_ms;
+    /* Set from output reports, and picked up by the next update */
+    gint requested_interval_ms;
+    guint16 rpm[LIQUID_EMULATOR_NZXT_SMART2_FAN_CHANNELS];
+    /* Set from output reports, atomically as they may be served on another thread */
+    gint duty[LIQUID_EMULATOR_NZXT_SMART2_FAN_CHANNELS];
+
+    /* Output reports may be served on another thread */
+    GMutex led_mutex;
+    GArray *led_frame_times;
+};
+
+G_DEFINE_FINAL_TYPE(LiquidEmulatorNzxtSmart2, liquid_emulator_nzxt_smart2, G_TYPE_OBJECT)
+
+static void
+liquid_emulator_nzxt_smart2_dispose(GObject *object)
+{
+    LiquidEmulatorNzxtSmart2 *emulator = LIQUID_EMULATOR_NZXT_SMART2(object);
+
+    if (emulator->output_source)
+    {
+        g_source_destroy(emulator->output_source);
+        g_clear_pointer(&emulator->output_source, g_source_unref);
+    }
+
+    g_clear_handle_id(&emulator->update_source_id, g_source_remove);
+
+    G_OBJECT_CLASS(liquid_emulator_nzxt_smart2_parent_class)->dispose(object);
+}
+
+static void
+liquid_emulator_nzxt_smart2_finalize(GObject *object)
+{
+    LiquidEmulatorNzxtSmart2 *emulator = LIQUID_EMULATOR_NZXT_SMART2(object);
+
+    if (emulator->device_fd != -1)
+    {
+        close(emulator->device_fd);
+    }
+
+    if (emulator->driver_fd != -1)
+    {
+        close(emulator->driver_fd);
+    }
+
+    g_array_unref(emulator->led_frame_times);
+    g_mutex_clear(&emulator->led_mutex);
+
+    G_OBJECT_CLASS(liquid_emulator_nzxt_smart2_parent_class)->finalize(object);
+}
+
+static void
+liquid_emulator_nzxt_smart2_class_init(LiquidEmulatorNzxtSmart2Class *class)
+{
+    GObjectClass *gobject_class = G_OBJECT_CLASS(class);
+
+    gobject_class->dispose = liquid_emulator_nzxt_smart2_dispose;
+    gobject_class->finalize = liquid_emulator_nzxt_smart2_finalize;
+}
+
+static void
+liquid_emulator_nzxt_smart2_init(LiquidEmulatorNzxtSmart2 *emulator)
+{
+    emulator->device_fd = -1;
+    emulator->driver_fd = -1;
+
+    for (guint i = 0; i < LIQUID_EMULATOR_NZXT_SMART2_FAN_CHANNELS; i++)
+    {
+        emulator->duty[i] = 50;
+    }
+
+    g_mutex_init(&emulator->led_mutex);
+    emulator->led_frame_times = g_array_new(FALSE, FALSE, sizeof(gint64));
+}
+
+LiquidEmulatorNzxtSmart2 *
+liquid_emulator_nzxt_smart2_new(guint index, GError **error)
+{
+    int fds[2];
+
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, fds) == -1)
+    {
+        int errsv = errno;
+        g_set_error(error, G_IO_ERROR, g_io_error_from_errno(errsv), "socketpair: %s", g_strerror(errsv));
+        return NULL;
+    }
+
+    LiquidEmulatorNzxtSmart2 *emulator = g_object_new(LIQUID_TYPE_EMULATOR_NZXT_SMART2, NULL);
+
+    emulator->index = index;
+    emulator->device_fd = fds[0];
+    emulator->driver_fd = fds[1];
+
+    if (!g_unix_set_fd_nonblocking(emulator->device_fd, TRUE, error))
+    {
+        g_object_unref(emulator);
+        return NULL;
+    }
+
+    return emulator;
+}
+
+LiquidHidDeviceInfo *
+liquid_emulator_nzxt_smart2_dup_device_info(LiquidEmulatorNzxtSmart2 *emulator)
+{
+    g_return_val_if_fail(LIQUID_IS_EMULATOR_NZXT_SMART2(emulator), NULL);
+
+    g_autofree gchar *hidraw_path = g_strdup_printf("emulated:%u", emulator->index);
+    g_autofree gchar *usb_path = g_strdup_printf("emulated-%u", emulator->index);
+    g_autofree gchar *serial = g_strdup_printf("EMU%08u", emulator->index);
+
+    return g_object_new(LIQUID_TYPE_HID_DEVICE_INFO,
+                        "hidraw-path",
+                        hidraw_path,
+                        "vendor-id",
+                        VENDOR_NZXT,
+                        "product-id",
+                        PRODUCT_SMART_DEVICE_V2,
+                        "usb-path",
+                        usb_path,
+                        "serial",
+                        serial,
+                        "interface-number",
+                        0,
+                        NULL);
+}
+
+int
+liquid_emulator_nzxt_smart2_steal_device_fd(LiquidEmulatorNzxtSmart2 *emulator)
+{
+    g_return_val_if_fail(LIQUID_IS_EMULATOR_NZXT_SMART2(emulator), -1);
+    g_return_val_if_fail(emulator->driver_fd != -1, -1);
+
+    int fd = emulator->driver_fd;
+    emulator->driver_fd = -1;
+
+    return fd;
+}
+
+static gboolean
+liquid_emulator_nzxt_smart2_send(LiquidEmulatorNzxtSmart2 *emulator,
+                                 const guint8 report[REPORT_SIZE],
+                                 GError **error)
+{
+    if (send(emulator->device_fd, report, REPORT_SIZE, MSG_NOSIGNAL) == -1)
+    {
+        int errsv = errno;
+        g_set_error(error, G_IO_ERROR, g_io_error_from_errno(errsv), "send: %s", g_strerror(errsv));
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+gboolean
+liquid_emulator_nzxt_smart2_send_fan_speed(LiquidEmulatorNzxtSmart2 *emulator,
+                                           const guint16 rpm[LIQUID_EMULATOR_NZXT_SMART2_FAN_CHANNELS],
+                                           GError **error)
+{
+    g_return_val_if_fail(LIQUID_IS_EMULATOR_NZXT_SMART2(emulator), FALSE);
+
+    guint8 report[REPORT_SIZE] = { 0x67, 0x02 };
+
+    for (guint i = 0; i < LIQUID_EMULATOR_NZXT_SMART2_FAN_CHANNELS; i++)
+    {
+        guint16 rpm_le = GUINT16_TO_LE(rpm[i]);
+
+        report[REPORT_FAN_TYPE_OFFSET + i] = FAN_TYPE_PWM;
+        memcpy(&report[REPORT_FAN_RPM_OFFSET + 2 * i], &rpm_le, sizeof(rpm_le));
+        report[REPORT_FAN_DUTY_OFFSET + i] = (guint8)g_atomic_int_get(&emulator->duty[i]);
+    }
+
+    return liquid_emulator_nzxt_smart2_send(emulator, report, error);
+}
+
+/* Current roughly follows speed, as it does for real fans */
+static gboolean
+liquid_emulator_nzxt_smart2_send_fan_voltage(LiquidEmulatorNzxtSmart2 *emulator, GError **error)
+{
+    guint8 report[REPORT_SIZE] = { 0x67, 0x04 };
+
+    for (guint i = 0; i < LIQUID_EMULATOR_NZXT_SMART2_FAN_CHANNELS; i++)
+    {
+        guint16 voltage_le = GUINT16_TO_LE(FAN_VOLTAGE_MV);
+        guint16 current_le = GUINT16_TO_LE(emulator->rpm[i] / 10);
+
+        report[REPORT_FAN_TYPE_OFFSET + i] = FAN_TYPE_PWM;
+        memcpy(&report[REPORT_FAN_VOLTAGE_OFFSET + 2 * i], &voltage_le, sizeof(voltage_le));
+        memcpy(&report[REPORT_FAN_CURRENT_OFFSET + 2 * i], &current_le, sizeof(current_le));
+    }
+
+    return liquid_emulator_nzxt_smart2_send(emulator, report, error);
+}
+
+static gboolean
+liquid_emulator_nzxt_smart2_send_fan_config(LiquidEmulatorNzxtSmart2 *emulator, GError **error)
+{
+    guint8 report[REPORT_SIZE] = { 0x61, 0x03 };
+
+    for (guint i = 0; i < LIQUID_EMULATOR_NZXT_SMART2_FAN_CHANNELS; i++)
+    {
+        report[REPORT_FAN_TYPE_OFFSET + i] = FAN_TYPE_PWM;
+    }
+
+    return liquid_emulator_nzxt_smart2_send(emulator, report, error);
+}
+
+static gboolean
+liquid_emulator_nzxt_smart2_output_report(gint fd, GIOCondition condition, gpointer user_data)
+{
+    LiquidEmulatorNzxtSmart2 *emulator = user_data;
+    guint8 report[REPORT_SIZE];
+
+    if (condition & (G_IO_HUP | G_IO_ERR))
+    {
+        return G_SOURCE_REMOVE;
+    }
+
+    ssize_t size = recv(fd, report, sizeof(report), 0);
+
+    if (size < 2)
+    {
+        return G_SOURCE_CONTINUE;
+    }
+
+    if (emulator->output_delay_us)
+    {
+        g_usleep(emulator->output_delay_us);
+    }
+
+    /* Only the first channel's, so the times are one per frame */
+    if (size > 2 && report[0] == REPORT_ID_LED && report[1] == LED_COMMAND_APPLY && report[2] == 0x01)
+    {
+        gint64 time = g_get_monotonic_time();
+
+        g_mutex_lock(&emulator->led_mutex);
+        g_array_append_val(emulator->led_frame_times, time);
+        g_mutex_unlock(&emulator->led_mutex);
+    }
+
+    if (size > 2 && report[0] == REPORT_ID_SET_FAN_SPEED)
+    {
+        for (guint i = 0; i < LIQUID_EMULATOR_NZXT_SMART2_FAN_CHANNELS; i++)
+        {
+            if (report[2] & (1 << i) && (gsize)size > i + 3)
+            {
+                g_atomic_int_set(&emulator->duty[i], MIN(report[i + 3], 100));
+            }
+        }
+    }
+
+    if (size > 4 && report[0] == REPORT_ID_INIT_COMMAND && report[1] == INIT_COMMAND_SET_UPDATE_INTERVAL)
+    {
+        guint interval_ms = report[3] | (guint)report[4] << 8;
+
+        if (interval_ms > 0)
+        {
+            g_atomic_int_set(&emulator->requested_interval_ms, (gint)interval_ms);
+        }
+    }
+
+    /* Other commands only configure the device, which doesn't need to answer them */
+    if (report[0] == REPORT_ID_INIT_COMMAND && report[1] == INIT_COMMAND_DETECT_FANS)
+    {
+        g_autoptr(GError) error = NULL;
+
+        if (!liquid_emulator_nzxt_smart2_send_fan_config(emulator, &error))
+        {
+            g_printerr("Emulated device %u: %s\n", emulator->index, error->message);
+        }
+    }
+
+    return G_SOURCE_CONTINUE;
+}
+
+static gboolean
+liquid_emulator_nzxt_smart2_update(gpointer user_data)
+{
+    LiquidEmulatorNzxtSmart2 *emulator = user_data;
+    g_autoptr(GError) error = NULL;
+
+    /*
+     * Spin up or down toward the speed for the duty, a quarter of the way per
+     * update, and wander around it so that every update changes something
+     */
+    for (guint i = 0; i < LIQUID_EMULATOR_NZXT_SMART2_FAN_CHANNELS; i++)
+    {
+        gint target = 300 + g_atomic_int_get(&emulator->duty[i]) * 17;
+        gint rpm = emulator->rpm[i] + (target - emulator->rpm[i]) / 4 + g_random_int_range(-20, 21);
+
+        emulator->rpm[i] = (guint16)CLAMP(rpm, 300, 2000);
+    }
+
+    if ((!liquid_emulator_nzxt_smart2_send_fan_speed(emulator, emulator->rpm, &error)
+         || !liquid_emulator_nzxt_smart2_send_fan_voltage(emulator, &error))
+        && !g_error_matches(error, G_IO_ERROR, G_IO_ERROR_WOULD_BLOCK))
+    {
+        g_printerr("Emulated device %u: %s\n", emulator->index, error->message);
+    }
+
+    guint requested_ms = (guint)g_atomic_int_get(&emulator->requested_interval_ms);
+
+    if (requested_ms != 0 && requested_ms != emulator->update_interval_ms)
+    {
+        emulator->update_interval_ms = requested_ms;
+        emulator->update_source_id = g_timeout_add(requested_ms, liquid_emulator_nzxt_smart2_update, emulator);
+        return G_SOURCE_REMOVE;
+    }
+
+    return G_SOURCE_CONTINUE;
+}
+
+void
+liquid_emulator_nzxt_smart2_serve_output(LiquidEmulatorNzxtSmart2 *emulator, GMainContext *context, guint delay_us)
+{
+    g_return_if_fail(LIQUID_IS_EMULATOR_NZXT_SMART2(emulator));
+    g_return_if_fail(emulator->output_source == NULL);
+
+    emulator->output_delay_us = delay_us;
+
+    /* Destroyed in dispose, so it doesn't need a reference to the emulator */
+    emulator->output_source = g_unix_fd_source_new(emulator->device_fd, G_IO_IN | G_IO_HUP | G_IO_ERR);
+    g_source_set_callback(emulator->output_source,
+                          G_SOURCE_FUNC(liquid_emulator_nzxt_smart2_output_report),
+                          emulator,
+                          NULL);
+    g_source_attach(emulator->output_source, context);
+}
+
+void
+liquid_emulator_nzxt_smart2_start(LiquidEmulatorNzxtSmart2 *emulator, guint interval_ms)
+{
+    g_return_if_fail(LIQUID_IS_EMULATOR_NZXT_SMART2(emulator));
+
+    for (guint i = 0; i < LIQUID_EMULATOR_NZXT_SMART2_FAN_CHANNELS; i++)
+    {
+        emulator->rpm[i] = 1000;
+    }
+
+    liquid_emulator_nzxt_smart2_serve_output(emulator, NULL, 0);
+    emulator->update_interval_ms = interval_ms;
+    emulator->update_source_id = g_timeout_add(interval_ms, liquid_emulator_nzxt_smart2_update, emulator);
+}
+
+GArray *
+liquid_emulator_nzxt_smart2_take_led_frame_times(LiquidEmulatorNzxtSmart2 *emulator)
+{
+    g_return_val_if_fail(LIQUID_IS_EMULATOR_NZXT_SMART2(emulator), NULL);
+
+    g_mutex_lock(&emulator->led_mutex);
+
+    GArray *times = emulator->led_frame_times;
+    emulator->led_frame_times = g_array_new(FALSE, FALSE, sizeof(gint64));
+
+    g_mutex_unlock(&emulator->led_mutex);
+
+    return times;
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <gio/gio.h>
+
+#include "hid_device_info.h"
+
+G_BEGIN_DECLS
+
+/*
+ * Device side of an emulated NZXT RGB & Fan Controller, connected to the
+ * driver through a SOCK_SEQPACKET socket pair, which keeps report boundaries
+ * like hidraw does.
+ */
+#define LIQUID_TYPE_EMULATOR_NZXT_SMART2 (liquid_emulator_nzxt_smart2_get_type())
+G_DECLARE_FINAL_TYPE(LiquidEmulatorNzxtSmart2, liquid_emulator_nzxt_smart2, LIQUID, EMULATOR_NZXT_SMART2, GObject)
+
+#define LIQUID_EMULATOR_NZXT_SMART2_FAN_CHANNELS 3
+
+LiquidEmulatorNzxtSmart2 *
+liquid_emulator_nzxt_smart2_new(guint index, GError **error);
+
+/* Info describing the emulated device, with a unique hidraw and USB path per index */
+LiquidHidDeviceInfo *
+liquid_emulator_nzxt_smart2_dup_device_info(LiquidEmulatorNzxtSmart2 *emulator);
+
+/* Driver end of the socket pair; the caller owns it. Can only be called once. */
+int
+liquid_emulator_nzxt_smart2_steal_device_fd(LiquidEmulatorNzxtSmart2 *emulator);
+
+/*
+ * Makes the device behave on its own: answer fan detection commands from the
+ * driver and send fan speeds, voltages and currents every interval_ms, on the
+ * global default context.
+ */
+void
+liquid_emulator_nzxt_smart2_start(LiquidEmulatorNzxtSmart2 *emulator, guint interval_ms);
+
+/*
+ * Only answers the driver's output reports, on `context` (NULL for the global
+ * default one), taking delay_us for each like a slow USB endpoint would.
+ */
+void
+liquid_emulator_nzxt_smart2_serve_output(LiquidEmulatorNzxtSmart2 *emulator, GMainContext *context, guint delay_us);
+
+/*
+ * Monotonic times at which frames were applied to the first LED channel since
+ * the last call. Thread safe.
+ */
+GArray *
+liquid_emulator_nzxt_smart2_take_led_frame_times(LiquidEmulatorNzxtSmart2 *emulator);
+
+/* Fails with G_IO_ERROR_WOULD_BLOCK while the driver hasn't caught up */
+gboolean
+liquid_emulator_nzxt_smart2_send_fan_speed(LiquidEmulatorNzxtSmart2 *emulator,
+                                           const guint16 rpm[LIQUID_EMULATOR_NZXT_SMART2_FAN_CHANNELS],
+                                           GError **error);
+
+G_END_DECLS
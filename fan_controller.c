@@ -0,0 +1,459 @@
+#include "fan_controller.h"
+
+#include <string.h>
+
+#include "metrics.h"
+#include "spec.h"
+
+struct _LiquidFanController
+{
+    GObject parent;
+
+    LiquidDriver *driver;
+    guint channel;
+    gchar *name;
+    gchar *metric_labels;
+
+    gchar *sensor_path;
+    LiquidPidParameters parameters;
+    LiquidPidState state;
+    gint64 last_update;
+    guint source_id;
+
+    gdouble temperature;
+    gint duty;
+
+    guint64 updates;
+    guint64 duty_writes;
+    guint64 sensor_errors;
+    guint64 write_errors;
+
+    /* Errors are reported once when they start, not on every update */
+    gboolean sensor_failing;
+    gboolean write_failing;
+};
+
+G_DEFINE_FINAL_TYPE(LiquidFanController, liquid_fan_controller, G_TYPE_OBJECT)
+
+static gboolean
+parse_double(const gchar *spec, const gchar *token, const gchar *what, gdouble *value, GError **error)
+{
+    gchar *end = NULL;
+
+    if (token == NULL)
+    {
+        g_set_error(error, G_OPTION_ERROR, G_OPTION_ERROR_BAD_VALUE, "Fan control '%s': expected %s", spec, what);
+        return FALSE;
+    }
+
+    *value = g_ascii_strtod(token, &end);
+
+    if (*end != '\0' || end == token)
+    {
+        g_set_error(error,
+                    G_OPTION_ERROR,
+                    G_OPTION_ERROR_BAD_VALUE,
+                    "Fan control '%s': '%s' is not a valid %s",
+                    spec,
+                    token,
+                    what);
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+LiquidFanControl *
+liquid_fan_control_parse(const gchar *spec, GError **error)
+{
+    g_return_val_if_fail(spec != NULL, NULL);
+
+    const gchar *colon = strchr(spec, ':');
+
+    if (colon == NULL || colon == spec)
+    {
+        g_set_error(error, G_OPTION_ERROR, G_OPTION_ERROR_BAD_VALUE, "Fan control '%s': expected CHANNEL: first", spec);
+        return NULL;
+    }
+
+    g_autoptr(LiquidFanControl) control = g_new0(LiquidFanControl, 1);
+    g_auto(GStrv) tokens = liquid_spec_tokenize(colon + 1, NULL);
+    guint n_tokens = g_strv_length(tokens);
+    gboolean has_target = FALSE;
+
+    control->channel = g_strndup(spec, (gsize)(colon - spec));
+    liquid_pid_parameters_init(&control->pid);
+
+    const struct
+    {
+        const gchar *keyword;
+        gdouble *value;
+    } keywords[] = {
+        { "target", &control->pid.setpoint },
+        { "kp", &control->pid.kp },
+        { "ki", &control->pid.ki },
+        { "kd", &control->pid.kd },
+        { "deadband", &control->pid.deadband },
+        { "rate", &control->pid.max_rate },
+        { "min", &control->pid.min_output },
+        { "max", &control->pid.max_output },
+    };
+
+    control->sensor_path = g_strdup(tokens[0]);
+
+    for (guint i = 1; i < n_tokens; i += 2)
+    {
+        guint k = 0;
+
+        while (k < G_N_ELEMENTS(keywords) && !g_str_equal(tokens[i], keywords[k].keyword))
+        {
+            k++;
+        }
+
+        if (k == G_N_ELEMENTS(keywords))
+        {
+            g_set_error(error, G_OPTION_ERROR, G_OPTION_ERROR_BAD_VALUE, "Fan control '%s': unexpected '%s'", spec, tokens[i]);
+            return NULL;
+        }
+
+        if (!parse_double(spec, tokens[i + 1], keywords[k].keyword, keywords[k].value, error))
+        {
+            return NULL;
+        }
+
+        has_target |= k == 0;
+    }
+
+    if (control->sensor_path == NULL || !has_target)
+    {
+        g_set_error(error, G_OPTION_ERROR, G_OPTION_ERROR_BAD_VALUE, "Fan control '%s': expected SENSOR target T", spec);
+        return NULL;
+    }
+
+    const LiquidPidParameters *pid = &control->pid;
+
+    if (pid->deadband < 0 || pid->max_rate < 0 || pid->min_output < 0 || pid->max_output > 100
+        || pid->min_output > pid->max_output)
+    {
+        g_set_error(error,
+                    G_OPTION_ERROR,
+                    G_OPTION_ERROR_BAD_VALUE,
+                    "Fan control '%s': expected 0 <= min <= max <= 100 and non-negative deadband and rate",
+                    spec);
+        return NULL;
+    }
+
+    return g_steal_pointer(&control);
+}
+
+void
+liquid_fan_control_free(LiquidFanControl *control)
+{
+    g_free(control->channel);
+    g_free(control->sensor_path);
+    g_free(control);
+}
+
+const LiquidFanControl *
+liquid_fan_control_lookup(GPtrArray *controls, const gchar *channel)
+{
+    g_return_val_if_fail(channel != NULL, NULL);
+
+    for (guint i = 0; controls && i < controls->len; i++)
+    {
+        const LiquidFanControl *control = g_ptr_array_index(controls, i);
+
+        if (g_str_equal(control->channel, channel))
+        {
+            return control;
+        }
+    }
+
+    return NULL;
+}
+
+static gboolean
+liquid_fan_controller_read_sensor(LiquidFanController *controller, gdouble *temperature, GError **error)
+{
+    g_autofree gchar *contents = NULL;
+    gchar *end = NULL;
+
+    if (!g_file_get_contents(controller->sensor_path, &contents, NULL, error))
+    {
+        return FALSE;
+    }
+
+    gint64 millidegrees = g_ascii_strtoll(contents, &end, 10);
+
+    if (end == contents)
+    {
+        g_set_error(error,
+                    G_IO_ERROR,
+                    G_IO_ERROR_INVALID_DATA,
+                    "%s doesn't hold a temperature",
+                    controller->sensor_path);
+        return FALSE;
+    }
+
+    *temperature = (gdouble)millidegrees / 1000.0;
+
+    return TRUE;
+}
+
+static gboolean
+liquid_fan_controller_update(gpointer user_data)
+{
+    LiquidFanController *controller = user_data;
+    g_autoptr(GError) error = NULL;
+    gint64 now = g_get_monotonic_time();
+    gdouble dt = controller->last_update ? (gdouble)(now - controller->last_update) / G_USEC_PER_SEC : 0.0;
+    gdouble output;
+
+    controller->last_update = now;
+    controller->updates++;
+
+    if (liquid_fan_controller_read_sensor(controller, &controller->temperature, &error))
+    {
+        controller->sensor_failing = FALSE;
+        output = liquid_pid_update(&controller->parameters, &controller->state, controller->temperature, dt);
+    }
+    else
+    {
+        controller->sensor_errors++;
+
+        if (!controller->sensor_failing)
+        {
+            g_printerr("%s: can't read temperature, running at full duty: %s\n", controller->name, error->message);
+            controller->sensor_failing = TRUE;
+        }
+
+        /* Ramps down from there once the sensor is back */
+        output = controller->parameters.max_output;
+        controller->state.output = output;
+        g_clear_error(&error);
+    }
+
+    gint duty = liquid_pid_quantize(output, controller->duty);
+
+    if (duty == controller->duty)
+    {
+        return G_SOURCE_CONTINUE;
+    }
+
+    if (!liquid_driver_set_duty(controller->driver, controller->channel, (guint)duty, &error))
+    {
+        controller->write_errors++;
+
+        if (!controller->write_failing)
+        {
+            g_printerr("%s: %s\n", controller->name, error->message);
+            controller->write_failing = TRUE;
+        }
+
+        return G_SOURCE_CONTINUE;
+    }
+
+    controller->write_failing = FALSE;
+    controller->duty_writes++;
+    controller->duty = duty;
+
+    return G_SOURCE_CONTINUE;
+}
+
+static void
+liquid_fan_controller_dispose(GObject *object)
+{
+    LiquidFanController *controller = LIQUID_FAN_CONTROLLER(object);
+
+    g_clear_handle_id(&controller->source_id, g_source_remove);
+    g_clear_object(&controller->driver);
+
+    G_OBJECT_CLASS(liquid_fan_controller_parent_class)->dispose(object);
+}
+
+static void
+liquid_fan_controller_finalize(GObject *object)
+{
+    LiquidFanController *controller = LIQUID_FAN_CONTROLLER(object);
+
+    g_free(controller->name);
+    g_free(controller->metric_labels);
+    g_free(controller->sensor_path);
+
+    G_OBJECT_CLASS(liquid_fan_controller_parent_class)->finalize(object);
+}
+
+static void
+liquid_fan_controller_init(LiquidFanController *controller)
+{
+    controller->duty = -1;
+}
+
+static void
+liquid_fan_controller_class_init(LiquidFanControllerClass *class)
+{
+    GObjectClass *gobject_class = G_OBJECT_CLASS(class);
+
+    gobject_class->dispose = liquid_fan_controller_dispose;
+    gobject_class->finalize = liquid_fan_controller_finalize;
+}
+
+LiquidFanController *
+liquid_fan_controller_new(LiquidDriver *driver, guint channel, const LiquidFanControl *control, guint interval_ms)
+{
+    g_return_val_if_fail(LIQUID_IS_DRIVER(driver), NULL);
+    g_return_val_if_fail(liquid_driver_get_channel_type(driver, channel) == LIQUID_CHANNEL_DUTY_PERCENT, NULL);
+    g_return_val_if_fail(control != NULL, NULL);
+    g_return_val_if_fail(interval_ms > 0, NULL);
+
+    LiquidFanController *controller = g_object_new(LIQUID_TYPE_FAN_CONTROLLER, NULL);
+    g_autofree gchar *object_name = LIQUID_DRIVER_GET_CLASS(driver)->dup_object_name(driver);
+    const gchar *channel_name = liquid_driver_get_channel_name(driver, channel);
+
+    controller->driver = g_object_ref(driver);
+    controller->channel = channel;
+    controller->name = g_strdup_printf("%s/%s", object_name, channel_name);
+    controller->metric_labels = g_strdup_printf("device=\"%s\",channel=\"%s\"", object_name, channel_name);
+    controller->sensor_path = g_strdup(control->sensor_path);
+    controller->parameters = control->pid;
+
+    /* Removed in dispose, so it doesn't need a reference */
+    controller->source_id = g_timeout_add(interval_ms, liquid_fan_controller_update, controller);
+
+    return controller;
+}
+
+GVariant *
+liquid_fan_controller_dup_statistics(LiquidFanController *controller)
+{
+    g_return_val_if_fail(LIQUID_IS_FAN_CONTROLLER(controller), NULL);
+
+    g_auto(GVariantDict) dict = G_VARIANT_DICT_INIT(NULL);
+
+    g_variant_dict_insert(&dict, "temperature", "d", controller->temperature);
+    g_variant_dict_insert(&dict, "duty", "i", controller->duty);
+    g_variant_dict_insert(&dict, "updates", "t", controller->updates);
+    g_variant_dict_insert(&dict, "duty-writes", "t", controller->duty_writes);
+    g_variant_dict_insert(&dict, "sensor-errors", "t", controller->sensor_errors);
+    g_variant_dict_insert(&dict, "write-errors", "t", controller->write_errors);
+
+    return g_variant_dict_end(&dict);
+}
+
+const gchar *
+liquid_fan_controller_get_name(LiquidFanController *controller)
+{
+    g_return_val_if_fail(LIQUID_IS_FAN_CONTROLLER(controller), NULL);
+
+    return controller->name;
+}
+
+LiquidDriver *
+liquid_fan_controller_get_driver(LiquidFanController *controller)
+{
+    g_return_val_if_fail(LIQUID_IS_FAN_CONTROLLER(controller), NULL);
+
+    return controller->driver;
+}
+
+guint
+liquid_fan_controller_get_channel(LiquidFanController *controller)
+{
+    g_return_val_if_fail(LIQUID_IS_FAN_CONTROLLER(controller), G_MAXUINT);
+
+    return controller->channel;
+}
+
+void
+liquid_fan_controller_set_control(LiquidFanController *controller, const LiquidFanControl *control)
+{
+    g_return_if_fail(LIQUID_IS_FAN_CONTROLLER(controller));
+    g_return_if_fail(control != NULL);
+
+    /* The integral and last output were built up against another temperature */
+    if (g_strcmp0(controller->sensor_path, control->sensor_path) != 0)
+    {
+        g_free(controller->sensor_path);
+        controller->sensor_path = g_strdup(control->sensor_path);
+        controller->state = (LiquidPidState){ 0 };
+        controller->sensor_failing = FALSE;
+    }
+
+    controller->parameters = control->pid;
+}
+
+typedef struct
+{
+    const gchar *name;
+    const gchar *type;
+    const gchar *help;
+    gdouble (*get)(LiquidFanController *controller);
+} LiquidFanControllerMetric;
+
+static gdouble
+get_temperature(LiquidFanController *controller)
+{
+    return controller->temperature;
+}
+
+static gdouble
+get_duty(LiquidFanController *controller)
+{
+    return controller->duty;
+}
+
+static gdouble
+get_updates(LiquidFanController *controller)
+{
+    return (gdouble)controller->updates;
+}
+
+static gdouble
+get_duty_writes(LiquidFanController *controller)
+{
+    return (gdouble)controller->duty_writes;
+}
+
+static gdouble
+get_sensor_errors(LiquidFanController *controller)
+{
+    return (gdouble)controller->sensor_errors;
+}
+
+static gdouble
+get_write_errors(LiquidFanController *controller)
+{
+    return (gdouble)controller->write_errors;
+}
+
+static const LiquidFanControllerMetric metrics[] = {
+    { "liquidd_fan_control_temperature_celsius", "gauge", "Last temperature read by the fan controller.", get_temperature },
+    { "liquidd_fan_control_duty_percent", "gauge", "Last duty set by the fan controller, -1 if none yet.", get_duty },
+    { "liquidd_fan_control_updates_total", "counter", "Fan controller updates.", get_updates },
+    { "liquidd_fan_control_duty_writes_total", "counter", "Duty changes written to the device.", get_duty_writes },
+    { "liquidd_fan_control_sensor_errors_total", "counter", "Failed temperature reads.", get_sensor_errors },
+    { "liquidd_fan_control_write_errors_total", "counter", "Duty changes that failed to be written.", get_write_errors },
+};
+
+void
+liquid_fan_controller_append_metrics(GPtrArray *controllers, GString *out)
+{
+    g_return_if_fail(controllers != NULL);
+
+    if (controllers->len == 0)
+    {
+        return;
+    }
+
+    for (guint i = 0; i < G_N_ELEMENTS(metrics); i++)
+    {
+        liquid_metrics_append_family(out, metrics[i].name, metrics[i].type, metrics[i].help);
+
+        for (guint j = 0; j < controllers->len; j++)
+        {
+            LiquidFanController *controller = g_ptr_array_index(controllers, j);
+
+            liquid_metrics_append_sample(out, metrics[i].name, controller->metric_labels, metrics[i].get(controller));
+        }
+    }
+}
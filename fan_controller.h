@@ -0,0 +1,80 @@
+#pragma once
+
+#include <glib-object.h>
+
+#include "driver.h"
+#include "pid_controller.h"
+
+G_BEGIN_DECLS
+
+/*
+ * Closed-loop control of a fan channel toward a target temperature, parsed
+ * from
+ *
+ *     CHANNEL: SENSOR target T [kp KP] [ki KI] [kd KD] [deadband D] [rate R] [min MIN] [max MAX]
+ *
+ * where SENSOR is a file holding a temperature in millidegrees Celsius, such
+ * as a hwmon temp*_input attribute, and the rest are LiquidPidParameters.
+ */
+typedef struct
+{
+    gchar *channel;
+    gchar *sensor_path;
+    LiquidPidParameters pid;
+} LiquidFanControl;
+
+LiquidFanControl *
+liquid_fan_control_parse(const gchar *spec, GError **error);
+
+void
+liquid_fan_control_free(LiquidFanControl *control);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC(LiquidFanControl, liquid_fan_control_free)
+
+/* The control of `channel` in a LiquidFanControl array, or NULL */
+const LiquidFanControl *
+liquid_fan_control_lookup(GPtrArray *controls, const gchar *channel);
+
+/*
+ * Reads the sensor every interval and sets the duty of the channel, but only
+ * when the duty rounded to whole percent changes. Runs the fan at the maximum
+ * duty while the sensor can't be read.
+ */
+#define LIQUID_TYPE_FAN_CONTROLLER (liquid_fan_controller_get_type())
+G_DECLARE_FINAL_TYPE(LiquidFanController, liquid_fan_controller, LIQUID, FAN_CONTROLLER, GObject)
+
+/* `channel` is a LIQUID_CHANNEL_DUTY_PERCENT channel of the driver */
+LiquidFanController *
+liquid_fan_controller_new(LiquidDriver *driver, guint channel, const LiquidFanControl *control, guint interval_ms);
+
+/*
+ * Returns an a{sv} dictionary with the last "temperature" (d) and "duty" (i,
+ * -1 before the first one is set), and counters "updates", "duty-writes",
+ * "sensor-errors" and "write-errors" (t).
+ */
+GVariant *
+liquid_fan_controller_dup_statistics(LiquidFanController *controller);
+
+/* Device and channel, as device/channel */
+const gchar *
+liquid_fan_controller_get_name(LiquidFanController *controller);
+
+LiquidDriver *
+liquid_fan_controller_get_driver(LiquidFanController *controller);
+
+guint
+liquid_fan_controller_get_channel(LiquidFanController *controller);
+
+/*
+ * Switches to another control of the same channel. The PID state carries
+ * over unless the sensor changes, so that retuning doesn't restart the fan
+ * from the minimum duty.
+ */
+void
+liquid_fan_controller_set_control(LiquidFanController *controller, const LiquidFanControl *control);
+
+/* The statistics of a LiquidFanController array as Prometheus metric families, see metrics.h */
+void
+liquid_fan_controller_append_metrics(GPtrArray *controllers, GString *out);
+
+G_END_DECLS
@@ -0,0 +1,273 @@
+#include "filter.h"
+
+#include <string.h>
+
+#include "spec.h"
+
+typedef struct
+{
+    LiquidFilterStage stage;
+
+    /* No sample yet: the first one passes through every stage unchanged */
+    gboolean started;
+    gdouble value;
+    gint64 time;
+
+    /* Median window, in arrival order and sorted */
+    gdouble *window;
+    gdouble *sorted;
+    guint count;
+    guint next;
+} FilterStageState;
+
+struct _LiquidFilterChain
+{
+    guint n_stages;
+    FilterStageState stages[];
+};
+
+static gboolean
+parse_stage(const gchar *spec, gchar **tokens, guint *next, LiquidFilterStage *stage, GError **error)
+{
+    const struct
+    {
+        const gchar *name;
+        LiquidFilterStageType type;
+        gdouble min;
+        gdouble max;
+    } stage_types[] = {
+        { "ema", LIQUID_FILTER_EMA, G_MINDOUBLE, 1.0 },
+        { "median", LIQUID_FILTER_MEDIAN, 1.0, LIQUID_FILTER_MAX_MEDIAN },
+        { "slew", LIQUID_FILTER_SLEW, G_MINDOUBLE, G_MAXDOUBLE },
+    };
+    const gchar *name = tokens[(*next)++];
+    const gchar *argument = tokens[*next];
+    guint i = 0;
+
+    while (i < G_N_ELEMENTS(stage_types) && !g_str_equal(name, stage_types[i].name))
+    {
+        i++;
+    }
+
+    if (i == G_N_ELEMENTS(stage_types))
+    {
+        g_set_error(error,
+                    G_OPTION_ERROR,
+                    G_OPTION_ERROR_BAD_VALUE,
+                    "Filter '%s': unknown stage '%s', expected ema, median or slew",
+                    spec,
+                    name);
+        return FALSE;
+    }
+
+    gchar *end = NULL;
+
+    stage->type = stage_types[i].type;
+    stage->parameter = argument ? g_ascii_strtod(argument, &end) : 0.0;
+
+    if (argument == NULL || *end != '\0' || end == argument || stage->parameter < stage_types[i].min
+        || stage->parameter > stage_types[i].max
+        || (stage->type == LIQUID_FILTER_MEDIAN && stage->parameter != (guint)stage->parameter))
+    {
+        g_set_error(error,
+                    G_OPTION_ERROR,
+                    G_OPTION_ERROR_BAD_VALUE,
+                    "Filter '%s': invalid or missing argument to %s",
+                    spec,
+                    name);
+        return FALSE;
+    }
+
+    (*next)++;
+
+    return TRUE;
+}
+
+LiquidFilterSpec *
+liquid_filter_spec_parse(const gchar *spec, GError **error)
+{
+    g_return_val_if_fail(spec != NULL, NULL);
+
+    const gchar *colon = strchr(spec, ':');
+    g_autoptr(LiquidFilterSpec) filter = g_new0(LiquidFilterSpec, 1);
+
+    filter->name = colon ? g_strndup(spec, (gsize)(colon - spec)) : NULL;
+
+    if (filter->name == NULL || !liquid_spec_is_valid_name(filter->name))
+    {
+        g_set_error(error,
+                    G_OPTION_ERROR,
+                    G_OPTION_ERROR_BAD_VALUE,
+                    "Filter '%s': expected NAME: first, of letters, digits and underscores",
+                    spec);
+        return NULL;
+    }
+
+    /* Stage separators are optional */
+    g_auto(GStrv) tokens = liquid_spec_tokenize(colon + 1, "|");
+    guint n_tokens = g_strv_length(tokens);
+
+    if (n_tokens < 3)
+    {
+        g_set_error(error, G_OPTION_ERROR, G_OPTION_ERROR_BAD_VALUE, "Filter '%s': expected CHANNEL TYPE STAGE", spec);
+        return NULL;
+    }
+
+    filter->channel_pattern = g_pattern_spec_new(tokens[0]);
+    filter->type = liquid_channel_type_from_nick(tokens[1]);
+
+    if (filter->type == LIQUID_CHANNEL_N_TYPES)
+    {
+        g_set_error(error,
+                    G_OPTION_ERROR,
+                    G_OPTION_ERROR_BAD_VALUE,
+                    "Filter '%s': unknown channel type '%s'",
+                    spec,
+                    tokens[1]);
+        return NULL;
+    }
+
+    guint next = 2;
+
+    while (tokens[next])
+    {
+        if (filter->n_stages == LIQUID_FILTER_MAX_STAGES)
+        {
+            g_set_error(error,
+                        G_OPTION_ERROR,
+                        G_OPTION_ERROR_BAD_VALUE,
+                        "Filter '%s': more than %d stages",
+                        spec,
+                        LIQUID_FILTER_MAX_STAGES);
+            return NULL;
+        }
+
+        if (!parse_stage(spec, tokens, &next, &filter->stages[filter->n_stages++], error))
+        {
+            return NULL;
+        }
+    }
+
+    return g_steal_pointer(&filter);
+}
+
+void
+liquid_filter_spec_free(LiquidFilterSpec *spec)
+{
+    g_free(spec->name);
+    g_clear_pointer(&spec->channel_pattern, g_pattern_spec_free);
+    g_free(spec);
+}
+
+LiquidFilterChain *
+liquid_filter_chain_new(const LiquidFilterSpec *spec)
+{
+    g_return_val_if_fail(spec != NULL, NULL);
+
+    LiquidFilterChain *chain = g_malloc0(sizeof(LiquidFilterChain) + spec->n_stages * sizeof(FilterStageState));
+
+    chain->n_stages = spec->n_stages;
+
+    for (guint i = 0; i < spec->n_stages; i++)
+    {
+        FilterStageState *state = &chain->stages[i];
+
+        state->stage = spec->stages[i];
+
+        if (state->stage.type == LIQUID_FILTER_MEDIAN)
+        {
+            state->window = g_new(gdouble, (guint)state->stage.parameter);
+            state->sorted = g_new(gdouble, (guint)state->stage.parameter);
+        }
+    }
+
+    return chain;
+}
+
+void
+liquid_filter_chain_free(LiquidFilterChain *chain)
+{
+    for (guint i = 0; i < chain->n_stages; i++)
+    {
+        g_free(chain->stages[i].window);
+        g_free(chain->stages[i].sorted);
+    }
+
+    g_free(chain);
+}
+
+/* Keeps `sorted` sorted by moving the elements between the old and new positions by one */
+static gdouble
+median_update(FilterStageState *state, gdouble value)
+{
+    guint size = (guint)state->stage.parameter;
+    guint position;
+
+    if (state->count == size)
+    {
+        gdouble oldest = state->window[state->next];
+
+        position = 0;
+
+        while (state->sorted[position] != oldest)
+        {
+            position++;
+        }
+
+        memmove(&state->sorted[position], &state->sorted[position + 1], (state->count - position - 1) * sizeof(gdouble));
+        state->count--;
+    }
+
+    position = state->count;
+
+    while (position > 0 && state->sorted[position - 1] > value)
+    {
+        state->sorted[position] = state->sorted[position - 1];
+        position--;
+    }
+
+    state->sorted[position] = value;
+    state->count++;
+    state->window[state->next] = value;
+    state->next = (state->next + 1) % size;
+
+    return state->count % 2 ? state->sorted[state->count / 2]
+                            : (state->sorted[state->count / 2 - 1] + state->sorted[state->count / 2]) / 2.0;
+}
+
+gdouble
+liquid_filter_chain_update(LiquidFilterChain *chain, gdouble value, gint64 time_us)
+{
+    g_return_val_if_fail(chain != NULL, value);
+
+    for (guint i = 0; i < chain->n_stages; i++)
+    {
+        FilterStageState *state = &chain->stages[i];
+
+        switch (state->stage.type)
+        {
+        case LIQUID_FILTER_EMA:
+            value = state->started ? state->value + state->stage.parameter * (value - state->value) : value;
+            break;
+
+        case LIQUID_FILTER_MEDIAN:
+            value = median_update(state, value);
+            break;
+
+        case LIQUID_FILTER_SLEW:
+            if (state->started)
+            {
+                gdouble step = state->stage.parameter * (gdouble)(time_us - state->time) / G_USEC_PER_SEC;
+
+                value = CLAMP(value, state->value - step, state->value + step);
+            }
+            break;
+        }
+
+        state->started = TRUE;
+        state->value = value;
+        state->time = time_us;
+    }
+
+    return value;
+}
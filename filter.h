@@ -0,0 +1,67 @@
+#pragma once
+
+#include <glib.h>
+
+#include "driver.h"
+
+G_BEGIN_DECLS
+
+#define LIQUID_FILTER_MAX_STAGES 8
+#define LIQUID_FILTER_MAX_MEDIAN 63
+
+typedef enum
+{
+    /* Exponential moving average with smoothing factor `parameter`, in (0, 1] */
+    LIQUID_FILTER_EMA,
+    /* Median of the last `parameter` samples */
+    LIQUID_FILTER_MEDIAN,
+    /* At most `parameter` units of change per second */
+    LIQUID_FILTER_SLEW,
+} LiquidFilterStageType;
+
+typedef struct
+{
+    LiquidFilterStageType type;
+    gdouble parameter;
+} LiquidFilterStage;
+
+/*
+ * A chain of filters applied to the channels it matches, parsed from
+ *
+ *     NAME: CHANNEL TYPE STAGE [| STAGE]...
+ *
+ * where CHANNEL is a glob, TYPE a channel type nick and each STAGE one of
+ * `ema ALPHA`, `median N` or `slew RATE`, applied in order. NAME may only
+ * hold letters, digits and underscores, as it ends up in object paths.
+ */
+typedef struct
+{
+    gchar *name;
+    GPatternSpec *channel_pattern;
+    LiquidChannelType type;
+    LiquidFilterStage stages[LIQUID_FILTER_MAX_STAGES];
+    guint n_stages;
+} LiquidFilterSpec;
+
+LiquidFilterSpec *
+liquid_filter_spec_parse(const gchar *spec, GError **error);
+
+void
+liquid_filter_spec_free(LiquidFilterSpec *spec);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC(LiquidFilterSpec, liquid_filter_spec_free)
+
+/* The state of a spec's filters for one channel */
+typedef struct _LiquidFilterChain LiquidFilterChain;
+
+LiquidFilterChain *
+liquid_filter_chain_new(const LiquidFilterSpec *spec);
+
+void
+liquid_filter_chain_free(LiquidFilterChain *chain);
+
+/* Feeds a sample taken at `time_us` (monotonic) and returns the output; doesn't allocate */
+gdouble
+liquid_filter_chain_update(LiquidFilterChain *chain, gdouble value, gint64 time_us);
+
+G_END_DECLS
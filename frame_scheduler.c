@@ -0,0 +1,494 @@
+#include "frame_scheduler.h"
+
+#include "histogram.h"
+#include "metrics.h"
+
+#define MAX_FRAME_RATE 240
+
+typedef struct
+{
+    LiquidDriverHid *driver;
+    guint channel;
+    LiquidLedEffect effect;
+    guint n_leds;
+    guint8 *rgb;
+
+    /* Device and channel, for statistics and as Prometheus labels */
+    gchar *name;
+    gchar *metric_labels;
+
+    /* Encoded frame, only touched by the worker while the scheduler is flushing */
+    GByteArray *reports;
+    gsize report_size;
+    LiquidHidDevice *device;
+    gint64 shown_time;
+    GError *error;
+
+    /* From the first frame of a tick being shown to this one */
+    LiquidHistogram *skew;
+
+    /* Reported once when writes start failing, not for every frame */
+    gboolean failing;
+} FrameTarget;
+
+typedef struct
+{
+    GSource source;
+    LiquidFrameScheduler *scheduler;
+} TickSource;
+
+struct _LiquidFrameScheduler
+{
+    GObject parent;
+
+    guint frame_rate;
+    GSource *source;
+    gint64 start_time;
+    guint64 tick;
+
+    GPtrArray *targets;
+
+    /* What the worker writes, kept so that ticks don't allocate */
+    GPtrArray *flush;
+    gboolean flushing;
+    gint64 flush_due_time;
+
+    guint64 ticks;
+    guint64 skipped_ticks;
+    guint64 frames;
+    guint64 dropped_frames;
+    guint64 write_errors;
+    LiquidHistogram *tick_lag;
+    LiquidHistogram *frame_latency;
+    LiquidHistogram *skew;
+};
+
+G_DEFINE_FINAL_TYPE(LiquidFrameScheduler, liquid_frame_scheduler, G_TYPE_OBJECT)
+
+enum
+{
+    PROP_0,
+    PROP_FRAME_RATE,
+    N_PROPERTIES
+};
+
+static GParamSpec *pspecs[N_PROPERTIES];
+
+static void
+frame_target_free(gpointer data)
+{
+    FrameTarget *target = data;
+
+    g_object_unref(target->driver);
+    g_free(target->rgb);
+    g_free(target->name);
+    g_free(target->metric_labels);
+    g_byte_array_unref(target->reports);
+    liquid_histogram_free(target->skew);
+    g_free(target);
+}
+
+/* Due time of a tick; computed from the start rather than accumulated, so it doesn't drift */
+static gint64
+liquid_frame_scheduler_due_time(LiquidFrameScheduler *scheduler, guint64 tick)
+{
+    return scheduler->start_time + (gint64)(tick * G_USEC_PER_SEC / scheduler->frame_rate);
+}
+
+/*
+ * Runs on a worker thread. Reports that only load a frame go first, device by
+ * device; the last report of each frame, which shows it, then goes out for
+ * all of them back to back, so that they change as close together as writes
+ * allow.
+ */
+static void
+liquid_frame_scheduler_write_flush(GTask *task,
+                                   gpointer source_object,
+                                   gpointer task_data G_GNUC_UNUSED,
+                                   GCancellable *cancellable G_GNUC_UNUSED)
+{
+    LiquidFrameScheduler *scheduler = LIQUID_FRAME_SCHEDULER(source_object);
+
+    for (guint i = 0; i < scheduler->flush->len; i++)
+    {
+        FrameTarget *target = g_ptr_array_index(scheduler->flush, i);
+        guint last = target->reports->len - (guint)target->report_size;
+
+        for (guint offset = 0; offset < last && target->error == NULL; offset += (guint)target->report_size)
+        {
+            liquid_hid_device_output_report(target->device,
+                                            target->reports->data + offset,
+                                            target->report_size,
+                                            &target->error);
+        }
+    }
+
+    for (guint i = 0; i < scheduler->flush->len; i++)
+    {
+        FrameTarget *target = g_ptr_array_index(scheduler->flush, i);
+        guint last = target->reports->len - (guint)target->report_size;
+
+        if (target->error == NULL
+            && liquid_hid_device_output_report(target->device,
+                                               target->reports->data + last,
+                                               target->report_size,
+                                               &target->error))
+        {
+            target->shown_time = g_get_monotonic_time();
+        }
+    }
+
+    g_task_return_boolean(task, TRUE);
+}
+
+static void
+liquid_frame_scheduler_flushed(GObject *source_object, GAsyncResult *result G_GNUC_UNUSED, gpointer user_data G_GNUC_UNUSED)
+{
+    LiquidFrameScheduler *scheduler = LIQUID_FRAME_SCHEDULER(source_object);
+    gint64 first_shown = G_MAXINT64;
+    gint64 last_shown = G_MININT64;
+
+    for (guint i = 0; i < scheduler->flush->len; i++)
+    {
+        FrameTarget *target = g_ptr_array_index(scheduler->flush, i);
+
+        if (target->error == NULL)
+        {
+            first_shown = MIN(first_shown, target->shown_time);
+            last_shown = MAX(last_shown, target->shown_time);
+        }
+    }
+
+    for (guint i = 0; i < scheduler->flush->len; i++)
+    {
+        FrameTarget *target = g_ptr_array_index(scheduler->flush, i);
+
+        g_clear_object(&target->device);
+
+        if (target->error)
+        {
+            scheduler->write_errors++;
+
+            if (!target->failing)
+            {
+                g_printerr("Can't write LED frame to %s: %s\n", target->name, target->error->message);
+                target->failing = TRUE;
+            }
+
+            g_clear_error(&target->error);
+            continue;
+        }
+
+        target->failing = FALSE;
+        scheduler->frames++;
+        liquid_histogram_add(scheduler->frame_latency, target->shown_time - scheduler->flush_due_time);
+        liquid_histogram_add(target->skew, target->shown_time - first_shown);
+    }
+
+    if (first_shown <= last_shown)
+    {
+        liquid_histogram_add(scheduler->skew, last_shown - first_shown);
+    }
+
+    g_ptr_array_set_size(scheduler->flush, 0);
+    scheduler->flushing = FALSE;
+}
+
+/* Every frame of a tick is computed and encoded before the first one is written */
+static void
+liquid_frame_scheduler_render(LiquidFrameScheduler *scheduler, gint64 due_time)
+{
+    /* The previous tick is still being written: this one would only queue behind it */
+    if (scheduler->flushing)
+    {
+        scheduler->dropped_frames += scheduler->targets->len;
+        return;
+    }
+
+    for (guint i = 0; i < scheduler->targets->len; i++)
+    {
+        FrameTarget *target = g_ptr_array_index(scheduler->targets, i);
+        LiquidHidDevice *device = liquid_driver_hid_get_device(target->driver);
+
+        /* Released along with a driver that's being disposed */
+        if (device == NULL)
+        {
+            scheduler->dropped_frames++;
+            continue;
+        }
+
+        liquid_led_effect_render(&target->effect, due_time, target->rgb, target->n_leds);
+
+        g_byte_array_set_size(target->reports, 0);
+        target->report_size
+            = liquid_driver_hid_encode_led_frame(target->driver, target->channel, target->rgb, target->n_leds, target->reports);
+        target->device = g_object_ref(device);
+
+        g_ptr_array_add(scheduler->flush, target);
+    }
+
+    scheduler->flushing = TRUE;
+    scheduler->flush_due_time = due_time;
+
+    g_autoptr(GTask) task = g_task_new(scheduler, NULL, liquid_frame_scheduler_flushed, NULL);
+
+    g_task_run_in_thread(task, liquid_frame_scheduler_write_flush);
+}
+
+static gboolean
+liquid_frame_scheduler_tick(GSource *source, GSourceFunc callback G_GNUC_UNUSED, gpointer user_data G_GNUC_UNUSED)
+{
+    LiquidFrameScheduler *scheduler = ((TickSource *)source)->scheduler;
+    gint64 now = g_get_monotonic_time();
+    gint64 due_time = liquid_frame_scheduler_due_time(scheduler, scheduler->tick);
+
+    liquid_histogram_add(scheduler->tick_lag, now - due_time);
+    scheduler->ticks++;
+
+    liquid_frame_scheduler_render(scheduler, due_time);
+
+    /*
+     * Skip ticks missed during a stall instead of rendering them back to back;
+     * due times are truncated, so a dispatch right on time can compute this tick again
+     */
+    guint64 next_tick = (guint64)(now - scheduler->start_time) * scheduler->frame_rate / G_USEC_PER_SEC + 1;
+
+    next_tick = MAX(next_tick, scheduler->tick + 1);
+
+    scheduler->skipped_ticks += next_tick - scheduler->tick - 1;
+    scheduler->tick = next_tick;
+
+    g_source_set_ready_time(source, liquid_frame_scheduler_due_time(scheduler, scheduler->tick));
+
+    return G_SOURCE_CONTINUE;
+}
+
+static GSourceFuncs tick_source_funcs = {
+    .dispatch = liquid_frame_scheduler_tick,
+};
+
+static void
+liquid_frame_scheduler_get_property(GObject *object, guint property_id, GValue *value, GParamSpec *pspec)
+{
+    LiquidFrameScheduler *scheduler = LIQUID_FRAME_SCHEDULER(object);
+
+    switch (property_id)
+    {
+    case PROP_FRAME_RATE:
+        g_value_set_uint(value, scheduler->frame_rate);
+        break;
+
+    default:
+        G_OBJECT_WARN_INVALID_PROPERTY_ID(object, property_id, pspec);
+    }
+}
+
+static void
+liquid_frame_scheduler_set_property(GObject *object, guint property_id, const GValue *value, GParamSpec *pspec)
+{
+    LiquidFrameScheduler *scheduler = LIQUID_FRAME_SCHEDULER(object);
+
+    switch (property_id)
+    {
+    case PROP_FRAME_RATE:
+        scheduler->frame_rate = g_value_get_uint(value);
+        break;
+
+    default:
+        G_OBJECT_WARN_INVALID_PROPERTY_ID(object, property_id, pspec);
+    }
+}
+
+static void
+liquid_frame_scheduler_dispose(GObject *object)
+{
+    LiquidFrameScheduler *scheduler = LIQUID_FRAME_SCHEDULER(object);
+
+    if (scheduler->source)
+    {
+        g_source_destroy(scheduler->source);
+        g_clear_pointer(&scheduler->source, g_source_unref);
+    }
+
+    G_OBJECT_CLASS(liquid_frame_scheduler_parent_class)->dispose(object);
+}
+
+/* Frames in flight hold a reference to the scheduler, so none are left by now */
+static void
+liquid_frame_scheduler_finalize(GObject *object)
+{
+    LiquidFrameScheduler *scheduler = LIQUID_FRAME_SCHEDULER(object);
+
+    g_ptr_array_unref(scheduler->flush);
+    g_ptr_array_unref(scheduler->targets);
+    liquid_histogram_free(scheduler->tick_lag);
+    liquid_histogram_free(scheduler->frame_latency);
+    liquid_histogram_free(scheduler->skew);
+
+    G_OBJECT_CLASS(liquid_frame_scheduler_parent_class)->finalize(object);
+}
+
+static void
+liquid_frame_scheduler_init(LiquidFrameScheduler *scheduler)
+{
+    scheduler->targets = g_ptr_array_new_with_free_func(frame_target_free);
+    scheduler->flush = g_ptr_array_new();
+    scheduler->tick_lag = liquid_histogram_new();
+    scheduler->frame_latency = liquid_histogram_new();
+    scheduler->skew = liquid_histogram_new();
+}
+
+static void
+liquid_frame_scheduler_class_init(LiquidFrameSchedulerClass *class)
+{
+    GObjectClass *gobject_class = G_OBJECT_CLASS(class);
+
+    gobject_class->dispose = liquid_frame_scheduler_dispose;
+    gobject_class->finalize = liquid_frame_scheduler_finalize;
+    gobject_class->get_property = liquid_frame_scheduler_get_property;
+    gobject_class->set_property = liquid_frame_scheduler_set_property;
+
+    pspecs[PROP_FRAME_RATE] = g_param_spec_uint("frame-rate", /* name */
+                                                "Frame rate", /* nick */
+                                                "Frames per second", /* blurb */
+                                                1, /* minimum */
+                                                MAX_FRAME_RATE, /* maximum */
+                                                30, /* default_value */
+                                                G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY | G_PARAM_STATIC_STRINGS);
+
+    g_object_class_install_properties(gobject_class, N_PROPERTIES, pspecs);
+}
+
+LiquidFrameScheduler *
+liquid_frame_scheduler_new(guint frame_rate)
+{
+    g_return_val_if_fail(frame_rate > 0 && frame_rate <= MAX_FRAME_RATE, NULL);
+
+    return g_object_new(LIQUID_TYPE_FRAME_SCHEDULER, "frame-rate", frame_rate, NULL);
+}
+
+void
+liquid_frame_scheduler_add(LiquidFrameScheduler *scheduler,
+                           LiquidDriverHid *driver,
+                           guint channel,
+                           const LiquidLedEffect *effect)
+{
+    g_return_if_fail(LIQUID_IS_FRAME_SCHEDULER(scheduler));
+    g_return_if_fail(LIQUID_IS_DRIVER_HID(driver));
+    g_return_if_fail(channel < liquid_driver_hid_get_n_led_channels(driver));
+    g_return_if_fail(effect != NULL);
+
+    FrameTarget *target = g_new0(FrameTarget, 1);
+    g_autofree gchar *object_name = LIQUID_DRIVER_GET_CLASS(driver)->dup_object_name(LIQUID_DRIVER(driver));
+
+    target->driver = g_object_ref(driver);
+    target->channel = channel;
+    target->name = g_strdup_printf("%s/led%u", object_name, channel);
+    target->metric_labels = g_strdup_printf("device=\"%s\",channel=\"led%u\"", object_name, channel);
+    target->skew = liquid_histogram_new();
+    target->effect = *effect;
+    target->n_leds = MIN(liquid_driver_hid_get_max_leds(driver), LIQUID_LED_EFFECT_MAX_LEDS);
+    target->rgb = g_malloc0(3 * (gsize)target->n_leds);
+    target->reports = g_byte_array_new();
+
+    g_ptr_array_add(scheduler->targets, target);
+
+    if (scheduler->source)
+    {
+        return;
+    }
+
+    /* Destroyed in dispose, so it doesn't need a reference to the scheduler */
+    g_autoptr(GMainContext) context = g_main_context_ref_thread_default();
+
+    scheduler->start_time = g_get_monotonic_time();
+    scheduler->tick = 0;
+    scheduler->source = g_source_new(&tick_source_funcs, sizeof(TickSource));
+    ((TickSource *)scheduler->source)->scheduler = scheduler;
+    g_source_set_name(scheduler->source, "LiquidFrameScheduler");
+    g_source_set_priority(scheduler->source, G_PRIORITY_HIGH);
+    g_source_set_ready_time(scheduler->source, scheduler->start_time);
+    g_source_attach(scheduler->source, context);
+}
+
+GVariant *
+liquid_frame_scheduler_dup_statistics(LiquidFrameScheduler *scheduler)
+{
+    g_return_val_if_fail(LIQUID_IS_FRAME_SCHEDULER(scheduler), NULL);
+
+    g_auto(GVariantDict) dict = G_VARIANT_DICT_INIT(NULL);
+
+    g_variant_dict_insert(&dict, "ticks", "t", scheduler->ticks);
+    g_variant_dict_insert(&dict, "skipped-ticks", "t", scheduler->skipped_ticks);
+    g_variant_dict_insert(&dict, "frames", "t", scheduler->frames);
+    g_variant_dict_insert(&dict, "dropped-frames", "t", scheduler->dropped_frames);
+    g_variant_dict_insert(&dict, "write-errors", "t", scheduler->write_errors);
+    g_variant_dict_insert_value(&dict, "tick-lag", liquid_histogram_to_variant(scheduler->tick_lag));
+    g_variant_dict_insert_value(&dict, "frame-latency", liquid_histogram_to_variant(scheduler->frame_latency));
+    g_variant_dict_insert_value(&dict, "skew", liquid_histogram_to_variant(scheduler->skew));
+
+    g_auto(GVariantBuilder) target_skew = G_VARIANT_BUILDER_INIT(G_VARIANT_TYPE_VARDICT);
+
+    for (guint i = 0; i < scheduler->targets->len; i++)
+    {
+        FrameTarget *target = g_ptr_array_index(scheduler->targets, i);
+
+        g_variant_builder_add(&target_skew, "{sv}", target->name, liquid_histogram_to_variant(target->skew));
+    }
+
+    g_variant_dict_insert_value(&dict, "target-skew", g_variant_builder_end(&target_skew));
+
+    return g_variant_dict_end(&dict);
+}
+
+void
+liquid_frame_scheduler_append_metrics(LiquidFrameScheduler *scheduler, GString *out)
+{
+    g_return_if_fail(LIQUID_IS_FRAME_SCHEDULER(scheduler));
+
+    const struct
+    {
+        const gchar *name;
+        const gchar *help;
+        guint64 value;
+    } counters[] = {
+        { "liquidd_led_ticks_total", "Frame ticks dispatched.", scheduler->ticks },
+        { "liquidd_led_skipped_ticks_total", "Frame ticks skipped because the main loop was stalled.", scheduler->skipped_ticks },
+        { "liquidd_led_frames_total", "LED frames written to devices.", scheduler->frames },
+        { "liquidd_led_dropped_frames_total", "LED frames dropped because the previous one was still being written.", scheduler->dropped_frames },
+        { "liquidd_led_write_errors_total", "LED frames that failed to be written.", scheduler->write_errors },
+    };
+
+    for (guint i = 0; i < G_N_ELEMENTS(counters); i++)
+    {
+        liquid_metrics_append_family(out, counters[i].name, "counter", counters[i].help);
+        liquid_metrics_append_sample(out, counters[i].name, NULL, (gdouble)counters[i].value);
+    }
+
+    liquid_metrics_append_family(out,
+                                 "liquidd_led_tick_lag_seconds",
+                                 "histogram",
+                                 "Delay from a frame tick being due to its dispatch.");
+    liquid_histogram_append_metrics(scheduler->tick_lag, out, "liquidd_led_tick_lag_seconds", NULL);
+    liquid_metrics_append_family(out,
+                                 "liquidd_led_frame_latency_seconds",
+                                 "histogram",
+                                 "Delay from a frame tick being due to the frame being shown.");
+    liquid_histogram_append_metrics(scheduler->frame_latency, out, "liquidd_led_frame_latency_seconds", NULL);
+    liquid_metrics_append_family(out,
+                                 "liquidd_led_skew_seconds",
+                                 "histogram",
+                                 "Spread between the first and last frame of a tick being shown.");
+    liquid_histogram_append_metrics(scheduler->skew, out, "liquidd_led_skew_seconds", NULL);
+    liquid_metrics_append_family(out,
+                                 "liquidd_led_target_skew_seconds",
+                                 "histogram",
+                                 "Delay from the first frame of a tick being shown to this channel's.");
+
+    for (guint i = 0; i < scheduler->targets->len; i++)
+    {
+        FrameTarget *target = g_ptr_array_index(scheduler->targets, i);
+
+        liquid_histogram_append_metrics(target->skew, out, "liquidd_led_target_skew_seconds", target->metric_labels);
+    }
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <gio/gio.h>
+
+#include "driver_hid.h"
+#include "led_effect.h"
+
+G_BEGIN_DECLS
+
+/*
+ * Streams LED effects to devices at a fixed frame rate, in lockstep. Each tick
+ * renders and encodes the frames for every LED channel on the main thread,
+ * then a worker thread writes them all: the reports that only load a frame
+ * first, then those that show it back to back, so that devices change
+ * together. While a tick is still being written, the next ones are dropped
+ * rather than queued behind it, for every channel alike; ticks missed by a
+ * stalled main loop are skipped, not caught up.
+ */
+#define LIQUID_TYPE_FRAME_SCHEDULER (liquid_frame_scheduler_get_type())
+G_DECLARE_FINAL_TYPE(LiquidFrameScheduler, liquid_frame_scheduler, LIQUID, FRAME_SCHEDULER, GObject)
+
+LiquidFrameScheduler *
+liquid_frame_scheduler_new(guint frame_rate);
+
+/* Starts showing `effect` on an LED channel of the driver's device, across all of its LEDs */
+void
+liquid_frame_scheduler_add(LiquidFrameScheduler *scheduler,
+                           LiquidDriverHid *driver,
+                           guint channel,
+                           const LiquidLedEffect *effect);
+
+/*
+ * Returns an a{sv} dictionary with counters "ticks", "skipped-ticks",
+ * "frames", "dropped-frames" and "write-errors" (t), the "tick-lag" (from
+ * each tick's due time to its dispatch), "frame-latency" (from due time to
+ * the frame being shown) and "skew" (from the first to the last frame of a
+ * tick being shown) histograms, and "target-skew", a dictionary of each
+ * channel's delay behind the first frame, keyed by device/ledN.
+ */
+GVariant *
+liquid_frame_scheduler_dup_statistics(LiquidFrameScheduler *scheduler);
+
+/* The same as Prometheus metric families, see metrics.h */
+void
+liquid_frame_scheduler_append_metrics(LiquidFrameScheduler *scheduler, GString *out);
+
+G_END_DECLS
@@ -0,0 +1,368 @@
+#include "handoff.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <gio/gio.h>
+
+/* Device states take a few hundred bytes */
+#define HANDOFF_MAX_PACKET_SIZE 65536
+
+/* Neither daemon waits longer than this on the other */
+#define HANDOFF_TIMEOUT_S 5
+
+typedef union
+{
+    struct cmsghdr header;
+    char buffer[CMSG_SPACE(sizeof(int))];
+} FdControl;
+
+static GVariant *
+ref_sink_or_empty(GVariant *dict)
+{
+    return g_variant_ref_sink(dict ? dict : g_variant_new("a{sv}", NULL));
+}
+
+LiquidHandoffDevice *
+liquid_handoff_device_new(const gchar *hidraw_path, gint fd, GVariant *state, GVariant *counters)
+{
+    LiquidHandoffDevice *device = g_new0(LiquidHandoffDevice, 1);
+
+    device->hidraw_path = g_strdup(hidraw_path);
+    device->fd = fd;
+    device->state = ref_sink_or_empty(state);
+    device->counters = ref_sink_or_empty(counters);
+
+    return device;
+}
+
+gint
+liquid_handoff_device_steal_fd(LiquidHandoffDevice *device)
+{
+    gint fd = device->fd;
+
+    device->fd = -1;
+
+    return fd;
+}
+
+void
+liquid_handoff_device_free(LiquidHandoffDevice *device)
+{
+    if (device->fd != -1)
+    {
+        close(device->fd);
+    }
+
+    g_free(device->hidraw_path);
+    g_variant_unref(device->state);
+    g_variant_unref(device->counters);
+    g_free(device);
+}
+
+static void
+set_error_from_errno(GError **error, const gchar *call)
+{
+    int errsv = errno;
+    g_set_error(error, G_IO_ERROR, g_io_error_from_errno(errsv), "%s: %s", call, g_strerror(errsv));
+}
+
+static gboolean
+handoff_address(const gchar *path, struct sockaddr_un *address, GError **error)
+{
+    gsize length = strlen(path);
+
+    if (length >= sizeof(address->sun_path))
+    {
+        g_set_error(error, G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT, "Socket path too long: %s", path);
+        return FALSE;
+    }
+
+    memset(address, 0, sizeof(*address));
+    address->sun_family = AF_UNIX;
+    memcpy(address->sun_path, path, length);
+
+    return TRUE;
+}
+
+static void
+set_timeouts(gint fd)
+{
+    struct timeval timeout = { .tv_sec = HANDOFF_TIMEOUT_S };
+
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+}
+
+gint
+liquid_handoff_listen(const gchar *path, GError **error)
+{
+    struct sockaddr_un address;
+
+    if (!handoff_address(path, &address, error))
+    {
+        return -1;
+    }
+
+    int fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+
+    if (fd == -1)
+    {
+        set_error_from_errno(error, "socket");
+        return -1;
+    }
+
+    struct stat st;
+
+    /* Left behind by a daemon that didn't exit cleanly; anything else stays */
+    if (lstat(path, &st) == 0 && S_ISSOCK(st.st_mode))
+    {
+        unlink(path);
+    }
+
+    /* Whoever connects gets the devices, so nobody else may */
+    mode_t mask = umask(0077);
+    int bound = bind(fd, (struct sockaddr *)&address, sizeof(address));
+
+    umask(mask);
+
+    if (bound == -1 || listen(fd, 1) == -1)
+    {
+        set_error_from_errno(error, bound == -1 ? "bind" : "listen");
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+gint
+liquid_handoff_accept(gint listen_fd, GError **error)
+{
+    int fd = accept(listen_fd, NULL, NULL);
+
+    if (fd == -1)
+    {
+        set_error_from_errno(error, "accept");
+        return -1;
+    }
+
+    fcntl(fd, F_SETFD, FD_CLOEXEC);
+    set_timeouts(fd);
+
+    return fd;
+}
+
+/* Sinks `packet` */
+static gboolean
+send_packet(gint fd, GVariant *packet, gint attached_fd, GError **error)
+{
+    g_autoptr(GVariant) owned_packet = g_variant_ref_sink(packet);
+    struct iovec iov = {
+        .iov_base = (gpointer)g_variant_get_data(owned_packet),
+        .iov_len = g_variant_get_size(owned_packet),
+    };
+    struct msghdr message = { .msg_iov = &iov, .msg_iovlen = 1 };
+    FdControl control;
+
+    if (attached_fd != -1)
+    {
+        memset(&control, 0, sizeof(control));
+        message.msg_control = control.buffer;
+        message.msg_controllen = sizeof(control.buffer);
+
+        struct cmsghdr *header = CMSG_FIRSTHDR(&message);
+
+        header->cmsg_level = SOL_SOCKET;
+        header->cmsg_type = SCM_RIGHTS;
+        header->cmsg_len = CMSG_LEN(sizeof(int));
+        memcpy(CMSG_DATA(header), &attached_fd, sizeof(int));
+    }
+
+    if (sendmsg(fd, &message, MSG_NOSIGNAL) == -1)
+    {
+        set_error_from_errno(error, "sendmsg");
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+gboolean
+liquid_handoff_send(gint fd, gint64 stop_time, GPtrArray *devices, GError **error)
+{
+    if (!send_packet(fd, g_variant_new("(xu)", stop_time, devices->len), -1, error))
+    {
+        return FALSE;
+    }
+
+    for (guint i = 0; i < devices->len; i++)
+    {
+        const LiquidHandoffDevice *device = g_ptr_array_index(devices, i);
+        GVariant *packet = g_variant_new("(s@a{sv}@a{sv})", device->hidraw_path, device->state, device->counters);
+
+        if (!send_packet(fd, packet, device->fd, error))
+        {
+            return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
+/* The file descriptor attached to the packet, if any, is returned in `attached_fd` even on error */
+static GVariant *
+receive_packet(gint fd, const GVariantType *type, guint8 *buffer, gint *attached_fd, GError **error)
+{
+    struct iovec iov = { .iov_base = buffer, .iov_len = HANDOFF_MAX_PACKET_SIZE };
+    FdControl control;
+    struct msghdr message = {
+        .msg_iov = &iov,
+        .msg_iovlen = 1,
+        .msg_control = control.buffer,
+        .msg_controllen = sizeof(control.buffer),
+    };
+    ssize_t size = recvmsg(fd, &message, MSG_CMSG_CLOEXEC);
+
+    *attached_fd = -1;
+
+    if (size == -1)
+    {
+        set_error_from_errno(error, "recvmsg");
+        return NULL;
+    }
+
+    for (struct cmsghdr *header = CMSG_FIRSTHDR(&message); header; header = CMSG_NXTHDR(&message, header))
+    {
+        if (header->cmsg_level == SOL_SOCKET && header->cmsg_type == SCM_RIGHTS
+            && header->cmsg_len == CMSG_LEN(sizeof(int)))
+        {
+            memcpy(attached_fd, CMSG_DATA(header), sizeof(int));
+        }
+    }
+
+    if (size == 0)
+    {
+        g_set_error(error, G_IO_ERROR, G_IO_ERROR_CONNECTION_CLOSED, "Handoff ended early");
+        return NULL;
+    }
+
+    if (message.msg_flags & (MSG_TRUNC | MSG_CTRUNC))
+    {
+        g_set_error(error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA, "Handoff packet too large");
+        return NULL;
+    }
+
+    g_autoptr(GBytes) bytes = g_bytes_new(buffer, (gsize)size);
+
+    return g_variant_ref_sink(g_variant_new_from_bytes(type, bytes, FALSE));
+}
+
+gboolean
+liquid_handoff_wait_ack(gint fd, GError **error)
+{
+    g_autofree guint8 *buffer = g_malloc(HANDOFF_MAX_PACKET_SIZE);
+    gint attached_fd = -1;
+    g_autoptr(GVariant) ack = receive_packet(fd, G_VARIANT_TYPE_BOOLEAN, buffer, &attached_fd, error);
+
+    if (attached_fd != -1)
+    {
+        close(attached_fd);
+    }
+
+    return ack != NULL;
+}
+
+GPtrArray *
+liquid_handoff_receive(const gchar *path, gint64 *stop_time, gint *fd_out, GError **error)
+{
+    struct sockaddr_un address;
+
+    if (!handoff_address(path, &address, error))
+    {
+        return NULL;
+    }
+
+    int fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+
+    if (fd == -1)
+    {
+        set_error_from_errno(error, "socket");
+        return NULL;
+    }
+
+    set_timeouts(fd);
+
+    if (connect(fd, (struct sockaddr *)&address, sizeof(address)) == -1)
+    {
+        set_error_from_errno(error, "connect");
+        close(fd);
+        return NULL;
+    }
+
+    g_autofree guint8 *buffer = g_malloc(HANDOFF_MAX_PACKET_SIZE);
+    g_autoptr(GPtrArray) devices = g_ptr_array_new_with_free_func((GDestroyNotify)liquid_handoff_device_free);
+    gint attached_fd = -1;
+    g_autoptr(GVariant) header = receive_packet(fd, G_VARIANT_TYPE("(xu)"), buffer, &attached_fd, error);
+    guint32 n_devices = 0;
+
+    if (attached_fd != -1)
+    {
+        close(attached_fd);
+    }
+
+    if (header == NULL)
+    {
+        close(fd);
+        return NULL;
+    }
+
+    g_variant_get(header, "(xu)", stop_time, &n_devices);
+
+    for (guint i = 0; i < n_devices; i++)
+    {
+        g_autoptr(GVariant) packet = receive_packet(fd, G_VARIANT_TYPE("(sa{sv}a{sv})"), buffer, &attached_fd, error);
+
+        if (packet == NULL || attached_fd == -1)
+        {
+            if (packet)
+            {
+                g_set_error(error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA, "Handoff device without a file descriptor");
+            }
+            else if (attached_fd != -1)
+            {
+                close(attached_fd);
+            }
+
+            close(fd);
+            return NULL;
+        }
+
+        const gchar *hidraw_path = NULL;
+        g_autoptr(GVariant) state = NULL;
+        g_autoptr(GVariant) counters = NULL;
+
+        g_variant_get(packet, "(&s@a{sv}@a{sv})", &hidraw_path, &state, &counters);
+        g_ptr_array_add(devices, liquid_handoff_device_new(hidraw_path, attached_fd, state, counters));
+    }
+
+    *fd_out = fd;
+
+    return g_steal_pointer(&devices);
+}
+
+gboolean
+liquid_handoff_ack(gint fd, GError **error)
+{
+    gboolean sent = send_packet(fd, g_variant_new_boolean(TRUE), -1, error);
+
+    close(fd);
+
+    return sent;
+}
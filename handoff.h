@@ -0,0 +1,70 @@
+#pragma once
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/*
+ * Open devices passed from a running daemon to the one replacing it, so that
+ * neither closes nor re-initializes them. The running daemon listens on a Unix
+ * socket; the new one connects and is sent, over SOCK_SEQPACKET, a header with
+ * the time at which the devices stopped being read and the number of devices,
+ * then one packet per device with its hidraw path, state and counters, and its
+ * file descriptor attached as SCM_RIGHTS. Once it has resumed reading them, the
+ * new daemon acknowledges; until then, the running daemon may take them back.
+ */
+typedef struct
+{
+    gchar *hidraw_path;
+    /* Owned, and closed with the device unless stolen */
+    gint fd;
+    /* a{sv}, as from liquid_driver_save_state() and liquid_driver_save_counters(); empty if there's none */
+    GVariant *state;
+    GVariant *counters;
+} LiquidHandoffDevice;
+
+/* Takes ownership of `fd`; `state` and `counters` may be NULL */
+LiquidHandoffDevice *
+liquid_handoff_device_new(const gchar *hidraw_path, gint fd, GVariant *state, GVariant *counters);
+
+gint
+liquid_handoff_device_steal_fd(LiquidHandoffDevice *device);
+
+void
+liquid_handoff_device_free(LiquidHandoffDevice *device);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC(LiquidHandoffDevice, liquid_handoff_device_free)
+
+/* Returns a listening socket, only accessible to the current user, or -1 */
+gint
+liquid_handoff_listen(const gchar *path, GError **error);
+
+/* Accepts a connection, or returns -1 */
+gint
+liquid_handoff_accept(gint listen_fd, GError **error);
+
+/* `devices` is a LiquidHandoffDevice array; their file descriptors are duplicated by the receiver */
+gboolean
+liquid_handoff_send(gint fd, gint64 stop_time, GPtrArray *devices, GError **error);
+
+/* Waits for the new daemon to acknowledge that it has resumed, after liquid_handoff_send() */
+gboolean
+liquid_handoff_wait_ack(gint fd, GError **error);
+
+/*
+ * Connects to a daemon listening on `path` and takes over its devices, as a
+ * LiquidHandoffDevice array; `stop_time` is the monotonic time at which the
+ * daemon stopped reading them. The connection is returned in `fd`, for
+ * liquid_handoff_ack().
+ */
+GPtrArray *
+liquid_handoff_receive(const gchar *path, gint64 *stop_time, gint *fd, GError **error);
+
+/*
+ * Tells the previous daemon that reads have resumed, and closes `fd`. If this
+ * fails, the previous daemon has taken the devices back or is about to.
+ */
+gboolean
+liquid_handoff_ack(gint fd, GError **error);
+
+G_END_DECLS
@@ -7,10 +7,28 @@
 #include <gio/gunixinputstream.h>
 #include <gio/gunixoutputstream.h>
 
+#include "spsc_queue.h"
+
 /* From Linux kernel's include/linux/hid.h */
 #define HID_MIN_BUFFER_SIZE 64
 #define HID_MAX_BUFFER_SIZE 16384
 
+/* Reports that can wait for the main context before new ones are dropped */
+#define INPUT_QUEUE_CAPACITY 256
+
+typedef struct
+{
+    GBytes *bytes;
+    GError *error;
+    gint64 time;
+} QueuedInput;
+
+typedef struct
+{
+    GSource source;
+    LiquidHidDevice *device;
+} QueueSource;
+
 struct _LiquidHidDevice
 {
     GObject parent;
@@ -19,6 +37,18 @@ struct _LiquidHidDevice
     GInputStream *input_stream;
     GCancellable *read_cancellable;
     GOutputStream *output_stream;
+    /* Output reports can come from any thread; a stream only takes one at a time */
+    GMutex output_mutex;
+
+    /* Only used when reading on a separate context */
+    GMainContext *io_context;
+    GMainContext *owner_context;
+    LiquidSpscQueue *input_queue;
+    GSource *input_queue_source;
+    gint dropped_reports;
+
+    /* Monotonic time at which the report being emitted was read */
+    gint64 report_time;
 };
 
 G_DEFINE_FINAL_TYPE(LiquidHidDevice, liquid_hid_device, G_TYPE_OBJECT)
@@ -29,6 +59,7 @@ enum
     PROP_MAX_INPUT_REPORT_SIZE,
     PROP_INPUT_STREAM,
     PROP_OUTPUT_STREAM,
+    PROP_IO_CONTEXT,
     N_PROPERTIES
 };
 
@@ -46,34 +77,165 @@ static guint signals[N_SIGNALS];
 static void
 liquid_hid_device_read_input_report(LiquidHidDevice *device);
 
+static void
+queued_input_free(gpointer data)
+{
+    QueuedInput *input = data;
+
+    g_clear_pointer(&input->bytes, g_bytes_unref);
+    g_clear_error(&input->error);
+    g_free(input);
+}
+
+static void
+liquid_hid_device_emit(LiquidHidDevice *device, GBytes *bytes, GError *error, gint64 time)
+{
+    device->report_time = time;
+
+    if (error)
+    {
+        g_signal_emit(device, signals[SIGNAL_ERROR], 0, error);
+    }
+
+    if (bytes)
+    {
+        g_signal_emit(device, signals[SIGNAL_INPUT_REPORT], 0, bytes);
+    }
+}
+
+/* Called on the I/O context */
+static void
+liquid_hid_device_enqueue(LiquidHidDevice *device, GBytes *bytes, GError *error, gint64 time)
+{
+    QueuedInput *input = g_new0(QueuedInput, 1);
+
+    input->time = time;
+    input->bytes = bytes ? g_bytes_ref(bytes) : NULL;
+    input->error = error ? g_error_copy(error) : NULL;
+
+    if (!liquid_spsc_queue_push(device->input_queue, input))
+    {
+        g_atomic_int_inc(&device->dropped_reports);
+        queued_input_free(input);
+        return;
+    }
+
+    g_main_context_wakeup(device->owner_context);
+}
+
+static gboolean
+queue_source_prepare(GSource *source, gint *timeout)
+{
+    QueueSource *queue_source = (QueueSource *)source;
+
+    *timeout = -1;
+
+    return !liquid_spsc_queue_is_empty(queue_source->device->input_queue);
+}
+
+static gboolean
+queue_source_check(GSource *source)
+{
+    QueueSource *queue_source = (QueueSource *)source;
+
+    return !liquid_spsc_queue_is_empty(queue_source->device->input_queue);
+}
+
+/* The device outlives its source, which it destroys on dispose, on the same context */
+static gboolean
+queue_source_dispatch(GSource *source, GSourceFunc callback G_GNUC_UNUSED, gpointer user_data G_GNUC_UNUSED)
+{
+    QueueSource *queue_source = (QueueSource *)source;
+    g_autoptr(LiquidHidDevice) device = g_object_ref(queue_source->device);
+
+    /* Don't starve other sources if the device keeps the queue full */
+    guint budget = liquid_spsc_queue_get_capacity(device->input_queue);
+    QueuedInput *input;
+
+    while (budget-- > 0 && !g_source_is_destroyed(source)
+           && (input = liquid_spsc_queue_pop(device->input_queue)) != NULL)
+    {
+        liquid_hid_device_emit(device, input->bytes, input->error, input->time);
+        queued_input_free(input);
+    }
+
+    return G_SOURCE_CONTINUE;
+}
+
+static GSourceFuncs queue_source_funcs = {
+    .prepare = queue_source_prepare,
+    .check = queue_source_check,
+    .dispatch = queue_source_dispatch,
+};
+
+static gboolean
+liquid_hid_device_released(gpointer user_data G_GNUC_UNUSED)
+{
+    return G_SOURCE_REMOVE;
+}
+
+/*
+ * Drops a reference taken while reading. Read on the I/O context, the device
+ * may have lost every other reference meanwhile, so the reference is dropped
+ * on the owner context instead: disposing of the device there, where its
+ * queue source runs, can't free the queue from under that source.
+ */
+static void
+liquid_hid_device_release(LiquidHidDevice *device)
+{
+    if (device->input_queue == NULL)
+    {
+        g_object_unref(device);
+        return;
+    }
+
+    GSource *source = g_idle_source_new();
+
+    g_source_set_callback(source, liquid_hid_device_released, device, g_object_unref);
+    g_source_attach(source, device->owner_context);
+    g_source_unref(source);
+}
+
 static void
 liquid_hid_device_input_report_ready(GObject *source_object, GAsyncResult *result, gpointer user_data)
 {
     GInputStream *stream = G_INPUT_STREAM(source_object);
     GWeakRef *device_weak = user_data;
 
-    g_autoptr(LiquidHidDevice) device = g_weak_ref_get(device_weak);
+    LiquidHidDevice *device = g_weak_ref_get(device_weak);
     g_weak_ref_clear(device_weak);
     g_free(device_weak);
 
     g_autoptr(GError) error = NULL;
     g_autoptr(GBytes) bytes = g_input_stream_read_bytes_finish(stream, result, &error);
 
+    /* Taken before anything else runs, so that dispatch delays downstream are measurable */
+    gint64 time = g_get_monotonic_time();
+
     if (device == NULL)
     {
         return;
     }
 
-    if (error)
+    /* Stopped, or disposed: neither is a device failure */
+    if (!g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
     {
-        g_signal_emit(device, signals[SIGNAL_ERROR], 0, error);
+        if (device->input_queue)
+        {
+            liquid_hid_device_enqueue(device, bytes, error, time);
+        }
+        else
+        {
+            liquid_hid_device_emit(device, bytes, error, time);
+        }
+
+        if (bytes)
+        {
+            liquid_hid_device_read_input_report(device);
+        }
     }
 
-    if (bytes)
-    {
-        g_signal_emit(device, signals[SIGNAL_INPUT_REPORT], 0, bytes);
-        liquid_hid_device_read_input_report(device);
-    }
+    liquid_hid_device_release(device);
 }
 
 static void
@@ -99,7 +261,16 @@ liquid_hid_device_dispose(GObject *object)
     LiquidHidDevice *device = LIQUID_HID_DEVICE(object);
 
     g_cancellable_cancel(device->read_cancellable);
+
+    g_mutex_lock(&device->output_mutex);
     g_clear_object(&device->output_stream);
+    g_mutex_unlock(&device->output_mutex);
+
+    if (device->input_queue_source)
+    {
+        g_source_destroy(device->input_queue_source);
+        g_clear_pointer(&device->input_queue_source, g_source_unref);
+    }
 
     G_OBJECT_CLASS(liquid_hid_device_parent_class)->dispose(object);
 }
@@ -112,6 +283,11 @@ liquid_hid_device_finalize(GObject *object)
     g_clear_object(&device->read_cancellable);
     g_clear_object(&device->input_stream);
 
+    liquid_spsc_queue_free(g_steal_pointer(&device->input_queue), queued_input_free);
+    g_clear_pointer(&device->io_context, g_main_context_unref);
+    g_clear_pointer(&device->owner_context, g_main_context_unref);
+    g_mutex_clear(&device->output_mutex);
+
     G_OBJECT_CLASS(liquid_hid_device_parent_class)->finalize(object);
 }
 
@@ -150,17 +326,55 @@ liquid_hid_device_set_property(GObject *object, guint property_id, const GValue
         g_set_object(&device->output_stream, g_value_get_object(value));
         break;
 
+    case PROP_IO_CONTEXT:
+        g_clear_pointer(&device->io_context, g_main_context_unref);
+        device->io_context = g_value_dup_boxed(value);
+        break;
+
     default:
         G_OBJECT_WARN_INVALID_PROPERTY_ID(object, property_id, pspec);
     }
 }
 
+static gboolean
+liquid_hid_device_start_reading(gpointer user_data)
+{
+    LiquidHidDevice *device = user_data;
+
+    if (!g_cancellable_is_cancelled(device->read_cancellable))
+    {
+        liquid_hid_device_read_input_report(device);
+    }
+
+    return G_SOURCE_REMOVE;
+}
+
 static void
 liquid_hid_device_constructed(GObject *object)
 {
     LiquidHidDevice *device = LIQUID_HID_DEVICE(object);
 
-    liquid_hid_device_read_input_report(device);
+    if (device->io_context == NULL)
+    {
+        liquid_hid_device_read_input_report(device);
+    }
+    else
+    {
+        device->owner_context = g_main_context_ref_thread_default();
+        device->input_queue = liquid_spsc_queue_new(INPUT_QUEUE_CAPACITY);
+
+        device->input_queue_source = g_source_new(&queue_source_funcs, sizeof(QueueSource));
+        ((QueueSource *)device->input_queue_source)->device = device;
+        g_source_set_name(device->input_queue_source, "LiquidHidDevice input queue");
+        g_source_attach(device->input_queue_source, device->owner_context);
+
+        /* The read callback, and every following read, then runs on io_context */
+        g_main_context_invoke_full(device->io_context,
+                                   G_PRIORITY_DEFAULT,
+                                   liquid_hid_device_start_reading,
+                                   g_object_ref(device),
+                                   g_object_unref);
+    }
 
     G_OBJECT_CLASS(liquid_hid_device_parent_class)->constructed(object);
 }
@@ -199,6 +413,13 @@ liquid_hid_device_class_init(LiquidHidDeviceClass *class)
                               G_TYPE_OUTPUT_STREAM, /* object_type */
                               G_PARAM_WRITABLE | G_PARAM_CONSTRUCT_ONLY | G_PARAM_STATIC_STRINGS);
 
+    pspecs[PROP_IO_CONTEXT]
+        = g_param_spec_boxed("io-context", /* name */
+                             "I/O context", /* nick */
+                             "Main context to read input reports on, or NULL for the thread-default one", /* blurb */
+                             G_TYPE_MAIN_CONTEXT, /* boxed_type */
+                             G_PARAM_WRITABLE | G_PARAM_CONSTRUCT_ONLY | G_PARAM_STATIC_STRINGS);
+
     g_object_class_install_properties(gobject_class, N_PROPERTIES, pspecs);
 
     signals[SIGNAL_INPUT_REPORT]
@@ -230,10 +451,11 @@ static void
 liquid_hid_device_init(LiquidHidDevice *device)
 {
     device->read_cancellable = g_cancellable_new();
+    g_mutex_init(&device->output_mutex);
 }
 
 LiquidHidDevice *
-liquid_hid_device_new_for_fd(int fd, guint max_input_report_size)
+liquid_hid_device_new_for_fd(int fd, guint max_input_report_size, GMainContext *io_context)
 {
     GInputStream *input_stream = g_unix_input_stream_new(fd, TRUE);
 
@@ -247,11 +469,13 @@ liquid_hid_device_new_for_fd(int fd, guint max_input_report_size)
                         output_stream,
                         "max-input-report-size",
                         max_input_report_size,
+                        "io-context",
+                        io_context,
                         NULL);
 }
 
-LiquidHidDevice *
-liquid_hid_device_new_for_path(const char *path, guint max_input_report_size, GError **error)
+static int
+open_hidraw(const char *path, GError **error)
 {
     int fd = open(path, O_RDWR);
 
@@ -259,14 +483,169 @@ liquid_hid_device_new_for_path(const char *path, guint max_input_report_size, GE
     {
         int errsv = errno;
         g_set_error(error, G_IO_ERROR, g_io_error_from_errno(errsv), "open: %s", g_strerror(errsv));
+    }
+
+    return fd;
+}
+
+LiquidHidDevice *
+liquid_hid_device_new_for_path(const char *path,
+                               guint max_input_report_size,
+                               GMainContext *io_context,
+                               GError **error)
+{
+    int fd = open_hidraw(path, error);
+
+    if (fd == -1)
+    {
         return NULL;
     }
 
-    return liquid_hid_device_new_for_fd(fd, max_input_report_size);
+    return liquid_hid_device_new_for_fd(fd, max_input_report_size, io_context);
+}
+
+typedef struct
+{
+    gchar *path;
+    guint max_input_report_size;
+    GMainContext *io_context;
+} OpenData;
+
+static void
+open_data_free(gpointer data)
+{
+    OpenData *open_data = data;
+
+    g_free(open_data->path);
+    g_clear_pointer(&open_data->io_context, g_main_context_unref);
+    g_free(open_data);
+}
+
+static void
+liquid_hid_device_open_thread(GTask *task,
+                              gpointer source_object G_GNUC_UNUSED,
+                              gpointer task_data,
+                              GCancellable *cancellable G_GNUC_UNUSED)
+{
+    OpenData *open_data = task_data;
+    GError *error = NULL;
+    int fd = open_hidraw(open_data->path, &error);
+
+    if (fd == -1)
+    {
+        g_task_return_error(task, error);
+        return;
+    }
+
+    g_task_return_int(task, fd);
+}
+
+void
+liquid_hid_device_new_for_path_async(const char *path,
+                                     guint max_input_report_size,
+                                     GMainContext *io_context,
+                                     GAsyncReadyCallback callback,
+                                     gpointer user_data)
+{
+    g_return_if_fail(path != NULL);
+
+    OpenData *open_data = g_new0(OpenData, 1);
+
+    open_data->path = g_strdup(path);
+    open_data->max_input_report_size = max_input_report_size;
+    open_data->io_context = io_context ? g_main_context_ref(io_context) : NULL;
+
+    /* Not cancellable: a cancelled task would leak the fd opened by the thread */
+    g_autoptr(GTask) task = g_task_new(NULL, NULL, callback, user_data);
+
+    g_task_set_source_tag(task, liquid_hid_device_new_for_path_async);
+    g_task_set_task_data(task, open_data, open_data_free);
+    g_task_run_in_thread(task, liquid_hid_device_open_thread);
+}
+
+LiquidHidDevice *
+liquid_hid_device_new_for_path_finish(GAsyncResult *result, GError **error)
+{
+    g_return_val_if_fail(g_task_is_valid(result, NULL), NULL);
+
+    GTask *task = G_TASK(result);
+    int fd = (int)g_task_propagate_int(task, error);
+
+    if (fd == -1)
+    {
+        return NULL;
+    }
+
+    /* Constructed here rather than in the thread, to bind to the caller's context */
+    OpenData *open_data = g_task_get_task_data(task);
+
+    return liquid_hid_device_new_for_fd(fd, open_data->max_input_report_size, open_data->io_context);
 }
 
 gboolean
 liquid_hid_device_output_report(LiquidHidDevice *device, const void *buffer, gsize count, GError **error)
 {
-    return g_output_stream_write(device->output_stream, buffer, count, NULL, error) >= 0;
+    gboolean written = FALSE;
+
+    g_mutex_lock(&device->output_mutex);
+
+    if (device->output_stream)
+    {
+        written = g_output_stream_write(device->output_stream, buffer, count, NULL, error) >= 0;
+    }
+    else
+    {
+        g_set_error(error, G_IO_ERROR, G_IO_ERROR_CLOSED, "Device is closed");
+    }
+
+    g_mutex_unlock(&device->output_mutex);
+
+    return written;
+}
+
+int
+liquid_hid_device_stop_reading(LiquidHidDevice *device)
+{
+    g_return_val_if_fail(LIQUID_IS_HID_DEVICE(device), -1);
+
+    g_cancellable_cancel(device->read_cancellable);
+
+    if (!G_IS_UNIX_INPUT_STREAM(device->input_stream))
+    {
+        return -1;
+    }
+
+    return g_unix_input_stream_get_fd(G_UNIX_INPUT_STREAM(device->input_stream));
+}
+
+guint
+liquid_hid_device_get_dropped_reports(LiquidHidDevice *device)
+{
+    g_return_val_if_fail(LIQUID_IS_HID_DEVICE(device), 0);
+
+    return (guint)g_atomic_int_get(&device->dropped_reports);
+}
+
+gint64
+liquid_hid_device_get_report_time(LiquidHidDevice *device)
+{
+    g_return_val_if_fail(LIQUID_IS_HID_DEVICE(device), 0);
+
+    return device->report_time;
+}
+
+guint
+liquid_hid_device_get_max_input_report_size(LiquidHidDevice *device)
+{
+    g_return_val_if_fail(LIQUID_IS_HID_DEVICE(device), 0);
+
+    return device->max_input_report_size;
+}
+
+GMainContext *
+liquid_hid_device_get_io_context(LiquidHidDevice *device)
+{
+    g_return_val_if_fail(LIQUID_IS_HID_DEVICE(device), NULL);
+
+    return device->io_context;
 }
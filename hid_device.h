@@ -7,13 +7,56 @@ G_BEGIN_DECLS
 #define LIQUID_TYPE_HID_DEVICE (liquid_hid_device_get_type())
 G_DECLARE_FINAL_TYPE(LiquidHidDevice, liquid_hid_device, LIQUID, HID_DEVICE, GObject)
 
+/*
+ * With an io_context, reads run on that context (typically another thread's)
+ * and reports are handed back through a lock-free queue; signals are always
+ * emitted on the thread-default context of the caller.
+ */
 LiquidHidDevice *
-liquid_hid_device_new_for_fd(int fd, guint max_input_report_size);
+liquid_hid_device_new_for_fd(int fd, guint max_input_report_size, GMainContext *io_context);
 
 LiquidHidDevice *
-liquid_hid_device_new_for_path(const char *path, guint max_input_report_size, GError **error);
+liquid_hid_device_new_for_path(const char *path,
+                               guint max_input_report_size,
+                               GMainContext *io_context,
+                               GError **error);
 
+/* Opens the device on a worker thread, for when open() could block */
+void
+liquid_hid_device_new_for_path_async(const char *path,
+                                     guint max_input_report_size,
+                                     GMainContext *io_context,
+                                     GAsyncReadyCallback callback,
+                                     gpointer user_data);
+
+LiquidHidDevice *
+liquid_hid_device_new_for_path_finish(GAsyncResult *result, GError **error);
+
+/* Can be called from any thread; concurrent reports are written one after the other */
 gboolean
 liquid_hid_device_output_report(LiquidHidDevice *device, const void *buffer, gsize count, GError **error);
 
+/*
+ * Stops reading input reports for good, so that another process can take
+ * over the device, and returns its file descriptor, which the device still
+ * owns; -1 if the device isn't backed by one. A read already under way on an
+ * I/O thread may still complete, but no other starts.
+ */
+int
+liquid_hid_device_stop_reading(LiquidHidDevice *device);
+
+guint
+liquid_hid_device_get_max_input_report_size(LiquidHidDevice *device);
+
+GMainContext *
+liquid_hid_device_get_io_context(LiquidHidDevice *device);
+
+/* Input reports lost because the owner context fell behind an I/O thread */
+guint
+liquid_hid_device_get_dropped_reports(LiquidHidDevice *device);
+
+/* Monotonic time at which the report currently being emitted was read */
+gint64
+liquid_hid_device_get_report_time(LiquidHidDevice *device);
+
 G_END_DECLS
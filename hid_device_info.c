@@ -11,6 +11,11 @@ struct _LiquidHidDeviceInfo
     gchar *hidraw_path;
     guint32 vendor_id;
     guint32 product_id;
+    gchar *usb_path;
+    gchar *usb_address;
+    gchar *serial;
+    guint report_descriptor_size;
+    gint interface_number;
 };
 
 G_DEFINE_FINAL_TYPE(LiquidHidDeviceInfo, liquid_hid_device_info, G_TYPE_OBJECT)
@@ -21,6 +26,11 @@ enum
     PROP_HIDRAW_PATH,
     PROP_VENDOR_ID,
     PROP_PRODUCT_ID,
+    PROP_USB_PATH,
+    PROP_USB_ADDRESS,
+    PROP_SERIAL,
+    PROP_REPORT_DESCRIPTOR_SIZE,
+    PROP_INTERFACE_NUMBER,
     N_PROPERTIES
 };
 
@@ -45,6 +55,26 @@ liquid_hid_device_info_get_property(GObject *object, guint property_id, GValue *
         g_value_set_uint(value, info->product_id);
         break;
 
+    case PROP_USB_PATH:
+        g_value_set_string(value, info->usb_path);
+        break;
+
+    case PROP_USB_ADDRESS:
+        g_value_set_string(value, info->usb_address);
+        break;
+
+    case PROP_SERIAL:
+        g_value_set_string(value, info->serial);
+        break;
+
+    case PROP_REPORT_DESCRIPTOR_SIZE:
+        g_value_set_uint(value, info->report_descriptor_size);
+        break;
+
+    case PROP_INTERFACE_NUMBER:
+        g_value_set_int(value, info->interface_number);
+        break;
+
     default:
         G_OBJECT_WARN_INVALID_PROPERTY_ID(object, property_id, pspec);
     }
@@ -70,6 +100,29 @@ liquid_hid_device_info_set_property(GObject *object, guint property_id, const GV
         info->product_id = g_value_get_uint(value);
         break;
 
+    case PROP_USB_PATH:
+        g_clear_pointer(&info->usb_path, g_free);
+        info->usb_path = g_value_dup_string(value);
+        break;
+
+    case PROP_USB_ADDRESS:
+        g_clear_pointer(&info->usb_address, g_free);
+        info->usb_address = g_value_dup_string(value);
+        break;
+
+    case PROP_SERIAL:
+        g_clear_pointer(&info->serial, g_free);
+        info->serial = g_value_dup_string(value);
+        break;
+
+    case PROP_REPORT_DESCRIPTOR_SIZE:
+        info->report_descriptor_size = g_value_get_uint(value);
+        break;
+
+    case PROP_INTERFACE_NUMBER:
+        info->interface_number = g_value_get_int(value);
+        break;
+
     default:
         G_OBJECT_WARN_INVALID_PROPERTY_ID(object, property_id, pspec);
     }
@@ -81,6 +134,9 @@ liquid_hid_device_info_finalize(GObject *object)
     LiquidHidDeviceInfo *info = LIQUID_HID_DEVICE_INFO(object);
 
     g_clear_pointer(&info->hidraw_path, g_free);
+    g_clear_pointer(&info->usb_path, g_free);
+    g_clear_pointer(&info->usb_address, g_free);
+    g_clear_pointer(&info->serial, g_free);
 
     G_OBJECT_CLASS(liquid_hid_device_info_parent_class)->finalize(object);
 }
@@ -124,6 +180,45 @@ liquid_hid_device_info_class_init(LiquidHidDeviceInfoClass *class)
                             0, /* default_value */
                             G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY | G_PARAM_STATIC_STRINGS);
 
+    pspecs[PROP_USB_PATH]
+        = g_param_spec_string("usb-path", /* name */
+                              "USB path", /* nick */
+                              "USB bus and port path of the device, e.g. 1-4.2", /* blurb */
+                              NULL, /* default_value */
+                              G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY | G_PARAM_STATIC_STRINGS);
+
+    pspecs[PROP_USB_ADDRESS]
+        = g_param_spec_string("usb-address", /* name */
+                              "USB address", /* nick */
+                              "USB bus and device numbers, e.g. 3:7, which change whenever the device enumerates", /* blurb */
+                              NULL, /* default_value */
+                              G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY | G_PARAM_STATIC_STRINGS);
+
+    pspecs[PROP_SERIAL]
+        = g_param_spec_string("serial", /* name */
+                              "Serial number", /* nick */
+                              "USB serial number string", /* blurb */
+                              NULL, /* default_value */
+                              G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY | G_PARAM_STATIC_STRINGS);
+
+    pspecs[PROP_REPORT_DESCRIPTOR_SIZE]
+        = g_param_spec_uint("report-descriptor-size", /* name */
+                            "Report descriptor size", /* nick */
+                            "HID report descriptor size, in bytes", /* blurb */
+                            0, /* minimum */
+                            G_MAXUINT, /* maximum */
+                            0, /* default_value */
+                            G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY | G_PARAM_STATIC_STRINGS);
+
+    pspecs[PROP_INTERFACE_NUMBER]
+        = g_param_spec_int("interface-number", /* name */
+                           "Interface number", /* nick */
+                           "USB interface number, or -1 if unknown", /* blurb */
+                           -1, /* minimum */
+                           G_MAXUINT8, /* maximum */
+                           -1, /* default_value */
+                           G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY | G_PARAM_STATIC_STRINGS);
+
     g_object_class_install_properties(gobject_class, N_PROPERTIES, pspecs);
 }
 
@@ -151,6 +246,75 @@ liquid_hid_device_info_get_product_id(LiquidHidDeviceInfo *info)
     return info->product_id;
 }
 
+const gchar *
+liquid_hid_device_info_get_usb_path(LiquidHidDeviceInfo *info)
+{
+    g_return_val_if_fail(LIQUID_IS_HID_DEVICE_INFO(info), NULL);
+
+    return info->usb_path;
+}
+
+const gchar *
+liquid_hid_device_info_get_usb_address(LiquidHidDeviceInfo *info)
+{
+    g_return_val_if_fail(LIQUID_IS_HID_DEVICE_INFO(info), NULL);
+
+    return info->usb_address;
+}
+
+const gchar *
+liquid_hid_device_info_get_serial(LiquidHidDeviceInfo *info)
+{
+    g_return_val_if_fail(LIQUID_IS_HID_DEVICE_INFO(info), NULL);
+
+    return info->serial;
+}
+
+gsize
+liquid_hid_device_info_get_report_descriptor_size(LiquidHidDeviceInfo *info)
+{
+    g_return_val_if_fail(LIQUID_IS_HID_DEVICE_INFO(info), 0);
+
+    return info->report_descriptor_size;
+}
+
+gint
+liquid_hid_device_info_get_interface_number(LiquidHidDeviceInfo *info)
+{
+    g_return_val_if_fail(LIQUID_IS_HID_DEVICE_INFO(info), -1);
+
+    return info->interface_number;
+}
+
+/*
+ * Identifies the physical device the hidraw node belongs to: all interfaces of
+ * one USB device share the same key. Falls back to the hidraw path if the USB
+ * topology is unknown.
+ */
+const gchar *
+liquid_hid_device_info_get_device_key(LiquidHidDeviceInfo *info)
+{
+    g_return_val_if_fail(LIQUID_IS_HID_DEVICE_INFO(info), NULL);
+
+    return info->usb_path ? info->usb_path : info->hidraw_path;
+}
+
+static gsize
+read_report_descriptor_size(GUdevDevice *hid_device)
+{
+    g_autofree gchar *path
+        = g_build_filename(g_udev_device_get_sysfs_path(hid_device), "report_descriptor", NULL);
+    g_autofree gchar *contents = NULL;
+    gsize length = 0;
+
+    if (!g_file_get_contents(path, &contents, &length, NULL))
+    {
+        return 0;
+    }
+
+    return length;
+}
+
 LiquidHidDeviceInfo *
 liquid_hid_device_info_new_for_udev_device(GUdevDevice *udev_device)
 {
@@ -189,6 +353,24 @@ liquid_hid_device_info_new_for_udev_device(GUdevDevice *udev_device)
         return NULL;
     }
 
+    g_autoptr(GUdevDevice) usb_device
+        = g_udev_device_get_parent_with_subsystem(udev_device, "usb", "usb_device");
+
+    /* Both are optional: they only make the device identity more precise */
+    const gchar *usb_path = usb_device ? g_udev_device_get_name(usb_device) : NULL;
+    const gchar *serial = usb_device ? g_udev_device_get_sysfs_attr(usb_device, "serial") : NULL;
+    const gchar *busnum = usb_device ? g_udev_device_get_sysfs_attr(usb_device, "busnum") : NULL;
+    const gchar *devnum = usb_device ? g_udev_device_get_sysfs_attr(usb_device, "devnum") : NULL;
+    g_autofree gchar *usb_address = busnum && devnum ? g_strdup_printf("%s:%s", busnum, devnum) : NULL;
+
+    g_autoptr(GUdevDevice) usb_interface
+        = g_udev_device_get_parent_with_subsystem(udev_device, "usb", "usb_interface");
+
+    /* bInterfaceNumber is printed in hex */
+    const gchar *interface_attr
+        = usb_interface ? g_udev_device_get_sysfs_attr(usb_interface, "bInterfaceNumber") : NULL;
+    gint interface_number = interface_attr ? (gint)g_ascii_strtoll(interface_attr, NULL, 16) : -1;
+
     return g_object_new(LIQUID_TYPE_HID_DEVICE_INFO,
                         "hidraw-path",
                         hidraw_path,
@@ -196,5 +378,15 @@ liquid_hid_device_info_new_for_udev_device(GUdevDevice *udev_device)
                         vendor,
                         "product-id",
                         product,
+                        "usb-path",
+                        usb_path,
+                        "usb-address",
+                        usb_address,
+                        "serial",
+                        serial,
+                        "report-descriptor-size",
+                        (guint)read_report_descriptor_size(parent),
+                        "interface-number",
+                        interface_number,
                         NULL);
 }
@@ -18,6 +18,25 @@ liquid_hid_device_info_get_vendor_id(LiquidHidDeviceInfo *info);
 unsigned int
 liquid_hid_device_info_get_product_id(LiquidHidDeviceInfo *info);
 
+const gchar *
+liquid_hid_device_info_get_usb_path(LiquidHidDeviceInfo *info);
+
+/* NULL if unknown */
+const gchar *
+liquid_hid_device_info_get_usb_address(LiquidHidDeviceInfo *info);
+
+const gchar *
+liquid_hid_device_info_get_serial(LiquidHidDeviceInfo *info);
+
+gsize
+liquid_hid_device_info_get_report_descriptor_size(LiquidHidDeviceInfo *info);
+
+gint
+liquid_hid_device_info_get_interface_number(LiquidHidDeviceInfo *info);
+
+const gchar *
+liquid_hid_device_info_get_device_key(LiquidHidDeviceInfo *info);
+
 LiquidHidDeviceInfo *
 liquid_hid_device_info_new_for_udev_device(GUdevDevice *udev_device);
 
@@ -7,6 +7,8 @@ struct _LiquidHidManager
     GObject parent;
 
     GUdevClient *udev_client;
+
+    /* Device key -> GPtrArray of LiquidHidDeviceInfo, one per hidraw node */
     GHashTable *devices;
 };
 
@@ -74,6 +76,24 @@ liquid_hid_manager_finalize(GObject *object)
     G_OBJECT_CLASS(liquid_hid_manager_parent_class)->finalize(object);
 }
 
+static gint
+interface_number_cmp(gconstpointer a, gconstpointer b)
+{
+    LiquidHidDeviceInfo *info_a = *(LiquidHidDeviceInfo **)a;
+    LiquidHidDeviceInfo *info_b = *(LiquidHidDeviceInfo **)b;
+
+    gint number_a = liquid_hid_device_info_get_interface_number(info_a);
+    gint number_b = liquid_hid_device_info_get_interface_number(info_b);
+
+    if (number_a != number_b)
+    {
+        return number_a < number_b ? -1 : 1;
+    }
+
+    return g_strcmp0(liquid_hid_device_info_get_hidraw_path(info_a),
+                     liquid_hid_device_info_get_hidraw_path(info_b));
+}
+
 static void
 liquid_hid_manager_add_udev_device(LiquidHidManager *manager, GUdevDevice *udev_device)
 {
@@ -84,13 +104,20 @@ liquid_hid_manager_add_udev_device(LiquidHidManager *manager, GUdevDevice *udev_
         return;
     }
 
-    const gchar *key = liquid_hid_device_info_get_hidraw_path(info);
+    const gchar *key = liquid_hid_device_info_get_device_key(info);
 
     g_return_if_fail(key != NULL);
 
-    g_hash_table_insert(manager->devices,
-                        g_strdup(key),
-                        g_steal_pointer(&info));
+    GPtrArray *interfaces = g_hash_table_lookup(manager->devices, key);
+
+    if (interfaces == NULL)
+    {
+        interfaces = g_ptr_array_new_with_free_func(g_object_unref);
+        g_hash_table_insert(manager->devices, g_strdup(key), interfaces);
+    }
+
+    g_ptr_array_add(interfaces, g_steal_pointer(&info));
+    g_ptr_array_sort(interfaces, interface_number_cmp);
 }
 
 static void
@@ -111,7 +138,10 @@ liquid_hid_manager_constructed(GObject *object)
 static void
 liquid_hid_manager_init(LiquidHidManager *info)
 {
-    info->devices = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_object_unref);
+    info->devices = g_hash_table_new_full(g_str_hash,
+                                          g_str_equal,
+                                          g_free,
+                                          (GDestroyNotify)g_ptr_array_unref);
 }
 
 static void
@@ -155,7 +185,29 @@ liquid_hid_manager_for_each_device(LiquidHidManager *manager,
     g_hash_table_iter_init(&iter, manager->devices);
 
     gchar *key;
-    LiquidHidDeviceInfo *value;
+    GPtrArray *value;
+
+    while (g_hash_table_iter_next(&iter, (gpointer)&key, (gpointer)&value))
+    {
+        for (guint i = 0; i < value->len; i++)
+        {
+            callback(manager, g_ptr_array_index(value, i), user_data);
+        }
+    }
+}
+
+void
+liquid_hid_manager_for_each_device_group(LiquidHidManager *manager,
+                                         LiquidHidManagerForEachGroupCallback callback,
+                                         gpointer user_data)
+{
+    g_return_if_fail(LIQUID_IS_HID_MANAGER(manager));
+
+    GHashTableIter iter;
+    g_hash_table_iter_init(&iter, manager->devices);
+
+    gchar *key;
+    GPtrArray *value;
 
     while (g_hash_table_iter_next(&iter, (gpointer)&key, (gpointer)&value))
     {
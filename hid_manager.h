@@ -24,4 +24,14 @@ liquid_hid_manager_for_each_device(LiquidHidManager *manager,
                                    LiquidHidManagerForEachDeviceCallback callback,
                                    gpointer user_data);
 
+/* interfaces: all hidraw nodes of one physical device, ordered by interface number */
+typedef void (*LiquidHidManagerForEachGroupCallback)(LiquidHidManager *manager,
+                                                     GPtrArray *interfaces,
+                                                     gpointer user_data);
+
+void
+liquid_hid_manager_for_each_device_group(LiquidHidManager *manager,
+                                         LiquidHidManagerForEachGroupCallback callback,
+                                         gpointer user_data);
+
 G_END_DECLS
@@ -0,0 +1,219 @@
+#include "hid_passthrough.h"
+
+#include <errno.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <gio/gio.h>
+#include <glib-unix.h>
+
+enum
+{
+    SIGNAL_OUTPUT_REPORT,
+    N_SIGNALS
+};
+
+static guint signals[N_SIGNALS];
+
+typedef struct
+{
+    LiquidHidPassthrough *passthrough;
+    int fd;
+    GSource *source;
+} PassthroughClient;
+
+struct _LiquidHidPassthrough
+{
+    GObject parent;
+
+    GMainContext *context;
+    GPtrArray *clients;
+
+    /* One more byte than the longest output report, to tell longer ones apart */
+    guint8 *buffer;
+    gsize buffer_size;
+
+    guint64 forwarded;
+    guint64 dropped;
+    guint64 output_reports;
+};
+
+G_DEFINE_FINAL_TYPE(LiquidHidPassthrough, liquid_hid_passthrough, G_TYPE_OBJECT)
+
+static void
+passthrough_client_free(PassthroughClient *client)
+{
+    g_source_destroy(client->source);
+    g_source_unref(client->source);
+    close(client->fd);
+    g_free(client);
+}
+
+static gboolean
+liquid_hid_passthrough_client_readable(gint fd, GIOCondition condition G_GNUC_UNUSED, gpointer user_data)
+{
+    PassthroughClient *client = user_data;
+    LiquidHidPassthrough *passthrough = client->passthrough;
+    ssize_t size = recv(fd, passthrough->buffer, passthrough->buffer_size, MSG_DONTWAIT);
+
+    if (size == -1 && (errno == EAGAIN || errno == EINTR))
+    {
+        return G_SOURCE_CONTINUE;
+    }
+
+    /* Hung up, which also covers G_IO_HUP and G_IO_ERR */
+    if (size <= 0)
+    {
+        g_ptr_array_remove_fast(passthrough->clients, client);
+        return G_SOURCE_REMOVE;
+    }
+
+    if ((gsize)size == passthrough->buffer_size)
+    {
+        g_printerr("Passthrough client output report longer than %" G_GSIZE_FORMAT " bytes discarded\n",
+                   passthrough->buffer_size - 1);
+        return G_SOURCE_CONTINUE;
+    }
+
+    g_autoptr(GBytes) report = g_bytes_new(passthrough->buffer, (gsize)size);
+
+    passthrough->output_reports++;
+    g_signal_emit(passthrough, signals[SIGNAL_OUTPUT_REPORT], 0, report);
+
+    return G_SOURCE_CONTINUE;
+}
+
+static void
+liquid_hid_passthrough_dispose(GObject *object)
+{
+    LiquidHidPassthrough *passthrough = LIQUID_HID_PASSTHROUGH(object);
+
+    g_ptr_array_set_size(passthrough->clients, 0);
+
+    G_OBJECT_CLASS(liquid_hid_passthrough_parent_class)->dispose(object);
+}
+
+static void
+liquid_hid_passthrough_finalize(GObject *object)
+{
+    LiquidHidPassthrough *passthrough = LIQUID_HID_PASSTHROUGH(object);
+
+    g_ptr_array_unref(passthrough->clients);
+    g_main_context_unref(passthrough->context);
+    g_free(passthrough->buffer);
+
+    G_OBJECT_CLASS(liquid_hid_passthrough_parent_class)->finalize(object);
+}
+
+static void
+liquid_hid_passthrough_init(LiquidHidPassthrough *passthrough)
+{
+    passthrough->context = g_main_context_ref_thread_default();
+    passthrough->clients = g_ptr_array_new_with_free_func((GDestroyNotify)passthrough_client_free);
+}
+
+static void
+liquid_hid_passthrough_class_init(LiquidHidPassthroughClass *class)
+{
+    GObjectClass *gobject_class = G_OBJECT_CLASS(class);
+
+    gobject_class->dispose = liquid_hid_passthrough_dispose;
+    gobject_class->finalize = liquid_hid_passthrough_finalize;
+
+    signals[SIGNAL_OUTPUT_REPORT]
+        = g_signal_new("output-report", /* signal_name */
+                       G_TYPE_FROM_CLASS(class), /* itype */
+                       G_SIGNAL_RUN_LAST, /* signal_flags */
+                       0, /* class_offset */
+                       NULL, /* accumulator */
+                       NULL, /* accu_data */
+                       NULL, /* c_marshaller */
+                       G_TYPE_NONE, /* return_type */
+                       1, /* n_params */
+                       G_TYPE_BYTES);
+}
+
+LiquidHidPassthrough *
+liquid_hid_passthrough_new(guint max_output_report_size)
+{
+    g_return_val_if_fail(max_output_report_size > 0, NULL);
+
+    LiquidHidPassthrough *passthrough = g_object_new(LIQUID_TYPE_HID_PASSTHROUGH, NULL);
+
+    passthrough->buffer_size = max_output_report_size + 1;
+    passthrough->buffer = g_malloc(passthrough->buffer_size);
+
+    return passthrough;
+}
+
+gint
+liquid_hid_passthrough_add_client(LiquidHidPassthrough *passthrough, GError **error)
+{
+    g_return_val_if_fail(LIQUID_IS_HID_PASSTHROUGH(passthrough), -1);
+
+    int fds[2];
+
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, fds) == -1)
+    {
+        int errsv = errno;
+        g_set_error(error, G_IO_ERROR, g_io_error_from_errno(errsv), "socketpair: %s", g_strerror(errsv));
+        return -1;
+    }
+
+    PassthroughClient *client = g_new0(PassthroughClient, 1);
+
+    client->passthrough = passthrough;
+    client->fd = fds[0];
+
+    /* Owned by the client, which is freed before the passthrough */
+    client->source = g_unix_fd_source_new(client->fd, G_IO_IN | G_IO_HUP | G_IO_ERR);
+    g_source_set_callback(client->source, G_SOURCE_FUNC(liquid_hid_passthrough_client_readable), client, NULL);
+    g_source_attach(client->source, passthrough->context);
+
+    g_ptr_array_add(passthrough->clients, client);
+
+    return fds[1];
+}
+
+/* Straight from the report's buffer: the socket is the only copy per client */
+void
+liquid_hid_passthrough_forward(LiquidHidPassthrough *passthrough, GBytes *report)
+{
+    g_return_if_fail(LIQUID_IS_HID_PASSTHROUGH(passthrough));
+
+    gsize size = 0;
+    const guint8 *data = g_bytes_get_data(report, &size);
+
+    for (guint i = passthrough->clients->len; i > 0; i--)
+    {
+        PassthroughClient *client = g_ptr_array_index(passthrough->clients, i - 1);
+
+        if (send(client->fd, data, size, MSG_DONTWAIT | MSG_NOSIGNAL) != -1)
+        {
+            passthrough->forwarded++;
+        }
+        else if (errno == EAGAIN || errno == ENOBUFS)
+        {
+            passthrough->dropped++;
+        }
+        else
+        {
+            g_ptr_array_remove_index_fast(passthrough->clients, i - 1);
+        }
+    }
+}
+
+GVariant *
+liquid_hid_passthrough_dup_statistics(LiquidHidPassthrough *passthrough)
+{
+    g_return_val_if_fail(LIQUID_IS_HID_PASSTHROUGH(passthrough), NULL);
+
+    g_auto(GVariantDict) dict = G_VARIANT_DICT_INIT(NULL);
+
+    g_variant_dict_insert(&dict, "clients", "u", passthrough->clients->len);
+    g_variant_dict_insert(&dict, "forwarded", "t", passthrough->forwarded);
+    g_variant_dict_insert(&dict, "dropped", "t", passthrough->dropped);
+    g_variant_dict_insert(&dict, "output-reports", "t", passthrough->output_reports);
+
+    return g_variant_dict_end(&dict);
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <glib-object.h>
+
+G_BEGIN_DECLS
+
+/*
+ * Raw report access for other programs, over SOCK_SEQPACKET connections with
+ * one report per packet. Every input report is copied to each client, and a
+ * client that doesn't keep up loses reports rather than holding up the rest;
+ * reports from clients are handed over through "output-report", on the
+ * thread-default context of the caller of liquid_hid_passthrough_new().
+ */
+#define LIQUID_TYPE_HID_PASSTHROUGH (liquid_hid_passthrough_get_type())
+G_DECLARE_FINAL_TYPE(LiquidHidPassthrough, liquid_hid_passthrough, LIQUID, HID_PASSTHROUGH, GObject)
+
+/* Longer output reports from clients are discarded */
+LiquidHidPassthrough *
+liquid_hid_passthrough_new(guint max_output_report_size);
+
+/* Returns the client's end of a new connection, or -1 */
+gint
+liquid_hid_passthrough_add_client(LiquidHidPassthrough *passthrough, GError **error);
+
+void
+liquid_hid_passthrough_forward(LiquidHidPassthrough *passthrough, GBytes *report);
+
+/*
+ * Returns an a{sv} dictionary with the number of "clients" (u), and counters
+ * "forwarded" and "dropped" input reports and "output-reports" (t).
+ */
+GVariant *
+liquid_hid_passthrough_dup_statistics(LiquidHidPassthrough *passthrough);
+
+G_END_DECLS
@@ -0,0 +1,158 @@
+#include "histogram.h"
+
+/* The last bucket also takes everything above 2^(N_BUCKETS - 2) us, about 36 minutes */
+#define N_BUCKETS 33
+
+struct _LiquidHistogram
+{
+    guint64 buckets[N_BUCKETS];
+    guint64 count;
+    gint64 min;
+    gint64 max;
+    gdouble sum;
+};
+
+LiquidHistogram *
+liquid_histogram_new(void)
+{
+    return g_new0(LiquidHistogram, 1);
+}
+
+void
+liquid_histogram_free(LiquidHistogram *histogram)
+{
+    g_free(histogram);
+}
+
+static guint
+bucket_for_value(gint64 value)
+{
+    guint bucket = 0;
+
+    while (value > 0 && bucket < N_BUCKETS - 1)
+    {
+        value >>= 1;
+        bucket++;
+    }
+
+    return bucket;
+}
+
+void
+liquid_histogram_add(LiquidHistogram *histogram, gint64 value_us)
+{
+    /* Clocks are monotonic, but callers may subtract unrelated timestamps */
+    value_us = MAX(value_us, 0);
+
+    histogram->buckets[bucket_for_value(value_us)]++;
+
+    if (histogram->count == 0 || value_us < histogram->min)
+    {
+        histogram->min = value_us;
+    }
+
+    if (histogram->count == 0 || value_us > histogram->max)
+    {
+        histogram->max = value_us;
+    }
+
+    histogram->count++;
+    histogram->sum += (gdouble)value_us;
+}
+
+guint64
+liquid_histogram_get_count(LiquidHistogram *histogram)
+{
+    return histogram->count;
+}
+
+GVariant *
+liquid_histogram_to_variant(LiquidHistogram *histogram)
+{
+    g_auto(GVariantDict) dict = G_VARIANT_DICT_INIT(NULL);
+    g_auto(GVariantBuilder) buckets = G_VARIANT_BUILDER_INIT(G_VARIANT_TYPE("a(xt)"));
+
+    for (guint i = 0; i < N_BUCKETS; i++)
+    {
+        if (histogram->buckets[i] > 0)
+        {
+            gint64 upper_bound = i == N_BUCKETS - 1 ? G_MAXINT64 : (gint64)1 << i;
+            g_variant_builder_add(&buckets, "(xt)", upper_bound, histogram->buckets[i]);
+        }
+    }
+
+    g_variant_dict_insert(&dict, "count", "t", histogram->count);
+    g_variant_dict_insert(&dict, "min", "x", histogram->min);
+    g_variant_dict_insert(&dict, "max", "x", histogram->max);
+    g_variant_dict_insert(&dict, "mean", "d", histogram->count > 0 ? histogram->sum / (gdouble)histogram->count : 0.0);
+    g_variant_dict_insert_value(&dict, "buckets", g_variant_builder_end(&buckets));
+
+    return g_variant_dict_end(&dict);
+}
+
+static void
+append_series(GString *out, const gchar *name, const gchar *suffix, const gchar *labels, const gchar *le)
+{
+    g_string_append(out, name);
+    g_string_append(out, suffix);
+
+    if (labels == NULL && le == NULL)
+    {
+        g_string_append_c(out, ' ');
+        return;
+    }
+
+    g_string_append_c(out, '{');
+
+    if (labels)
+    {
+        g_string_append(out, labels);
+    }
+
+    if (le)
+    {
+        g_string_append(out, labels ? ",le=\"" : "le=\"");
+        g_string_append(out, le);
+        g_string_append_c(out, '"');
+    }
+
+    g_string_append(out, "} ");
+}
+
+/*
+ * Bucket bounds are exclusive while Prometheus' are inclusive; the difference
+ * only shows for values of exactly a power of two microseconds.
+ */
+void
+liquid_histogram_append_metrics(LiquidHistogram *histogram, GString *out, const gchar *name, const gchar *labels)
+{
+    gchar number[G_ASCII_DTOSTR_BUF_SIZE];
+    gchar le[G_ASCII_DTOSTR_BUF_SIZE];
+    guint64 cumulative = 0;
+
+    for (guint i = 0; i < N_BUCKETS; i++)
+    {
+        cumulative += histogram->buckets[i];
+
+        if (i == N_BUCKETS - 1)
+        {
+            g_strlcpy(le, "+Inf", sizeof(le));
+        }
+        else
+        {
+            g_ascii_dtostr(le, sizeof(le), i == 0 ? 0.0 : (gdouble)((gint64)1 << i) / G_USEC_PER_SEC);
+        }
+
+        append_series(out, name, "_bucket", labels, le);
+        g_string_append(out, g_ascii_dtostr(number, sizeof(number), (gdouble)cumulative));
+        g_string_append_c(out, '\n');
+    }
+
+    append_series(out, name, "_sum", labels, NULL);
+    g_string_append(out, g_ascii_dtostr(number, sizeof(number), histogram->sum / G_USEC_PER_SEC));
+    g_string_append_c(out, '\n');
+
+    append_series(out, name, "_count", labels, NULL);
+    g_string_append(out, g_ascii_dtostr(number, sizeof(number), (gdouble)histogram->count));
+    g_string_append_c(out, '\n');
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/*
+ * Histogram of non-negative durations in microseconds, with power-of-two
+ * buckets: bucket n counts values in [2^(n-1), 2^n), bucket 0 counts zeros.
+ */
+typedef struct _LiquidHistogram LiquidHistogram;
+
+LiquidHistogram *
+liquid_histogram_new(void);
+
+void
+liquid_histogram_free(LiquidHistogram *histogram);
+
+void
+liquid_histogram_add(LiquidHistogram *histogram, gint64 value_us);
+
+guint64
+liquid_histogram_get_count(LiquidHistogram *histogram);
+
+/*
+ * Returns an a{sv} dictionary with "count" (t), "min", "max" (x), "mean" (d)
+ * and "buckets" (a(xt): exclusive upper bound and count of non-empty buckets).
+ */
+GVariant *
+liquid_histogram_to_variant(LiquidHistogram *histogram);
+
+/*
+ * Appends the histogram as Prometheus series `name`_bucket, _sum and _count,
+ * in seconds, with `labels` (text between the braces, or NULL) on each one.
+ * Doesn't allocate, apart from growing `out`.
+ */
+void
+liquid_histogram_append_metrics(LiquidHistogram *histogram, GString *out, const gchar *name, const gchar *labels);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC(LiquidHistogram, liquid_histogram_free)
+
+G_END_DECLS
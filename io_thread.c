@@ -0,0 +1,161 @@
+#include "io_thread.h"
+
+/* A thread running its own main context, for device I/O off the D-Bus thread */
+struct _LiquidIoThread
+{
+    GObject parent;
+
+    gchar *name;
+    GMainContext *context;
+    GMainLoop *loop;
+    GThread *thread;
+};
+
+G_DEFINE_FINAL_TYPE(LiquidIoThread, liquid_io_thread, G_TYPE_OBJECT)
+
+enum
+{
+    PROP_0,
+    PROP_NAME,
+    N_PROPERTIES
+};
+
+static GParamSpec *pspecs[N_PROPERTIES];
+
+static gpointer
+liquid_io_thread_run(gpointer user_data)
+{
+    LiquidIoThread *thread = user_data;
+
+    g_main_context_push_thread_default(thread->context);
+    g_main_loop_run(thread->loop);
+    g_main_context_pop_thread_default(thread->context);
+
+    return NULL;
+}
+
+static gboolean
+liquid_io_thread_quit(gpointer user_data)
+{
+    GMainLoop *loop = user_data;
+    g_main_loop_quit(loop);
+    return G_SOURCE_REMOVE;
+}
+
+static void
+liquid_io_thread_get_property(GObject *object, guint property_id, GValue *value, GParamSpec *pspec)
+{
+    LiquidIoThread *thread = LIQUID_IO_THREAD(object);
+
+    switch (property_id)
+    {
+    case PROP_NAME:
+        g_value_set_string(value, thread->name);
+        break;
+
+    default:
+        G_OBJECT_WARN_INVALID_PROPERTY_ID(object, property_id, pspec);
+    }
+}
+
+static void
+liquid_io_thread_set_property(GObject *object, guint property_id, const GValue *value, GParamSpec *pspec)
+{
+    LiquidIoThread *thread = LIQUID_IO_THREAD(object);
+
+    switch (property_id)
+    {
+    case PROP_NAME:
+        g_clear_pointer(&thread->name, g_free);
+        thread->name = g_value_dup_string(value);
+        break;
+
+    default:
+        G_OBJECT_WARN_INVALID_PROPERTY_ID(object, property_id, pspec);
+    }
+}
+
+static void
+liquid_io_thread_constructed(GObject *object)
+{
+    LiquidIoThread *thread = LIQUID_IO_THREAD(object);
+
+    thread->thread = g_thread_new(thread->name, liquid_io_thread_run, thread);
+
+    G_OBJECT_CLASS(liquid_io_thread_parent_class)->constructed(object);
+}
+
+static void
+liquid_io_thread_dispose(GObject *object)
+{
+    LiquidIoThread *thread = LIQUID_IO_THREAD(object);
+
+    if (thread->thread)
+    {
+        /*
+         * Quitting through the context rather than directly avoids racing with
+         * g_main_loop_run() if the thread hasn't got that far yet
+         */
+        g_main_context_invoke(thread->context, liquid_io_thread_quit, thread->loop);
+        g_thread_join(g_steal_pointer(&thread->thread));
+    }
+
+    G_OBJECT_CLASS(liquid_io_thread_parent_class)->dispose(object);
+}
+
+static void
+liquid_io_thread_finalize(GObject *object)
+{
+    LiquidIoThread *thread = LIQUID_IO_THREAD(object);
+
+    g_clear_pointer(&thread->loop, g_main_loop_unref);
+    g_clear_pointer(&thread->context, g_main_context_unref);
+    g_clear_pointer(&thread->name, g_free);
+
+    G_OBJECT_CLASS(liquid_io_thread_parent_class)->finalize(object);
+}
+
+static void
+liquid_io_thread_init(LiquidIoThread *thread)
+{
+    thread->context = g_main_context_new();
+    thread->loop = g_main_loop_new(thread->context, FALSE);
+}
+
+static void
+liquid_io_thread_class_init(LiquidIoThreadClass *class)
+{
+    GObjectClass *gobject_class = G_OBJECT_CLASS(class);
+
+    gobject_class->constructed = liquid_io_thread_constructed;
+    gobject_class->dispose = liquid_io_thread_dispose;
+    gobject_class->finalize = liquid_io_thread_finalize;
+    gobject_class->get_property = liquid_io_thread_get_property;
+    gobject_class->set_property = liquid_io_thread_set_property;
+
+    pspecs[PROP_NAME]
+        = g_param_spec_string("name", /* name */
+                              "Thread name", /* nick */
+                              "Thread name", /* blurb */
+                              "liquidd-io", /* default_value */
+                              G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY | G_PARAM_STATIC_STRINGS);
+
+    g_object_class_install_properties(gobject_class, N_PROPERTIES, pspecs);
+}
+
+LiquidIoThread *
+liquid_io_thread_new(const gchar *name)
+{
+    return g_object_new(LIQUID_TYPE_IO_THREAD,
+                        "name",
+                        name,
+                        NULL);
+}
+
+GMainContext *
+liquid_io_thread_get_context(LiquidIoThread *thread)
+{
+    g_return_val_if_fail(LIQUID_IS_IO_THREAD(thread), NULL);
+
+    return thread->context;
+}
@@ -0,0 +1,16 @@
+#pragma once
+
+#include <glib-object.h>
+
+G_BEGIN_DECLS
+
+#define LIQUID_TYPE_IO_THREAD (liquid_io_thread_get_type())
+G_DECLARE_FINAL_TYPE(LiquidIoThread, liquid_io_thread, LIQUID, IO_THREAD, GObject)
+
+LiquidIoThread *
+liquid_io_thread_new(const gchar *name);
+
+GMainContext *
+liquid_io_thread_get_context(LiquidIoThread *thread);
+
+G_END_DECLS
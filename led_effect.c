@@ -0,0 +1,229 @@
+#include "led_effect.h"
+
+#include <math.h>
+#include <string.h>
+
+#define WHEEL_SIZE 256
+
+/* Fully saturated hues, so that the spectrum wave is a table lookup per LED */
+static guint8 wheel[WHEEL_SIZE][3];
+
+static void
+wheel_init(void)
+{
+    static gsize initialized = 0;
+
+    if (!g_once_init_enter(&initialized))
+    {
+        return;
+    }
+
+    for (guint i = 0; i < WHEEL_SIZE; i++)
+    {
+        /* Six segments of a linear ramp between the primaries */
+        guint segment = i * 6 / WHEEL_SIZE;
+        guint8 ramp = (guint8)((i * 6 % WHEEL_SIZE) * 255 / (WHEEL_SIZE - 1));
+        guint8 up = ramp;
+        guint8 down = 255 - ramp;
+        const guint8 colors[6][3] = {
+            { 255, up, 0 },
+            { down, 255, 0 },
+            { 0, 255, up },
+            { 0, down, 255 },
+            { up, 0, 255 },
+            { 255, 0, down },
+        };
+
+        memcpy(wheel[i], colors[segment], 3);
+    }
+
+    g_once_init_leave(&initialized, 1);
+}
+
+static void
+fill(guint8 *restrict rgb, const guint8 color[3], guint n_leds)
+{
+    for (guint i = 0; i < n_leds; i++)
+    {
+        rgb[3 * i] = color[0];
+        rgb[3 * i + 1] = color[1];
+        rgb[3 * i + 2] = color[2];
+    }
+}
+
+/* rgb = rgb * scale / 255, rounded */
+static void
+scale(guint8 *restrict rgb, guint8 factor, gsize n_bytes)
+{
+    for (gsize i = 0; i < n_bytes; i++)
+    {
+        guint product = (guint)rgb[i] * factor + 128;
+        rgb[i] = (guint8)((product + (product >> 8)) >> 8);
+    }
+}
+
+/* rgb = a * (255 - w) / 255 + b * w / 255 per LED, with one weight per LED */
+static void
+blend(guint8 *restrict rgb, const guint8 a[3], const guint8 b[3], const guint8 *restrict weights, guint n_leds)
+{
+    for (guint i = 0; i < n_leds; i++)
+    {
+        for (guint c = 0; c < 3; c++)
+        {
+            guint mixed = (guint)a[c] * (255u - weights[i]) + (guint)b[c] * weights[i] + 128;
+            rgb[3 * i + c] = (guint8)((mixed + (mixed >> 8)) >> 8);
+        }
+    }
+}
+
+static gboolean
+parse_color(const gchar *string, guint8 color[3])
+{
+    if (strlen(string) != 6)
+    {
+        return FALSE;
+    }
+
+    for (guint i = 0; i < 3; i++)
+    {
+        gint high = g_ascii_xdigit_value(string[2 * i]);
+        gint low = g_ascii_xdigit_value(string[2 * i + 1]);
+
+        if (high < 0 || low < 0)
+        {
+            return FALSE;
+        }
+
+        color[i] = (guint8)(high << 4 | low);
+    }
+
+    return TRUE;
+}
+
+gboolean
+liquid_led_effect_parse(const gchar *spec, LiquidLedEffect *effect, GError **error)
+{
+    g_return_val_if_fail(spec != NULL, FALSE);
+    g_return_val_if_fail(effect != NULL, FALSE);
+
+    g_auto(GStrv) words = g_strsplit(spec, " ", -1);
+    guint n_words = g_strv_length(words);
+    const struct
+    {
+        const gchar *name;
+        LiquidLedEffectType type;
+        guint n_colors;
+        gboolean has_period;
+    } effects[] = {
+        { "static", LIQUID_LED_EFFECT_STATIC, 1, FALSE },
+        { "breathing", LIQUID_LED_EFFECT_BREATHING, 1, TRUE },
+        { "gradient", LIQUID_LED_EFFECT_GRADIENT, 2, FALSE },
+        { "spectrum-wave", LIQUID_LED_EFFECT_SPECTRUM_WAVE, 0, TRUE },
+    };
+
+    for (guint i = 0; i < G_N_ELEMENTS(effects); i++)
+    {
+        if (n_words == 0 || !g_str_equal(words[0], effects[i].name))
+        {
+            continue;
+        }
+
+        if (n_words != 1 + effects[i].n_colors + (effects[i].has_period ? 1 : 0))
+        {
+            break;
+        }
+
+        memset(effect, 0, sizeof(*effect));
+        effect->type = effects[i].type;
+
+        for (guint j = 0; j < effects[i].n_colors; j++)
+        {
+            if (!parse_color(words[1 + j], effect->colors[j]))
+            {
+                g_set_error(error, G_OPTION_ERROR, G_OPTION_ERROR_BAD_VALUE, "Invalid color '%s'", words[1 + j]);
+                return FALSE;
+            }
+        }
+
+        if (effects[i].has_period)
+        {
+            guint64 period_ms = 0;
+
+            if (!g_ascii_string_to_unsigned(words[n_words - 1], 10, 1, G_MAXUINT, &period_ms, error))
+            {
+                return FALSE;
+            }
+
+            effect->period_ms = (guint)period_ms;
+        }
+
+        return TRUE;
+    }
+
+    g_set_error(error,
+                G_OPTION_ERROR,
+                G_OPTION_ERROR_BAD_VALUE,
+                "Invalid effect '%s', expected 'static RRGGBB', 'breathing RRGGBB PERIOD_MS', "
+                "'gradient RRGGBB RRGGBB' or 'spectrum-wave PERIOD_MS'",
+                spec);
+    return FALSE;
+}
+
+/* Position in the effect's cycle, from 0 to 1 */
+static gdouble
+cycle_phase(const LiquidLedEffect *effect, gint64 time_us)
+{
+    gint64 period_us = (gint64)effect->period_ms * 1000;
+
+    return (gdouble)(time_us % period_us) / (gdouble)period_us;
+}
+
+void
+liquid_led_effect_render(const LiquidLedEffect *effect, gint64 time_us, guint8 *rgb, guint n_leds)
+{
+    g_return_if_fail(effect != NULL);
+    g_return_if_fail(rgb != NULL || n_leds == 0);
+    g_return_if_fail(n_leds <= LIQUID_LED_EFFECT_MAX_LEDS);
+
+    switch (effect->type)
+    {
+    case LIQUID_LED_EFFECT_STATIC:
+        fill(rgb, effect->colors[0], n_leds);
+        break;
+
+    case LIQUID_LED_EFFECT_BREATHING:
+    {
+        gdouble brightness = (1.0 - cos(2.0 * G_PI * cycle_phase(effect, time_us))) / 2.0;
+
+        fill(rgb, effect->colors[0], n_leds);
+        scale(rgb, (guint8)lround(brightness * 255.0), (gsize)n_leds * 3);
+        break;
+    }
+
+    case LIQUID_LED_EFFECT_GRADIENT:
+    {
+        guint8 weights[LIQUID_LED_EFFECT_MAX_LEDS];
+
+        for (guint i = 0; i < n_leds; i++)
+        {
+            weights[i] = (guint8)(n_leds > 1 ? i * 255 / (n_leds - 1) : 0);
+        }
+
+        blend(rgb, effect->colors[0], effect->colors[1], weights, n_leds);
+        break;
+    }
+
+    case LIQUID_LED_EFFECT_SPECTRUM_WAVE:
+    {
+        guint offset = (guint)(cycle_phase(effect, time_us) * WHEEL_SIZE);
+
+        wheel_init();
+
+        for (guint i = 0; i < n_leds; i++)
+        {
+            memcpy(&rgb[3 * i], wheel[(i * WHEEL_SIZE / MAX(n_leds, 1) + offset) % WHEEL_SIZE], 3);
+        }
+        break;
+    }
+    }
+}
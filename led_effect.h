@@ -0,0 +1,43 @@
+#pragma once
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+#define LIQUID_LED_EFFECT_MAX_LEDS 256
+
+typedef enum
+{
+    LIQUID_LED_EFFECT_STATIC,
+    LIQUID_LED_EFFECT_BREATHING,
+    LIQUID_LED_EFFECT_GRADIENT,
+    LIQUID_LED_EFFECT_SPECTRUM_WAVE,
+} LiquidLedEffectType;
+
+/*
+ * An effect as a function of time, parsed from one of
+ *
+ *     static RRGGBB
+ *     breathing RRGGBB PERIOD_MS
+ *     gradient RRGGBB RRGGBB
+ *     spectrum-wave PERIOD_MS
+ */
+typedef struct
+{
+    LiquidLedEffectType type;
+    guint8 colors[2][3];
+    guint period_ms;
+} LiquidLedEffect;
+
+gboolean
+liquid_led_effect_parse(const gchar *spec, LiquidLedEffect *effect, GError **error);
+
+/*
+ * Computes the frame at `time_us` (any monotonic time base) into `rgb`, which
+ * holds n_leds packed RGB triplets. Doesn't allocate; the kernels are plain
+ * loops over bytes that compilers vectorize.
+ */
+void
+liquid_led_effect_render(const LiquidLedEffect *effect, gint64 time_us, guint8 *rgb, guint n_leds);
+
+G_END_DECLS
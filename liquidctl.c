@@ -1,8 +1,22 @@
 #include <stdlib.h>
+#include <string.h>
 
 #include <gio/gio.h>
 
 #include "dbus_interfaces.h"
+#include "liquidctl.h"
+
+typedef struct
+{
+    const gchar *name;
+    int (*run)(GDBusConnection *connection, int argc, char *argv[]);
+} Command;
+
+static const Command commands[] = {
+    { "monitor", liquidctl_monitor },
+    { "get", liquidctl_get },
+    { "bench", liquidctl_bench },
+};
 
 static gint
 object_path_cmp(gconstpointer a, gconstpointer b)
@@ -14,23 +28,307 @@ object_path_cmp(gconstpointer a, gconstpointer b)
                      g_dbus_object_get_object_path(obj_b));
 }
 
-int
-main(void)
+gboolean
+liquidctl_parse_object_path(const gchar *path, gchar **device, gchar **channel)
 {
-    g_autoptr(GError) error = NULL;
-    g_autoptr(GDBusConnection) connection = g_bus_get_sync(G_BUS_TYPE_SESSION, NULL, &error);
+    const gchar *prefix = LIQUIDCTL_OBJECT_PATH "/";
 
-    if (!connection)
+    if (!g_str_has_prefix(path, prefix))
     {
-        g_printerr("Can't connect to D-Bus: %s\n", error->message);
-        return EXIT_FAILURE;
+        return FALSE;
+    }
+
+    g_auto(GStrv) elements = g_strsplit(path + strlen(prefix), "/", 3);
+    guint n_elements = g_strv_length(elements);
+
+    if (n_elements == 0 || n_elements > 2)
+    {
+        return FALSE;
+    }
+
+    *device = g_strdup(elements[0]);
+    *channel = n_elements == 2 ? g_strdup(elements[1]) : NULL;
+
+    return TRUE;
+}
+
+gboolean
+liquidctl_parse_format(const gchar *name, LiquidctlFormat *format, GError **error)
+{
+    static const gchar *const names[] = {
+        [LIQUIDCTL_FORMAT_TABLE] = "table",
+        [LIQUIDCTL_FORMAT_JSON] = "json",
+        [LIQUIDCTL_FORMAT_CSV] = "csv",
+        [LIQUIDCTL_FORMAT_VALUE] = "value",
+    };
+
+    for (guint i = 0; i < G_N_ELEMENTS(names); i++)
+    {
+        if (g_str_equal(name, names[i]))
+        {
+            *format = (LiquidctlFormat)i;
+            return TRUE;
+        }
+    }
+
+    g_set_error(error, G_OPTION_ERROR, G_OPTION_ERROR_BAD_VALUE, "Unknown format '%s', expected table, json, csv or value", name);
+    return FALSE;
+}
+
+static void
+append_json_string(GString *out, const gchar *string)
+{
+    g_string_append_c(out, '"');
+
+    for (const gchar *c = string; *c; c++)
+    {
+        switch (*c)
+        {
+        case '"':
+            g_string_append(out, "\\\"");
+            break;
+
+        case '\\':
+            g_string_append(out, "\\\\");
+            break;
+
+        case '\n':
+            g_string_append(out, "\\n");
+            break;
+
+        default:
+            if ((guchar)*c < 0x20)
+            {
+                g_string_append_printf(out, "\\u%04x", (guchar)*c);
+            }
+            else
+            {
+                g_string_append_c(out, *c);
+            }
+        }
+    }
+
+    g_string_append_c(out, '"');
+}
+
+/* Numbers and booleans as they are, strings quoted, anything else in GVariant text format */
+static void
+append_json_value(GString *out, GVariant *value)
+{
+    switch (g_variant_classify(value))
+    {
+    case G_VARIANT_CLASS_BOOLEAN:
+        g_string_append(out, g_variant_get_boolean(value) ? "true" : "false");
+        break;
+
+    case G_VARIANT_CLASS_BYTE:
+        g_string_append_printf(out, "%u", g_variant_get_byte(value));
+        break;
+
+    case G_VARIANT_CLASS_INT16:
+        g_string_append_printf(out, "%d", g_variant_get_int16(value));
+        break;
+
+    case G_VARIANT_CLASS_UINT16:
+        g_string_append_printf(out, "%u", g_variant_get_uint16(value));
+        break;
+
+    case G_VARIANT_CLASS_INT32:
+        g_string_append_printf(out, "%d", g_variant_get_int32(value));
+        break;
+
+    case G_VARIANT_CLASS_UINT32:
+        g_string_append_printf(out, "%u", g_variant_get_uint32(value));
+        break;
+
+    case G_VARIANT_CLASS_INT64:
+        g_string_append_printf(out, "%" G_GINT64_FORMAT, g_variant_get_int64(value));
+        break;
+
+    case G_VARIANT_CLASS_UINT64:
+        g_string_append_printf(out, "%" G_GUINT64_FORMAT, g_variant_get_uint64(value));
+        break;
+
+    case G_VARIANT_CLASS_DOUBLE:
+    {
+        gchar buffer[G_ASCII_DTOSTR_BUF_SIZE];
+        g_string_append(out, g_ascii_dtostr(buffer, sizeof(buffer), g_variant_get_double(value)));
+        break;
+    }
+
+    case G_VARIANT_CLASS_STRING:
+    case G_VARIANT_CLASS_OBJECT_PATH:
+    case G_VARIANT_CLASS_SIGNATURE:
+        append_json_string(out, g_variant_get_string(value, NULL));
+        break;
+
+    default:
+    {
+        g_autofree gchar *text = g_variant_print(value, FALSE);
+        append_json_string(out, text);
+        break;
+    }
+    }
+}
+
+static void
+append_csv_field(GString *out, const gchar *field)
+{
+    if (strpbrk(field, ",\"\n") == NULL)
+    {
+        g_string_append(out, field);
+        return;
+    }
+
+    g_string_append_c(out, '"');
+
+    for (const gchar *c = field; *c; c++)
+    {
+        if (*c == '"')
+        {
+            g_string_append_c(out, '"');
+        }
+
+        g_string_append_c(out, *c);
+    }
+
+    g_string_append_c(out, '"');
+}
+
+void
+liquidctl_print_header(LiquidctlFormat format, gboolean with_time)
+{
+    switch (format)
+    {
+    case LIQUIDCTL_FORMAT_TABLE:
+        g_print("%s%-40s %-10s %-28s %-16s %s\n",
+                with_time ? "TIME                          " : "",
+                "DEVICE",
+                "CHANNEL",
+                "INTERFACE",
+                "PROPERTY",
+                "VALUE");
+        break;
+
+    case LIQUIDCTL_FORMAT_CSV:
+        g_print("%sdevice,channel,interface,property,value\n", with_time ? "time," : "");
+        break;
+
+    case LIQUIDCTL_FORMAT_JSON:
+    case LIQUIDCTL_FORMAT_VALUE:
+        break;
+    }
+}
+
+void
+liquidctl_print_property(LiquidctlFormat format,
+                         GDateTime *time,
+                         const gchar *device,
+                         const gchar *channel,
+                         const gchar *interface_name,
+                         const gchar *property_name,
+                         GVariant *value)
+{
+    g_autoptr(GString) line = g_string_new(NULL);
+    g_autofree gchar *time_str = time ? g_date_time_format_iso8601(time) : NULL;
+
+    switch (format)
+    {
+    case LIQUIDCTL_FORMAT_TABLE:
+    {
+        g_autofree gchar *value_str = g_variant_print(value, FALSE);
+
+        if (time_str)
+        {
+            g_string_append_printf(line, "%-29s ", time_str);
+        }
+
+        g_string_append_printf(line,
+                               "%-40s %-10s %-28s %-16s %s",
+                               device,
+                               channel ? channel : "-",
+                               interface_name,
+                               property_name,
+                               value_str);
+        break;
+    }
+
+    case LIQUIDCTL_FORMAT_JSON:
+        g_string_append_c(line, '{');
+
+        if (time_str)
+        {
+            g_string_append(line, "\"time\":");
+            append_json_string(line, time_str);
+            g_string_append_c(line, ',');
+        }
+
+        g_string_append(line, "\"device\":");
+        append_json_string(line, device);
+        g_string_append(line, ",\"channel\":");
+
+        if (channel)
+        {
+            append_json_string(line, channel);
+        }
+        else
+        {
+            g_string_append(line, "null");
+        }
+
+        g_string_append(line, ",\"interface\":");
+        append_json_string(line, interface_name);
+        g_string_append(line, ",\"property\":");
+        append_json_string(line, property_name);
+        g_string_append(line, ",\"value\":");
+        append_json_value(line, value);
+        g_string_append_c(line, '}');
+        break;
+
+    case LIQUIDCTL_FORMAT_CSV:
+    {
+        g_autofree gchar *value_str = g_variant_is_of_type(value, G_VARIANT_TYPE_STRING)
+                                          ? g_strdup(g_variant_get_string(value, NULL))
+                                          : g_variant_print(value, FALSE);
+
+        if (time_str)
+        {
+            g_string_append_printf(line, "%s,", time_str);
+        }
+
+        append_csv_field(line, device);
+        g_string_append_c(line, ',');
+        append_csv_field(line, channel ? channel : "");
+        g_string_append_printf(line, ",%s,%s,", interface_name, property_name);
+        append_csv_field(line, value_str);
+        break;
     }
 
+    case LIQUIDCTL_FORMAT_VALUE:
+        if (g_variant_is_of_type(value, G_VARIANT_TYPE_STRING))
+        {
+            g_string_append(line, g_variant_get_string(value, NULL));
+        }
+        else
+        {
+            g_variant_print_string(value, line, FALSE);
+        }
+        break;
+    }
+
+    /* g_print flushes, so consumers tailing the output see every line as it's printed */
+    g_print("%s\n", line->str);
+}
+
+static int
+list_objects(GDBusConnection *connection)
+{
+    g_autoptr(GError) error = NULL;
     g_autoptr(GDBusObjectManager) manager
         = liquid_dbus_object_manager_client_new_sync(connection, /* connection */
                                                      G_DBUS_OBJECT_MANAGER_CLIENT_FLAGS_NONE, /* flags */
-                                                     "org.liquidctl.LiquidD", /* name */
-                                                     "/org/liquidctl/LiquidD", /* object_path */
+                                                     LIQUIDCTL_BUS_NAME, /* name */
+                                                     LIQUIDCTL_OBJECT_PATH, /* object_path */
                                                      NULL, /* cancellable */
                                                      &error /* error */);
     if (!manager)
@@ -74,3 +372,41 @@ main(void)
 
     return EXIT_SUCCESS;
 }
+
+int
+main(int argc, char *argv[])
+{
+    g_autoptr(GError) error = NULL;
+    g_autoptr(GDBusConnection) connection = g_bus_get_sync(G_BUS_TYPE_SESSION, NULL, &error);
+
+    if (!connection)
+    {
+        g_printerr("Can't connect to D-Bus: %s\n", error->message);
+        return EXIT_FAILURE;
+    }
+
+    if (argc < 2)
+    {
+        return list_objects(connection);
+    }
+
+    for (guint i = 0; i < G_N_ELEMENTS(commands); i++)
+    {
+        if (g_str_equal(argv[1], commands[i].name))
+        {
+            return commands[i].run(connection, argc - 1, argv + 1);
+        }
+    }
+
+    g_printerr("Unknown command '%s'\n", argv[1]);
+    g_printerr("Usage: %s [", argv[0]);
+
+    for (guint i = 0; i < G_N_ELEMENTS(commands); i++)
+    {
+        g_printerr("%s%s", i > 0 ? "|" : "", commands[i].name);
+    }
+
+    g_printerr("] [OPTION...]\n");
+
+    return EXIT_FAILURE;
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <gio/gio.h>
+
+G_BEGIN_DECLS
+
+#define LIQUIDCTL_BUS_NAME "org.liquidctl.LiquidD"
+#define LIQUIDCTL_OBJECT_PATH "/org/liquidctl/LiquidD"
+
+typedef enum
+{
+    LIQUIDCTL_FORMAT_TABLE,
+    LIQUIDCTL_FORMAT_JSON,
+    LIQUIDCTL_FORMAT_CSV,
+    /* Just the value, for shell scripts */
+    LIQUIDCTL_FORMAT_VALUE,
+} LiquidctlFormat;
+
+/*
+ * Splits a path exported by liquidd into the device object name and, for
+ * channel objects, the channel name. Returns FALSE for other paths.
+ */
+gboolean
+liquidctl_parse_object_path(const gchar *path, gchar **device, gchar **channel);
+
+gboolean
+liquidctl_parse_format(const gchar *name, LiquidctlFormat *format, GError **error);
+
+/*
+ * One property value per line, with a leading time column if with_time; the
+ * header is only printed for tables and CSV.
+ */
+void
+liquidctl_print_header(LiquidctlFormat format, gboolean with_time);
+
+void
+liquidctl_print_property(LiquidctlFormat format,
+                         GDateTime *time,
+                         const gchar *device,
+                         const gchar *channel,
+                         const gchar *interface_name,
+                         const gchar *property_name,
+                         GVariant *value);
+
+int
+liquidctl_monitor(GDBusConnection *connection, int argc, char *argv[]);
+
+int
+liquidctl_get(GDBusConnection *connection, int argc, char *argv[]);
+
+int
+liquidctl_bench(GDBusConnection *connection, int argc, char *argv[]);
+
+G_END_DECLS
@@ -0,0 +1,520 @@
+#include <stdlib.h>
+
+#include <gio/gio.h>
+
+#include "histogram.h"
+#include "liquidctl.h"
+
+/*
+ * Measures liquidd the way clients see it: over the same bus connection, with
+ * the same calls. Report to signal delays compare the ReportTime property with
+ * the local monotonic clock, which liquidd shares as it always runs on the same
+ * host as its bus.
+ */
+
+typedef struct
+{
+    gchar *device_path;
+    gboolean has_init_device;
+
+    /* A property that is read back for the latency and throughput measurements */
+    gchar *property_path;
+    gchar *property_interface;
+    gchar *property_name;
+} Target;
+
+static void
+target_clear_property(Target *target)
+{
+    g_clear_pointer(&target->property_path, g_free);
+    g_clear_pointer(&target->property_interface, g_free);
+    g_clear_pointer(&target->property_name, g_free);
+}
+
+static void
+target_clear(Target *target)
+{
+    g_clear_pointer(&target->device_path, g_free);
+    target_clear_property(target);
+}
+
+G_DEFINE_AUTO_CLEANUP_CLEAR_FUNC(Target, target_clear)
+
+static gint
+compare_int64(gconstpointer a, gconstpointer b)
+{
+    gint64 x = *(const gint64 *)a;
+    gint64 y = *(const gint64 *)b;
+
+    return x < y ? -1 : x > y;
+}
+
+static gint64
+percentile(GArray *sorted, gdouble p)
+{
+    guint index = (guint)(p / 100.0 * (sorted->len - 1) + 0.5);
+
+    return g_array_index(sorted, gint64, index);
+}
+
+static void
+print_results(const gchar *name, GArray *samples_us)
+{
+    if (samples_us->len == 0)
+    {
+        g_print("%s: no samples\n\n", name);
+        return;
+    }
+
+    g_autoptr(LiquidHistogram) histogram = liquid_histogram_new();
+
+    for (guint i = 0; i < samples_us->len; i++)
+    {
+        liquid_histogram_add(histogram, g_array_index(samples_us, gint64, i));
+    }
+
+    g_array_sort(samples_us, compare_int64);
+
+    g_print("%s: %u samples, us: min %" G_GINT64_FORMAT " p50 %" G_GINT64_FORMAT " p90 %" G_GINT64_FORMAT
+            " p99 %" G_GINT64_FORMAT " p99.9 %" G_GINT64_FORMAT " max %" G_GINT64_FORMAT "\n",
+            name,
+            samples_us->len,
+            g_array_index(samples_us, gint64, 0),
+            percentile(samples_us, 50),
+            percentile(samples_us, 90),
+            percentile(samples_us, 99),
+            percentile(samples_us, 99.9),
+            g_array_index(samples_us, gint64, samples_us->len - 1));
+
+    g_autoptr(GVariant) statistics = liquid_histogram_to_variant(histogram);
+    g_autoptr(GVariant) buckets = g_variant_lookup_value(statistics, "buckets", G_VARIANT_TYPE("a(xt)"));
+    GVariantIter iter;
+    gint64 upper_bound;
+    guint64 count;
+    guint64 cumulative = 0;
+
+    g_variant_iter_init(&iter, buckets);
+
+    /* Bucket bound, count, cumulative percentage, and one mark per 2% of the samples */
+    while (g_variant_iter_next(&iter, "(xt)", &upper_bound, &count))
+    {
+        g_autofree gchar *bar = g_strnfill(MAX(1, count * 50 / samples_us->len), '#');
+
+        cumulative += count;
+
+        if (upper_bound == G_MAXINT64)
+        {
+            g_print("  %10s", "larger");
+        }
+        else
+        {
+            g_print("  < %8" G_GINT64_FORMAT, upper_bound);
+        }
+
+        g_print(" %8" G_GUINT64_FORMAT " %6.2f%% %s\n",
+                count,
+                100.0 * (gdouble)cumulative / samples_us->len,
+                bar);
+    }
+
+    g_print("\n");
+}
+
+/* The first property of the first channel, or the device's own vendor ID */
+static void
+target_find_property(Target *target, GVariant *objects)
+{
+    g_autofree gchar *channel_prefix = g_strconcat(target->device_path, "/", NULL);
+    GVariantIter iter;
+    const gchar *object_path;
+    GVariant *interfaces;
+
+    g_variant_iter_init(&iter, objects);
+
+    while (g_variant_iter_next(&iter, "{&o@a{sa{sv}}}", &object_path, &interfaces))
+    {
+        g_autoptr(GVariant) owned_interfaces = interfaces;
+        GVariantIter interface_iter;
+        const gchar *interface_name;
+        GVariant *properties;
+
+        if (!g_str_has_prefix(object_path, channel_prefix)
+            || (target->property_path && g_strcmp0(object_path, target->property_path) > 0))
+        {
+            continue;
+        }
+
+        g_variant_iter_init(&interface_iter, interfaces);
+
+        while (g_variant_iter_next(&interface_iter, "{&s@a{sv}}", &interface_name, &properties))
+        {
+            g_autoptr(GVariant) owned_properties = properties;
+            const gchar *property_name;
+
+            if (g_str_has_prefix(interface_name, "org.liquidctl.") && g_variant_n_children(properties) > 0)
+            {
+                g_variant_get_child(properties, 0, "{&sv}", &property_name, NULL);
+
+                target_clear_property(target);
+                target->property_path = g_strdup(object_path);
+                target->property_interface = g_strdup(interface_name);
+                target->property_name = g_strdup(property_name);
+                break;
+            }
+        }
+    }
+
+    if (target->property_path == NULL)
+    {
+        target->property_path = g_strdup(target->device_path);
+        target->property_interface = g_strdup("org.liquidctl.HidDevice");
+        target->property_name = g_strdup("VendorId");
+    }
+}
+
+static gboolean
+target_find(Target *target, GDBusConnection *connection, GPatternSpec *device_pattern, GError **error)
+{
+    g_autoptr(GVariant) reply = g_dbus_connection_call_sync(connection,
+                                                            LIQUIDCTL_BUS_NAME,
+                                                            LIQUIDCTL_OBJECT_PATH,
+                                                            "org.freedesktop.DBus.ObjectManager",
+                                                            "GetManagedObjects",
+                                                            NULL,
+                                                            G_VARIANT_TYPE("(a{oa{sa{sv}}})"),
+                                                            G_DBUS_CALL_FLAGS_NONE,
+                                                            -1,
+                                                            NULL,
+                                                            error);
+
+    if (reply == NULL)
+    {
+        return FALSE;
+    }
+
+    g_autoptr(GVariant) objects = g_variant_get_child_value(reply, 0);
+    GVariantIter iter;
+    const gchar *object_path;
+    GVariant *interfaces;
+
+    g_variant_iter_init(&iter, objects);
+
+    /* Lowest matching device path, so that repeated runs pick the same device */
+    while (g_variant_iter_next(&iter, "{&o@a{sa{sv}}}", &object_path, &interfaces))
+    {
+        g_autoptr(GVariant) owned_interfaces = interfaces;
+        g_autofree gchar *device = NULL;
+        g_autofree gchar *channel = NULL;
+
+        if (!liquidctl_parse_object_path(object_path, &device, &channel) || channel
+            || (device_pattern && !g_pattern_spec_match_string(device_pattern, device))
+            || !g_variant_lookup(interfaces, "org.liquidctl.HidDevice", "@a{sv}", NULL)
+            || (target->device_path && g_strcmp0(object_path, target->device_path) > 0))
+        {
+            continue;
+        }
+
+        g_free(target->device_path);
+        target->device_path = g_strdup(object_path);
+        target->has_init_device = g_variant_lookup(interfaces, "org.liquidctl.InitDevice", "@a{sv}", NULL);
+    }
+
+    if (target->device_path == NULL)
+    {
+        g_set_error(error, G_IO_ERROR, G_IO_ERROR_NOT_FOUND, "No matching device");
+        return FALSE;
+    }
+
+    target_find_property(target, objects);
+
+    return TRUE;
+}
+
+static gboolean
+measure_get_latency(GDBusConnection *connection, Target *target, guint iterations, GError **error)
+{
+    g_autoptr(GArray) samples = g_array_sized_new(FALSE, FALSE, sizeof(gint64), iterations);
+
+    for (guint i = 0; i < iterations; i++)
+    {
+        gint64 start = g_get_monotonic_time();
+        g_autoptr(GVariant) reply
+            = g_dbus_connection_call_sync(connection,
+                                          LIQUIDCTL_BUS_NAME,
+                                          target->property_path,
+                                          "org.freedesktop.DBus.Properties",
+                                          "Get",
+                                          g_variant_new("(ss)", target->property_interface, target->property_name),
+                                          G_VARIANT_TYPE("(v)"),
+                                          G_DBUS_CALL_FLAGS_NONE,
+                                          -1,
+                                          NULL,
+                                          error);
+        gint64 latency = g_get_monotonic_time() - start;
+
+        if (reply == NULL)
+        {
+            return FALSE;
+        }
+
+        g_array_append_val(samples, latency);
+    }
+
+    print_results("property read latency", samples);
+
+    return TRUE;
+}
+
+typedef struct
+{
+    GMainLoop *loop;
+    guint pending;
+    GError *error;
+} Throughput;
+
+static void
+throughput_reply(GObject *source_object, GAsyncResult *result, gpointer user_data)
+{
+    Throughput *throughput = user_data;
+    g_autoptr(GError) error = NULL;
+    g_autoptr(GVariant) reply = g_dbus_connection_call_finish(G_DBUS_CONNECTION(source_object), result, &error);
+
+    if (reply == NULL && throughput->error == NULL)
+    {
+        throughput->error = g_steal_pointer(&error);
+    }
+
+    if (--throughput->pending == 0)
+    {
+        g_main_loop_quit(throughput->loop);
+    }
+}
+
+/* All reads in flight at once, as a busy client with many outstanding requests */
+static gboolean
+measure_get_throughput(GDBusConnection *connection, Target *target, guint iterations, GError **error)
+{
+    g_autoptr(GMainLoop) loop = g_main_loop_new(NULL, FALSE);
+    Throughput throughput = { loop, iterations, NULL };
+    gint64 start = g_get_monotonic_time();
+
+    for (guint i = 0; i < iterations; i++)
+    {
+        g_dbus_connection_call(connection,
+                               LIQUIDCTL_BUS_NAME,
+                               target->property_path,
+                               "org.freedesktop.DBus.Properties",
+                               "Get",
+                               g_variant_new("(ss)", target->property_interface, target->property_name),
+                               G_VARIANT_TYPE("(v)"),
+                               G_DBUS_CALL_FLAGS_NONE,
+                               -1,
+                               NULL,
+                               throughput_reply,
+                               &throughput);
+    }
+
+    g_main_loop_run(loop);
+
+    gint64 elapsed = MAX(g_get_monotonic_time() - start, 1);
+
+    if (throughput.error)
+    {
+        g_propagate_error(error, throughput.error);
+        return FALSE;
+    }
+
+    g_print("property read throughput: %u reads in %" G_GINT64_FORMAT " us, %.0f reads/s\n\n",
+            iterations,
+            elapsed,
+            iterations * (gdouble)G_USEC_PER_SEC / elapsed);
+
+    return TRUE;
+}
+
+static gboolean
+measure_init_device(GDBusConnection *connection, Target *target, guint iterations, GError **error)
+{
+    g_autoptr(GArray) samples = g_array_sized_new(FALSE, FALSE, sizeof(gint64), iterations);
+
+    for (guint i = 0; i < iterations; i++)
+    {
+        gint64 start = g_get_monotonic_time();
+        g_autoptr(GVariant) reply = g_dbus_connection_call_sync(connection,
+                                                                LIQUIDCTL_BUS_NAME,
+                                                                target->device_path,
+                                                                "org.liquidctl.InitDevice",
+                                                                "InitDevice",
+                                                                NULL,
+                                                                NULL,
+                                                                G_DBUS_CALL_FLAGS_NONE,
+                                                                -1,
+                                                                NULL,
+                                                                error);
+        gint64 latency = g_get_monotonic_time() - start;
+
+        if (reply == NULL)
+        {
+            return FALSE;
+        }
+
+        g_array_append_val(samples, latency);
+    }
+
+    print_results("InitDevice latency", samples);
+
+    return TRUE;
+}
+
+typedef struct
+{
+    GMainLoop *loop;
+    GArray *samples;
+    guint n_reports;
+} ReportDelay;
+
+static void
+report_delay_properties_changed(GDBusConnection *connection G_GNUC_UNUSED,
+                                const gchar *sender_name G_GNUC_UNUSED,
+                                const gchar *object_path G_GNUC_UNUSED,
+                                const gchar *interface_name G_GNUC_UNUSED,
+                                const gchar *signal_name G_GNUC_UNUSED,
+                                GVariant *parameters,
+                                gpointer user_data)
+{
+    gint64 now = g_get_monotonic_time();
+    ReportDelay *report_delay = user_data;
+    g_autoptr(GVariant) changed = NULL;
+    gint64 report_time;
+
+    g_variant_get(parameters, "(&s@a{sv}as)", NULL, &changed, NULL);
+
+    if (!g_variant_lookup(changed, "ReportTime", "x", &report_time))
+    {
+        return;
+    }
+
+    gint64 delay = now - report_time;
+    g_array_append_val(report_delay->samples, delay);
+
+    if (report_delay->samples->len >= report_delay->n_reports)
+    {
+        g_main_loop_quit(report_delay->loop);
+    }
+}
+
+static gboolean
+report_delay_timeout(gpointer user_data)
+{
+    ReportDelay *report_delay = user_data;
+
+    g_main_loop_quit(report_delay->loop);
+    return G_SOURCE_REMOVE;
+}
+
+static void
+measure_report_delay(GDBusConnection *connection, Target *target, guint n_reports, guint timeout_s)
+{
+    g_autoptr(GMainLoop) loop = g_main_loop_new(NULL, FALSE);
+    g_autoptr(GArray) samples = g_array_sized_new(FALSE, FALSE, sizeof(gint64), n_reports);
+    ReportDelay report_delay = { loop, samples, n_reports };
+
+    guint subscription_id = g_dbus_connection_signal_subscribe(connection,
+                                                               LIQUIDCTL_BUS_NAME, /* sender */
+                                                               "org.freedesktop.DBus.Properties", /* interface_name */
+                                                               "PropertiesChanged", /* member */
+                                                               target->device_path, /* object_path */
+                                                               "org.liquidctl.HidDevice", /* arg0 */
+                                                               G_DBUS_SIGNAL_FLAGS_NONE, /* flags */
+                                                               report_delay_properties_changed, /* callback */
+                                                               &report_delay, /* user_data */
+                                                               NULL /* user_data_free_func */);
+    guint timeout_id = g_timeout_add_seconds(timeout_s, report_delay_timeout, &report_delay);
+
+    g_main_loop_run(loop);
+
+    g_dbus_connection_signal_unsubscribe(connection, subscription_id);
+
+    if (samples->len < n_reports)
+    {
+        g_printerr("Only %u of %u reports arrived within %u s\n", samples->len, n_reports, timeout_s);
+    }
+    else
+    {
+        g_source_remove(timeout_id);
+    }
+
+    print_results("report to PropertiesChanged delay", samples);
+}
+
+int
+liquidctl_bench(GDBusConnection *connection, int argc, char *argv[])
+{
+    g_autofree gchar *device = NULL;
+    gint iterations = 1000;
+    gint init_iterations = 0;
+    gint n_reports = 10;
+    gint timeout_s = 60;
+
+    GOptionEntry entries[] = {
+        { "device", 'd', 0, G_OPTION_ARG_STRING, &device, "First device whose object name matches PATTERN", "PATTERN" },
+        { "iterations", 'n', 0, G_OPTION_ARG_INT, &iterations, "Property reads, for latency and throughput", "N" },
+        { "init-iterations", 0, 0, G_OPTION_ARG_INT, &init_iterations, "Measure InitDevice latency over N calls, which re-initializes the device (0)", "N" },
+        { "reports", 0, 0, G_OPTION_ARG_INT, &n_reports, "Device reports to wait for; 0 to skip", "N" },
+        { "timeout", 0, 0, G_OPTION_ARG_INT, &timeout_s, "Seconds to wait for the reports", "S" },
+        { NULL },
+    };
+
+    g_autoptr(GError) error = NULL;
+    g_autoptr(GOptionContext) option_context = g_option_context_new("- measure latency and throughput seen by clients");
+
+    g_option_context_add_main_entries(option_context, entries, NULL);
+
+    if (!g_option_context_parse(option_context, &argc, &argv, &error))
+    {
+        g_printerr("%s\n", error->message);
+        return EXIT_FAILURE;
+    }
+
+    if (iterations < 1 || init_iterations < 0 || n_reports < 0 || timeout_s < 1)
+    {
+        g_printerr("Invalid arguments\n");
+        return EXIT_FAILURE;
+    }
+
+    g_autoptr(GPatternSpec) device_pattern = device ? g_pattern_spec_new(device) : NULL;
+    g_auto(Target) target = { NULL };
+
+    if (!target_find(&target, connection, device_pattern, &error))
+    {
+        g_printerr("Can't find a device to measure: %s\n", error->message);
+        return EXIT_FAILURE;
+    }
+
+    g_print("device: %s\nproperty: %s %s.%s\n\n",
+            target.device_path,
+            target.property_path,
+            target.property_interface,
+            target.property_name);
+
+    if (!measure_get_latency(connection, &target, (guint)iterations, &error)
+        || !measure_get_throughput(connection, &target, (guint)iterations, &error))
+    {
+        g_printerr("Can't read %s: %s\n", target.property_name, error->message);
+        return EXIT_FAILURE;
+    }
+
+    if (init_iterations > 0 && target.has_init_device
+        && !measure_init_device(connection, &target, (guint)init_iterations, &error))
+    {
+        g_printerr("Can't initialize %s: %s\n", target.device_path, error->message);
+        return EXIT_FAILURE;
+    }
+
+    if (n_reports > 0)
+    {
+        measure_report_delay(connection, &target, (guint)n_reports, (guint)timeout_s);
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,243 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include <gio/gio.h>
+
+#include "liquidctl.h"
+
+/*
+ * Reads properties of one object with plain Properties.Get/GetAll calls,
+ * instead of building an object manager client with proxies for everything.
+ */
+
+static GVariant *
+call_properties(GDBusConnection *connection,
+                const gchar *object_path,
+                const gchar *method,
+                GVariant *parameters,
+                const GVariantType *reply_type,
+                GError **error)
+{
+    return g_dbus_connection_call_sync(connection,
+                                       LIQUIDCTL_BUS_NAME,
+                                       object_path,
+                                       "org.freedesktop.DBus.Properties",
+                                       method,
+                                       parameters,
+                                       reply_type,
+                                       G_DBUS_CALL_FLAGS_NONE,
+                                       -1,
+                                       NULL,
+                                       error);
+}
+
+/* Only needed when no interface was given: one call instead of a proxy per interface */
+static GStrv
+introspect_interfaces(GDBusConnection *connection, const gchar *object_path, GError **error)
+{
+    g_autoptr(GVariant) reply = g_dbus_connection_call_sync(connection,
+                                                            LIQUIDCTL_BUS_NAME,
+                                                            object_path,
+                                                            "org.freedesktop.DBus.Introspectable",
+                                                            "Introspect",
+                                                            NULL,
+                                                            G_VARIANT_TYPE("(s)"),
+                                                            G_DBUS_CALL_FLAGS_NONE,
+                                                            -1,
+                                                            NULL,
+                                                            error);
+
+    if (reply == NULL)
+    {
+        return NULL;
+    }
+
+    const gchar *xml = NULL;
+    g_variant_get(reply, "(&s)", &xml);
+
+    g_autoptr(GDBusNodeInfo) node_info = g_dbus_node_info_new_for_xml(xml, error);
+
+    if (node_info == NULL)
+    {
+        return NULL;
+    }
+
+    g_autoptr(GStrvBuilder) builder = g_strv_builder_new();
+
+    for (GDBusInterfaceInfo **interface = node_info->interfaces; interface && *interface; interface++)
+    {
+        if (!g_str_has_prefix((*interface)->name, "org.freedesktop.DBus."))
+        {
+            g_strv_builder_add(builder, (*interface)->name);
+        }
+    }
+
+    return g_strv_builder_end(builder);
+}
+
+int
+liquidctl_get(GDBusConnection *connection, int argc, char *argv[])
+{
+    g_autofree gchar *path = NULL;
+    g_autofree gchar *device = NULL;
+    g_autofree gchar *channel = NULL;
+    g_autofree gchar *interface = NULL;
+    g_autofree gchar *format_name = NULL;
+
+    GOptionEntry entries[] = {
+        { "path", 'p', 0, G_OPTION_ARG_STRING, &path, "Object path", "PATH" },
+        { "device", 'd', 0, G_OPTION_ARG_STRING, &device, "Device object name, instead of --path", "NAME" },
+        { "channel", 'c', 0, G_OPTION_ARG_STRING, &channel, "Channel of the device", "NAME" },
+        { "interface", 'i', 0, G_OPTION_ARG_STRING, &interface, "Interface; the org.liquidctl. prefix is optional", "NAME" },
+        { "format", 'f', 0, G_OPTION_ARG_STRING, &format_name, "Output format: table (default), json, csv or value", "FORMAT" },
+        { NULL },
+    };
+
+    g_autoptr(GError) error = NULL;
+    g_autoptr(GOptionContext) option_context = g_option_context_new("[PROPERTY...] - read properties of one object");
+    LiquidctlFormat format = LIQUIDCTL_FORMAT_TABLE;
+
+    g_option_context_add_main_entries(option_context, entries, NULL);
+
+    if (!g_option_context_parse(option_context, &argc, &argv, &error)
+        || (format_name && !liquidctl_parse_format(format_name, &format, &error)))
+    {
+        g_printerr("%s\n", error->message);
+        return EXIT_FAILURE;
+    }
+
+    if ((path == NULL) == (device == NULL) || (path && channel))
+    {
+        g_printerr("Either --path or --device (and optionally --channel) is required\n");
+        return EXIT_FAILURE;
+    }
+
+    if (path == NULL)
+    {
+        path = channel ? g_strdup_printf("%s/%s/%s", LIQUIDCTL_OBJECT_PATH, device, channel)
+                       : g_strdup_printf("%s/%s", LIQUIDCTL_OBJECT_PATH, device);
+    }
+
+    if (!g_variant_is_object_path(path))
+    {
+        g_printerr("Invalid object path '%s'\n", path);
+        return EXIT_FAILURE;
+    }
+
+    g_autofree gchar *device_name = NULL;
+    g_autofree gchar *channel_name = NULL;
+
+    if (!liquidctl_parse_object_path(path, &device_name, &channel_name))
+    {
+        device_name = g_strdup(path);
+    }
+
+    g_auto(GStrv) interfaces = NULL;
+
+    if (interface)
+    {
+        g_autofree gchar *full_name
+            = strchr(interface, '.') ? g_strdup(interface) : g_strconcat("org.liquidctl.", interface, NULL);
+        const gchar *names[] = { full_name, NULL };
+
+        interfaces = g_strdupv((gchar **)names);
+    }
+    else
+    {
+        interfaces = introspect_interfaces(connection, path, &error);
+
+        if (interfaces == NULL)
+        {
+            g_printerr("Can't introspect %s: %s\n", path, error->message);
+            return EXIT_FAILURE;
+        }
+    }
+
+    /* Properties named on the command line that haven't been found yet */
+    const gint n_properties = argc - 1;
+    g_autofree gboolean *found = g_new0(gboolean, MAX(n_properties, 1));
+
+    liquidctl_print_header(format, FALSE);
+
+    for (GStrv i = interfaces; *i; i++)
+    {
+        /* With a single known interface, each property is one small Get */
+        if (interface && n_properties > 0)
+        {
+            for (gint j = 0; j < n_properties; j++)
+            {
+                g_autoptr(GVariant) reply = call_properties(connection,
+                                                            path,
+                                                            "Get",
+                                                            g_variant_new("(ss)", *i, argv[j + 1]),
+                                                            G_VARIANT_TYPE("(v)"),
+                                                            &error);
+
+                if (reply == NULL)
+                {
+                    g_printerr("Can't get %s: %s\n", argv[j + 1], error->message);
+                    g_clear_error(&error);
+                    continue;
+                }
+
+                g_autoptr(GVariant) value = NULL;
+                g_variant_get(reply, "(v)", &value);
+
+                liquidctl_print_property(format, NULL, device_name, channel_name, *i, argv[j + 1], value);
+                found[j] = TRUE;
+            }
+
+            continue;
+        }
+
+        g_autoptr(GVariant) reply = call_properties(connection,
+                                                    path,
+                                                    "GetAll",
+                                                    g_variant_new("(s)", *i),
+                                                    G_VARIANT_TYPE("(a{sv})"),
+                                                    &error);
+
+        if (reply == NULL)
+        {
+            g_printerr("Can't get properties of %s: %s\n", *i, error->message);
+            return EXIT_FAILURE;
+        }
+
+        g_autoptr(GVariant) properties = g_variant_get_child_value(reply, 0);
+        GVariantIter iter;
+        const gchar *property_name;
+        GVariant *value;
+
+        g_variant_iter_init(&iter, properties);
+
+        while (g_variant_iter_next(&iter, "{&sv}", &property_name, &value))
+        {
+            gboolean wanted = n_properties == 0;
+
+            for (gint j = 0; j < n_properties; j++)
+            {
+                if (g_str_equal(property_name, argv[j + 1]))
+                {
+                    wanted = found[j] = TRUE;
+                }
+            }
+
+            if (wanted)
+            {
+                liquidctl_print_property(format, NULL, device_name, channel_name, *i, property_name, value);
+            }
+
+            g_variant_unref(value);
+        }
+    }
+
+    for (gint j = 0; j < n_properties; j++)
+    {
+        if (!found[j])
+        {
+            return EXIT_FAILURE;
+        }
+    }
+
+    return EXIT_SUCCESS;
+}
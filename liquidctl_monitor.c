@@ -0,0 +1,184 @@
+#include <stdlib.h>
+
+#include <gio/gio.h>
+
+#include "liquidctl.h"
+
+/*
+ * Prints the current values once, then every change as liquidd announces it.
+ * Only PropertiesChanged from liquidd is subscribed to and no proxies are
+ * created, so an idle monitor costs nothing but the match rule on the bus.
+ */
+
+typedef struct
+{
+    LiquidctlFormat format;
+    GPatternSpec *device_pattern;
+    GPatternSpec *channel_pattern;
+} Monitor;
+
+static void
+monitor_print_properties(Monitor *monitor,
+                         GDateTime *time,
+                         const gchar *object_path,
+                         const gchar *interface_name,
+                         GVariant *properties)
+{
+    g_autofree gchar *device = NULL;
+    g_autofree gchar *channel = NULL;
+
+    if (!liquidctl_parse_object_path(object_path, &device, &channel))
+    {
+        return;
+    }
+
+    if (monitor->device_pattern && !g_pattern_spec_match_string(monitor->device_pattern, device))
+    {
+        return;
+    }
+
+    if (monitor->channel_pattern
+        && (channel == NULL || !g_pattern_spec_match_string(monitor->channel_pattern, channel)))
+    {
+        return;
+    }
+
+    GVariantIter iter;
+    const gchar *property_name;
+    GVariant *value;
+
+    g_variant_iter_init(&iter, properties);
+
+    while (g_variant_iter_next(&iter, "{&sv}", &property_name, &value))
+    {
+        liquidctl_print_property(monitor->format, time, device, channel, interface_name, property_name, value);
+        g_variant_unref(value);
+    }
+}
+
+static void
+monitor_properties_changed(GDBusConnection *connection G_GNUC_UNUSED,
+                           const gchar *sender_name G_GNUC_UNUSED,
+                           const gchar *object_path,
+                           const gchar *interface_name G_GNUC_UNUSED,
+                           const gchar *signal_name G_GNUC_UNUSED,
+                           GVariant *parameters,
+                           gpointer user_data)
+{
+    Monitor *monitor = user_data;
+    const gchar *changed_interface = NULL;
+    g_autoptr(GVariant) changed = NULL;
+    g_autoptr(GDateTime) time = g_date_time_new_now_local();
+
+    g_variant_get(parameters, "(&s@a{sv}as)", &changed_interface, &changed, NULL);
+
+    monitor_print_properties(monitor, time, object_path, changed_interface, changed);
+}
+
+static gboolean
+monitor_print_snapshot(Monitor *monitor, GDBusConnection *connection, GError **error)
+{
+    g_autoptr(GVariant) reply = g_dbus_connection_call_sync(connection,
+                                                            LIQUIDCTL_BUS_NAME,
+                                                            LIQUIDCTL_OBJECT_PATH,
+                                                            "org.freedesktop.DBus.ObjectManager",
+                                                            "GetManagedObjects",
+                                                            NULL,
+                                                            G_VARIANT_TYPE("(a{oa{sa{sv}}})"),
+                                                            G_DBUS_CALL_FLAGS_NONE,
+                                                            -1,
+                                                            NULL,
+                                                            error);
+
+    if (reply == NULL)
+    {
+        return FALSE;
+    }
+
+    g_autoptr(GVariant) objects = g_variant_get_child_value(reply, 0);
+    g_autoptr(GDateTime) time = g_date_time_new_now_local();
+    GVariantIter object_iter;
+    const gchar *object_path;
+    GVariant *interfaces;
+
+    g_variant_iter_init(&object_iter, objects);
+
+    while (g_variant_iter_next(&object_iter, "{&o@a{sa{sv}}}", &object_path, &interfaces))
+    {
+        GVariantIter interface_iter;
+        const gchar *interface_name;
+        GVariant *properties;
+
+        g_variant_iter_init(&interface_iter, interfaces);
+
+        while (g_variant_iter_next(&interface_iter, "{&s@a{sv}}", &interface_name, &properties))
+        {
+            monitor_print_properties(monitor, time, object_path, interface_name, properties);
+            g_variant_unref(properties);
+        }
+
+        g_variant_unref(interfaces);
+    }
+
+    return TRUE;
+}
+
+int
+liquidctl_monitor(GDBusConnection *connection, int argc, char *argv[])
+{
+    g_autofree gchar *device = NULL;
+    g_autofree gchar *channel = NULL;
+    g_autofree gchar *format = NULL;
+
+    GOptionEntry entries[] = {
+        { "device", 'd', 0, G_OPTION_ARG_STRING, &device, "Only devices whose object name matches PATTERN", "PATTERN" },
+        { "channel", 'c', 0, G_OPTION_ARG_STRING, &channel, "Only channels whose name matches PATTERN", "PATTERN" },
+        { "format", 'f', 0, G_OPTION_ARG_STRING, &format, "Output format: table (default), json, csv or value", "FORMAT" },
+        { NULL },
+    };
+
+    g_autoptr(GError) error = NULL;
+    g_autoptr(GOptionContext) option_context = g_option_context_new("- print property changes as they happen");
+
+    g_option_context_add_main_entries(option_context, entries, NULL);
+
+    Monitor monitor = { LIQUIDCTL_FORMAT_TABLE, NULL, NULL };
+
+    if (!g_option_context_parse(option_context, &argc, &argv, &error)
+        || (format && !liquidctl_parse_format(format, &monitor.format, &error)))
+    {
+        g_printerr("%s\n", error->message);
+        return EXIT_FAILURE;
+    }
+
+    g_autoptr(GPatternSpec) device_pattern = device ? g_pattern_spec_new(device) : NULL;
+    g_autoptr(GPatternSpec) channel_pattern = channel ? g_pattern_spec_new(channel) : NULL;
+
+    monitor.device_pattern = device_pattern;
+    monitor.channel_pattern = channel_pattern;
+
+    /* Subscribed before taking the snapshot, so that no change falls in between */
+    g_dbus_connection_signal_subscribe(connection,
+                                       LIQUIDCTL_BUS_NAME, /* sender */
+                                       "org.freedesktop.DBus.Properties", /* interface_name */
+                                       "PropertiesChanged", /* member */
+                                       NULL, /* object_path */
+                                       NULL, /* arg0 */
+                                       G_DBUS_SIGNAL_FLAGS_NONE, /* flags */
+                                       monitor_properties_changed, /* callback */
+                                       &monitor, /* user_data */
+                                       NULL /* user_data_free_func */);
+
+    liquidctl_print_header(monitor.format, TRUE);
+
+    if (!monitor_print_snapshot(&monitor, connection, &error))
+    {
+        g_printerr("Can't connect to LiquidD: %s\n", error->message);
+        return EXIT_FAILURE;
+    }
+
+    g_autoptr(GMainLoop) loop = g_main_loop_new(NULL, FALSE);
+    g_main_loop_run(loop);
+
+    return EXIT_SUCCESS;
+}
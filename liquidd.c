@@ -1,59 +1,1086 @@
+#include <errno.h>
+#include <fcntl.h>
 #include <signal.h>
 #include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
 
 #include <gio/gio.h>
 #include <glib-unix.h>
 
+#include "aggregate.h"
+#include "alert.h"
+#include "config.h"
+#include "dbus_interfaces.h"
+#include "device_cache.h"
 #include "driver.h"
-#include "driver_nzxt_smart2.h"
+#include "driver_hid.h"
+#include "driver_registry.h"
+#include "emulator_nzxt_smart2.h"
+#include "fan_controller.h"
+#include "filter.h"
+#include "frame_scheduler.h"
+#include "handoff.h"
 #include "hid_device.h"
 #include "hid_device_info.h"
 #include "hid_manager.h"
+#include "io_thread.h"
+#include "led_effect.h"
+#include "loop_monitor.h"
+#include "metrics.h"
+#include "metrics_server.h"
+#include "publisher.h"
 
 #define HID_MAX_BUFFER_SIZE 16384
 
+#define LOOP_MONITOR_INTERVAL_MS 100
+
+#define EMULATOR_UPDATE_INTERVAL_MS 1000
+
+#define FAN_CONTROL_INTERVAL_MS 1000
+
+/* Every device checkpoints on its own, so saves are batched */
+#define STATE_SAVE_DELAY_S 5
+
+/* Seconds to wait for the daemon taken over to release the metrics port, polled each second */
+#define METRICS_PORT_ATTEMPTS 10
+
+/* The LiquidDevicePlan applied to a driver */
+#define PLAN_DATA_KEY "liquidd-device-plan"
+/* The one whose alert rules the driver has, which can be older since they're only replaced when they change */
+#define ALERTS_PLAN_DATA_KEY "liquidd-alerts-plan"
+
+/* An effect for the LED channel of that number, on every device that has one */
+typedef struct
+{
+    guint channel;
+    LiquidLedEffect effect;
+} LedAssignment;
+
+/* Where drivers' state and counters are saved */
+typedef struct
+{
+    /* State that the device loses with power, in the cache directory */
+    LiquidDeviceCache *device_cache;
+    /* Counters that outlive the device, such as energy, in the state directory */
+    LiquidDeviceCache *counters;
+    guint save_source_id;
+} StateStores;
+
+typedef struct
+{
+    GDBusObjectManagerServer *object_manager;
+    StateStores *stores;
+    LiquidDriverRegistry *drivers;
+
+    /* Devices are spread over these round robin; empty to read on the main context */
+    GPtrArray *io_threads;
+    guint next_io_thread;
+
+    LiquidPublisher *publisher;
+    /* Daemon-wide, ahead of those of each device's plan */
+    GPtrArray *alert_rules;
+    GPtrArray *filters;
+    /* NULL without aggregates */
+    LiquidAggregator *aggregator;
+    LiquidFrameScheduler *frame_scheduler;
+    GArray *led_assignments;
+
+    /* Daemon-wide LiquidFanControl specs, and the controllers started from them and from plans */
+    GPtrArray *fan_controls;
+    GPtrArray *fan_controllers;
+
+    const gchar *config_path;
+    /* Owned, and replaced whole when the file changes */
+    LiquidConfig *config;
+
+    /* LiquidHandoffDevice by hidraw path, taken over from the previous daemon; NULL without one */
+    GHashTable *handoff_devices;
+} ProbeContext;
+
+/* What the daemon-wide interfaces and metrics report on */
+typedef struct
+{
+    GDBusObjectManager *object_manager;
+    LiquidLoopMonitor *loop_monitor;
+    LiquidDriverRegistry *drivers;
+    LiquidPublisher *publisher;
+    LiquidFrameScheduler *frame_scheduler;
+    GPtrArray *fan_controllers;
+
+    /* From the previous daemon stopping to read devices to this one starting; -1 without a handoff */
+    gint64 handoff_downtime_us;
+
+    /* Outgoing messages, counted on the GDBus worker thread */
+    gint dbus_signals;
+    gint dbus_method_replies;
+} DaemonContext;
+
+/* Listening for a new daemon to take over the devices */
+typedef struct
+{
+    GMainLoop *loop;
+    GDBusObjectManager *object_manager;
+    const gchar *path;
+    gint listen_fd;
+    gboolean handed_off;
+} HandoffContext;
+
+static gboolean
+shutdown_signal(gpointer user_data)
+{
+    GMainLoop *loop = user_data;
+    g_main_loop_quit(loop);
+    return G_SOURCE_CONTINUE;
+}
+
+/* $STATE_DIRECTORY when run as a systemd service, the XDG state directory otherwise */
+static gchar *
+build_state_path(const gchar *basename)
+{
+    const gchar *state_directory = g_getenv("STATE_DIRECTORY");
+    const gchar *xdg_state_home = g_getenv("XDG_STATE_HOME");
+
+    if (state_directory && g_path_is_absolute(state_directory))
+    {
+        return g_build_filename(state_directory, basename, NULL);
+    }
+
+    if (xdg_state_home && g_path_is_absolute(xdg_state_home))
+    {
+        return g_build_filename(xdg_state_home, "liquidd", basename, NULL);
+    }
+
+    return g_build_filename(g_get_home_dir(), ".local", "state", "liquidd", basename, NULL);
+}
+
+static void
+save_store(LiquidDeviceCache *store, const gchar *what)
+{
+    g_autoptr(GError) error = NULL;
+
+    if (!liquid_device_cache_save(store, &error))
+    {
+        g_printerr("Can't save %s: %s\n", what, error->message);
+    }
+}
+
+static void
+save_state_stores(StateStores *stores)
+{
+    g_clear_handle_id(&stores->save_source_id, g_source_remove);
+
+    save_store(stores->device_cache, "device cache");
+    save_store(stores->counters, "device counters");
+}
+
+static gboolean
+save_state_stores_timeout(gpointer user_data)
+{
+    StateStores *stores = user_data;
+
+    stores->save_source_id = 0;
+    save_state_stores(stores);
+
+    return G_SOURCE_REMOVE;
+}
+
+static void
+schedule_state_save(StateStores *stores)
+{
+    if (stores->save_source_id == 0)
+    {
+        stores->save_source_id = g_timeout_add_seconds(STATE_SAVE_DELAY_S, save_state_stores_timeout, stores);
+    }
+}
+
+static void
+driver_state_changed(LiquidDriver *driver, gpointer user_data)
+{
+    StateStores *stores = user_data;
+    LiquidHidDeviceInfo *info = liquid_driver_hid_get_device_info(LIQUID_DRIVER_HID(driver));
+    g_autoptr(GVariant) state = liquid_driver_save_state(driver);
+
+    liquid_device_cache_store(stores->device_cache, info, state);
+    schedule_state_save(stores);
+}
+
+static void
+driver_counters_changed(LiquidDriver *driver, gpointer user_data)
+{
+    StateStores *stores = user_data;
+    LiquidHidDeviceInfo *info = liquid_driver_hid_get_device_info(LIQUID_DRIVER_HID(driver));
+    g_autoptr(GVariant) counters = liquid_driver_save_counters(driver);
+
+    liquid_device_cache_store(stores->counters, info, counters);
+    schedule_state_save(stores);
+}
+
+/* `handoff_device` is the device taken over, or NULL */
+static void
+start_driver(LiquidDriver *driver, LiquidHidDeviceInfo *info, StateStores *stores, LiquidHandoffDevice *handoff_device)
+{
+    const char *hidraw_path = liquid_hid_device_info_get_hidraw_path(info);
+    GVariant *handoff_state = handoff_device ? handoff_device->state : NULL;
+
+    g_signal_connect_object(driver,
+                            "state-changed",
+                            G_CALLBACK(driver_state_changed),
+                            stores,
+                            G_CONNECT_DEFAULT);
+    g_signal_connect_object(driver,
+                            "counters-changed",
+                            G_CALLBACK(driver_counters_changed),
+                            stores,
+                            G_CONNECT_DEFAULT);
+
+    /* The previous daemon's counters are newer than the saved ones */
+    g_autoptr(GVariant) counters = handoff_device ? g_variant_ref(handoff_device->counters)
+                                                  : liquid_device_cache_lookup(stores->counters, info);
+
+    if (counters)
+    {
+        liquid_driver_restore_counters(driver, counters);
+    }
+
+    if (handoff_state && liquid_driver_restore_state(driver, handoff_state))
+    {
+        g_printerr("Device %s taken over\n", hidraw_path);
+        return;
+    }
+
+    g_autoptr(GVariant) state = liquid_device_cache_lookup(stores->device_cache, info);
+
+    if (state && liquid_driver_restore_state(driver, state))
+    {
+        g_printerr("Device %s restored from cache\n", hidraw_path);
+        return;
+    }
+
+    g_autoptr(GError) error = NULL;
+
+    if (!liquid_driver_init_device(driver, &error))
+    {
+        g_printerr("Can't initialize device %s: %s\n", hidraw_path, error->message);
+    }
+}
+
+/*
+ * The installed drivers, or when there are none, as when run from the build
+ * directory, those next to the executable, where the build puts them. Without
+ * either, every device would be skipped, so that fails.
+ */
+static gboolean
+add_default_driver_dir(LiquidDriverRegistry *drivers)
+{
+    g_autoptr(GError) error = NULL;
+
+    if (liquid_driver_registry_add_directory(drivers, LIQUIDD_DRIVER_DIR, &error)
+        && liquid_driver_registry_get_n_manifests(drivers) > 0)
+    {
+        return TRUE;
+    }
+
+    g_autofree gchar *executable = g_file_read_link("/proc/self/exe", NULL);
+    g_autofree gchar *own_dir = executable ? g_path_get_dirname(executable) : NULL;
+
+    if (own_dir && liquid_driver_registry_add_directory(drivers, own_dir, NULL)
+        && liquid_driver_registry_get_n_manifests(drivers) > 0)
+    {
+        g_printerr("No drivers installed, using those in %s\n", own_dir);
+        return TRUE;
+    }
+
+    g_printerr("No driver manifests in %s%s%s, nor next to liquidd; use --driver-dir\n",
+               LIQUIDD_DRIVER_DIR,
+               error ? ": " : "",
+               error ? error->message : "");
+
+    return FALSE;
+}
+
+static GMainContext *
+next_io_context(ProbeContext *context)
+{
+    if (context->io_threads->len == 0)
+    {
+        return NULL;
+    }
+
+    LiquidIoThread *io_thread
+        = g_ptr_array_index(context->io_threads, context->next_io_thread++ % context->io_threads->len);
+
+    return liquid_io_thread_get_context(io_thread);
+}
+
+/*
+ * Gives the driver a controller for each of the plan's fan controls: those of
+ * channels that already have one are retuned in place, keeping their state,
+ * and those of channels no longer controlled are stopped.
+ */
+static void
+update_fan_controllers(ProbeContext *context, LiquidDriverHid *driver, const LiquidDevicePlan *plan)
+{
+    g_autoptr(GPtrArray) previous = g_ptr_array_new_with_free_func(g_object_unref);
+
+    for (guint i = context->fan_controllers->len; i > 0; i--)
+    {
+        LiquidFanController *controller = g_ptr_array_index(context->fan_controllers, i - 1);
+
+        if (liquid_fan_controller_get_driver(controller) == LIQUID_DRIVER(driver))
+        {
+            g_ptr_array_add(previous, g_ptr_array_steal_index(context->fan_controllers, i - 1));
+        }
+    }
+
+    for (guint i = 0; i < plan->fan_controls->len; i++)
+    {
+        const LiquidFanControl *control = g_ptr_array_index(plan->fan_controls, i);
+        guint channel = liquid_driver_lookup_channel(LIQUID_DRIVER(driver), control->channel, LIQUID_CHANNEL_DUTY_PERCENT);
+        LiquidFanController *controller = NULL;
+
+        if (channel == G_MAXUINT)
+        {
+            continue;
+        }
+
+        for (guint j = 0; j < previous->len && controller == NULL; j++)
+        {
+            if (liquid_fan_controller_get_channel(g_ptr_array_index(previous, j)) == channel)
+            {
+                controller = g_ptr_array_steal_index(previous, j);
+            }
+        }
+
+        if (controller)
+        {
+            liquid_fan_controller_set_control(controller, control);
+        }
+        else
+        {
+            controller = liquid_fan_controller_new(LIQUID_DRIVER(driver), channel, control, FAN_CONTROL_INTERVAL_MS);
+        }
+
+        g_ptr_array_add(context->fan_controllers, controller);
+    }
+}
+
+/* Once the device is started, since restoring its state also restores its interval */
+static void
+apply_update_interval(LiquidDriverHid *driver, const LiquidDevicePlan *plan)
+{
+    g_autoptr(GError) error = NULL;
+
+    if (!liquid_driver_hid_configure_update_interval(driver, plan->update_interval_ms, &error))
+    {
+        g_printerr("Can't set the update interval of device %s: %s\n",
+                   liquid_hid_device_info_get_device_key(liquid_driver_hid_get_device_info(driver)),
+                   error->message);
+    }
+}
+
+static void
+export_driver(ProbeContext *context, LiquidDriverHid *driver, LiquidDevicePlan *plan)
+{
+    g_object_set_data_full(G_OBJECT(driver),
+                           PLAN_DATA_KEY,
+                           liquid_device_plan_ref(plan),
+                           (GDestroyNotify)liquid_device_plan_unref);
+    g_object_set_data_full(G_OBJECT(driver),
+                           ALERTS_PLAN_DATA_KEY,
+                           liquid_device_plan_ref(plan),
+                           (GDestroyNotify)liquid_device_plan_unref);
+
+    liquid_driver_set_publisher(LIQUID_DRIVER(driver), context->publisher);
+    liquid_driver_set_filters(LIQUID_DRIVER(driver), context->filters);
+    liquid_driver_set_alert_rules(LIQUID_DRIVER(driver), plan->alert_rules);
+    liquid_driver_export(LIQUID_DRIVER(driver), context->object_manager);
+
+    if (context->aggregator)
+    {
+        liquid_aggregator_add_driver(context->aggregator, LIQUID_DRIVER(driver));
+    }
+
+    for (guint i = 0; i < context->led_assignments->len; i++)
+    {
+        const LedAssignment *assignment = &g_array_index(context->led_assignments, LedAssignment, i);
+
+        if (assignment->channel < liquid_driver_hid_get_n_led_channels(driver))
+        {
+            liquid_frame_scheduler_add(context->frame_scheduler, driver, assignment->channel, &assignment->effect);
+        }
+    }
+
+    update_fan_controllers(context, driver, plan);
+}
+
+static gboolean
+probe_hid_device(ProbeContext *context, LiquidHidDeviceInfo *info)
+{
+    const char *hidraw_path = liquid_hid_device_info_get_hidraw_path(info);
+
+    g_printerr("hid device vendor=%0#6x product=%0#6x interface=%d: %s\n",
+               liquid_hid_device_info_get_vendor_id(info),
+               liquid_hid_device_info_get_product_id(info),
+               liquid_hid_device_info_get_interface_number(info),
+               hidraw_path);
+
+    g_autoptr(GError) error = NULL;
+    const LiquidDriverModule *module = liquid_driver_registry_lookup(context->drivers, info, &error);
+
+    if (module == NULL)
+    {
+        if (error)
+        {
+            g_printerr("Can't probe device %s: %s\n", hidraw_path, error->message);
+        }
+
+        return FALSE;
+    }
+
+    g_printerr("Device %s matched\n", hidraw_path);
+
+    const gchar *device_key = liquid_hid_device_info_get_device_key(info);
+    g_autoptr(LiquidDevicePlan) plan
+        = liquid_config_resolve(context->config, device_key, context->alert_rules, context->fan_controls);
+
+    /* Still bound, so that no other interface of the device is */
+    if (!plan->enabled)
+    {
+        g_printerr("Device %s disabled by the configuration\n", device_key);
+        return TRUE;
+    }
+
+    LiquidHandoffDevice *handoff_device
+        = context->handoff_devices ? g_hash_table_lookup(context->handoff_devices, hidraw_path) : NULL;
+    LiquidHidDevice *hid_device = NULL;
+
+    if (handoff_device)
+    {
+        hid_device = liquid_hid_device_new_for_fd(liquid_handoff_device_steal_fd(handoff_device),
+                                                  HID_MAX_BUFFER_SIZE,
+                                                  next_io_context(context));
+    }
+    else
+    {
+        hid_device = liquid_hid_device_new_for_path(hidraw_path, HID_MAX_BUFFER_SIZE, next_io_context(context), &error);
+    }
+
+    if (hid_device == NULL)
+    {
+        g_printerr("Can't open HID device %s: %s\n", hidraw_path, error->message);
+        return FALSE;
+    }
+
+    g_autoptr(LiquidDriverHid) driver = module->create(hid_device, info);
+
+    export_driver(context, driver, plan);
+    start_driver(LIQUID_DRIVER(driver), info, context->stores, handoff_device);
+    apply_update_interval(driver, plan);
+
+    return TRUE;
+}
+
+/* One driver per physical device: the first interface that a driver binds to wins */
+static void
+probe_hid_device_group(LiquidHidManager *manager G_GNUC_UNUSED,
+                       GPtrArray *interfaces,
+                       gpointer user_data)
+{
+    ProbeContext *context = user_data;
+
+    for (guint i = 0; i < interfaces->len; i++)
+    {
+        if (probe_hid_device(context, g_ptr_array_index(interfaces, i)))
+        {
+            return;
+        }
+    }
+}
+
+/* Emulated devices bypass the device cache, which is for real hardware only */
+static void
+add_emulated_devices(ProbeContext *context, GPtrArray *emulators, guint n_devices)
+{
+    for (guint i = 0; i < n_devices; i++)
+    {
+        g_autoptr(GError) error = NULL;
+        g_autoptr(LiquidEmulatorNzxtSmart2) emulator = liquid_emulator_nzxt_smart2_new(i, &error);
+
+        if (emulator == NULL)
+        {
+            g_printerr("Can't create emulated device %u: %s\n", i, error->message);
+            return;
+        }
+
+        g_autoptr(LiquidHidDeviceInfo) info = liquid_emulator_nzxt_smart2_dup_device_info(emulator);
+        const gchar *device_key = liquid_hid_device_info_get_device_key(info);
+        g_autoptr(LiquidDevicePlan) plan
+            = liquid_config_resolve(context->config, device_key, context->alert_rules, context->fan_controls);
+
+        if (!plan->enabled)
+        {
+            g_printerr("Device %s disabled by the configuration\n", device_key);
+            continue;
+        }
+
+        const LiquidDriverModule *module = liquid_driver_registry_lookup(context->drivers, info, &error);
+
+        if (module == NULL)
+        {
+            g_printerr("Can't create emulated device %u: %s\n", i, error ? error->message : "no driver for it");
+            return;
+        }
+
+        g_autoptr(LiquidHidDevice) hid_device
+            = liquid_hid_device_new_for_fd(liquid_emulator_nzxt_smart2_steal_device_fd(emulator),
+                                           HID_MAX_BUFFER_SIZE,
+                                           next_io_context(context));
+        g_autoptr(LiquidDriverHid) driver = module->create(hid_device, info);
+
+        export_driver(context, driver, plan);
+        liquid_emulator_nzxt_smart2_start(emulator, EMULATOR_UPDATE_INTERVAL_MS);
+
+        if (!liquid_driver_init_device(LIQUID_DRIVER(driver), &error))
+        {
+            g_printerr("Can't initialize emulated device %u: %s\n", i, error->message);
+        }
+
+        apply_update_interval(driver, plan);
+
+        g_ptr_array_add(emulators, g_steal_pointer(&emulator));
+    }
+}
+
+/*
+ * Replaces the configuration with the file's contents, and applies what
+ * changed in each device's plan, leaving the rest alone: alerts keep their
+ * state and fan controllers their PID state unless their own settings
+ * changed. Runs on the main context, like everything reading plans, so that
+ * the swap is never seen half done; the previous configuration stays in use if
+ * the file is invalid.
+ */
+static void
+reload_config(ProbeContext *context)
+{
+    gint64 start = g_get_monotonic_time();
+    g_autoptr(GError) error = NULL;
+    g_autoptr(LiquidConfig) config = liquid_config_load(context->config_path, &error);
+
+    if (config == NULL)
+    {
+        g_printerr("Keeping the current configuration: %s\n", error->message);
+        return;
+    }
+
+    GList *objects = g_dbus_object_manager_get_objects(G_DBUS_OBJECT_MANAGER(context->object_manager));
+    guint n_changed = 0;
+
+    for (GList *l = objects; l; l = l->next)
+    {
+        if (!LIQUID_IS_DRIVER_HID(l->data))
+        {
+            continue;
+        }
+
+        LiquidDriverHid *driver = LIQUID_DRIVER_HID(l->data);
+        const LiquidDevicePlan *current = g_object_get_data(G_OBJECT(driver), PLAN_DATA_KEY);
+        const gchar *device_key = liquid_hid_device_info_get_device_key(liquid_driver_hid_get_device_info(driver));
+        g_autoptr(LiquidDevicePlan) plan
+            = liquid_config_resolve(config, device_key, context->alert_rules, context->fan_controls);
+
+        if (current == NULL)
+        {
+            continue;
+        }
+
+        gboolean alerts_changed = !liquid_device_plan_alerts_equal(current, plan);
+        gboolean fan_controls_changed = !liquid_device_plan_fan_controls_equal(current, plan);
+
+        if (plan->enabled == current->enabled && plan->update_interval_ms == current->update_interval_ms
+            && !alerts_changed && !fan_controls_changed)
+        {
+            continue;
+        }
+
+        if (plan->enabled != current->enabled)
+        {
+            g_printerr("Device %s is %s on restart\n", device_key, plan->enabled ? "enabled" : "disabled");
+        }
+
+        if (plan->update_interval_ms != current->update_interval_ms)
+        {
+            apply_update_interval(driver, plan);
+        }
+
+        if (alerts_changed)
+        {
+            liquid_driver_set_alert_rules(LIQUID_DRIVER(driver), plan->alert_rules);
+
+            /* Otherwise the rules stay those of the older plan, which keeps their configuration alive */
+            g_object_set_data_full(G_OBJECT(driver),
+                                   ALERTS_PLAN_DATA_KEY,
+                                   liquid_device_plan_ref(plan),
+                                   (GDestroyNotify)liquid_device_plan_unref);
+        }
+
+        if (fan_controls_changed)
+        {
+            update_fan_controllers(context, driver, plan);
+        }
+
+        /* Last, since it may release the previous plan and whatever it points to */
+        g_object_set_data_full(G_OBJECT(driver),
+                               PLAN_DATA_KEY,
+                               g_steal_pointer(&plan),
+                               (GDestroyNotify)liquid_device_plan_unref);
+        n_changed++;
+    }
+
+    g_list_free_full(objects, g_object_unref);
+
+    g_clear_pointer(&context->config, liquid_config_unref);
+    context->config = g_steal_pointer(&config);
+
+    g_printerr("Configuration reloaded in %.1f ms, %u devices changed\n",
+               (gdouble)(g_get_monotonic_time() - start) / 1000.0,
+               n_changed);
+}
+
+/*
+ * Editors replace the file as often as they write it in place. Either way,
+ * only a complete file is loaded: one written in place once it's closed, one
+ * moved over the old one as soon as it's there. A new or truncated file isn't
+ * reloaded before it's written.
+ */
+static void
+config_file_changed(GFileMonitor *monitor G_GNUC_UNUSED,
+                    GFile *file G_GNUC_UNUSED,
+                    GFile *other_file,
+                    GFileMonitorEvent event,
+                    gpointer user_data)
+{
+    ProbeContext *context = user_data;
+
+    if (event == G_FILE_MONITOR_EVENT_RENAMED)
+    {
+        g_autoptr(GFile) config_file = g_file_new_for_path(context->config_path);
+
+        /* Renamed away, rather than another file renamed to it */
+        if (other_file == NULL || !g_file_equal(other_file, config_file))
+        {
+            return;
+        }
+    }
+
+    if (event == G_FILE_MONITOR_EVENT_CHANGES_DONE_HINT || event == G_FILE_MONITOR_EVENT_RENAMED
+        || event == G_FILE_MONITOR_EVENT_MOVED_IN)
+    {
+        reload_config(context);
+    }
+}
+
+static gboolean
+handoff_requested(gint listen_fd, GIOCondition condition, gpointer user_data);
+
+/* After a failed handoff, for the next successor to try again */
+static void
+listen_for_handoff(HandoffContext *context)
+{
+    g_autoptr(GError) error = NULL;
+
+    context->listen_fd = liquid_handoff_listen(context->path, &error);
+
+    if (context->listen_fd == -1)
+    {
+        g_printerr("Can't listen for handoff on %s: %s\n", context->path, error->message);
+        return;
+    }
+
+    g_unix_fd_add(context->listen_fd, G_IO_IN, handoff_requested, context);
+}
+
+/*
+ * Stops reading every device and sends them to the daemon that connected,
+ * then quits once it has acknowledged resuming them. Otherwise the devices
+ * are reopened as after a read error, and this daemon carries on: the new
+ * daemon gives up on them when it can't acknowledge.
+ */
+static gboolean
+handoff_requested(gint listen_fd, GIOCondition condition G_GNUC_UNUSED, gpointer user_data)
+{
+    HandoffContext *context = user_data;
+    g_autoptr(GError) error = NULL;
+    gint fd = liquid_handoff_accept(listen_fd, &error);
+
+    if (fd == -1)
+    {
+        g_printerr("Can't accept handoff: %s\n", error->message);
+        return G_SOURCE_CONTINUE;
+    }
+
+    g_autoptr(GPtrArray) devices = g_ptr_array_new_with_free_func((GDestroyNotify)liquid_handoff_device_free);
+    g_autoptr(GPtrArray) stopped = g_ptr_array_new_with_free_func(g_object_unref);
+    GList *objects = g_dbus_object_manager_get_objects(context->object_manager);
+    /* Before the first device stops, so that the downtime includes stopping them all */
+    gint64 stop_time = g_get_monotonic_time();
+
+    for (GList *l = objects; l; l = l->next)
+    {
+        if (!LIQUID_IS_DRIVER_HID(l->data))
+        {
+            continue;
+        }
+
+        LiquidDriverHid *driver = LIQUID_DRIVER_HID(l->data);
+        gint device_fd = liquid_hid_device_stop_reading(liquid_driver_hid_get_device(driver));
+
+        if (device_fd == -1)
+        {
+            continue;
+        }
+
+        g_ptr_array_add(stopped, g_object_ref(driver));
+
+        const char *hidraw_path = liquid_hid_device_info_get_hidraw_path(liquid_driver_hid_get_device_info(driver));
+        g_autoptr(GVariant) state = liquid_driver_save_state(LIQUID_DRIVER(driver));
+        g_autoptr(GVariant) counters = liquid_driver_save_counters(LIQUID_DRIVER(driver));
+
+        /* Owned by the handoff device, as on the receiving end */
+        device_fd = fcntl(device_fd, F_DUPFD_CLOEXEC, 0);
+
+        if (device_fd == -1)
+        {
+            g_printerr("Can't hand device %s over: %s\n", hidraw_path, g_strerror(errno));
+            continue;
+        }
+
+        g_ptr_array_add(devices, liquid_handoff_device_new(hidraw_path, device_fd, state, counters));
+    }
+
+    g_list_free_full(objects, g_object_unref);
+
+    /* The new daemon listens on the same path once it's done */
+    unlink(context->path);
+    close(context->listen_fd);
+    context->listen_fd = -1;
+
+    if (liquid_handoff_send(fd, stop_time, devices, &error) && liquid_handoff_wait_ack(fd, &error))
+    {
+        g_printerr("Handed %u devices over\n", devices->len);
+        context->handed_off = TRUE;
+        close(fd);
+        g_main_loop_quit(context->loop);
+
+        return G_SOURCE_REMOVE;
+    }
+
+    g_printerr("Can't hand devices over, reopening them: %s\n", error->message);
+    close(fd);
+
+    for (guint i = 0; i < stopped->len; i++)
+    {
+        liquid_driver_hid_recover(g_ptr_array_index(stopped, i));
+    }
+
+    listen_for_handoff(context);
+
+    return G_SOURCE_REMOVE;
+}
+
+/*
+ * Takes over the devices of the daemon listening on `path`, by hidraw path;
+ * NULL if there's none. `fd` is the connection to acknowledge over.
+ */
+static GHashTable *
+take_over_devices(const gchar *path, gint64 *stop_time, gint *fd)
+{
+    g_autoptr(GError) error = NULL;
+    g_autoptr(GPtrArray) devices = liquid_handoff_receive(path, stop_time, fd, &error);
+
+    if (devices == NULL)
+    {
+        g_printerr("Can't take devices over: %s\n", error->message);
+        return NULL;
+    }
+
+    GHashTable *table
+        = g_hash_table_new_full(g_str_hash, g_str_equal, NULL, (GDestroyNotify)liquid_handoff_device_free);
+
+    /* Owned by the table from here on */
+    g_ptr_array_set_free_func(devices, NULL);
+
+    for (guint i = 0; i < devices->len; i++)
+    {
+        LiquidHandoffDevice *device = g_ptr_array_index(devices, i);
+
+        g_hash_table_replace(table, device->hidraw_path, device);
+    }
+
+    return table;
+}
+
 static gboolean
-shutdown_signal(gpointer user_data)
+daemon_handle_get_statistics(LiquidDBusDiagnostics *interface,
+                             GDBusMethodInvocation *invocation,
+                             DaemonContext *context)
 {
-    GMainLoop *loop = user_data;
-    g_main_loop_quit(loop);
-    return G_SOURCE_CONTINUE;
+    g_autoptr(GVariant) loop_statistics = liquid_loop_monitor_dup_statistics(context->loop_monitor);
+    g_auto(GVariantDict) dict = G_VARIANT_DICT_INIT(loop_statistics);
+
+    g_variant_dict_insert_value(&dict, "drivers", liquid_driver_registry_dup_statistics(context->drivers));
+    g_variant_dict_insert_value(&dict, "publisher", liquid_publisher_dup_statistics(context->publisher));
+    g_variant_dict_insert_value(&dict, "lighting", liquid_frame_scheduler_dup_statistics(context->frame_scheduler));
+
+    g_auto(GVariantBuilder) fan_control = G_VARIANT_BUILDER_INIT(G_VARIANT_TYPE_VARDICT);
+
+    for (guint i = 0; i < context->fan_controllers->len; i++)
+    {
+        LiquidFanController *controller = g_ptr_array_index(context->fan_controllers, i);
+
+        g_variant_builder_add(&fan_control,
+                              "{sv}",
+                              liquid_fan_controller_get_name(controller),
+                              liquid_fan_controller_dup_statistics(controller));
+    }
+
+    g_variant_dict_insert_value(&dict, "fan-control", g_variant_builder_end(&fan_control));
+
+    if (context->handoff_downtime_us >= 0)
+    {
+        g_variant_dict_insert(&dict, "handoff-downtime-us", "x", context->handoff_downtime_us);
+    }
+
+    liquid_dbus_diagnostics_complete_get_statistics(interface, invocation, g_variant_dict_end(&dict));
+
+    return TRUE;
+}
+
+static gboolean
+daemon_handle_get_changes_since(LiquidDBusChanges *interface,
+                                GDBusMethodInvocation *invocation,
+                                guint64 since,
+                                DaemonContext *context)
+{
+    g_auto(GVariantBuilder) changes = G_VARIANT_BUILDER_INIT(G_VARIANT_TYPE("a(osv)"));
+    GList *objects = g_dbus_object_manager_get_objects(context->object_manager);
+
+    /* Taken first: anything changing while collecting is simply returned again next time */
+    guint64 sequence = liquid_driver_get_sequence();
+
+    /* A number from a previous daemon says nothing about this one's changes */
+    if (!liquid_driver_sequence_is_current(since))
+    {
+        since = 0;
+    }
+
+    for (GList *l = objects; l; l = l->next)
+    {
+        if (LIQUID_IS_DRIVER(l->data))
+        {
+            liquid_driver_collect_changes(LIQUID_DRIVER(l->data), since, &changes);
+        }
+    }
+
+    g_list_free_full(objects, g_object_unref);
+
+    liquid_dbus_changes_complete_get_changes_since(interface,
+                                                   invocation,
+                                                   sequence,
+                                                   g_variant_builder_end(&changes));
+
+    return TRUE;
+}
+
+/* Object for daemon-wide interfaces, as opposed to per-device ones */
+static GDBusObjectSkeleton *
+create_daemon_object(DaemonContext *context)
+{
+    GDBusObjectSkeleton *object = g_dbus_object_skeleton_new("/org/liquidctl/LiquidD/Daemon");
+    g_autoptr(LiquidDBusDiagnostics) diagnostics = liquid_dbus_diagnostics_skeleton_new();
+    g_autoptr(LiquidDBusChanges) changes = liquid_dbus_changes_skeleton_new();
+
+    g_signal_connect(diagnostics, "handle-get-statistics", G_CALLBACK(daemon_handle_get_statistics), context);
+
+    g_dbus_object_skeleton_add_interface(object, G_DBUS_INTERFACE_SKELETON(diagnostics));
+
+    g_signal_connect(changes, "handle-get-changes-since", G_CALLBACK(daemon_handle_get_changes_since), context);
+
+    g_dbus_object_skeleton_add_interface(object, G_DBUS_INTERFACE_SKELETON(changes));
+
+    return object;
+}
+
+static GDBusMessage *
+count_outgoing_dbus_message(GDBusConnection *connection G_GNUC_UNUSED,
+                            GDBusMessage *message,
+                            gboolean incoming,
+                            gpointer user_data)
+{
+    DaemonContext *context = user_data;
+
+    if (incoming)
+    {
+        return message;
+    }
+
+    switch (g_dbus_message_get_message_type(message))
+    {
+    case G_DBUS_MESSAGE_TYPE_SIGNAL:
+        g_atomic_int_inc(&context->dbus_signals);
+        break;
+
+    case G_DBUS_MESSAGE_TYPE_METHOD_RETURN:
+    case G_DBUS_MESSAGE_TYPE_ERROR:
+        g_atomic_int_inc(&context->dbus_method_replies);
+        break;
+
+    default:
+        break;
+    }
+
+    return message;
 }
 
 static void
-probe_hid_device(LiquidHidManager *manager G_GNUC_UNUSED,
-                 LiquidHidDeviceInfo *info,
-                 gpointer user_data)
+collect_metrics(LiquidMetricsServer *server G_GNUC_UNUSED, GString *out, DaemonContext *context)
 {
-    GDBusObjectManagerServer *object_manager = user_data;
+    GList *objects = g_dbus_object_manager_get_objects(context->object_manager);
 
-    const char *hidraw_path = liquid_hid_device_info_get_hidraw_path(info);
+    liquid_driver_append_metrics(objects, out);
+    liquid_driver_hid_append_metrics(objects, out);
 
-    g_printerr("hid device vendor=%0#6x product=%0#6x: %s\n",
-               liquid_hid_device_info_get_vendor_id(info),
-               liquid_hid_device_info_get_product_id(info),
-               hidraw_path);
+    g_list_free_full(objects, g_object_unref);
+
+    liquid_loop_monitor_append_metrics(context->loop_monitor, out);
+    liquid_publisher_append_metrics(context->publisher, out);
+    liquid_frame_scheduler_append_metrics(context->frame_scheduler, out);
+    liquid_fan_controller_append_metrics(context->fan_controllers, out);
+
+    /* Wrap around at 2^32, which Prometheus takes for a counter reset */
+    liquid_metrics_append_family(out, "liquidd_dbus_signals_total", "counter", "D-Bus signals emitted.");
+    liquid_metrics_append_sample(out,
+                                 "liquidd_dbus_signals_total",
+                                 NULL,
+                                 (guint)g_atomic_int_get(&context->dbus_signals));
+    liquid_metrics_append_family(out,
+                                 "liquidd_dbus_method_replies_total",
+                                 "counter",
+                                 "D-Bus method replies and errors sent.");
+    liquid_metrics_append_sample(out,
+                                 "liquidd_dbus_method_replies_total",
+                                 NULL,
+                                 (guint)g_atomic_int_get(&context->dbus_method_replies));
+
+    liquid_metrics_append_process(out);
+}
+
+/* Polls for the port of the daemon taken over, which holds it until it exits */
+typedef struct
+{
+    LiquidMetricsServer *server;
+    guint16 port;
+    guint attempts;
+    guint source_id;
+} MetricsPortRetry;
+
+static gboolean
+retry_metrics_port(gpointer user_data)
+{
+    MetricsPortRetry *retry = user_data;
+    g_autoptr(GError) error = NULL;
 
-    if (!liquid_driver_nzxt_smart2_match(info))
+    if (liquid_metrics_server_listen_loopback(retry->server, retry->port, &error))
     {
-        return;
+        retry->source_id = 0;
+        return G_SOURCE_REMOVE;
     }
 
-    g_printerr("Device %s matched\n", hidraw_path);
+    if (!g_error_matches(error, G_IO_ERROR, G_IO_ERROR_ADDRESS_IN_USE) || ++retry->attempts == METRICS_PORT_ATTEMPTS)
+    {
+        g_printerr("Can't listen for metrics on port %u, continuing without: %s\n", retry->port, error->message);
+        retry->source_id = 0;
+        return G_SOURCE_REMOVE;
+    }
+
+    return G_SOURCE_CONTINUE;
+}
 
+/*
+ * After a takeover the devices are already this daemon's, so failing to serve
+ * metrics isn't fatal, and a port still in use is retried in `port_retry`.
+ */
+static LiquidMetricsServer *
+create_metrics_server(const gchar *socket_path,
+                      gint port,
+                      gboolean took_over,
+                      MetricsPortRetry *port_retry,
+                      DaemonContext *context)
+{
+    g_autoptr(LiquidMetricsServer) server = liquid_metrics_server_new();
     g_autoptr(GError) error = NULL;
-    LiquidHidDevice *hid_device
-        = liquid_hid_device_new_for_path(hidraw_path, HID_MAX_BUFFER_SIZE, &error);
+    const gchar *outcome = took_over ? ", continuing without" : "";
 
-    if (hid_device == NULL)
+    if (socket_path && !liquid_metrics_server_listen_unix(server, socket_path, &error))
     {
-        g_printerr("Can't open HID device %s: %s\n", hidraw_path, error->message);
-        return;
+        g_printerr("Can't listen for metrics on %s%s: %s\n", socket_path, outcome, error->message);
+
+        if (!took_over)
+        {
+            return NULL;
+        }
+
+        g_clear_error(&error);
+    }
+
+    if (port > 0 && !liquid_metrics_server_listen_loopback(server, (guint16)port, &error))
+    {
+        if (took_over && g_error_matches(error, G_IO_ERROR, G_IO_ERROR_ADDRESS_IN_USE))
+        {
+            port_retry->server = server;
+            port_retry->port = (guint16)port;
+            port_retry->attempts = 1;
+            port_retry->source_id = g_timeout_add_seconds(1, retry_metrics_port, port_retry);
+        }
+        else
+        {
+            g_printerr("Can't listen for metrics on port %d%s: %s\n", port, outcome, error->message);
+
+            if (!took_over)
+            {
+                return NULL;
+            }
+        }
     }
 
-    g_autoptr(LiquidDriverNzxtSmart2) driver = liquid_driver_nzxt_smart2_new(hid_device, info);
+    g_signal_connect(server, "collect", G_CALLBACK(collect_metrics), context);
 
-    liquid_driver_export(LIQUID_DRIVER(driver), object_manager);
+    return g_steal_pointer(&server);
+}
+
+/* CHANNEL:EFFECT, where LED channels are named led0, led1... */
+static gboolean
+parse_led_assignment(const gchar *spec, LedAssignment *assignment, GError **error)
+{
+    const gchar *colon = strchr(spec, ':');
+    guint64 channel = 0;
+
+    if (colon == NULL || !g_str_has_prefix(spec, "led"))
+    {
+        g_set_error(error, G_OPTION_ERROR, G_OPTION_ERROR_BAD_VALUE, "Expected ledN:EFFECT, got '%s'", spec);
+        return FALSE;
+    }
+
+    g_autofree gchar *number = g_strndup(spec + strlen("led"), (gsize)(colon - spec) - strlen("led"));
+
+    if (!g_ascii_string_to_unsigned(number, 10, 0, G_MAXUINT, &channel, error))
+    {
+        return FALSE;
+    }
+
+    assignment->channel = (guint)channel;
+
+    return liquid_led_effect_parse(colon + 1, &assignment->effect, error);
 }
 
 static void
@@ -69,11 +1096,163 @@ dbus_name_lost(GDBusConnection *connection G_GNUC_UNUSED, const gchar *name, gpo
 }
 
 int
-main(void)
+main(int argc, char *argv[])
 {
-    g_autoptr(GMainLoop) loop = g_main_loop_new(NULL, FALSE);
+    gint n_io_threads = 0;
+    gint n_emulated = 0;
+    g_autofree gchar *metrics_socket = NULL;
+    gint metrics_port = 0;
+    g_auto(GStrv) alerts = NULL;
+    g_auto(GStrv) filter_specs = NULL;
+    g_auto(GStrv) aggregate_specs = NULL;
+    g_auto(GStrv) leds = NULL;
+    g_auto(GStrv) fan_control_specs = NULL;
+    gint frame_rate = 30;
+    g_autofree gchar *handoff_socket = NULL;
+    g_autofree gchar *take_over = NULL;
+    g_autofree gchar *driver_dir = NULL;
+    gboolean preload_drivers = FALSE;
+    g_autofree gchar *config_path = NULL;
+
+    GOptionEntry entries[] = {
+        { "io-threads", 0, 0, G_OPTION_ARG_INT, &n_io_threads, "Read devices on N separate threads", "N" },
+        { "emulate", 0, 0, G_OPTION_ARG_INT, &n_emulated, "Add N emulated NZXT Smart2 devices", "N" },
+        { "metrics-socket", 0, 0, G_OPTION_ARG_FILENAME, &metrics_socket, "Serve Prometheus metrics on a Unix socket", "PATH" },
+        { "metrics-port", 0, 0, G_OPTION_ARG_INT, &metrics_port, "Serve Prometheus metrics on a loopback TCP port", "PORT" },
+        { "alert", 0, 0, G_OPTION_ARG_STRING_ARRAY, &alerts, "Add an alert rule, such as 'fan-stopped: fan* rpm < 300 for 3'", "RULE" },
+        { "filter", 0, 0, G_OPTION_ARG_STRING_ARRAY, &filter_specs, "Add a derived channel, such as 'smooth: fan* rpm median 5 | ema 0.3'", "SPEC" },
+        { "aggregate", 0, 0, G_OPTION_ARG_STRING_ARRAY, &aggregate_specs, "Add a channel combining others, such as 'pump_rpm: max rpm */fan0'", "SPEC" },
+        { "led", 0, 0, G_OPTION_ARG_STRING_ARRAY, &leds, "Show an LED effect, such as 'led0:spectrum-wave 4000'", "CHANNEL:EFFECT" },
+        { "frame-rate", 0, 0, G_OPTION_ARG_INT, &frame_rate, "Update LED effects N times per second (30)", "N" },
+        { "fan-control", 0, 0, G_OPTION_ARG_STRING_ARRAY, &fan_control_specs, "Control a fan toward a temperature, such as 'fan0: /sys/class/hwmon/hwmon1/temp1_input target 45'", "SPEC" },
+        { "handoff-socket", 0, 0, G_OPTION_ARG_FILENAME, &handoff_socket, "Hand devices over to a new daemon connecting to a Unix socket", "PATH" },
+        { "take-over", 0, 0, G_OPTION_ARG_FILENAME, &take_over, "Take devices over from the daemon listening on a Unix socket", "PATH" },
+        { "driver-dir", 0, 0, G_OPTION_ARG_FILENAME, &driver_dir, "Load driver modules from a directory (" LIQUIDD_DRIVER_DIR ")", "PATH" },
+        { "preload-drivers", 0, 0, G_OPTION_ARG_NONE, &preload_drivers, "Load every driver module on startup, rather than on a matching device", NULL },
+        { "config", 0, 0, G_OPTION_ARG_FILENAME, &config_path, "Read device settings from a file, reloaded when it changes (~/.config/liquidd/liquidd.conf)", "PATH" },
+        { NULL },
+    };
 
     g_autoptr(GError) error = NULL;
+    g_autoptr(GOptionContext) option_context = g_option_context_new(NULL);
+
+    g_option_context_add_main_entries(option_context, entries, NULL);
+
+    if (!g_option_context_parse(option_context, &argc, &argv, &error))
+    {
+        g_printerr("%s\n", error->message);
+        return EXIT_FAILURE;
+    }
+
+    if (metrics_port < 0 || metrics_port > G_MAXUINT16)
+    {
+        g_printerr("Invalid metrics port %d\n", metrics_port);
+        return EXIT_FAILURE;
+    }
+
+    g_autoptr(GPtrArray) alert_rules = g_ptr_array_new_with_free_func((GDestroyNotify)liquid_alert_rule_free);
+
+    for (GStrv alert = alerts; alert && *alert; alert++)
+    {
+        LiquidAlertRule *rule = liquid_alert_rule_parse(*alert, &error);
+
+        if (rule == NULL)
+        {
+            g_printerr("%s\n", error->message);
+            return EXIT_FAILURE;
+        }
+
+        g_ptr_array_add(alert_rules, rule);
+    }
+
+    g_autoptr(GPtrArray) filters = g_ptr_array_new_with_free_func((GDestroyNotify)liquid_filter_spec_free);
+
+    for (GStrv spec = filter_specs; spec && *spec; spec++)
+    {
+        LiquidFilterSpec *filter = liquid_filter_spec_parse(*spec, &error);
+
+        if (filter == NULL)
+        {
+            g_printerr("%s\n", error->message);
+            return EXIT_FAILURE;
+        }
+
+        g_ptr_array_add(filters, filter);
+    }
+
+    g_autoptr(GPtrArray) aggregates = g_ptr_array_new_with_free_func((GDestroyNotify)liquid_aggregate_spec_free);
+
+    for (GStrv spec = aggregate_specs; spec && *spec; spec++)
+    {
+        LiquidAggregateSpec *aggregate = liquid_aggregate_spec_parse(*spec, &error);
+
+        if (aggregate == NULL)
+        {
+            g_printerr("%s\n", error->message);
+            return EXIT_FAILURE;
+        }
+
+        g_ptr_array_add(aggregates, aggregate);
+    }
+
+    if (frame_rate < 1 || frame_rate > 240)
+    {
+        g_printerr("Invalid frame rate %d\n", frame_rate);
+        return EXIT_FAILURE;
+    }
+
+    g_autoptr(GArray) led_assignments = g_array_new(FALSE, FALSE, sizeof(LedAssignment));
+
+    for (GStrv led = leds; led && *led; led++)
+    {
+        LedAssignment assignment;
+
+        if (!parse_led_assignment(*led, &assignment, &error))
+        {
+            g_printerr("%s\n", error->message);
+            return EXIT_FAILURE;
+        }
+
+        g_array_append_val(led_assignments, assignment);
+    }
+
+    g_autoptr(GPtrArray) fan_controls = g_ptr_array_new_with_free_func((GDestroyNotify)liquid_fan_control_free);
+
+    for (GStrv spec = fan_control_specs; spec && *spec; spec++)
+    {
+        LiquidFanControl *control = liquid_fan_control_parse(*spec, &error);
+
+        if (control == NULL)
+        {
+            g_printerr("%s\n", error->message);
+            return EXIT_FAILURE;
+        }
+
+        if (liquid_fan_control_lookup(fan_controls, control->channel))
+        {
+            g_printerr("Fan channel %s is controlled twice\n", control->channel);
+            liquid_fan_control_free(control);
+            return EXIT_FAILURE;
+        }
+
+        g_ptr_array_add(fan_controls, control);
+    }
+
+    if (config_path == NULL)
+    {
+        config_path = g_build_filename(g_get_user_config_dir(), "liquidd", "liquidd.conf", NULL);
+    }
+
+    /* Invalid settings fail startup, but only keep the previous ones on reload */
+    LiquidConfig *config = liquid_config_load(config_path, &error);
+
+    if (config == NULL)
+    {
+        g_printerr("%s\n", error->message);
+        return EXIT_FAILURE;
+    }
+
+    g_autoptr(GMainLoop) loop = g_main_loop_new(NULL, FALSE);
     g_autoptr(GDBusConnection) connection = g_bus_get_sync(G_BUS_TYPE_SESSION, NULL, &error);
 
     if (!connection)
@@ -82,16 +1261,218 @@ main(void)
         return EXIT_FAILURE;
     }
 
+    g_autofree gchar *cache_path = g_build_filename(g_get_user_cache_dir(), "liquidd", "devices.ini", NULL);
+    g_autoptr(LiquidDeviceCache) device_cache = liquid_device_cache_new(cache_path, TRUE);
+
+    if (!liquid_device_cache_load(device_cache, &error))
+    {
+        g_printerr("Can't load device cache: %s\n", error->message);
+        g_clear_error(&error);
+    }
+
+    g_autofree gchar *counters_path = build_state_path("counters.ini");
+    g_autoptr(LiquidDeviceCache) counters = liquid_device_cache_new(counters_path, FALSE);
+
+    if (!liquid_device_cache_load(counters, &error))
+    {
+        g_printerr("Can't load device counters: %s\n", error->message);
+        g_clear_error(&error);
+    }
+
+    StateStores state_stores = {
+        .device_cache = device_cache,
+        .counters = counters,
+        .save_source_id = 0,
+    };
+
+    /* Declared before anything holding devices, so that the threads are joined last */
+    g_autoptr(GPtrArray) io_threads = g_ptr_array_new_with_free_func(g_object_unref);
+
+    for (gint i = 0; i < n_io_threads; i++)
+    {
+        g_autofree gchar *name = g_strdup_printf("liquidd-io-%d", i);
+        g_ptr_array_add(io_threads, liquid_io_thread_new(name));
+    }
+
+    /* Only the manifests: modules are loaded once a device they list shows up */
+    g_autoptr(LiquidDriverRegistry) drivers = liquid_driver_registry_new();
+
+    if (driver_dir == NULL)
+    {
+        if (!add_default_driver_dir(drivers))
+        {
+            return EXIT_FAILURE;
+        }
+    }
+    else if (!liquid_driver_registry_add_directory(drivers, driver_dir, &error))
+    {
+        g_printerr("Can't read driver manifests: %s\n", error->message);
+        g_clear_error(&error);
+    }
+
+    if (preload_drivers && !liquid_driver_registry_load_all(drivers, &error))
+    {
+        g_printerr("%s\n", error->message);
+        g_clear_error(&error);
+    }
+
     g_autoptr(GDBusObjectManagerServer) object_manager = g_dbus_object_manager_server_new("/org/liquidctl/LiquidD");
     g_autoptr(GUdevClient) udev_client = g_udev_client_new(NULL);
     g_autoptr(LiquidHidManager) hid_manager = liquid_hid_manager_new(udev_client);
+    g_autoptr(LiquidPublisher) publisher = liquid_publisher_new(connection);
+    g_autoptr(LiquidFrameScheduler) frame_scheduler = liquid_frame_scheduler_new((guint)frame_rate);
+    g_autoptr(GPtrArray) fan_controllers = g_ptr_array_new_with_free_func(g_object_unref);
+    g_autoptr(LiquidAggregator) aggregator = aggregates->len ? liquid_aggregator_new(aggregates) : NULL;
+
+    /* Exported first, so that devices are bound to it as they come */
+    if (aggregator)
+    {
+        liquid_driver_set_publisher(LIQUID_DRIVER(aggregator), publisher);
+        liquid_driver_set_alert_rules(LIQUID_DRIVER(aggregator), alert_rules);
+        liquid_driver_export(LIQUID_DRIVER(aggregator), object_manager);
+    }
+
+    ProbeContext probe_context = {
+        .object_manager = object_manager,
+        .stores = &state_stores,
+        .drivers = drivers,
+        .io_threads = io_threads,
+        .next_io_thread = 0,
+        .publisher = publisher,
+        .alert_rules = alert_rules,
+        .filters = filters,
+        .aggregator = aggregator,
+        .frame_scheduler = frame_scheduler,
+        .led_assignments = led_assignments,
+        .fan_controls = fan_controls,
+        .fan_controllers = fan_controllers,
+        .config_path = config_path,
+        .config = config,
+        .handoff_devices = NULL,
+    };
+
+    /* As late as possible, since the previous daemon has stopped reading by the time this returns */
+    gint64 handoff_stop_time = 0;
+    gint handoff_fd = -1;
+    g_autoptr(GHashTable) handoff_devices
+        = take_over ? take_over_devices(take_over, &handoff_stop_time, &handoff_fd) : NULL;
+
+    probe_context.handoff_devices = handoff_devices;
+    liquid_hid_manager_for_each_device_group(hid_manager, probe_hid_device_group, &probe_context);
+
+    /* Reads of devices taken over have started, or are about to on their I/O threads */
+    gint64 handoff_downtime_us = handoff_devices ? g_get_monotonic_time() - handoff_stop_time : -1;
+
+    if (handoff_devices)
+    {
+        g_clear_pointer(&handoff_devices, g_hash_table_unref);
+
+        /* The previous daemon reopens the devices when it isn't told in time, so both would read them */
+        if (!liquid_handoff_ack(handoff_fd, &error))
+        {
+            g_printerr("Can't acknowledge takeover, leaving the devices to the previous daemon: %s\n",
+                       error->message);
+            return EXIT_FAILURE;
+        }
+
+        g_printerr("Took devices over after %.1f ms\n", (gdouble)handoff_downtime_us / 1000.0);
+    }
+
+    g_autoptr(GPtrArray) emulators = g_ptr_array_new_with_free_func(g_object_unref);
+    add_emulated_devices(&probe_context, emulators, (guint)MAX(n_emulated, 0));
+
+    /* Watches the file even if it doesn't exist yet */
+    g_autoptr(GFile) config_file = g_file_new_for_path(config_path);
+    g_autoptr(GFileMonitor) config_monitor = g_file_monitor_file(config_file, G_FILE_MONITOR_WATCH_MOVES, NULL, &error);
+
+    if (config_monitor)
+    {
+        g_signal_connect(config_monitor, "changed", G_CALLBACK(config_file_changed), &probe_context);
+    }
+    else
+    {
+        g_printerr("Can't watch %s, changes need a restart: %s\n", config_path, error->message);
+        g_clear_error(&error);
+    }
+
+    g_autoptr(LiquidLoopMonitor) loop_monitor = liquid_loop_monitor_new(LOOP_MONITOR_INTERVAL_MS);
+
+    DaemonContext daemon_context = {
+        .object_manager = G_DBUS_OBJECT_MANAGER(object_manager),
+        .loop_monitor = loop_monitor,
+        .drivers = drivers,
+        .publisher = publisher,
+        .frame_scheduler = frame_scheduler,
+        .fan_controllers = fan_controllers,
+        .handoff_downtime_us = handoff_downtime_us,
+        .dbus_signals = 0,
+        .dbus_method_replies = 0,
+    };
+    g_autoptr(GDBusObjectSkeleton) daemon_object = create_daemon_object(&daemon_context);
+
+    g_dbus_object_manager_server_export(object_manager, daemon_object);
+    g_autoptr(LiquidMetricsServer) metrics_server = NULL;
+    MetricsPortRetry metrics_port_retry = { 0 };
+    guint dbus_filter_id = 0;
+
+    if (metrics_socket || metrics_port > 0)
+    {
+        metrics_server = create_metrics_server(metrics_socket,
+                                               metrics_port,
+                                               handoff_downtime_us >= 0,
+                                               &metrics_port_retry,
+                                               &daemon_context);
+
+        if (metrics_server == NULL)
+        {
+            return EXIT_FAILURE;
+        }
+
+        dbus_filter_id = g_dbus_connection_add_filter(connection,
+                                                      count_outgoing_dbus_message, /* filter_function */
+                                                      &daemon_context, /* user_data */
+                                                      NULL /* user_data_free_func */);
+    }
+
+    HandoffContext handoff_context = {
+        .loop = loop,
+        .object_manager = G_DBUS_OBJECT_MANAGER(object_manager),
+        .path = handoff_socket,
+        .listen_fd = -1,
+        .handed_off = FALSE,
+    };
+
+    if (handoff_socket)
+    {
+        handoff_context.listen_fd = liquid_handoff_listen(handoff_socket, &error);
+
+        if (handoff_context.listen_fd == -1)
+        {
+            g_printerr("Can't listen for handoff on %s: %s\n", handoff_socket, error->message);
+            return EXIT_FAILURE;
+        }
+
+        g_unix_fd_add(handoff_context.listen_fd, G_IO_IN, handoff_requested, &handoff_context);
+    }
 
-    liquid_hid_manager_for_each_device(hid_manager, probe_hid_device, object_manager);
     g_dbus_object_manager_server_set_connection(object_manager, connection);
 
+    /* The name passes straight from a daemon handing its devices over to the one taking them */
+    GBusNameOwnerFlags name_flags = G_BUS_NAME_OWNER_FLAGS_NONE;
+
+    if (handoff_socket)
+    {
+        name_flags |= G_BUS_NAME_OWNER_FLAGS_ALLOW_REPLACEMENT;
+    }
+
+    if (take_over)
+    {
+        name_flags |= G_BUS_NAME_OWNER_FLAGS_REPLACE;
+    }
+
     g_bus_own_name_on_connection(connection,
                                  "org.liquidctl.LiquidD", /* name */
-                                 G_BUS_NAME_OWNER_FLAGS_NONE, /* flags */
+                                 name_flags, /* flags */
                                  dbus_name_acquired, /* name_acquired_handler */
                                  dbus_name_lost, /* name_lost_handler */
                                  NULL, /* user_data */
@@ -102,5 +1483,30 @@ main(void)
 
     g_main_loop_run(loop);
 
+    g_clear_handle_id(&metrics_port_retry.source_id, g_source_remove);
+
+    if (dbus_filter_id)
+    {
+        g_dbus_connection_remove_filter(connection, dbus_filter_id);
+    }
+
+    if (handoff_context.listen_fd != -1)
+    {
+        unlink(handoff_socket);
+        close(handoff_context.listen_fd);
+    }
+
+    /* Otherwise the new daemon's saves could be overwritten with older state */
+    if (handoff_context.handed_off)
+    {
+        g_clear_handle_id(&state_stores.save_source_id, g_source_remove);
+    }
+    else
+    {
+        save_state_stores(&state_stores);
+    }
+
+    g_clear_pointer(&probe_context.config, liquid_config_unref);
+
     return EXIT_SUCCESS;
 }
@@ -0,0 +1,787 @@
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <gio/gio.h>
+
+#include "driver.h"
+#include "driver_hid.h"
+#include "driver_nzxt_smart2.h"
+#include "emulator_nzxt_smart2.h"
+#include "hid_device.h"
+#include "io_thread.h"
+#include "publisher.h"
+
+/* Smart2 input reports are 64 bytes, plus room for anything unexpected */
+#define MAX_INPUT_REPORT_SIZE 512
+
+/* Reports in flight per device, below what a socket buffer holds */
+#define DEVICE_WINDOW 32
+
+/* Devices publishing to the stalled subscriber */
+#define STALLED_DEVICES 10
+
+/* Resident memory growth past the first second that counts as unbounded queueing */
+#define STALLED_RSS_GROWTH_LIMIT (4 * 1024 * 1024)
+
+/*
+ * Allocation counting by interposing malloc: every allocation in the process,
+ * including the GDBus worker thread's, is attributed to the pipeline.
+ */
+#ifdef __GLIBC__
+extern void *
+__libc_malloc(size_t size);
+
+extern void *
+__libc_calloc(size_t nmemb, size_t size);
+
+extern void *
+__libc_realloc(void *ptr, size_t size);
+
+static gint allocations;
+
+void *
+malloc(size_t size)
+{
+    g_atomic_int_inc(&allocations);
+    return __libc_malloc(size);
+}
+
+void *
+calloc(size_t nmemb, size_t size)
+{
+    g_atomic_int_inc(&allocations);
+    return __libc_calloc(nmemb, size);
+}
+
+void *
+realloc(void *ptr, size_t size)
+{
+    g_atomic_int_inc(&allocations);
+    return __libc_realloc(ptr, size);
+}
+
+#define ALLOCATIONS_COUNTED TRUE
+#else
+static gint allocations;
+#define ALLOCATIONS_COUNTED FALSE
+#endif
+
+typedef struct
+{
+    LiquidEmulatorNzxtSmart2 *emulator;
+    LiquidHidDevice *hid_device;
+    LiquidDriverNzxtSmart2 *driver;
+    gchar *fan_path;
+
+    guint sent;
+    guint handled;
+    guint16 rpm;
+} BenchDevice;
+
+typedef struct
+{
+    gchar *path;
+    guint value;
+    gint64 time;
+} PropertyChange;
+
+/* Receives PropertiesChanged on its own thread, like an independent client would */
+typedef struct
+{
+    gchar *address;
+    GThread *thread;
+    GMainContext *context;
+    GMainLoop *loop;
+
+    GMutex mutex;
+    GCond cond;
+    gboolean ready;
+
+    GAsyncQueue *changes;
+} BenchClient;
+
+static void
+discard_print(const gchar *string G_GNUC_UNUSED)
+{
+}
+
+static void
+property_change_free(gpointer data)
+{
+    PropertyChange *change = data;
+
+    g_free(change->path);
+    g_free(change);
+}
+
+static void
+bench_device_handled(LiquidHidDevice *hid_device G_GNUC_UNUSED,
+                     GBytes *report G_GNUC_UNUSED,
+                     BenchDevice *device)
+{
+    device->handled++;
+}
+
+static BenchDevice *
+bench_device_new(guint index, GMainContext *io_context, GDBusObjectManagerServer *object_manager)
+{
+    g_autoptr(GError) error = NULL;
+    BenchDevice *device = g_new0(BenchDevice, 1);
+
+    device->emulator = liquid_emulator_nzxt_smart2_new(index, &error);
+
+    if (device->emulator == NULL)
+    {
+        g_printerr("Can't create emulated device: %s\n", error->message);
+        exit(EXIT_FAILURE);
+    }
+
+    g_autoptr(LiquidHidDeviceInfo) info = liquid_emulator_nzxt_smart2_dup_device_info(device->emulator);
+
+    device->hid_device
+        = liquid_hid_device_new_for_fd(liquid_emulator_nzxt_smart2_steal_device_fd(device->emulator),
+                                       MAX_INPUT_REPORT_SIZE,
+                                       io_context);
+    device->driver = liquid_driver_nzxt_smart2_new(device->hid_device, info);
+
+    /* Connected after the driver, so this runs once the report has been decoded */
+    g_signal_connect(device->hid_device, "input-report", G_CALLBACK(bench_device_handled), device);
+
+    /* Synthetic load isn't periodic, so the stall watchdog would only get in the way */
+    liquid_driver_hid_set_update_interval(LIQUID_DRIVER_HID(device->driver), 0);
+    liquid_driver_export(LIQUID_DRIVER(device->driver), object_manager);
+
+    device->fan_path = g_strdup_printf("%s/fan0", g_dbus_object_get_object_path(G_DBUS_OBJECT(device->driver)));
+
+    return device;
+}
+
+static void
+bench_device_free(gpointer data)
+{
+    BenchDevice *device = data;
+
+    g_signal_handlers_disconnect_by_func(device->hid_device, bench_device_handled, device);
+
+    g_clear_object(&device->driver);
+    g_clear_object(&device->hid_device);
+    g_clear_object(&device->emulator);
+    g_free(device->fan_path);
+    g_free(device);
+}
+
+/* Returns FALSE if the device's socket buffer is full */
+static gboolean
+bench_device_send(BenchDevice *device)
+{
+    g_autoptr(GError) error = NULL;
+
+    /* Always a new value, so that every report changes the exported property */
+    device->rpm = device->rpm % 2000 + 1;
+
+    guint16 rpm[LIQUID_EMULATOR_NZXT_SMART2_FAN_CHANNELS] = { device->rpm, device->rpm, device->rpm };
+
+    if (!liquid_emulator_nzxt_smart2_send_fan_speed(device->emulator, rpm, &error))
+    {
+        if (g_error_matches(error, G_IO_ERROR, G_IO_ERROR_WOULD_BLOCK))
+        {
+            return FALSE;
+        }
+
+        g_printerr("Can't send report: %s\n", error->message);
+        exit(EXIT_FAILURE);
+    }
+
+    device->sent++;
+
+    return TRUE;
+}
+
+static void
+bench_client_properties_changed(GDBusConnection *connection G_GNUC_UNUSED,
+                                const gchar *sender_name G_GNUC_UNUSED,
+                                const gchar *object_path,
+                                const gchar *interface_name G_GNUC_UNUSED,
+                                const gchar *signal_name G_GNUC_UNUSED,
+                                GVariant *parameters,
+                                gpointer user_data)
+{
+    BenchClient *client = user_data;
+    gint64 time = g_get_monotonic_time();
+    g_autoptr(GVariant) changed = g_variant_get_child_value(parameters, 1);
+    guint value = 0;
+
+    if (!g_variant_lookup(changed, "Value", "u", &value))
+    {
+        return;
+    }
+
+    PropertyChange *change = g_new0(PropertyChange, 1);
+
+    change->path = g_strdup(object_path);
+    change->value = value;
+    change->time = time;
+
+    g_async_queue_push(client->changes, change);
+    g_main_context_wakeup(NULL);
+}
+
+static gpointer
+bench_client_run(gpointer user_data)
+{
+    BenchClient *client = user_data;
+    g_autoptr(GError) error = NULL;
+
+    g_main_context_push_thread_default(client->context);
+
+    g_autoptr(GDBusConnection) connection
+        = g_dbus_connection_new_for_address_sync(client->address,
+                                                 G_DBUS_CONNECTION_FLAGS_AUTHENTICATION_CLIENT
+                                                     | G_DBUS_CONNECTION_FLAGS_MESSAGE_BUS_CONNECTION,
+                                                 NULL,
+                                                 NULL,
+                                                 &error);
+
+    if (connection == NULL)
+    {
+        g_printerr("Client can't connect to the bus: %s\n", error->message);
+        exit(EXIT_FAILURE);
+    }
+
+    g_dbus_connection_signal_subscribe(connection,
+                                       NULL, /* sender */
+                                       "org.freedesktop.DBus.Properties", /* interface_name */
+                                       "PropertiesChanged", /* member */
+                                       NULL, /* object_path */
+                                       "org.liquidctl.FanSpeedRPM", /* arg0 */
+                                       G_DBUS_SIGNAL_FLAGS_NONE, /* flags */
+                                       bench_client_properties_changed, /* callback */
+                                       client, /* user_data */
+                                       NULL /* user_data_free_func */);
+
+    /* A round trip guarantees that the bus has seen the match rule */
+    g_autoptr(GVariant) reply = g_dbus_connection_call_sync(connection,
+                                                            "org.freedesktop.DBus",
+                                                            "/org/freedesktop/DBus",
+                                                            "org.freedesktop.DBus",
+                                                            "GetId",
+                                                            NULL,
+                                                            NULL,
+                                                            G_DBUS_CALL_FLAGS_NONE,
+                                                            -1,
+                                                            NULL,
+                                                            &error);
+
+    if (reply == NULL)
+    {
+        g_printerr("Client can't reach the bus: %s\n", error->message);
+        exit(EXIT_FAILURE);
+    }
+
+    g_mutex_lock(&client->mutex);
+    client->ready = TRUE;
+    g_cond_signal(&client->cond);
+    g_mutex_unlock(&client->mutex);
+
+    g_main_loop_run(client->loop);
+
+    g_main_context_pop_thread_default(client->context);
+
+    return NULL;
+}
+
+static gboolean
+bench_client_quit(gpointer user_data)
+{
+    GMainLoop *loop = user_data;
+    g_main_loop_quit(loop);
+    return G_SOURCE_REMOVE;
+}
+
+static BenchClient *
+bench_client_start(const gchar *address)
+{
+    BenchClient *client = g_new0(BenchClient, 1);
+
+    client->address = g_strdup(address);
+    client->context = g_main_context_new();
+    client->loop = g_main_loop_new(client->context, FALSE);
+    client->changes = g_async_queue_new_full(property_change_free);
+    g_mutex_init(&client->mutex);
+    g_cond_init(&client->cond);
+
+    client->thread = g_thread_new("bench-client", bench_client_run, client);
+
+    g_mutex_lock(&client->mutex);
+
+    while (!client->ready)
+    {
+        g_cond_wait(&client->cond, &client->mutex);
+    }
+
+    g_mutex_unlock(&client->mutex);
+
+    return client;
+}
+
+static void
+bench_client_stop(BenchClient *client)
+{
+    g_main_context_invoke(client->context, bench_client_quit, client->loop);
+    g_thread_join(client->thread);
+
+    g_async_queue_unref(client->changes);
+    g_main_loop_unref(client->loop);
+    g_main_context_unref(client->context);
+    g_mutex_clear(&client->mutex);
+    g_cond_clear(&client->cond);
+    g_free(client->address);
+    g_free(client);
+}
+
+static void
+bench_client_drain(BenchClient *client)
+{
+    PropertyChange *change;
+
+    while ((change = g_async_queue_try_pop(client->changes)) != NULL)
+    {
+        property_change_free(change);
+    }
+}
+
+static void
+bench_throughput(GDBusConnection *connection, GPtrArray *devices, guint n_reports)
+{
+    guint quota = MAX(n_reports / devices->len, 1);
+    guint total = quota * devices->len;
+    guint handled = 0;
+
+    gint allocations_before = g_atomic_int_get(&allocations);
+    gint64 start = g_get_monotonic_time();
+
+    while (handled < total)
+    {
+        handled = 0;
+
+        for (guint i = 0; i < devices->len; i++)
+        {
+            BenchDevice *device = g_ptr_array_index(devices, i);
+
+            while (device->sent < quota && device->sent - device->handled < DEVICE_WINDOW)
+            {
+                if (!bench_device_send(device))
+                {
+                    break;
+                }
+            }
+
+            handled += device->handled;
+        }
+
+        if (handled < total)
+        {
+            g_main_context_iteration(NULL, TRUE);
+        }
+    }
+
+    /* Include emitting the PropertiesChanged signals queued by the skeletons */
+    while (g_main_context_iteration(NULL, FALSE))
+    {
+    }
+
+    g_dbus_connection_flush_sync(connection, NULL, NULL);
+
+    gint64 elapsed = g_get_monotonic_time() - start;
+    gint allocated = g_atomic_int_get(&allocations) - allocations_before;
+
+    printf("%4u devices: %10.0f reports/s %8.0f ns/report",
+           devices->len,
+           (gdouble)total * G_USEC_PER_SEC / (gdouble)elapsed,
+           (gdouble)elapsed * 1000.0 / (gdouble)total);
+
+    if (ALLOCATIONS_COUNTED)
+    {
+        printf(" %6.1f allocations/report", (gdouble)allocated / (gdouble)total);
+    }
+
+    printf("\n");
+
+    for (guint i = 0; i < devices->len; i++)
+    {
+        BenchDevice *device = g_ptr_array_index(devices, i);
+        device->sent = device->handled = 0;
+    }
+}
+
+static gint
+compare_int64(gconstpointer a, gconstpointer b)
+{
+    gint64 x = *(const gint64 *)a;
+    gint64 y = *(const gint64 *)b;
+
+    return x < y ? -1 : x > y;
+}
+
+/* Time from a report being sent to the client seeing the property change, one report at a time */
+static void
+bench_latency(BenchClient *client, GPtrArray *devices, guint n_samples)
+{
+    g_autoptr(GArray) latencies = g_array_sized_new(FALSE, FALSE, sizeof(gint64), n_samples);
+
+    while (g_main_context_iteration(NULL, FALSE))
+    {
+    }
+
+    bench_client_drain(client);
+
+    for (guint i = 0; i < n_samples; i++)
+    {
+        BenchDevice *device = g_ptr_array_index(devices, i % devices->len);
+        gint64 start = g_get_monotonic_time();
+        gint64 latency = -1;
+
+        while (!bench_device_send(device))
+        {
+            g_main_context_iteration(NULL, TRUE);
+        }
+
+        while (latency < 0)
+        {
+            PropertyChange *change = g_async_queue_try_pop(client->changes);
+
+            if (change == NULL)
+            {
+                g_main_context_iteration(NULL, TRUE);
+                continue;
+            }
+
+            if (change->value == device->rpm && g_str_equal(change->path, device->fan_path))
+            {
+                latency = change->time - start;
+            }
+
+            property_change_free(change);
+        }
+
+        g_array_append_val(latencies, latency);
+    }
+
+    g_array_sort(latencies, compare_int64);
+
+    printf("%4u devices: latency median %6" G_GINT64_FORMAT " us p99 %6" G_GINT64_FORMAT " us max %6" G_GINT64_FORMAT " us\n",
+           devices->len,
+           g_array_index(latencies, gint64, latencies->len / 2),
+           g_array_index(latencies, gint64, latencies->len * 99 / 100),
+           g_array_index(latencies, gint64, latencies->len - 1));
+}
+
+static gsize
+resident_set_size(void)
+{
+    g_autofree gchar *statm = NULL;
+    guint64 pages = 0;
+
+    if (g_file_get_contents("/proc/self/statm", &statm, NULL, NULL))
+    {
+        sscanf(statm, "%*u %" G_GUINT64_FORMAT, &pages);
+    }
+
+    return (gsize)pages * (gsize)sysconf(_SC_PAGESIZE);
+}
+
+static void
+connection_ready(GObject *source_object G_GNUC_UNUSED, GAsyncResult *result, gpointer user_data)
+{
+    GDBusConnection **connection = user_data;
+    g_autoptr(GError) error = NULL;
+
+    *connection = g_dbus_connection_new_finish(result, &error);
+
+    if (*connection == NULL)
+    {
+        g_printerr("Can't set up the stalled subscriber's connection: %s\n", error->message);
+        exit(EXIT_FAILURE);
+    }
+}
+
+/*
+ * A peer connection whose other end authenticates and then never reads, so
+ * that every signal sent on it stays in the connection's outgoing queue, as
+ * with a client stopped under a debugger. The other end is returned in
+ * `subscriber_fd`, to be closed once done.
+ */
+static GDBusConnection *
+stalled_connection_new(gint *subscriber_fd)
+{
+    g_autoptr(GError) error = NULL;
+    gint fds[2];
+
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) == -1)
+    {
+        g_printerr("Can't create socket pair: %s\n", g_strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+
+    g_autoptr(GSocket) server_socket = g_socket_new_from_fd(fds[0], &error);
+
+    if (server_socket == NULL)
+    {
+        g_printerr("Can't wrap socket: %s\n", error->message);
+        exit(EXIT_FAILURE);
+    }
+
+    g_autoptr(GSocketConnection) stream = g_socket_connection_factory_create_connection(server_socket);
+    g_autofree gchar *guid = g_dbus_generate_guid();
+    GDBusConnection *connection = NULL;
+
+    /* Authenticated on the GDBus worker thread, while this one plays the client */
+    g_dbus_connection_new(G_IO_STREAM(stream),
+                          guid, /* guid */
+                          G_DBUS_CONNECTION_FLAGS_AUTHENTICATION_SERVER, /* flags */
+                          NULL, /* observer */
+                          NULL, /* cancellable */
+                          connection_ready, /* callback */
+                          &connection /* user_data */);
+
+    g_autofree gchar *uid = g_strdup_printf("%u", (guint)getuid());
+    g_autoptr(GString) auth = g_string_new(NULL);
+    gchar reply[256];
+
+    g_string_append_len(auth, "\0AUTH EXTERNAL ", 15);
+
+    for (const gchar *c = uid; *c; c++)
+    {
+        g_string_append_printf(auth, "%02x", (guint)*c);
+    }
+
+    g_string_append(auth, "\r\n");
+
+    if (write(fds[1], auth->str, auth->len) != (ssize_t)auth->len || read(fds[1], reply, sizeof(reply)) < 2
+        || strncmp(reply, "OK", 2) != 0
+        || write(fds[1], "BEGIN\r\n", 7) != 7)
+    {
+        g_printerr("Stalled subscriber can't authenticate\n");
+        exit(EXIT_FAILURE);
+    }
+
+    while (connection == NULL)
+    {
+        g_main_context_iteration(NULL, TRUE);
+    }
+
+    *subscriber_fd = fds[1];
+
+    return connection;
+}
+
+/*
+ * Publishes for `seconds` to a subscriber that stopped reading, sampling the
+ * publisher and resident memory every second. Returns FALSE if memory kept
+ * growing, as it would if signals queued up without bound.
+ */
+static gboolean
+bench_stalled_subscriber(guint seconds)
+{
+    gint subscriber_fd = -1;
+    g_autoptr(GDBusConnection) connection = stalled_connection_new(&subscriber_fd);
+    g_autoptr(LiquidPublisher) publisher = liquid_publisher_new(connection);
+    g_autoptr(GDBusObjectManagerServer) object_manager = g_dbus_object_manager_server_new("/org/liquidctl/LiquidD");
+    g_autoptr(GPtrArray) devices = g_ptr_array_new_with_free_func(bench_device_free);
+
+    for (guint i = 0; i < STALLED_DEVICES; i++)
+    {
+        BenchDevice *device = bench_device_new(i, NULL, object_manager);
+
+        liquid_driver_set_publisher(LIQUID_DRIVER(device->driver), publisher);
+        g_ptr_array_add(devices, device);
+    }
+
+    g_dbus_object_manager_server_set_connection(object_manager, connection);
+
+    gint64 start = g_get_monotonic_time();
+    gsize baseline = 0;
+    gsize rss = 0;
+
+    printf("%4s %10s %10s %12s %12s %10s %8s\n",
+           "s",
+           "RSS KiB",
+           "batches",
+           "published",
+           "superseded",
+           "deferred",
+           "flushing");
+
+    for (guint second = 1; second <= seconds; second++)
+    {
+        while (g_get_monotonic_time() - start < (gint64)second * G_USEC_PER_SEC)
+        {
+            for (guint i = 0; i < devices->len; i++)
+            {
+                BenchDevice *device = g_ptr_array_index(devices, i);
+
+                while (device->sent - device->handled < DEVICE_WINDOW && bench_device_send(device))
+                {
+                }
+            }
+
+            g_main_context_iteration(NULL, TRUE);
+        }
+
+        g_autoptr(GVariant) statistics = liquid_publisher_dup_statistics(publisher);
+        guint64 batches = 0;
+        guint64 published = 0;
+        guint64 superseded = 0;
+        guint64 deferred = 0;
+        gboolean flushing = FALSE;
+
+        g_variant_lookup(statistics, "batches", "t", &batches);
+        g_variant_lookup(statistics, "published-values", "t", &published);
+        g_variant_lookup(statistics, "superseded-values", "t", &superseded);
+        g_variant_lookup(statistics, "deferred-batches", "t", &deferred);
+        g_variant_lookup(statistics, "flushing", "b", &flushing);
+
+        rss = resident_set_size();
+
+        /* By the end of the first second the socket buffer is full and the queue has settled */
+        if (second == 1)
+        {
+            baseline = rss;
+        }
+
+        printf("%4u %10zu %10" G_GUINT64_FORMAT " %12" G_GUINT64_FORMAT " %12" G_GUINT64_FORMAT
+               " %10" G_GUINT64_FORMAT " %8s\n",
+               second,
+               rss / 1024,
+               batches,
+               published,
+               superseded,
+               deferred,
+               flushing ? "yes" : "no");
+    }
+
+    g_dbus_object_manager_server_set_connection(object_manager, NULL);
+    close(subscriber_fd);
+
+    if (rss > baseline + STALLED_RSS_GROWTH_LIMIT)
+    {
+        g_printerr("Memory grew by %zu KiB while the subscriber was stalled\n", (rss - baseline) / 1024);
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+int
+main(int argc, char *argv[])
+{
+    gint n_reports = 100000;
+    gint n_latency_samples = 200;
+    gint n_io_threads = 0;
+    gint stalled_seconds = 0;
+
+    GOptionEntry entries[] = {
+        { "reports", 0, 0, G_OPTION_ARG_INT, &n_reports, "Reports per throughput run", "N" },
+        { "latency-samples", 0, 0, G_OPTION_ARG_INT, &n_latency_samples, "Reports per latency run", "N" },
+        { "io-threads", 0, 0, G_OPTION_ARG_INT, &n_io_threads, "Read devices on N separate threads", "N" },
+        { "stalled-subscriber",
+          0,
+          0,
+          G_OPTION_ARG_INT,
+          &stalled_seconds,
+          "Instead, publish for N s to a subscriber that stopped reading, and fail if memory grows",
+          "N" },
+        { NULL },
+    };
+
+    g_autoptr(GError) error = NULL;
+    g_autoptr(GOptionContext) option_context = g_option_context_new(NULL);
+
+    g_option_context_set_summary(option_context,
+                                 "Pushes emulated NZXT Smart2 reports through liquidd's pipeline on a private bus.");
+    g_option_context_add_main_entries(option_context, entries, NULL);
+
+    if (!g_option_context_parse(option_context, &argc, &argv, &error))
+    {
+        g_printerr("%s\n", error->message);
+        return EXIT_FAILURE;
+    }
+
+    if (n_reports < 1 || n_latency_samples < 1 || n_io_threads < 0 || stalled_seconds < 0)
+    {
+        g_printerr("Invalid arguments\n");
+        return EXIT_FAILURE;
+    }
+
+    /* Drivers print every report; terminal output would dominate the numbers */
+    g_set_print_handler(discard_print);
+
+    if (stalled_seconds > 0)
+    {
+        return bench_stalled_subscriber((guint)stalled_seconds) ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    g_autoptr(GTestDBus) test_bus = g_test_dbus_new(G_TEST_DBUS_NONE);
+    g_test_dbus_up(test_bus);
+
+    const gchar *address = g_test_dbus_get_bus_address(test_bus);
+    g_autoptr(GDBusConnection) connection
+        = g_dbus_connection_new_for_address_sync(address,
+                                                 G_DBUS_CONNECTION_FLAGS_AUTHENTICATION_CLIENT
+                                                     | G_DBUS_CONNECTION_FLAGS_MESSAGE_BUS_CONNECTION,
+                                                 NULL,
+                                                 NULL,
+                                                 &error);
+
+    if (connection == NULL)
+    {
+        g_printerr("Can't connect to the private bus: %s\n", error->message);
+        return EXIT_FAILURE;
+    }
+
+    g_autoptr(GPtrArray) io_threads = g_ptr_array_new_with_free_func(g_object_unref);
+
+    for (gint i = 0; i < n_io_threads; i++)
+    {
+        g_autofree gchar *name = g_strdup_printf("bench-io-%d", i);
+        g_ptr_array_add(io_threads, liquid_io_thread_new(name));
+    }
+
+    BenchClient *client = bench_client_start(address);
+    const guint device_counts[] = { 1, 10, 100 };
+
+    for (guint i = 0; i < G_N_ELEMENTS(device_counts); i++)
+    {
+        g_autoptr(GDBusObjectManagerServer) object_manager
+            = g_dbus_object_manager_server_new("/org/liquidctl/LiquidD");
+        g_autoptr(GPtrArray) devices = g_ptr_array_new_with_free_func(bench_device_free);
+
+        for (guint j = 0; j < device_counts[i]; j++)
+        {
+            GMainContext *io_context = NULL;
+
+            if (io_threads->len > 0)
+            {
+                io_context = liquid_io_thread_get_context(g_ptr_array_index(io_threads, j % io_threads->len));
+            }
+
+            g_ptr_array_add(devices, bench_device_new(j, io_context, object_manager));
+        }
+
+        g_dbus_object_manager_server_set_connection(object_manager, connection);
+
+        bench_throughput(connection, devices, (guint)n_reports);
+        bench_latency(client, devices, (guint)n_latency_samples);
+
+        g_dbus_object_manager_server_set_connection(object_manager, NULL);
+    }
+
+    bench_client_stop(client);
+    g_test_dbus_down(test_bus);
+
+    return EXIT_SUCCESS;
+}
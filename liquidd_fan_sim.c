@@ -0,0 +1,236 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <glib.h>
+
+#include "pid_controller.h"
+#include "thermal_plant.h"
+
+/* Distance from the target within which the temperature counts as settled, in °C */
+#define SETTLED_BAND 1.0
+
+#define BENCH_UPDATES 1000000
+
+typedef struct
+{
+    gdouble seconds;
+    gdouble interval;
+    gdouble load_step;
+    gdouble sensor_resolution;
+    gdouble noise;
+    guint32 seed;
+} Scenario;
+
+typedef struct
+{
+    gdouble overshoot;
+    gdouble settle_time[2];
+    gdouble steady_error[2];
+    guint duty_writes;
+    guint duty_travel;
+} SimResult;
+
+/* Half the run at the plant's power, the other half with the load step added */
+static SimResult
+simulate(const Scenario *scenario, const LiquidPidParameters *parameters)
+{
+    g_autoptr(GRand) rand = g_rand_new_with_seed(scenario->seed);
+    LiquidThermalPlant plant;
+    LiquidPidState state = { 0 };
+    SimResult result = { 0 };
+    guint n_updates = (guint)(scenario->seconds / scenario->interval);
+    guint phase_updates = n_updates / 2;
+    gdouble error_sum[2] = { 0 };
+    guint error_count[2] = { 0 };
+    gint duty = -1;
+
+    liquid_thermal_plant_init(&plant);
+
+    for (guint i = 0; i < n_updates; i++)
+    {
+        guint phase = i < phase_updates ? 0 : 1;
+        gdouble time = (i - phase * phase_updates) * scenario->interval;
+
+        if (i == phase_updates)
+        {
+            plant.power += scenario->load_step;
+        }
+
+        /* What a sensor reports: noisy, and in steps of its resolution */
+        gdouble measured = plant.temperature + g_rand_double_range(rand, -scenario->noise, scenario->noise);
+
+        if (scenario->sensor_resolution > 0)
+        {
+            measured = round(measured / scenario->sensor_resolution) * scenario->sensor_resolution;
+        }
+
+        gdouble output = liquid_pid_update(parameters, &state, measured, i ? scenario->interval : 0.0);
+        gint quantized = liquid_pid_quantize(output, duty);
+
+        if (quantized != duty)
+        {
+            result.duty_writes++;
+            result.duty_travel += duty < 0 ? 0 : (guint)ABS(quantized - duty);
+            duty = quantized;
+        }
+
+        liquid_thermal_plant_step(&plant, duty, scenario->interval);
+
+        gdouble error = plant.temperature - parameters->setpoint;
+
+        if (phase == 0)
+        {
+            result.overshoot = MAX(result.overshoot, error);
+        }
+
+        if (fabs(error) > SETTLED_BAND)
+        {
+            result.settle_time[phase] = time + scenario->interval;
+        }
+
+        /* Steady state: the last quarter of each phase */
+        if (i % phase_updates >= phase_updates * 3 / 4)
+        {
+            error_sum[phase] += fabs(error);
+            error_count[phase]++;
+        }
+    }
+
+    for (guint phase = 0; phase < 2; phase++)
+    {
+        result.steady_error[phase] = error_count[phase] ? error_sum[phase] / error_count[phase] : NAN;
+    }
+
+    return result;
+}
+
+/* Cost of an update, on a temperature swinging around the target */
+static gdouble
+bench_controller(const LiquidPidParameters *parameters)
+{
+    LiquidPidState state = { 0 };
+    gint duty = -1;
+    gint64 start = g_get_monotonic_time();
+
+    for (guint i = 0; i < BENCH_UPDATES; i++)
+    {
+        gdouble measured = parameters->setpoint + 5.0 * sin(i * 0.01);
+
+        duty = liquid_pid_quantize(liquid_pid_update(parameters, &state, measured, 1.0), duty);
+    }
+
+    gint64 elapsed = g_get_monotonic_time() - start;
+
+    /* Keeps the loop from being optimized away */
+    if (duty < 0)
+    {
+        printf("\n");
+    }
+
+    return (gdouble)elapsed * 1000.0 / BENCH_UPDATES;
+}
+
+static void
+print_result(const gchar *name, const SimResult *result)
+{
+    printf("%-28s %7.1f %7.0f %7.0f %7.2f %7.2f %7u %7u\n",
+           name,
+           result->overshoot,
+           result->settle_time[0],
+           result->settle_time[1],
+           result->steady_error[0],
+           result->steady_error[1],
+           result->duty_writes,
+           result->duty_travel);
+}
+
+int
+main(int argc, char *argv[])
+{
+    LiquidPidParameters parameters;
+    gdouble seconds = 3600;
+    gdouble interval_ms = 1000;
+    gdouble load_step = 40;
+    gdouble sensor_resolution = 0.125;
+    gdouble noise = 0.25;
+    gint seed = 1;
+
+    liquid_pid_parameters_init(&parameters);
+    parameters.setpoint = 55.0;
+
+    GOptionEntry entries[] = {
+        { "target", 0, 0, G_OPTION_ARG_DOUBLE, &parameters.setpoint, "Target temperature (55)", "°C" },
+        { "kp", 0, 0, G_OPTION_ARG_DOUBLE, &parameters.kp, "Proportional gain", "%/°C" },
+        { "ki", 0, 0, G_OPTION_ARG_DOUBLE, &parameters.ki, "Integral gain", "%/°C/s" },
+        { "kd", 0, 0, G_OPTION_ARG_DOUBLE, &parameters.kd, "Derivative gain", "%·s/°C" },
+        { "deadband", 0, 0, G_OPTION_ARG_DOUBLE, &parameters.deadband, "Deadband around the target", "°C" },
+        { "rate", 0, 0, G_OPTION_ARG_DOUBLE, &parameters.max_rate, "Largest duty change, 0 for none", "%/s" },
+        { "min", 0, 0, G_OPTION_ARG_DOUBLE, &parameters.min_output, "Least duty", "%" },
+        { "max", 0, 0, G_OPTION_ARG_DOUBLE, &parameters.max_output, "Greatest duty", "%" },
+        { "seconds", 0, 0, G_OPTION_ARG_DOUBLE, &seconds, "Simulated time (3600)", "S" },
+        { "interval", 0, 0, G_OPTION_ARG_DOUBLE, &interval_ms, "Controller update interval (1000)", "MS" },
+        { "load-step", 0, 0, G_OPTION_ARG_DOUBLE, &load_step, "Power added halfway through (40)", "W" },
+        { "sensor-resolution", 0, 0, G_OPTION_ARG_DOUBLE, &sensor_resolution, "Sensor resolution (0.125)", "°C" },
+        { "noise", 0, 0, G_OPTION_ARG_DOUBLE, &noise, "Sensor noise amplitude (0.25)", "°C" },
+        { "seed", 0, 0, G_OPTION_ARG_INT, &seed, "Seed of the sensor noise", "N" },
+        { NULL },
+    };
+
+    g_autoptr(GError) error = NULL;
+    g_autoptr(GOptionContext) option_context = g_option_context_new(NULL);
+
+    g_option_context_set_summary(option_context,
+                                 "Runs the fan PID controller against a simulated heat source and radiator, with a\n"
+                                 "load step halfway through, and compares it to the same gains without deadband\n"
+                                 "and rate limiting.");
+    g_option_context_add_main_entries(option_context, entries, NULL);
+
+    if (!g_option_context_parse(option_context, &argc, &argv, &error))
+    {
+        g_printerr("%s\n", error->message);
+        return EXIT_FAILURE;
+    }
+
+    if (seconds <= 0 || interval_ms <= 0 || seconds * 1000 < 4 * interval_ms || sensor_resolution < 0 || noise < 0
+        || parameters.min_output < 0 || parameters.max_output > 100 || parameters.min_output > parameters.max_output)
+    {
+        g_printerr("Invalid arguments\n");
+        return EXIT_FAILURE;
+    }
+
+    Scenario scenario = {
+        .seconds = seconds,
+        .interval = interval_ms / 1000.0,
+        .load_step = load_step,
+        .sensor_resolution = sensor_resolution,
+        .noise = noise,
+        .seed = (guint32)seed,
+    };
+    LiquidPidParameters plain = parameters;
+
+    plain.deadband = 0;
+    plain.max_rate = 0;
+
+    SimResult configured_result = simulate(&scenario, &parameters);
+    SimResult plain_result = simulate(&scenario, &plain);
+
+    printf("%-28s %7s %7s %7s %7s %7s %7s %7s\n",
+           "",
+           "over°C",
+           "settle",
+           "settle2",
+           "err°C",
+           "err2°C",
+           "writes",
+           "travel");
+    print_result("configured", &configured_result);
+    print_result("no deadband or rate limit", &plain_result);
+    printf("\nover: overshoot after start; settle, settle2: seconds until within %.0f °C after start and\n"
+           "after the load step; err, err2: mean distance from the target over the last quarter of\n"
+           "each half; writes: duty changes sent; travel: sum of duty changes in percent\n",
+           SETTLED_BAND);
+    printf("controller update: %.0f ns\n", bench_controller(&parameters));
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,324 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <gio/gio.h>
+
+#include "driver_hid.h"
+#include "driver_nzxt_smart2.h"
+#include "emulator_nzxt_smart2.h"
+#include "frame_scheduler.h"
+#include "hid_device.h"
+#include "io_thread.h"
+#include "led_effect.h"
+
+/* Smart2 input reports are 64 bytes, plus room for anything unexpected */
+#define MAX_INPUT_REPORT_SIZE 512
+
+typedef struct
+{
+    LiquidIoThread *thread;
+    LiquidEmulatorNzxtSmart2 *emulator;
+    LiquidHidDevice *hid_device;
+    LiquidDriverNzxtSmart2 *driver;
+} FramesDevice;
+
+static void
+discard_print(const gchar *string G_GNUC_UNUSED)
+{
+}
+
+static FramesDevice *
+frames_device_new(guint index, guint usb_delay_us)
+{
+    g_autoptr(GError) error = NULL;
+    g_autofree gchar *thread_name = g_strdup_printf("frames-device-%u", index);
+    FramesDevice *device = g_new0(FramesDevice, 1);
+
+    device->emulator = liquid_emulator_nzxt_smart2_new(index, &error);
+
+    if (device->emulator == NULL)
+    {
+        g_printerr("Can't create emulated device: %s\n", error->message);
+        exit(EXIT_FAILURE);
+    }
+
+    /*
+     * Answered on a thread per device, like independent USB devices would,
+     * so that a slow one delays neither the scheduler's loop nor the others
+     */
+    device->thread = liquid_io_thread_new(thread_name);
+    liquid_emulator_nzxt_smart2_serve_output(device->emulator,
+                                             liquid_io_thread_get_context(device->thread),
+                                             usb_delay_us);
+
+    g_autoptr(LiquidHidDeviceInfo) info = liquid_emulator_nzxt_smart2_dup_device_info(device->emulator);
+
+    device->hid_device = liquid_hid_device_new_for_fd(liquid_emulator_nzxt_smart2_steal_device_fd(device->emulator),
+                                                      MAX_INPUT_REPORT_SIZE,
+                                                      NULL);
+    device->driver = liquid_driver_nzxt_smart2_new(device->hid_device, info);
+
+    /* The emulator isn't started, so there are no periodic reports to watch */
+    liquid_driver_hid_set_update_interval(LIQUID_DRIVER_HID(device->driver), 0);
+
+    return device;
+}
+
+static void
+frames_device_free(gpointer data)
+{
+    FramesDevice *device = data;
+
+    g_clear_object(&device->driver);
+    g_clear_object(&device->hid_device);
+    g_clear_object(&device->emulator);
+    g_clear_object(&device->thread);
+    g_free(device);
+}
+
+static gint
+compare_int64(gconstpointer a, gconstpointer b)
+{
+    gint64 x = *(const gint64 *)a;
+    gint64 y = *(const gint64 *)b;
+
+    return x < y ? -1 : x > y;
+}
+
+static gboolean
+quit_loop(gpointer user_data)
+{
+    g_main_loop_quit(user_data);
+    return G_SOURCE_REMOVE;
+}
+
+/* Spread of the times at which the devices applied the same frame */
+static void
+report_skew(GPtrArray *frame_times)
+{
+    guint n_frames = ((GArray *)g_ptr_array_index(frame_times, 0))->len;
+    g_autoptr(GArray) spreads = g_array_new(FALSE, FALSE, sizeof(gint64));
+
+    for (guint i = 1; i < frame_times->len; i++)
+    {
+        if (((GArray *)g_ptr_array_index(frame_times, i))->len != n_frames)
+        {
+            printf("skew:     devices applied different numbers of frames\n");
+            return;
+        }
+    }
+
+    for (guint j = 0; j < n_frames; j++)
+    {
+        gint64 first = G_MAXINT64;
+        gint64 last = G_MININT64;
+
+        for (guint i = 0; i < frame_times->len; i++)
+        {
+            gint64 time = g_array_index((GArray *)g_ptr_array_index(frame_times, i), gint64, j);
+
+            first = MIN(first, time);
+            last = MAX(last, time);
+        }
+
+        gint64 spread = last - first;
+        g_array_append_val(spreads, spread);
+    }
+
+    if (spreads->len == 0)
+    {
+        return;
+    }
+
+    g_array_sort(spreads, compare_int64);
+
+    printf("skew:     median %6" G_GINT64_FORMAT " us p99 %6" G_GINT64_FORMAT " us max %6" G_GINT64_FORMAT " us\n",
+           g_array_index(spreads, gint64, spreads->len / 2),
+           g_array_index(spreads, gint64, spreads->len * 99 / 100),
+           g_array_index(spreads, gint64, spreads->len - 1));
+}
+
+/* Intervals between frames applied by the devices, their deviation from the frame period, and skew */
+static void
+report_intervals(GPtrArray *devices, guint frame_rate, guint seconds)
+{
+    gint64 period = G_USEC_PER_SEC / frame_rate;
+    g_autoptr(GArray) intervals = g_array_new(FALSE, FALSE, sizeof(gint64));
+    g_autoptr(GArray) jitter = g_array_new(FALSE, FALSE, sizeof(gint64));
+    g_autoptr(GPtrArray) frame_times = g_ptr_array_new_with_free_func((GDestroyNotify)g_array_unref);
+    guint frames = 0;
+
+    for (guint i = 0; i < devices->len; i++)
+    {
+        FramesDevice *device = g_ptr_array_index(devices, i);
+        GArray *times = liquid_emulator_nzxt_smart2_take_led_frame_times(device->emulator);
+
+        g_ptr_array_add(frame_times, times);
+        frames += times->len;
+
+        for (guint j = 1; j < times->len; j++)
+        {
+            gint64 interval = g_array_index(times, gint64, j) - g_array_index(times, gint64, j - 1);
+            gint64 deviation = ABS(interval - period);
+
+            g_array_append_val(intervals, interval);
+            g_array_append_val(jitter, deviation);
+        }
+    }
+
+    printf("%u frames applied, %.1f per device per second (%u expected)\n",
+           frames,
+           (gdouble)frames / devices->len / seconds,
+           frame_rate);
+
+    if (intervals->len == 0)
+    {
+        return;
+    }
+
+    g_array_sort(intervals, compare_int64);
+    g_array_sort(jitter, compare_int64);
+
+    printf("interval: median %6" G_GINT64_FORMAT " us p1 %6" G_GINT64_FORMAT " us p99 %6" G_GINT64_FORMAT " us"
+           " (period %" G_GINT64_FORMAT " us)\n",
+           g_array_index(intervals, gint64, intervals->len / 2),
+           g_array_index(intervals, gint64, intervals->len / 100),
+           g_array_index(intervals, gint64, intervals->len * 99 / 100),
+           period);
+    printf("jitter:   median %6" G_GINT64_FORMAT " us p99 %6" G_GINT64_FORMAT " us max %6" G_GINT64_FORMAT " us\n",
+           g_array_index(jitter, gint64, jitter->len / 2),
+           g_array_index(jitter, gint64, jitter->len * 99 / 100),
+           g_array_index(jitter, gint64, jitter->len - 1));
+
+    report_skew(frame_times);
+}
+
+static void
+report_scheduler(LiquidFrameScheduler *scheduler)
+{
+    g_autoptr(GVariant) statistics = liquid_frame_scheduler_dup_statistics(scheduler);
+    guint64 ticks = 0;
+    guint64 skipped_ticks = 0;
+    guint64 frames = 0;
+    guint64 dropped_frames = 0;
+    guint64 write_errors = 0;
+
+    g_variant_lookup(statistics, "ticks", "t", &ticks);
+    g_variant_lookup(statistics, "skipped-ticks", "t", &skipped_ticks);
+    g_variant_lookup(statistics, "frames", "t", &frames);
+    g_variant_lookup(statistics, "dropped-frames", "t", &dropped_frames);
+    g_variant_lookup(statistics, "write-errors", "t", &write_errors);
+
+    g_autoptr(GVariant) skew = g_variant_lookup_value(statistics, "skew", G_VARIANT_TYPE_VARDICT);
+    gdouble skew_mean = 0;
+    gint64 skew_max = 0;
+
+    g_variant_lookup(skew, "mean", "d", &skew_mean);
+    g_variant_lookup(skew, "max", "x", &skew_max);
+
+    printf("scheduler: %" G_GUINT64_FORMAT " ticks, %" G_GUINT64_FORMAT " skipped, %" G_GUINT64_FORMAT
+           " frames written, %" G_GUINT64_FORMAT " dropped, %" G_GUINT64_FORMAT " write errors\n",
+           ticks,
+           skipped_ticks,
+           frames,
+           dropped_frames,
+           write_errors);
+    printf("scheduler: skew between devices' writes mean %.0f us max %" G_GINT64_FORMAT " us\n", skew_mean, skew_max);
+}
+
+int
+main(int argc, char *argv[])
+{
+    gint n_devices = 1;
+    gint frame_rate = 30;
+    gint seconds = 5;
+    gint usb_delay_us = 0;
+    g_autofree gchar *effect_spec = NULL;
+
+    GOptionEntry entries[] = {
+        { "devices", 0, 0, G_OPTION_ARG_INT, &n_devices, "Number of emulated devices", "N" },
+        { "frame-rate", 0, 0, G_OPTION_ARG_INT, &frame_rate, "Frames per second", "N" },
+        { "seconds", 0, 0, G_OPTION_ARG_INT, &seconds, "Duration of the run", "N" },
+        { "usb-delay", 0, 0, G_OPTION_ARG_INT, &usb_delay_us, "Time each output report takes on the device", "US" },
+        { "effect", 0, 0, G_OPTION_ARG_STRING, &effect_spec, "Effect to show, see liquidd --led", "EFFECT" },
+        { NULL },
+    };
+
+    g_autoptr(GError) error = NULL;
+    g_autoptr(GOptionContext) option_context = g_option_context_new(NULL);
+
+    g_option_context_set_summary(option_context,
+                                 "Streams an LED effect to emulated NZXT Smart2 devices and measures frame pacing and skew.");
+    g_option_context_add_main_entries(option_context, entries, NULL);
+
+    if (!g_option_context_parse(option_context, &argc, &argv, &error))
+    {
+        g_printerr("%s\n", error->message);
+        return EXIT_FAILURE;
+    }
+
+    if (n_devices < 1 || frame_rate < 1 || frame_rate > 240 || seconds < 1 || usb_delay_us < 0)
+    {
+        g_printerr("Invalid arguments\n");
+        return EXIT_FAILURE;
+    }
+
+    LiquidLedEffect effect;
+
+    if (!liquid_led_effect_parse(effect_spec ? effect_spec : "spectrum-wave 4000", &effect, &error))
+    {
+        g_printerr("%s\n", error->message);
+        return EXIT_FAILURE;
+    }
+
+    g_set_print_handler(discard_print);
+
+    g_autoptr(GPtrArray) devices = g_ptr_array_new_with_free_func(frames_device_free);
+    g_autoptr(LiquidFrameScheduler) scheduler = liquid_frame_scheduler_new((guint)frame_rate);
+
+    for (gint i = 0; i < n_devices; i++)
+    {
+        g_ptr_array_add(devices, frames_device_new((guint)i, (guint)usb_delay_us));
+    }
+
+    /* Let the drivers' initialization reports through before timing anything */
+    while (g_main_context_iteration(NULL, FALSE))
+    {
+    }
+
+    for (guint i = 0; i < devices->len; i++)
+    {
+        FramesDevice *device = g_ptr_array_index(devices, i);
+        LiquidDriverHid *driver = LIQUID_DRIVER_HID(device->driver);
+
+        g_array_unref(liquid_emulator_nzxt_smart2_take_led_frame_times(device->emulator));
+
+        for (guint channel = 0; channel < liquid_driver_hid_get_n_led_channels(driver); channel++)
+        {
+            liquid_frame_scheduler_add(scheduler, driver, channel, &effect);
+        }
+    }
+
+    g_autoptr(GMainLoop) loop = g_main_loop_new(NULL, FALSE);
+
+    g_timeout_add_seconds((guint)seconds, quit_loop, loop);
+    g_main_loop_run(loop);
+
+    report_scheduler(scheduler);
+
+    /* Stop ticking, then wait for the frames still being written, which hold references */
+    LiquidFrameScheduler *stopping = scheduler;
+
+    g_object_run_dispose(G_OBJECT(scheduler));
+    g_object_add_weak_pointer(G_OBJECT(stopping), (gpointer *)&stopping);
+    g_clear_object(&scheduler);
+
+    while (stopping)
+    {
+        g_main_context_iteration(NULL, TRUE);
+    }
+
+    report_intervals(devices, (guint)frame_rate, (guint)seconds);
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,527 @@
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include <gio/gio.h>
+#include <glib/gstdio.h>
+
+#include "dbus_interfaces.h"
+
+/* Each emulated device needs two descriptors in liquidd */
+#define FDS_PER_DEVICE 2
+
+/* Built next to liquidd-scale, which copies it for each extra driver */
+#define STAND_IN_MODULE "libstand-in.so"
+
+typedef struct
+{
+    GMainLoop *loop;
+    gboolean appeared;
+} NameWait;
+
+static void
+name_appeared(GDBusConnection *connection G_GNUC_UNUSED,
+              const gchar *name G_GNUC_UNUSED,
+              const gchar *name_owner G_GNUC_UNUSED,
+              gpointer user_data)
+{
+    NameWait *wait = user_data;
+
+    wait->appeared = TRUE;
+    g_main_loop_quit(wait->loop);
+}
+
+static gboolean
+name_timeout(gpointer user_data)
+{
+    NameWait *wait = user_data;
+
+    g_main_loop_quit(wait->loop);
+    return G_SOURCE_REMOVE;
+}
+
+/* liquidd exports all devices before owning its name, so this also waits for the objects */
+static gboolean
+wait_for_liquidd(GDBusConnection *connection, guint timeout_s)
+{
+    g_autoptr(GMainLoop) loop = g_main_loop_new(NULL, FALSE);
+    NameWait wait = { loop, FALSE };
+
+    guint watch_id = g_bus_watch_name_on_connection(connection,
+                                                    "org.liquidctl.LiquidD", /* name */
+                                                    G_BUS_NAME_WATCHER_FLAGS_NONE, /* flags */
+                                                    name_appeared, /* name_appeared_handler */
+                                                    NULL, /* name_vanished_handler */
+                                                    &wait, /* user_data */
+                                                    NULL /* user_data_free_func */);
+    guint timeout_id = g_timeout_add_seconds(timeout_s, name_timeout, &wait);
+
+    g_main_loop_run(loop);
+
+    g_bus_unwatch_name(watch_id);
+
+    if (wait.appeared)
+    {
+        g_source_remove(timeout_id);
+    }
+
+    return wait.appeared;
+}
+
+/* Resident set size in KiB, or 0 if unknown */
+static guint64
+read_rss_kib(const gchar *pid)
+{
+    g_autofree gchar *path = g_strdup_printf("/proc/%s/status", pid);
+    g_autofree gchar *contents = NULL;
+
+    if (!g_file_get_contents(path, &contents, NULL, NULL))
+    {
+        return 0;
+    }
+
+    const gchar *line = strstr(contents, "\nVmRSS:");
+
+    if (line == NULL)
+    {
+        return 0;
+    }
+
+    return g_ascii_strtoull(line + strlen("\nVmRSS:"), NULL, 10);
+}
+
+static gint
+compare_int64(gconstpointer a, gconstpointer b)
+{
+    gint64 x = *(const gint64 *)a;
+    gint64 y = *(const gint64 *)b;
+
+    return x < y ? -1 : x > y;
+}
+
+/* One per channel value; channels sharing a name share an object */
+static const gchar *const channel_interfaces[] = {
+    "org.liquidctl.FanSpeedRPM",
+    "org.liquidctl.DutyPercent",
+    "org.liquidctl.Voltage",
+    "org.liquidctl.Current",
+    "org.liquidctl.Power",
+    "org.liquidctl.Energy",
+    NULL,
+};
+
+static gboolean
+measure_get_managed_objects(GDBusConnection *connection, guint iterations, GError **error)
+{
+    g_autoptr(GArray) latencies = g_array_sized_new(FALSE, FALSE, sizeof(gint64), iterations);
+    gsize reply_size = 0;
+    guint n_objects = 0;
+    guint n_interfaces = 0;
+    guint n_channels = 0;
+
+    for (guint i = 0; i < iterations; i++)
+    {
+        gint64 start = g_get_monotonic_time();
+        g_autoptr(GVariant) reply = g_dbus_connection_call_sync(connection,
+                                                                "org.liquidctl.LiquidD",
+                                                                "/org/liquidctl/LiquidD",
+                                                                "org.freedesktop.DBus.ObjectManager",
+                                                                "GetManagedObjects",
+                                                                NULL,
+                                                                G_VARIANT_TYPE("(a{oa{sa{sv}}})"),
+                                                                G_DBUS_CALL_FLAGS_NONE,
+                                                                -1,
+                                                                NULL,
+                                                                error);
+        gint64 latency = g_get_monotonic_time() - start;
+
+        if (reply == NULL)
+        {
+            return FALSE;
+        }
+
+        g_array_append_val(latencies, latency);
+
+        if (i == 0)
+        {
+            g_autoptr(GVariant) objects = g_variant_get_child_value(reply, 0);
+            GVariantIter iter;
+            GVariant *interfaces;
+
+            reply_size = g_variant_get_size(reply);
+            n_objects = (guint)g_variant_n_children(objects);
+
+            g_variant_iter_init(&iter, objects);
+
+            while (g_variant_iter_next(&iter, "{&o@a{sa{sv}}}", NULL, &interfaces))
+            {
+                GVariantIter interface_iter;
+                const gchar *interface_name;
+
+                g_variant_iter_init(&interface_iter, interfaces);
+
+                while (g_variant_iter_next(&interface_iter, "{&s@a{sv}}", &interface_name, NULL))
+                {
+                    n_interfaces++;
+                    n_channels += g_strv_contains(channel_interfaces, interface_name);
+                }
+
+                g_variant_unref(interfaces);
+            }
+        }
+    }
+
+    g_array_sort(latencies, compare_int64);
+
+    printf("objects: %u interfaces: %u channels: %u\n", n_objects, n_interfaces, n_channels);
+    printf("GetManagedObjects reply: %" G_GSIZE_FORMAT " bytes\n", reply_size);
+    printf("GetManagedObjects latency: median %" G_GINT64_FORMAT " us max %" G_GINT64_FORMAT " us\n",
+           g_array_index(latencies, gint64, latencies->len / 2),
+           g_array_index(latencies, gint64, latencies->len - 1));
+
+    return TRUE;
+}
+
+/* What liquidctl does on startup: one object manager client with proxies for everything */
+static gboolean
+measure_client_startup(GDBusConnection *connection, GError **error)
+{
+    guint64 rss_before = read_rss_kib("self");
+    gint64 start = g_get_monotonic_time();
+
+    g_autoptr(GDBusObjectManager) manager
+        = liquid_dbus_object_manager_client_new_sync(connection, /* connection */
+                                                     G_DBUS_OBJECT_MANAGER_CLIENT_FLAGS_NONE, /* flags */
+                                                     "org.liquidctl.LiquidD", /* name */
+                                                     "/org/liquidctl/LiquidD", /* object_path */
+                                                     NULL, /* cancellable */
+                                                     error /* error */);
+
+    if (manager == NULL)
+    {
+        return FALSE;
+    }
+
+    gint64 elapsed = g_get_monotonic_time() - start;
+    guint64 rss_after = read_rss_kib("self");
+
+    printf("client startup: %" G_GINT64_FORMAT " us, client memory: +%" G_GUINT64_FORMAT " KiB\n",
+           elapsed,
+           rss_after - MIN(rss_before, rss_after));
+
+    return TRUE;
+}
+
+static void
+remove_driver_dir(const gchar *path)
+{
+    g_autoptr(GDir) dir = g_dir_open(path, 0, NULL);
+    const gchar *name;
+
+    while (dir && (name = g_dir_read_name(dir)) != NULL)
+    {
+        g_autofree gchar *child = g_build_filename(path, name, NULL);
+        g_remove(child);
+    }
+
+    g_rmdir(path);
+}
+
+static gboolean
+link_driver_file(const gchar *target, const gchar *link, GError **error)
+{
+    if (symlink(target, link) == -1)
+    {
+        int errsv = errno;
+
+        g_set_error(error, G_IO_ERROR, g_io_error_from_errno(errsv), "Can't link %s: %s", link, g_strerror(errsv));
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+/*
+ * A driver directory holding the drivers of `source_dir`, plus `n_extra`
+ * manifests for devices that don't exist, each with its own copy of the
+ * `stand_in` module, like an installation with many drivers. Copies rather
+ * than links, since the dynamic loader would only load one file once.
+ */
+static gchar *
+create_driver_dir(const gchar *source_dir, const gchar *stand_in, guint n_extra, GError **error)
+{
+    g_autofree gchar *dir = g_dir_make_tmp("liquidd-scale-drivers-XXXXXX", error);
+    g_autoptr(GDir) source = dir ? g_dir_open(source_dir, 0, error) : NULL;
+    const gchar *name;
+
+    if (source == NULL)
+    {
+        if (dir)
+        {
+            remove_driver_dir(dir);
+        }
+
+        return NULL;
+    }
+
+    while ((name = g_dir_read_name(source)) != NULL)
+    {
+        if (g_str_has_suffix(name, ".driver") || g_str_has_suffix(name, ".so"))
+        {
+            g_autofree gchar *target = g_build_filename(source_dir, name, NULL);
+            g_autofree gchar *link = g_build_filename(dir, name, NULL);
+
+            if (!link_driver_file(target, link, error))
+            {
+                remove_driver_dir(dir);
+                return NULL;
+            }
+        }
+    }
+
+    g_autoptr(GFile) stand_in_file = g_file_new_for_path(stand_in);
+
+    for (guint i = 0; i < n_extra; i++)
+    {
+        g_autofree gchar *module = g_strdup_printf("libextra-%u.so", i);
+        g_autofree gchar *module_path = g_build_filename(dir, module, NULL);
+        g_autoptr(GFile) module_file = g_file_new_for_path(module_path);
+        g_autofree gchar *manifest_name = g_strdup_printf("extra-%u.driver", i);
+        g_autofree gchar *manifest_path = g_build_filename(dir, manifest_name, NULL);
+        g_autofree gchar *manifest
+            = g_strdup_printf("[Driver]\nModule=%s\nDevices=ffff:%04x;\n", module, i & G_MAXUINT16);
+
+        if (!g_file_copy(stand_in_file, module_file, G_FILE_COPY_NONE, NULL, NULL, NULL, error)
+            || !g_file_set_contents(manifest_path, manifest, -1, error))
+        {
+            remove_driver_dir(dir);
+            return NULL;
+        }
+    }
+
+    return g_steal_pointer(&dir);
+}
+
+/* What the daemon's driver registry reports: manifests read, modules loaded and the time it took */
+static gboolean
+print_driver_statistics(GDBusConnection *connection, GError **error)
+{
+    g_autoptr(GVariant) reply = g_dbus_connection_call_sync(connection,
+                                                            "org.liquidctl.LiquidD",
+                                                            "/org/liquidctl/LiquidD/Daemon",
+                                                            "org.liquidctl.Diagnostics",
+                                                            "GetStatistics",
+                                                            NULL,
+                                                            G_VARIANT_TYPE("(a{sv})"),
+                                                            G_DBUS_CALL_FLAGS_NONE,
+                                                            -1,
+                                                            NULL,
+                                                            error);
+
+    if (reply == NULL)
+    {
+        return FALSE;
+    }
+
+    g_autoptr(GVariant) statistics = g_variant_get_child_value(reply, 0);
+    g_autoptr(GVariant) drivers = g_variant_lookup_value(statistics, "drivers", G_VARIANT_TYPE_VARDICT);
+    g_autofree const gchar **loaded = NULL;
+    guint32 n_manifests = 0;
+    guint64 load_time_us = 0;
+
+    if (drivers == NULL || !g_variant_lookup(drivers, "manifests", "u", &n_manifests)
+        || !g_variant_lookup(drivers, "loaded", "^a&s", &loaded)
+        || !g_variant_lookup(drivers, "load-time-us", "t", &load_time_us))
+    {
+        g_set_error(error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA, "No driver statistics");
+        return FALSE;
+    }
+
+    printf("driver manifests: %u modules loaded: %u (%" G_GUINT64_FORMAT " us)\n",
+           n_manifests,
+           g_strv_length((gchar **)loaded),
+           load_time_us);
+
+    return TRUE;
+}
+
+static void
+raise_fd_limit(guint n_devices)
+{
+    struct rlimit limit;
+
+    if (getrlimit(RLIMIT_NOFILE, &limit) == -1)
+    {
+        return;
+    }
+
+    limit.rlim_cur = limit.rlim_max;
+
+    if (setrlimit(RLIMIT_NOFILE, &limit) == -1 || limit.rlim_cur < (rlim_t)n_devices * FDS_PER_DEVICE + 64)
+    {
+        g_printerr("Warning: file descriptor limit may be too low for %u devices\n", n_devices);
+    }
+}
+
+int
+main(int argc, char *argv[])
+{
+    gint n_devices = 1000;
+    gint iterations = 10;
+    gint timeout_s = 60;
+    g_autofree gchar *liquidd_path = NULL;
+    g_autofree gchar *driver_source_dir = NULL;
+    gint n_extra_drivers = 0;
+    gboolean preload_drivers = FALSE;
+
+    GOptionEntry entries[] = {
+        { "devices", 0, 0, G_OPTION_ARG_INT, &n_devices, "Emulated Smart2 devices, with three fans each", "N" },
+        { "iterations", 0, 0, G_OPTION_ARG_INT, &iterations, "GetManagedObjects calls", "N" },
+        { "timeout", 0, 0, G_OPTION_ARG_INT, &timeout_s, "Seconds to wait for liquidd to start", "S" },
+        { "liquidd", 0, 0, G_OPTION_ARG_FILENAME, &liquidd_path, "liquidd executable", "PATH" },
+        { "driver-dir", 0, 0, G_OPTION_ARG_FILENAME, &driver_source_dir, "Driver modules to install (liquidd's directory, or " LIQUIDD_DRIVER_DIR " with --liquidd)", "PATH" },
+        { "drivers", 0, 0, G_OPTION_ARG_INT, &n_extra_drivers, "Additional drivers installed, for devices that aren't present", "N" },
+        { "preload-drivers", 0, 0, G_OPTION_ARG_NONE, &preload_drivers, "Have liquidd load every driver on startup", NULL },
+        { NULL },
+    };
+
+    g_autoptr(GError) error = NULL;
+    g_autoptr(GOptionContext) option_context = g_option_context_new(NULL);
+
+    g_option_context_set_summary(option_context,
+                                 "Starts liquidd with emulated devices on a private bus and measures how\n"
+                                 "D-Bus object management scales with the number of exported channels.");
+    g_option_context_add_main_entries(option_context, entries, NULL);
+
+    if (!g_option_context_parse(option_context, &argc, &argv, &error))
+    {
+        g_printerr("%s\n", error->message);
+        return EXIT_FAILURE;
+    }
+
+    if (n_devices < 0 || iterations < 1 || timeout_s < 1 || n_extra_drivers < 0)
+    {
+        g_printerr("Invalid arguments\n");
+        return EXIT_FAILURE;
+    }
+
+    /* Run from the build directory, modules and manifests are right next to liquidd */
+    if (liquidd_path == NULL)
+    {
+        g_autofree gchar *dir = g_path_get_dirname(argv[0]);
+        liquidd_path = g_build_filename(dir, "liquidd", NULL);
+
+        if (driver_source_dir == NULL)
+        {
+            driver_source_dir = g_steal_pointer(&dir);
+        }
+    }
+
+    if (driver_source_dir == NULL)
+    {
+        driver_source_dir = g_strdup(LIQUIDD_DRIVER_DIR);
+    }
+
+    g_autofree gchar *own_dir = g_path_get_dirname(argv[0]);
+    g_autofree gchar *stand_in = g_build_filename(own_dir, STAND_IN_MODULE, NULL);
+    g_autofree gchar *driver_dir = create_driver_dir(driver_source_dir, stand_in, (guint)n_extra_drivers, &error);
+
+    if (driver_dir == NULL)
+    {
+        g_printerr("Can't create driver directory: %s\n", error->message);
+        return EXIT_FAILURE;
+    }
+
+    raise_fd_limit((guint)n_devices);
+
+    g_autoptr(GTestDBus) test_bus = g_test_dbus_new(G_TEST_DBUS_NONE);
+    g_test_dbus_up(test_bus);
+
+    const gchar *address = g_test_dbus_get_bus_address(test_bus);
+    g_autoptr(GDBusConnection) connection
+        = g_dbus_connection_new_for_address_sync(address,
+                                                 G_DBUS_CONNECTION_FLAGS_AUTHENTICATION_CLIENT
+                                                     | G_DBUS_CONNECTION_FLAGS_MESSAGE_BUS_CONNECTION,
+                                                 NULL,
+                                                 NULL,
+                                                 &error);
+
+    if (connection == NULL)
+    {
+        g_printerr("Can't connect to the private bus: %s\n", error->message);
+        return EXIT_FAILURE;
+    }
+
+    g_autoptr(GSubprocessLauncher) launcher = g_subprocess_launcher_new(G_SUBPROCESS_FLAGS_STDOUT_SILENCE);
+    g_autofree gchar *emulate = g_strdup_printf("--emulate=%d", n_devices);
+    g_autofree gchar *driver_dir_option = g_strdup_printf("--driver-dir=%s", driver_dir);
+
+    /* Keep liquidd away from the user's device cache */
+    g_autofree gchar *cache_dir = g_dir_make_tmp("liquidd-scale-XXXXXX", &error);
+
+    if (cache_dir == NULL)
+    {
+        g_printerr("Can't create cache directory: %s\n", error->message);
+        return EXIT_FAILURE;
+    }
+
+    g_subprocess_launcher_setenv(launcher, "DBUS_SESSION_BUS_ADDRESS", address, TRUE);
+    g_subprocess_launcher_setenv(launcher, "XDG_CACHE_HOME", cache_dir, TRUE);
+
+    gint64 start = g_get_monotonic_time();
+    g_autoptr(GSubprocess) liquidd = g_subprocess_launcher_spawn(launcher,
+                                                                 &error,
+                                                                 liquidd_path,
+                                                                 emulate,
+                                                                 driver_dir_option,
+                                                                 preload_drivers ? "--preload-drivers" : NULL,
+                                                                 NULL);
+
+    if (liquidd == NULL)
+    {
+        g_printerr("Can't start %s: %s\n", liquidd_path, error->message);
+        return EXIT_FAILURE;
+    }
+
+    if (!wait_for_liquidd(connection, (guint)timeout_s))
+    {
+        g_printerr("liquidd didn't appear on the bus\n");
+        g_subprocess_force_exit(liquidd);
+        return EXIT_FAILURE;
+    }
+
+    printf("devices: %d\n", n_devices);
+    printf("daemon startup: %" G_GINT64_FORMAT " ms\n", (g_get_monotonic_time() - start) / 1000);
+
+    gboolean ok = print_driver_statistics(connection, &error)
+                  && measure_get_managed_objects(connection, (guint)iterations, &error)
+                  && measure_client_startup(connection, &error);
+
+    if (!ok)
+    {
+        g_printerr("%s\n", error->message);
+    }
+
+    printf("daemon memory: %" G_GUINT64_FORMAT " KiB\n", read_rss_kib(g_subprocess_get_identifier(liquidd)));
+
+    g_subprocess_send_signal(liquidd, SIGTERM);
+    g_subprocess_wait(liquidd, NULL, NULL);
+
+    g_test_dbus_down(test_bus);
+
+    g_autoptr(GFile) cache = g_file_new_for_path(cache_dir);
+    g_autoptr(GFile) liquidd_cache = g_file_get_child(cache, "liquidd");
+    g_autoptr(GFile) devices_cache = g_file_get_child(liquidd_cache, "devices.ini");
+
+    g_file_delete(devices_cache, NULL, NULL);
+    g_file_delete(liquidd_cache, NULL, NULL);
+    g_file_delete(cache, NULL, NULL);
+
+    remove_driver_dir(driver_dir);
+
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,193 @@
+#include "loop_monitor.h"
+
+#include "histogram.h"
+#include "metrics.h"
+
+struct _LiquidLoopMonitor
+{
+    GObject parent;
+
+    guint interval_ms;
+    GSource *source;
+    LiquidHistogram *dispatch_lag;
+};
+
+G_DEFINE_FINAL_TYPE(LiquidLoopMonitor, liquid_loop_monitor, G_TYPE_OBJECT)
+
+enum
+{
+    PROP_0,
+    PROP_INTERVAL,
+    N_PROPERTIES
+};
+
+static GParamSpec *pspecs[N_PROPERTIES];
+
+typedef struct
+{
+    GSource source;
+    LiquidLoopMonitor *monitor;
+} TickSource;
+
+static gboolean
+liquid_loop_monitor_tick(GSource *source, GSourceFunc callback G_GNUC_UNUSED, gpointer user_data G_GNUC_UNUSED)
+{
+    LiquidLoopMonitor *monitor = ((TickSource *)source)->monitor;
+    gint64 now = g_get_monotonic_time();
+    gint64 expected = g_source_get_ready_time(source);
+    gint64 interval_us = (gint64)monitor->interval_ms * G_TIME_SPAN_MILLISECOND;
+
+    liquid_histogram_add(monitor->dispatch_lag, now - expected);
+
+    /* Skip ticks missed during a long stall instead of firing them back to back */
+    expected += interval_us;
+
+    if (expected <= now)
+    {
+        expected = now + interval_us;
+    }
+
+    g_source_set_ready_time(source, expected);
+
+    return G_SOURCE_CONTINUE;
+}
+
+static GSourceFuncs tick_source_funcs = {
+    .dispatch = liquid_loop_monitor_tick,
+};
+
+static void
+liquid_loop_monitor_get_property(GObject *object, guint property_id, GValue *value, GParamSpec *pspec)
+{
+    LiquidLoopMonitor *monitor = LIQUID_LOOP_MONITOR(object);
+
+    switch (property_id)
+    {
+    case PROP_INTERVAL:
+        g_value_set_uint(value, monitor->interval_ms);
+        break;
+
+    default:
+        G_OBJECT_WARN_INVALID_PROPERTY_ID(object, property_id, pspec);
+    }
+}
+
+static void
+liquid_loop_monitor_set_property(GObject *object, guint property_id, const GValue *value, GParamSpec *pspec)
+{
+    LiquidLoopMonitor *monitor = LIQUID_LOOP_MONITOR(object);
+
+    switch (property_id)
+    {
+    case PROP_INTERVAL:
+        monitor->interval_ms = g_value_get_uint(value);
+        break;
+
+    default:
+        G_OBJECT_WARN_INVALID_PROPERTY_ID(object, property_id, pspec);
+    }
+}
+
+static void
+liquid_loop_monitor_constructed(GObject *object)
+{
+    LiquidLoopMonitor *monitor = LIQUID_LOOP_MONITOR(object);
+    g_autoptr(GMainContext) context = g_main_context_ref_thread_default();
+
+    /* Destroyed in dispose, so it doesn't need a reference to the monitor */
+    monitor->source = g_source_new(&tick_source_funcs, sizeof(TickSource));
+    ((TickSource *)monitor->source)->monitor = monitor;
+    g_source_set_name(monitor->source, "LiquidLoopMonitor");
+    g_source_set_ready_time(monitor->source,
+                            g_get_monotonic_time() + (gint64)monitor->interval_ms * G_TIME_SPAN_MILLISECOND);
+    g_source_attach(monitor->source, context);
+
+    G_OBJECT_CLASS(liquid_loop_monitor_parent_class)->constructed(object);
+}
+
+static void
+liquid_loop_monitor_dispose(GObject *object)
+{
+    LiquidLoopMonitor *monitor = LIQUID_LOOP_MONITOR(object);
+
+    if (monitor->source)
+    {
+        g_source_destroy(monitor->source);
+        g_clear_pointer(&monitor->source, g_source_unref);
+    }
+
+    G_OBJECT_CLASS(liquid_loop_monitor_parent_class)->dispose(object);
+}
+
+static void
+liquid_loop_monitor_finalize(GObject *object)
+{
+    LiquidLoopMonitor *monitor = LIQUID_LOOP_MONITOR(object);
+
+    liquid_histogram_free(monitor->dispatch_lag);
+
+    G_OBJECT_CLASS(liquid_loop_monitor_parent_class)->finalize(object);
+}
+
+static void
+liquid_loop_monitor_init(LiquidLoopMonitor *monitor)
+{
+    monitor->dispatch_lag = liquid_histogram_new();
+}
+
+static void
+liquid_loop_monitor_class_init(LiquidLoopMonitorClass *class)
+{
+    GObjectClass *gobject_class = G_OBJECT_CLASS(class);
+
+    gobject_class->constructed = liquid_loop_monitor_constructed;
+    gobject_class->dispose = liquid_loop_monitor_dispose;
+    gobject_class->finalize = liquid_loop_monitor_finalize;
+    gobject_class->get_property = liquid_loop_monitor_get_property;
+    gobject_class->set_property = liquid_loop_monitor_set_property;
+
+    pspecs[PROP_INTERVAL]
+        = g_param_spec_uint("interval", /* name */
+                            "Interval", /* nick */
+                            "Time between probes, in milliseconds", /* blurb */
+                            1, /* minimum */
+                            G_MAXUINT, /* maximum */
+                            100, /* default_value */
+                            G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY | G_PARAM_STATIC_STRINGS);
+
+    g_object_class_install_properties(gobject_class, N_PROPERTIES, pspecs);
+}
+
+LiquidLoopMonitor *
+liquid_loop_monitor_new(guint interval_ms)
+{
+    return g_object_new(LIQUID_TYPE_LOOP_MONITOR,
+                        "interval",
+                        interval_ms,
+                        NULL);
+}
+
+GVariant *
+liquid_loop_monitor_dup_statistics(LiquidLoopMonitor *monitor)
+{
+    g_return_val_if_fail(LIQUID_IS_LOOP_MONITOR(monitor), NULL);
+
+    g_auto(GVariantDict) dict = G_VARIANT_DICT_INIT(NULL);
+
+    g_variant_dict_insert(&dict, "interval", "u", monitor->interval_ms);
+    g_variant_dict_insert_value(&dict, "dispatch-lag", liquid_histogram_to_variant(monitor->dispatch_lag));
+
+    return g_variant_dict_end(&dict);
+}
+
+void
+liquid_loop_monitor_append_metrics(LiquidLoopMonitor *monitor, GString *out)
+{
+    g_return_if_fail(LIQUID_IS_LOOP_MONITOR(monitor));
+
+    liquid_metrics_append_family(out,
+                                 "liquidd_main_loop_lag_seconds",
+                                 "histogram",
+                                 "Delay of a periodic main loop source past its ready time.");
+    liquid_histogram_append_metrics(monitor->dispatch_lag, out, "liquidd_main_loop_lag_seconds", NULL);
+}
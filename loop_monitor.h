@@ -0,0 +1,25 @@
+#pragma once
+
+#include <glib-object.h>
+
+G_BEGIN_DECLS
+
+/*
+ * Measures how late the thread-default main context dispatches a periodic
+ * source, which is how long anything else on the context could be delayed.
+ */
+#define LIQUID_TYPE_LOOP_MONITOR (liquid_loop_monitor_get_type())
+G_DECLARE_FINAL_TYPE(LiquidLoopMonitor, liquid_loop_monitor, LIQUID, LOOP_MONITOR, GObject)
+
+LiquidLoopMonitor *
+liquid_loop_monitor_new(guint interval_ms);
+
+/* Returns an a{sv} dictionary with the lag histogram under "dispatch-lag" */
+GVariant *
+liquid_loop_monitor_dup_statistics(LiquidLoopMonitor *monitor);
+
+/* The lag histogram as a Prometheus metric family, see metrics.h */
+void
+liquid_loop_monitor_append_metrics(LiquidLoopMonitor *monitor, GString *out);
+
+G_END_DECLS
@@ -0,0 +1,91 @@
+#include "metrics.h"
+
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+
+#ifdef HAVE_MALLINFO2
+#include <malloc.h>
+#endif
+
+void
+liquid_metrics_append_family(GString *out, const gchar *name, const gchar *type, const gchar *help)
+{
+    g_string_append(out, "# HELP ");
+    g_string_append(out, name);
+    g_string_append_c(out, ' ');
+    g_string_append(out, help);
+    g_string_append(out, "\n# TYPE ");
+    g_string_append(out, name);
+    g_string_append_c(out, ' ');
+    g_string_append(out, type);
+    g_string_append_c(out, '\n');
+}
+
+void
+liquid_metrics_append_sample(GString *out, const gchar *name, const gchar *labels, gdouble value)
+{
+    gchar buffer[G_ASCII_DTOSTR_BUF_SIZE];
+
+    g_string_append(out, name);
+
+    if (labels)
+    {
+        g_string_append_c(out, '{');
+        g_string_append(out, labels);
+        g_string_append_c(out, '}');
+    }
+
+    g_string_append_c(out, ' ');
+    g_string_append(out, g_ascii_dtostr(buffer, sizeof(buffer), value));
+    g_string_append_c(out, '\n');
+}
+
+/* Read into a stack buffer; g_file_get_contents() would allocate on every scrape */
+static gdouble
+read_resident_bytes(void)
+{
+    gchar buffer[128];
+    int fd = open("/proc/self/statm", O_RDONLY | O_CLOEXEC);
+
+    if (fd == -1)
+    {
+        return 0.0;
+    }
+
+    ssize_t size = read(fd, buffer, sizeof(buffer) - 1);
+    close(fd);
+
+    if (size <= 0)
+    {
+        return 0.0;
+    }
+
+    buffer[size] = '\0';
+
+    /* Total program size, then resident pages */
+    gchar *resident = strchr(buffer, ' ');
+
+    if (resident == NULL)
+    {
+        return 0.0;
+    }
+
+    return (gdouble)g_ascii_strtoull(resident + 1, NULL, 10) * (gdouble)sysconf(_SC_PAGESIZE);
+}
+
+void
+liquid_metrics_append_process(GString *out)
+{
+    liquid_metrics_append_family(out, "liquidd_resident_memory_bytes", "gauge", "Resident set size.");
+    liquid_metrics_append_sample(out, "liquidd_resident_memory_bytes", NULL, read_resident_bytes());
+
+#ifdef HAVE_MALLINFO2
+    struct mallinfo2 info = mallinfo2();
+
+    liquid_metrics_append_family(out, "liquidd_heap_allocated_bytes", "gauge", "Heap memory in use by allocations.");
+    liquid_metrics_append_sample(out, "liquidd_heap_allocated_bytes", NULL, (gdouble)(info.uordblks + info.hblkhd));
+    liquid_metrics_append_family(out, "liquidd_heap_free_bytes", "gauge", "Heap memory held but not allocated.");
+    liquid_metrics_append_sample(out, "liquidd_heap_free_bytes", NULL, (gdouble)info.fordblks);
+#endif
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/*
+ * Prometheus text exposition format. Everything appends to the caller's
+ * buffer without allocating, so that a scrape only grows the buffer until it
+ * has reached its steady size; series names and labels are meant to be
+ * formatted once and kept by whoever owns the values.
+ */
+
+/* HELP and TYPE lines; all samples of a metric must follow their family */
+void
+liquid_metrics_append_family(GString *out, const gchar *name, const gchar *type, const gchar *help);
+
+/* `labels` is the text between the braces, e.g. device="x"; NULL for none */
+void
+liquid_metrics_append_sample(GString *out, const gchar *name, const gchar *labels, gdouble value);
+
+/* Resident memory and, where the C library can tell, heap usage of this process */
+void
+liquid_metrics_append_process(GString *out);
+
+G_END_DECLS
@@ -0,0 +1,315 @@
+#include "metrics_server.h"
+
+#include <errno.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <gio/gunixsocketaddress.h>
+
+/* Anything past this is ignored; scrapers send a few hundred bytes */
+#define REQUEST_SIZE_MAX 4096
+
+/* Seconds a client may take to send its request or read the response */
+#define CLIENT_TIMEOUT_S 5
+
+struct _LiquidMetricsServer
+{
+    GObject parent;
+
+    GSocketService *service;
+    GString *buffer;
+    GPtrArray *unix_sockets;
+};
+
+/* A socket file this server bound, recognized by its inode once another process may have replaced it */
+typedef struct
+{
+    gchar *path;
+    dev_t dev;
+    ino_t ino;
+} UnixSocket;
+
+static void
+unix_socket_free(UnixSocket *unix_socket)
+{
+    g_free(unix_socket->path);
+    g_free(unix_socket);
+}
+
+G_DEFINE_FINAL_TYPE(LiquidMetricsServer, liquid_metrics_server, G_TYPE_OBJECT)
+
+enum
+{
+    SIGNAL_COLLECT,
+    N_SIGNALS
+};
+
+static guint signals[N_SIGNALS];
+
+typedef struct
+{
+    LiquidMetricsServer *server;
+    GSocketConnection *connection;
+
+    gchar request[REQUEST_SIZE_MAX];
+    gsize request_size;
+
+    gchar header[128];
+    GBytes *body;
+    GOutputVector response[2];
+} Scrape;
+
+static void
+scrape_free(Scrape *scrape)
+{
+    g_object_unref(scrape->server);
+    g_object_unref(scrape->connection);
+    g_clear_pointer(&scrape->body, g_bytes_unref);
+    g_free(scrape);
+}
+
+static void
+liquid_metrics_server_response_written(GObject *source_object, GAsyncResult *result, gpointer user_data)
+{
+    Scrape *scrape = user_data;
+    g_autoptr(GError) error = NULL;
+
+    if (!g_output_stream_writev_all_finish(G_OUTPUT_STREAM(source_object), result, NULL, &error))
+    {
+        g_printerr("Can't send metrics: %s\n", error->message);
+    }
+
+    /* Unreferencing the connection closes it */
+    scrape_free(scrape);
+}
+
+static void
+liquid_metrics_server_respond(Scrape *scrape)
+{
+    LiquidMetricsServer *server = scrape->server;
+
+    g_string_truncate(server->buffer, 0);
+    g_signal_emit(server, signals[SIGNAL_COLLECT], 0, server->buffer);
+
+    /* A copy, as the buffer is reused by scrapes that overlap with this one */
+    scrape->body = g_bytes_new(server->buffer->str, server->buffer->len);
+
+    g_snprintf(scrape->header,
+               sizeof(scrape->header),
+               "HTTP/1.0 200 OK\r\n"
+               "Content-Type: text/plain; version=0.0.4\r\n"
+               "Content-Length: %" G_GSIZE_FORMAT "\r\n"
+               "\r\n",
+               g_bytes_get_size(scrape->body));
+
+    scrape->response[0].buffer = scrape->header;
+    scrape->response[0].size = strlen(scrape->header);
+    scrape->response[1].buffer = g_bytes_get_data(scrape->body, &scrape->response[1].size);
+
+    g_output_stream_writev_all_async(g_io_stream_get_output_stream(G_IO_STREAM(scrape->connection)),
+                                     scrape->response,
+                                     G_N_ELEMENTS(scrape->response),
+                                     G_PRIORITY_DEFAULT,
+                                     NULL,
+                                     liquid_metrics_server_response_written,
+                                     scrape);
+}
+
+static void
+liquid_metrics_server_read_request(Scrape *scrape);
+
+static void
+liquid_metrics_server_request_read(GObject *source_object, GAsyncResult *result, gpointer user_data)
+{
+    Scrape *scrape = user_data;
+    g_autoptr(GError) error = NULL;
+    gssize size = g_input_stream_read_finish(G_INPUT_STREAM(source_object), result, &error);
+
+    if (size < 0)
+    {
+        scrape_free(scrape);
+        return;
+    }
+
+    scrape->request_size += (gsize)size;
+
+    /* Whatever was asked for, the answer is the same once the headers are in */
+    if (size == 0 || scrape->request_size == sizeof(scrape->request)
+        || g_strstr_len(scrape->request, (gssize)scrape->request_size, "\r\n\r\n"))
+    {
+        liquid_metrics_server_respond(scrape);
+        return;
+    }
+
+    liquid_metrics_server_read_request(scrape);
+}
+
+static void
+liquid_metrics_server_read_request(Scrape *scrape)
+{
+    g_input_stream_read_async(g_io_stream_get_input_stream(G_IO_STREAM(scrape->connection)),
+                              scrape->request + scrape->request_size,
+                              sizeof(scrape->request) - scrape->request_size,
+                              G_PRIORITY_DEFAULT,
+                              NULL,
+                              liquid_metrics_server_request_read,
+                              scrape);
+}
+
+static gboolean
+liquid_metrics_server_incoming(GSocketService *service G_GNUC_UNUSED,
+                               GSocketConnection *connection,
+                               GObject *source_object G_GNUC_UNUSED,
+                               LiquidMetricsServer *server)
+{
+    Scrape *scrape = g_new0(Scrape, 1);
+
+    scrape->server = g_object_ref(server);
+    scrape->connection = g_object_ref(connection);
+
+    g_socket_set_timeout(g_socket_connection_get_socket(connection), CLIENT_TIMEOUT_S);
+
+    liquid_metrics_server_read_request(scrape);
+
+    return TRUE;
+}
+
+static void
+liquid_metrics_server_dispose(GObject *object)
+{
+    LiquidMetricsServer *server = LIQUID_METRICS_SERVER(object);
+
+    if (server->service)
+    {
+        g_socket_service_stop(server->service);
+        g_socket_listener_close(G_SOCKET_LISTENER(server->service));
+        g_clear_object(&server->service);
+    }
+
+    for (guint i = 0; i < server->unix_sockets->len; i++)
+    {
+        UnixSocket *unix_socket = g_ptr_array_index(server->unix_sockets, i);
+        struct stat st;
+
+        /* A daemon taking over binds its own socket at the same path */
+        if (lstat(unix_socket->path, &st) == 0 && st.st_dev == unix_socket->dev && st.st_ino == unix_socket->ino)
+        {
+            unlink(unix_socket->path);
+        }
+    }
+
+    g_ptr_array_set_size(server->unix_sockets, 0);
+
+    G_OBJECT_CLASS(liquid_metrics_server_parent_class)->dispose(object);
+}
+
+static void
+liquid_metrics_server_finalize(GObject *object)
+{
+    LiquidMetricsServer *server = LIQUID_METRICS_SERVER(object);
+
+    g_string_free(server->buffer, TRUE);
+    g_ptr_array_unref(server->unix_sockets);
+
+    G_OBJECT_CLASS(liquid_metrics_server_parent_class)->finalize(object);
+}
+
+static void
+liquid_metrics_server_init(LiquidMetricsServer *server)
+{
+    server->service = g_socket_service_new();
+    server->buffer = g_string_new(NULL);
+    server->unix_sockets = g_ptr_array_new_with_free_func((GDestroyNotify)unix_socket_free);
+
+    g_signal_connect(server->service, "incoming", G_CALLBACK(liquid_metrics_server_incoming), server);
+}
+
+static void
+liquid_metrics_server_class_init(LiquidMetricsServerClass *class)
+{
+    GObjectClass *gobject_class = G_OBJECT_CLASS(class);
+
+    gobject_class->dispose = liquid_metrics_server_dispose;
+    gobject_class->finalize = liquid_metrics_server_finalize;
+
+    /* Static scope: handlers must append to the server's buffer, not to a copy */
+    signals[SIGNAL_COLLECT]
+        = g_signal_new("collect", /* signal_name */
+                       G_TYPE_FROM_CLASS(class), /* itype */
+                       G_SIGNAL_RUN_LAST, /* signal_flags */
+                       0, /* class_offset */
+                       NULL, /* accumulator */
+                       NULL, /* accu_data */
+                       NULL, /* c_marshaller */
+                       G_TYPE_NONE, /* return_type */
+                       1, /* n_params */
+                       G_TYPE_GSTRING | G_SIGNAL_TYPE_STATIC_SCOPE);
+}
+
+LiquidMetricsServer *
+liquid_metrics_server_new(void)
+{
+    return g_object_new(LIQUID_TYPE_METRICS_SERVER, NULL);
+}
+
+static gboolean
+liquid_metrics_server_listen(LiquidMetricsServer *server, GSocketAddress *address, GError **error)
+{
+    return g_socket_listener_add_address(G_SOCKET_LISTENER(server->service),
+                                         address,
+                                         G_SOCKET_TYPE_STREAM,
+                                         G_SOCKET_PROTOCOL_DEFAULT,
+                                         NULL,
+                                         NULL,
+                                         error);
+}
+
+gboolean
+liquid_metrics_server_listen_unix(LiquidMetricsServer *server, const gchar *path, GError **error)
+{
+    g_return_val_if_fail(LIQUID_IS_METRICS_SERVER(server), FALSE);
+    g_return_val_if_fail(path != NULL, FALSE);
+
+    g_autoptr(GSocketAddress) address = g_unix_socket_address_new(path);
+    struct stat st;
+
+    /* Left behind by a daemon that didn't exit cleanly, or held by one being taken over; anything else stays */
+    if (lstat(path, &st) == 0 && S_ISSOCK(st.st_mode))
+    {
+        unlink(path);
+    }
+
+    if (!liquid_metrics_server_listen(server, address, error))
+    {
+        return FALSE;
+    }
+
+    if (lstat(path, &st) != 0)
+    {
+        int errsv = errno;
+
+        g_set_error(error, G_IO_ERROR, g_io_error_from_errno(errsv), "stat: %s", g_strerror(errsv));
+        return FALSE;
+    }
+
+    UnixSocket *unix_socket = g_new(UnixSocket, 1);
+
+    unix_socket->path = g_strdup(path);
+    unix_socket->dev = st.st_dev;
+    unix_socket->ino = st.st_ino;
+    g_ptr_array_add(server->unix_sockets, unix_socket);
+
+    return TRUE;
+}
+
+gboolean
+liquid_metrics_server_listen_loopback(LiquidMetricsServer *server, guint16 port, GError **error)
+{
+    g_return_val_if_fail(LIQUID_IS_METRICS_SERVER(server), FALSE);
+
+    g_autoptr(GInetAddress) loopback = g_inet_address_new_loopback(G_SOCKET_FAMILY_IPV4);
+    g_autoptr(GSocketAddress) address = g_inet_socket_address_new(loopback, port);
+
+    return liquid_metrics_server_listen(server, address, error);
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <gio/gio.h>
+
+G_BEGIN_DECLS
+
+/*
+ * Answers every HTTP request on its sockets with metrics in the Prometheus
+ * text format. The "collect" signal is emitted on each scrape, with a buffer
+ * that handlers append their metric families to (see metrics.h); the buffer is
+ * reused across scrapes.
+ */
+#define LIQUID_TYPE_METRICS_SERVER (liquid_metrics_server_get_type())
+G_DECLARE_FINAL_TYPE(LiquidMetricsServer, liquid_metrics_server, LIQUID, METRICS_SERVER, GObject)
+
+LiquidMetricsServer *
+liquid_metrics_server_new(void);
+
+/*
+ * Replaces a socket file left at `path`; the file is removed on dispose unless
+ * another socket has replaced it since.
+ */
+gboolean
+liquid_metrics_server_listen_unix(LiquidMetricsServer *server, const gchar *path, GError **error);
+
+/* Loopback only: metrics aren't meant to leave the host without a proxy in front */
+gboolean
+liquid_metrics_server_listen_loopback(LiquidMetricsServer *server, guint16 port, GError **error);
+
+G_END_DECLS
@@ -0,0 +1,85 @@
+#include "pid_controller.h"
+
+#include <math.h>
+
+void
+liquid_pid_parameters_init(LiquidPidParameters *parameters)
+{
+    g_return_if_fail(parameters != NULL);
+
+    *parameters = (LiquidPidParameters) {
+        .setpoint = 50.0,
+        .kp = 5.0,
+        .ki = 0.1,
+        .kd = 0.0,
+        .deadband = 0.5,
+        .max_rate = 5.0,
+        .min_output = 20.0,
+        .max_output = 100.0,
+    };
+}
+
+gdouble
+liquid_pid_update(const LiquidPidParameters *parameters, LiquidPidState *state, gdouble measurement, gdouble dt)
+{
+    g_return_val_if_fail(parameters != NULL, 0.0);
+    g_return_val_if_fail(state != NULL, 0.0);
+
+    gdouble error = measurement - parameters->setpoint;
+
+    /* Shrunk rather than cut off, so the output doesn't jump at the edge of the band */
+    if (fabs(error) <= parameters->deadband)
+    {
+        error = 0.0;
+    }
+    else
+    {
+        error -= copysign(parameters->deadband, error);
+    }
+
+    if (!state->started)
+    {
+        /* The integral carries the duty that holds the setpoint, starting from the least */
+        state->started = TRUE;
+        state->integral = parameters->min_output;
+        state->previous_measurement = measurement;
+        state->output = parameters->min_output;
+        dt = 0.0;
+    }
+
+    gdouble proportional = parameters->kp * error;
+    gdouble derivative = dt > 0.0 ? parameters->kd * (measurement - state->previous_measurement) / dt : 0.0;
+    gdouble integral = state->integral + parameters->ki * error * dt;
+    gdouble unclamped = proportional + integral + derivative;
+
+    /* Only integrate while that doesn't push the output further past its limits */
+    if ((unclamped <= parameters->max_output || error < 0.0) && (unclamped >= parameters->min_output || error > 0.0))
+    {
+        state->integral = CLAMP(integral, parameters->min_output, parameters->max_output);
+    }
+
+    gdouble output = CLAMP(proportional + state->integral + derivative, parameters->min_output, parameters->max_output);
+
+    if (parameters->max_rate > 0.0 && dt > 0.0)
+    {
+        gdouble step = parameters->max_rate * dt;
+
+        output = CLAMP(output, state->output - step, state->output + step);
+    }
+
+    state->previous_measurement = measurement;
+    state->output = output;
+
+    return output;
+}
+
+gint
+liquid_pid_quantize(gdouble output, gint last)
+{
+    if (last >= 0 && fabs(output - last) < 1.0)
+    {
+        return last;
+    }
+
+    return (gint)lround(output);
+}
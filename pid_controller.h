@@ -0,0 +1,56 @@
+#pragma once
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/*
+ * A reverse-acting PID controller for cooling: the hotter the measurement is
+ * than the setpoint, the higher the output duty.
+ */
+typedef struct
+{
+    gdouble setpoint;
+    gdouble kp;
+    gdouble ki;
+    gdouble kd;
+
+    /* Errors within this distance of the setpoint count as none */
+    gdouble deadband;
+
+    /* Largest output change in percent per second, 0 for none */
+    gdouble max_rate;
+
+    gdouble min_output;
+    gdouble max_output;
+} LiquidPidParameters;
+
+typedef struct
+{
+    gboolean started;
+    gdouble integral;
+    gdouble previous_measurement;
+    gdouble output;
+} LiquidPidState;
+
+void
+liquid_pid_parameters_init(LiquidPidParameters *parameters);
+
+/*
+ * Advances the controller by `dt` seconds to a new measurement and returns
+ * the output. The derivative acts on the measurement, so setpoint changes
+ * don't kick the output, and the integral stops growing while the output is
+ * saturated in the same direction (anti-windup).
+ */
+gdouble
+liquid_pid_update(const LiquidPidParameters *parameters, LiquidPidState *state, gdouble measurement, gdouble dt);
+
+/*
+ * Rounds an output to whole percent, keeping `last` (negative for none) until
+ * the output is a full step away from it, so that an output hovering around a
+ * rounding boundary doesn't toggle between two values.
+ */
+gint
+liquid_pid_quantize(gdouble output, gint last);
+
+G_END_DECLS
@@ -0,0 +1,260 @@
+#include "publisher.h"
+
+#include "driver.h"
+#include "histogram.h"
+#include "metrics.h"
+
+struct _LiquidPublisher
+{
+    GObject parent;
+
+    GDBusConnection *connection;
+
+    /* Drivers waiting for the flush, each holding a reference */
+    GHashTable *pending;
+    gboolean flushing;
+    gint64 flush_start;
+
+    guint64 batches;
+    guint64 published_values;
+    guint64 superseded_values;
+    guint64 deferred_batches;
+    LiquidHistogram *flush_latency;
+};
+
+G_DEFINE_FINAL_TYPE(LiquidPublisher, liquid_publisher, G_TYPE_OBJECT)
+
+enum
+{
+    PROP_0,
+    PROP_CONNECTION,
+    N_PROPERTIES
+};
+
+static GParamSpec *pspecs[N_PROPERTIES];
+
+static void
+liquid_publisher_publish_pending(LiquidPublisher *publisher);
+
+static void
+liquid_publisher_flushed(GObject *source_object, GAsyncResult *result, gpointer user_data)
+{
+    g_autoptr(LiquidPublisher) publisher = user_data;
+    g_autoptr(GError) error = NULL;
+
+    /* A closed connection won't take any more signals either; nothing to wait for */
+    if (!g_dbus_connection_flush_finish(G_DBUS_CONNECTION(source_object), result, &error)
+        && !g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CLOSED))
+    {
+        g_printerr("Can't flush D-Bus connection: %s\n", error->message);
+    }
+
+    liquid_histogram_add(publisher->flush_latency, g_get_monotonic_time() - publisher->flush_start);
+    publisher->flushing = FALSE;
+
+    if (g_hash_table_size(publisher->pending) > 0)
+    {
+        publisher->deferred_batches++;
+        liquid_publisher_publish_pending(publisher);
+    }
+}
+
+static void
+liquid_publisher_publish_pending(LiquidPublisher *publisher)
+{
+    GHashTableIter iter;
+    gpointer driver;
+    guint n_values = 0;
+
+    g_hash_table_iter_init(&iter, publisher->pending);
+
+    while (g_hash_table_iter_next(&iter, &driver, NULL))
+    {
+        guint n_superseded = 0;
+
+        n_values += liquid_driver_publish(driver, &n_superseded);
+        publisher->superseded_values += n_superseded;
+        g_hash_table_iter_remove(&iter);
+    }
+
+    if (n_values == 0)
+    {
+        return;
+    }
+
+    publisher->batches++;
+    publisher->published_values += n_values;
+
+    publisher->flushing = TRUE;
+    publisher->flush_start = g_get_monotonic_time();
+    g_dbus_connection_flush(publisher->connection, NULL, liquid_publisher_flushed, g_object_ref(publisher));
+}
+
+static void
+liquid_publisher_get_property(GObject *object, guint property_id, GValue *value, GParamSpec *pspec)
+{
+    LiquidPublisher *publisher = LIQUID_PUBLISHER(object);
+
+    switch (property_id)
+    {
+    case PROP_CONNECTION:
+        g_value_set_object(value, publisher->connection);
+        break;
+
+    default:
+        G_OBJECT_WARN_INVALID_PROPERTY_ID(object, property_id, pspec);
+    }
+}
+
+static void
+liquid_publisher_set_property(GObject *object, guint property_id, const GValue *value, GParamSpec *pspec)
+{
+    LiquidPublisher *publisher = LIQUID_PUBLISHER(object);
+
+    switch (property_id)
+    {
+    case PROP_CONNECTION:
+        publisher->connection = g_value_dup_object(value);
+        break;
+
+    default:
+        G_OBJECT_WARN_INVALID_PROPERTY_ID(object, property_id, pspec);
+    }
+}
+
+static void
+liquid_publisher_dispose(GObject *object)
+{
+    LiquidPublisher *publisher = LIQUID_PUBLISHER(object);
+
+    g_hash_table_remove_all(publisher->pending);
+    g_clear_object(&publisher->connection);
+
+    G_OBJECT_CLASS(liquid_publisher_parent_class)->dispose(object);
+}
+
+static void
+liquid_publisher_finalize(GObject *object)
+{
+    LiquidPublisher *publisher = LIQUID_PUBLISHER(object);
+
+    g_hash_table_unref(publisher->pending);
+    liquid_histogram_free(publisher->flush_latency);
+
+    G_OBJECT_CLASS(liquid_publisher_parent_class)->finalize(object);
+}
+
+static void
+liquid_publisher_init(LiquidPublisher *publisher)
+{
+    publisher->pending = g_hash_table_new_full(g_direct_hash, g_direct_equal, g_object_unref, NULL);
+    publisher->flush_latency = liquid_histogram_new();
+}
+
+static void
+liquid_publisher_class_init(LiquidPublisherClass *class)
+{
+    GObjectClass *gobject_class = G_OBJECT_CLASS(class);
+
+    gobject_class->dispose = liquid_publisher_dispose;
+    gobject_class->finalize = liquid_publisher_finalize;
+    gobject_class->get_property = liquid_publisher_get_property;
+    gobject_class->set_property = liquid_publisher_set_property;
+
+    pspecs[PROP_CONNECTION]
+        = g_param_spec_object("connection", /* name */
+                              "Connection", /* nick */
+                              "Bus connection the telemetry signals go out on", /* blurb */
+                              G_TYPE_DBUS_CONNECTION, /* object_type */
+                              G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY | G_PARAM_STATIC_STRINGS);
+
+    g_object_class_install_properties(gobject_class, N_PROPERTIES, pspecs);
+}
+
+LiquidPublisher *
+liquid_publisher_new(GDBusConnection *connection)
+{
+    g_return_val_if_fail(G_IS_DBUS_CONNECTION(connection), NULL);
+
+    return g_object_new(LIQUID_TYPE_PUBLISHER,
+                        "connection",
+                        connection,
+                        NULL);
+}
+
+void
+liquid_publisher_schedule(LiquidPublisher *publisher, LiquidDriver *driver)
+{
+    g_return_if_fail(LIQUID_IS_PUBLISHER(publisher));
+    g_return_if_fail(LIQUID_IS_DRIVER(driver));
+
+    if (!g_hash_table_contains(publisher->pending, driver))
+    {
+        g_hash_table_add(publisher->pending, g_object_ref(driver));
+    }
+
+    if (!publisher->flushing)
+    {
+        liquid_publisher_publish_pending(publisher);
+    }
+}
+
+GVariant *
+liquid_publisher_dup_statistics(LiquidPublisher *publisher)
+{
+    g_return_val_if_fail(LIQUID_IS_PUBLISHER(publisher), NULL);
+
+    g_auto(GVariantDict) dict = G_VARIANT_DICT_INIT(NULL);
+
+    g_variant_dict_insert(&dict, "batches", "t", publisher->batches);
+    g_variant_dict_insert(&dict, "published-values", "t", publisher->published_values);
+    g_variant_dict_insert(&dict, "superseded-values", "t", publisher->superseded_values);
+    g_variant_dict_insert(&dict, "deferred-batches", "t", publisher->deferred_batches);
+    g_variant_dict_insert(&dict, "flushing", "b", publisher->flushing);
+    g_variant_dict_insert_value(&dict, "flush-latency", liquid_histogram_to_variant(publisher->flush_latency));
+
+    return g_variant_dict_end(&dict);
+}
+
+void
+liquid_publisher_append_metrics(LiquidPublisher *publisher, GString *out)
+{
+    g_return_if_fail(LIQUID_IS_PUBLISHER(publisher));
+
+    liquid_metrics_append_family(out, "liquidd_telemetry_batches_total", "counter", "Batches of channel values published.");
+    liquid_metrics_append_sample(out, "liquidd_telemetry_batches_total", NULL, (gdouble)publisher->batches);
+    liquid_metrics_append_family(out,
+                                 "liquidd_telemetry_published_values_total",
+                                 "counter",
+                                 "Channel values published.");
+    liquid_metrics_append_sample(out,
+                                 "liquidd_telemetry_published_values_total",
+                                 NULL,
+                                 (gdouble)publisher->published_values);
+    liquid_metrics_append_family(out,
+                                 "liquidd_telemetry_superseded_values_total",
+                                 "counter",
+                                 "Channel values replaced by newer ones before they could be published.");
+    liquid_metrics_append_sample(out,
+                                 "liquidd_telemetry_superseded_values_total",
+                                 NULL,
+                                 (gdouble)publisher->superseded_values);
+    liquid_metrics_append_family(out,
+                                 "liquidd_telemetry_deferred_batches_total",
+                                 "counter",
+                                 "Batches that waited for the previous one to be flushed.");
+    liquid_metrics_append_sample(out,
+                                 "liquidd_telemetry_deferred_batches_total",
+                                 NULL,
+                                 (gdouble)publisher->deferred_batches);
+    liquid_metrics_append_family(out,
+                                 "liquidd_telemetry_flushing",
+                                 "gauge",
+                                 "Whether published values are still waiting to be written to the bus.");
+    liquid_metrics_append_sample(out, "liquidd_telemetry_flushing", NULL, publisher->flushing);
+    liquid_metrics_append_family(out,
+                                 "liquidd_telemetry_flush_seconds",
+                                 "histogram",
+                                 "Time for a batch of telemetry signals to be written to the bus.");
+    liquid_histogram_append_metrics(publisher->flush_latency, out, "liquidd_telemetry_flush_seconds", NULL);
+}
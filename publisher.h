@@ -0,0 +1,38 @@
+#pragma once
+
+#include <gio/gio.h>
+
+G_BEGIN_DECLS
+
+typedef struct _LiquidDriver LiquidDriver;
+
+/*
+ * Paces telemetry to what the bus connection actually writes. Drivers with new
+ * values schedule themselves; they publish right away unless signals from the
+ * previous batch are still waiting in the connection's outgoing queue, in which
+ * case they publish once that has been flushed, with whatever values are
+ * latest by then. A bus that stops reading then costs one batch of signals
+ * instead of an ever-growing queue.
+ */
+#define LIQUID_TYPE_PUBLISHER (liquid_publisher_get_type())
+G_DECLARE_FINAL_TYPE(LiquidPublisher, liquid_publisher, LIQUID, PUBLISHER, GObject)
+
+LiquidPublisher *
+liquid_publisher_new(GDBusConnection *connection);
+
+void
+liquid_publisher_schedule(LiquidPublisher *publisher, LiquidDriver *driver);
+
+/*
+ * Returns an a{sv} dictionary with counters "batches", "published-values",
+ * "superseded-values" and "deferred-batches" (t), "flushing" (b) and the
+ * "flush-latency" histogram.
+ */
+GVariant *
+liquid_publisher_dup_statistics(LiquidPublisher *publisher);
+
+/* The same as Prometheus metric families, see metrics.h */
+void
+liquid_publisher_append_metrics(LiquidPublisher *publisher, GString *out);
+
+G_END_DECLS
@@ -0,0 +1,47 @@
+#include "spec.h"
+
+gchar **
+liquid_spec_tokenize(const gchar *text, const gchar *ignored)
+{
+    g_return_val_if_fail(text != NULL, NULL);
+
+    gchar **tokens = g_strsplit_set(text, " \t", -1);
+    guint n_tokens = 0;
+
+    for (guint i = 0; tokens[i]; i++)
+    {
+        if (*tokens[i] && (ignored == NULL || !g_str_equal(tokens[i], ignored)))
+        {
+            tokens[n_tokens++] = tokens[i];
+        }
+        else
+        {
+            g_free(tokens[i]);
+        }
+    }
+
+    tokens[n_tokens] = NULL;
+
+    return tokens;
+}
+
+gboolean
+liquid_spec_is_valid_name(const gchar *name)
+{
+    g_return_val_if_fail(name != NULL, FALSE);
+
+    if (*name == '\0')
+    {
+        return FALSE;
+    }
+
+    for (const gchar *c = name; *c; c++)
+    {
+        if (!g_ascii_isalnum(*c) && *c != '_')
+        {
+            return FALSE;
+        }
+    }
+
+    return TRUE;
+}
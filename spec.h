@@ -0,0 +1,21 @@
+#pragma once
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/*
+ * Shared by the parsers of the `NAME: ...` specs given on the command line
+ * and in the configuration file: alert rules, fan controls, filters and
+ * aggregates.
+ */
+
+/* Splits on blanks, dropping the empty tokens of blank runs and any token equal to `ignored` */
+gchar **
+liquid_spec_tokenize(const gchar *text, const gchar *ignored);
+
+/* Non-empty, of letters, digits and underscores, so that it fits in D-Bus object paths and metric names */
+gboolean
+liquid_spec_is_valid_name(const gchar *name);
+
+G_END_DECLS
@@ -0,0 +1,109 @@
+#include "spsc_queue.h"
+
+/* Keeps the producer and consumer indices on separate cache lines */
+#define CACHE_LINE_SIZE 64
+
+struct _LiquidSpscQueue
+{
+    guint mask;
+    gpointer *slots;
+
+    /* Free-running counters, only ever written by the consumer and producer respectively */
+    gint head;
+    guint8 head_padding[CACHE_LINE_SIZE - sizeof(gint)];
+    gint tail;
+    guint8 tail_padding[CACHE_LINE_SIZE - sizeof(gint)];
+};
+
+LiquidSpscQueue *
+liquid_spsc_queue_new(guint capacity)
+{
+    g_return_val_if_fail(capacity > 0 && capacity <= G_MAXINT / 2, NULL);
+
+    LiquidSpscQueue *queue = g_new0(LiquidSpscQueue, 1);
+    guint size = 1;
+
+    while (size < capacity)
+    {
+        size <<= 1;
+    }
+
+    queue->mask = size - 1;
+    queue->slots = g_new0(gpointer, size);
+
+    return queue;
+}
+
+void
+liquid_spsc_queue_free(LiquidSpscQueue *queue, GDestroyNotify free_func)
+{
+    if (queue == NULL)
+    {
+        return;
+    }
+
+    gpointer item;
+
+    while ((item = liquid_spsc_queue_pop(queue)) != NULL)
+    {
+        if (free_func)
+        {
+            free_func(item);
+        }
+    }
+
+    g_free(queue->slots);
+    g_free(queue);
+}
+
+guint
+liquid_spsc_queue_get_capacity(LiquidSpscQueue *queue)
+{
+    return queue->mask + 1;
+}
+
+gboolean
+liquid_spsc_queue_push(LiquidSpscQueue *queue, gpointer item)
+{
+    g_return_val_if_fail(item != NULL, FALSE);
+
+    guint tail = (guint)queue->tail;
+    guint head = (guint)g_atomic_int_get(&queue->head);
+
+    if (tail - head > queue->mask)
+    {
+        return FALSE;
+    }
+
+    queue->slots[tail & queue->mask] = item;
+
+    /* Publishes the slot write above to the consumer */
+    g_atomic_int_set(&queue->tail, (gint)(tail + 1));
+
+    return TRUE;
+}
+
+gpointer
+liquid_spsc_queue_pop(LiquidSpscQueue *queue)
+{
+    guint head = (guint)queue->head;
+    guint tail = (guint)g_atomic_int_get(&queue->tail);
+
+    if (head == tail)
+    {
+        return NULL;
+    }
+
+    gpointer item = queue->slots[head & queue->mask];
+
+    /* Hands the slot back to the producer only after it has been read */
+    g_atomic_int_set(&queue->head, (gint)(head + 1));
+
+    return item;
+}
+
+gboolean
+liquid_spsc_queue_is_empty(LiquidSpscQueue *queue)
+{
+    return g_atomic_int_get(&queue->head) == g_atomic_int_get(&queue->tail);
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/*
+ * Bounded lock-free single-producer single-consumer queue of pointers.
+ *
+ * Exactly one thread may push and exactly one (possibly different) thread may
+ * pop; NULL can't be queued.
+ */
+typedef struct _LiquidSpscQueue LiquidSpscQueue;
+
+LiquidSpscQueue *
+liquid_spsc_queue_new(guint capacity);
+
+void
+liquid_spsc_queue_free(LiquidSpscQueue *queue, GDestroyNotify free_func);
+
+guint
+liquid_spsc_queue_get_capacity(LiquidSpscQueue *queue);
+
+gboolean
+liquid_spsc_queue_push(LiquidSpscQueue *queue, gpointer item);
+
+gpointer
+liquid_spsc_queue_pop(LiquidSpscQueue *queue);
+
+gboolean
+liquid_spsc_queue_is_empty(LiquidSpscQueue *queue);
+
+G_END_DECLS
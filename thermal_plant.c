@@ -0,0 +1,47 @@
+#include "thermal_plant.h"
+
+#include <math.h>
+
+/* Model steps, short against both time constants so that Euler steps stay accurate */
+#define MAX_STEP_S 0.1
+
+void
+liquid_thermal_plant_init(LiquidThermalPlant *plant)
+{
+    g_return_if_fail(plant != NULL);
+
+    *plant = (LiquidThermalPlant) {
+        .ambient = 25.0,
+        .heat_capacity = 600.0,
+        .power = 150.0,
+        .idle_conductance = 1.0,
+        .fan_conductance = 6.0,
+        .fan_time_constant = 2.0,
+        .temperature = 25.0,
+        .airflow = 0.0,
+    };
+}
+
+gdouble
+liquid_thermal_plant_step(LiquidThermalPlant *plant, gdouble duty, gdouble dt)
+{
+    g_return_val_if_fail(plant != NULL, 0.0);
+
+    gdouble target_airflow = CLAMP(duty, 0.0, 100.0) / 100.0;
+
+    while (dt > 0.0)
+    {
+        gdouble step = MIN(dt, MAX_STEP_S);
+
+        plant->airflow += (target_airflow - plant->airflow) * step / (plant->fan_time_constant + step);
+
+        /* Convective cooling grows less than linearly with airflow */
+        gdouble conductance = plant->idle_conductance + plant->fan_conductance * pow(plant->airflow, 0.8);
+        gdouble heat_flow = plant->power - conductance * (plant->temperature - plant->ambient);
+
+        plant->temperature += heat_flow * step / plant->heat_capacity;
+        dt -= step;
+    }
+
+    return plant->temperature;
+}
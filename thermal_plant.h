@@ -0,0 +1,40 @@
+#pragma once
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/*
+ * A lumped thermal model of a heat source cooled by fans, for tuning fan
+ * control offline: a single heat capacity loses heat to ambient air through
+ * a conductance that grows with airflow, and airflow follows the fan duty
+ * with a first order lag, as fans take a while to spin up.
+ */
+typedef struct
+{
+    /* °C */
+    gdouble ambient;
+    /* J/K */
+    gdouble heat_capacity;
+    /* W */
+    gdouble power;
+    /* W/K with the fans stopped, and added at full airflow */
+    gdouble idle_conductance;
+    gdouble fan_conductance;
+    /* s */
+    gdouble fan_time_constant;
+
+    /* State: °C, and airflow from 0 to 1 */
+    gdouble temperature;
+    gdouble airflow;
+} LiquidThermalPlant;
+
+/* A 150 W load cooled by a radiator, starting at ambient temperature */
+void
+liquid_thermal_plant_init(LiquidThermalPlant *plant);
+
+/* Advances the model by `dt` seconds at `duty` percent; returns the temperature */
+gdouble
+liquid_thermal_plant_step(LiquidThermalPlant *plant, gdouble duty, gdouble dt);
+
+G_END_DECLS